@@ -181,16 +181,6 @@ static bool loadFile(const char* filename, uhdr_raw_image_t* handle) {
   return false;
 }
 
-static bool writeFile(const char* filename, void*& result, int length) {
-  std::ofstream ofd(filename, std::ios::binary);
-  if (ofd.is_open()) {
-    ofd.write(static_cast<char*>(result), length);
-    return true;
-  }
-  std::cerr << "unable to write to file : " << filename << std::endl;
-  return false;
-}
-
 static bool writeFile(const char* filename, uhdr_raw_image_t* img) {
   std::ofstream ofd(filename, std::ios::binary);
   if (ofd.is_open()) {
@@ -302,7 +292,6 @@ class UltraHdrAppInput {
     if (mJpegImgR.data) free(mJpegImgR.data);
   }
 
-  bool fillJpegRImageHandle();
   bool fillP010ImageHandle();
   bool convertP010ToRGBImage();
   bool fillYuv420ImageHandle();
@@ -451,22 +440,6 @@ bool UltraHdrAppInput::fillGainMapMetadataDescriptor() {
   return true;
 }
 
-bool UltraHdrAppInput::fillJpegRImageHandle() {
-  std::ifstream ifd(mJpegRFile, std::ios::binary | std::ios::ate);
-  if (ifd.good()) {
-    int size = ifd.tellg();
-    mJpegImgR.capacity = size;
-    mJpegImgR.data_sz = size;
-    mJpegImgR.data = nullptr;
-    mYuv420JpegImage.cg = UHDR_CG_UNSPECIFIED;
-    mYuv420JpegImage.ct = UHDR_CT_UNSPECIFIED;
-    mYuv420JpegImage.range = UHDR_CR_UNSPECIFIED;
-    ifd.close();
-    return loadFile(mJpegRFile, mJpegImgR.data, size);
-  }
-  return false;
-}
-
 bool UltraHdrAppInput::encode() {
 #define RET_IF_ERR(x)                            \
   {                                              \
@@ -542,18 +515,16 @@ bool UltraHdrAppInput::encode() {
   mJpegImgR.cg = output->cg;
   mJpegImgR.ct = output->ct;
   mJpegImgR.range = output->range;
-  writeFile("out.jpeg", output->data, output->data_sz);
+  uhdr_error_info_t status = uhdr_enc_write_to_file(handle, "out.jpeg");
+  if (status.error_code != UHDR_CODEC_OK && status.has_detail) {
+    std::cerr << status.detail << std::endl;
+  }
   uhdr_release_encoder(handle);
 
   return true;
 }
 
 bool UltraHdrAppInput::decode() {
-  if (mMode == 1 && !fillJpegRImageHandle()) {
-    std::cerr << " failed to load file " << mJpegRFile << std::endl;
-    return false;
-  }
-
 #define RET_IF_ERR(x)                            \
   {                                              \
     uhdr_error_info_t status = (x);              \
@@ -567,7 +538,12 @@ bool UltraHdrAppInput::decode() {
   }
 
   uhdr_codec_private_t* handle = uhdr_create_decoder();
-  RET_IF_ERR(uhdr_dec_set_image(handle, &mJpegImgR))
+  if (mMode == 1) {
+    // decode straight from the mapped file
+    RET_IF_ERR(uhdr_dec_set_image_from_file(handle, mJpegRFile))
+  } else {
+    RET_IF_ERR(uhdr_dec_set_image(handle, &mJpegImgR))
+  }
   RET_IF_ERR(uhdr_dec_set_out_color_transfer(handle, mOTf))
   RET_IF_ERR(uhdr_dec_set_out_img_format(handle, mOfmt))
 
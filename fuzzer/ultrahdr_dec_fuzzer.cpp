@@ -26,6 +26,10 @@ using namespace ultrahdr;
 const int kOfMin = ULTRAHDR_OUTPUT_UNSPECIFIED + 1;
 const int kOfMax = ULTRAHDR_OUTPUT_MAX;
 
+// keep the output allocation cheap, larger images only exercise the same code paths
+const size_t kFuzzMaxWidth = 8192;
+const size_t kFuzzMaxHeight = 8192;
+
 class UltraHdrDecFuzzer {
  public:
   UltraHdrDecFuzzer(const uint8_t* data, size_t size) : mFdp(data, size){};
@@ -50,7 +54,7 @@ void UltraHdrDecFuzzer::process() {
   std::cout << "input buffer size " << jpegImgR.length << std::endl;
   std::cout << "image dimensions " << info.width << " x " << info.width << std::endl;
 #endif
-  if (info.width > kMaxWidth || info.height > kMaxHeight) return;
+  if (info.width > kFuzzMaxWidth || info.height > kFuzzMaxHeight) return;
   size_t outSize = info.width * info.height * ((of == ULTRAHDR_OUTPUT_HDR_LINEAR) ? 8 : 4);
   ultrahdr_uncompressed_struct decodedJpegR;
   auto decodedRaw = std::make_unique<uint8_t[]>(outSize);
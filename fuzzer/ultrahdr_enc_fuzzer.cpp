@@ -42,6 +42,10 @@ const int kOfMax = ULTRAHDR_OUTPUT_MAX;
 const int kQfMin = 0;
 const int kQfMax = 100;
 
+// keep the fuzzed image dimensions small enough for the allocations to be cheap
+const int kFuzzMaxWidth = 8192;
+const int kFuzzMaxHeight = 8192;
+
 class UltraHdrEncFuzzer {
  public:
   UltraHdrEncFuzzer(const uint8_t* data, size_t size) : mFdp(data, size){};
@@ -113,10 +117,10 @@ void UltraHdrEncFuzzer::process() {
     // hdr_of
     auto of = static_cast<ultrahdr_output_format>(mFdp.ConsumeIntegralInRange<int>(kOfMin, kOfMax));
 
-    int width = mFdp.ConsumeIntegralInRange<int>(kMinWidth, kMaxWidth);
+    int width = mFdp.ConsumeIntegralInRange<int>(kMinWidth, kFuzzMaxWidth);
     width = (width >> 1) << 1;
 
-    int height = mFdp.ConsumeIntegralInRange<int>(kMinHeight, kMaxHeight);
+    int height = mFdp.ConsumeIntegralInRange<int>(kMinHeight, kFuzzMaxHeight);
     height = (height >> 1) << 1;
 
     std::unique_ptr<uint16_t[]> bufferYHdr = nullptr;
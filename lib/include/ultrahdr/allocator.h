@@ -0,0 +1,133 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ULTRAHDR_ALLOCATOR_H
+#define ULTRAHDR_ALLOCATOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "ultrahdr_api.h"
+
+namespace ultrahdr {
+
+// Alignment of every block handed out by uhdrMalloc(). Covers a cache line and the widest SIMD
+// load used by the library.
+static const size_t kAllocAlignment = 64;
+
+/*
+ * Allocation accounting. An instance collects the traffic of all uhdrMalloc() / uhdrFree() calls
+ * made by a thread while it is installed with AllocStatsScope. The instance must outlive the blocks
+ * accounted to it.
+ */
+struct AllocStats {
+  // Clears the counters. Blocks allocated before the reset are no longer tracked on release.
+  void reset();
+
+  std::atomic<uint32_t> mEpoch{0};
+  std::atomic<size_t> mBytesAllocated{0};
+  std::atomic<size_t> mBytesInUse{0};
+  std::atomic<size_t> mPeakBytesInUse{0};
+  std::atomic<uint32_t> mNumAllocations{0};
+};
+
+/*
+ * Installs |stats| as the accounting target of the calling thread for the lifetime of the object.
+ * Scopes nest; the previous target is restored on destruction.
+ */
+class AllocStatsScope {
+ public:
+  explicit AllocStatsScope(AllocStats* stats);
+  ~AllocStatsScope();
+  AllocStatsScope(const AllocStatsScope&) = delete;
+  AllocStatsScope& operator=(const AllocStatsScope&) = delete;
+
+ private:
+  AllocStats* mPrevious;
+};
+
+/*
+ * Replaces the allocator used by uhdrMalloc(). Passing nullptr for both callbacks restores the
+ * default allocator. Blocks already handed out are released with the allocator that created them.
+ */
+void setAllocator(uhdr_alloc_cb_t alloc_cb, uhdr_free_cb_t free_cb, void* user_data);
+
+/*
+ * Allocates |size| bytes aligned to kAllocAlignment with the current allocator.
+ *
+ * @return pointer to the block, nullptr on failure
+ */
+void* uhdrMalloc(size_t size);
+
+/*
+ * Releases a block returned by uhdrMalloc(). nullptr is ignored.
+ */
+void uhdrFree(void* ptr);
+
+struct UhdrFree {
+  void operator()(void* ptr) const { uhdrFree(ptr); }
+};
+
+// Array owned by the library allocator
+template <typename T>
+using uhdr_unique_ptr = std::unique_ptr<T[], UhdrFree>;
+
+// Counterpart of std::make_unique<T[]>(count) using the library allocator. Contents are zero
+// initialized. Holds nullptr if the allocation failed.
+template <typename T>
+uhdr_unique_ptr<T> uhdrMakeUnique(size_t count) {
+  T* ptr = static_cast<T*>(uhdrMalloc(count * sizeof(T)));
+  if (ptr) memset(ptr, 0, count * sizeof(T));
+  return uhdr_unique_ptr<T>(ptr);
+}
+
+// Standard library allocator backed by uhdrMalloc()
+template <typename T>
+struct UhdrAllocator {
+  typedef T value_type;
+
+  UhdrAllocator() = default;
+  template <typename U>
+  UhdrAllocator(const UhdrAllocator<U>&) {}
+
+  T* allocate(size_t count) {
+    void* ptr = uhdrMalloc(count * sizeof(T));
+    if (!ptr) throw std::bad_alloc();
+    return static_cast<T*>(ptr);
+  }
+  void deallocate(T* ptr, size_t) { uhdrFree(ptr); }
+};
+
+template <typename T, typename U>
+bool operator==(const UhdrAllocator<T>&, const UhdrAllocator<U>&) {
+  return true;
+}
+template <typename T, typename U>
+bool operator!=(const UhdrAllocator<T>&, const UhdrAllocator<U>&) {
+  return false;
+}
+
+template <typename T>
+using uhdr_vector = std::vector<T, UhdrAllocator<T>>;
+
+}  // namespace ultrahdr
+
+#endif  // ULTRAHDR_ALLOCATOR_H
@@ -17,7 +17,12 @@
 #ifndef ULTRAHDR_GAINMAPMATH_H
 #define ULTRAHDR_GAINMAPMATH_H
 
+#include <algorithm>
+#include <cfloat>
 #include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
 
 #include "ultrahdr/ultrahdr.h"
 #include "ultrahdr/jpegr.h"
@@ -146,6 +151,60 @@ inline uint16_t floatToHalf(float f) {
          (e > 143) * 0x7FFF;
 }
 
+/*
+ * Polynomial approximations of log2(), exp2() and pow() for the *Fast() transfer functions. The
+ * coefficients are minimax fits found with the Remez algorithm. These are kept inline and free of
+ * branches so that loops over pixels can be vectorized by the compiler. With GCC this also needs
+ * -fno-trapping-math. The gain map kernels use them in place of the exact functions when built
+ * with USE_FAST_TRANSFER_FUNCTIONS and no LUT variant is selected.
+ */
+
+// log2(x) for x > 0, inputs below FLT_MIN are clamped. log2(1 + t), t in [0, 1) is fit with max
+// abs error 4.3e-8.
+inline float fastLog2(float x) {
+  x = (std::max)(x, FLT_MIN);
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof bits);
+  const float exponent = static_cast<float>(static_cast<int32_t>(bits >> 23) - 127);
+  bits = (bits & 0x007FFFFF) | 0x3F800000;
+  float mantissa;
+  memcpy(&mantissa, &bits, sizeof mantissa);
+  const float t = mantissa - 1.0f;
+  const float p =
+      4.23144088e-08f +
+      t * (1.44268762f +
+           t * (-0.721132204f +
+                t * (0.478464224f +
+                     t * (-0.346548564f +
+                          t * (0.240410242f +
+                               t * (-0.135926927f + t * (0.0511344373f + t * -0.00908890792f)))))));
+  return exponent + p;
+}
+
+// exp2(x), x is clamped to [-126, 127]. 2^t, t in [0, 1) is fit with max relative error 1.1e-7.
+inline float fastExp2(float x) {
+  x = (std::min)((std::max)(x, -126.0f), 127.0f);
+  // x + 127 is positive, so truncation rounds down
+  const int32_t xi = static_cast<int32_t>(x + 127.0f) - 127;
+  const float t = x - static_cast<float>(xi);
+  const float p =
+      0.999999893f +
+      t * (0.693154752f +
+           t * (0.240139711f + t * (0.0558662463f + t * (0.00894282898f + t * 0.00189646115f))));
+  int32_t bits;
+  memcpy(&bits, &p, sizeof bits);
+  bits += xi * (1 << 23);
+  float result;
+  memcpy(&result, &bits, sizeof result);
+  return result;
+}
+
+// x^y for x > 0
+inline float fastPow(float x, float y) { return fastExp2(y * fastLog2(x)); }
+
+constexpr float kLn2 = 0.69314718f;
+constexpr float kLog2E = 1.44269504f;
+
 constexpr size_t kGainFactorPrecision = 10;
 constexpr size_t kGainFactorNumEntries = 1 << kGainFactorPrecision;
 struct GainLUT {
@@ -170,7 +229,7 @@ struct GainLUT {
 
   ~GainLUT() {}
 
-  float getGainFactor(float gain) {
+  float getGainFactor(float gain) const {
     uint32_t idx = static_cast<uint32_t>(gain * (kGainFactorNumEntries - 1) + 0.5);
     // TODO() : Remove once conversion modules have appropriate clamping in place
     idx = CLIP3(idx, 0, kGainFactorNumEntries - 1);
@@ -227,6 +286,136 @@ struct ShepardsIDW {
   void fillShepardsIDW(float* weights, int incR, int incB);
 };
 
+/*
+ * Tables used to apply a gain map for one rendering configuration. Plans are immutable once built
+ * and are shared across calls and threads, see getRenderPlan().
+ */
+struct RenderPlan {
+  RenderPlan(ultrahdr_metadata_ptr metadata, float displayBoost, size_t mapScaleFactor)
+      : mMinContentBoost(metadata->minContentBoost),
+        mMaxContentBoost(metadata->maxContentBoost),
+        mDisplayBoost(displayBoost),
+        mMapScaleFactor(mapScaleFactor),
+        mGainLUT(metadata, displayBoost),
+        mIdwTable(static_cast<int>(mapScaleFactor)) {}
+
+  // configuration the tables are computed for
+  const float mMinContentBoost;
+  const float mMaxContentBoost;
+  const float mDisplayBoost;
+  const size_t mMapScaleFactor;
+
+  const GainLUT mGainLUT;
+  const ShepardsIDW mIdwTable;
+};
+
+// Number of render plans retained by getRenderPlan()
+constexpr size_t kRenderPlanCacheSize = 8;
+
+/*
+ * Returns the render plan for the given configuration. Plans are kept in a process wide cache of
+ * the kRenderPlanCacheSize most recently used configurations, so repeated decodes with the same
+ * metadata and display boost do not rebuild the tables. Safe to call from multiple threads.
+ *
+ * @return render plan, nullptr if allocation fails
+ */
+std::shared_ptr<const RenderPlan> getRenderPlan(ultrahdr_metadata_ptr metadata,
+                                                float displayBoost, size_t mapScaleFactor);
+
+// Interpolation used to upsample the gain map to the primary image resolution
+typedef enum {
+  // Shepard's inverse distance weighting, same result as sampleMap()
+  GAINMAP_UPSAMPLE_SHEPARDS_IDW,
+  // separable bilinear interpolation
+  GAINMAP_UPSAMPLE_BILINEAR,
+} gainmap_upsample_mode;
+
+/*
+ * Upsamples a gain map one output row at a time. The two gain map rows bracketing an output row
+ * are converted to float once and padded with one replicated sample on the right, so the per
+ * pixel loop has no edge checks, and the following output rows between the same gain map rows
+ * reuse them. Power of two scale factors use shifts instead of divisions.
+ *
+ * An instance keeps per row state and must not be shared across threads.
+ */
+class GainMapUpsampler {
+ public:
+  /*
+   * @param map gain map image, single channel 8 bit
+   * @param mapScaleFactor ratio of the primary image dimensions to the gain map dimensions
+   * @param idwTable weight tables for mapScaleFactor, used in GAINMAP_UPSAMPLE_SHEPARDS_IDW mode
+   * @param mode interpolation method
+   */
+  GainMapUpsampler(uhdr_uncompressed_ptr map, size_t mapScaleFactor, const ShepardsIDW& idwTable,
+                   gainmap_upsample_mode mode = GAINMAP_UPSAMPLE_SHEPARDS_IDW);
+
+  /*
+   * Returns the gain values of output row y, map->width * mapScaleFactor entries in [0.0, 1.0].
+   * The row stays valid until the next call.
+   */
+  const float* getRow(size_t y);
+
+  /*
+   * Same as getRow(y), except only the output samples of gain map columns
+   * [mapColStart, mapColEnd) are computed. The rest of the row is left undefined.
+   */
+  const float* getRow(size_t y, size_t mapColStart, size_t mapColEnd);
+
+ private:
+  void loadMapRows(size_t yLower);
+
+  uhdr_uncompressed_ptr mMap;
+  const size_t mMapScaleFactor;
+  // log2(mMapScaleFactor) if it is a power of 2, -1 otherwise
+  int mScaleShift;
+  const ShepardsIDW& mIdwTable;
+  const gainmap_upsample_mode mMode;
+
+  // gain map row that mLower holds, mMap->height if none
+  size_t mLoadedRow;
+  // gain map rows y_lower and y_upper, width + 1 entries each
+  std::vector<float> mLower;
+  std::vector<float> mUpper;
+  // vertically interpolated gain map row, bilinear mode only
+  std::vector<float> mColumn;
+  // horizontal sub-sample positions, bilinear mode only
+  std::vector<float> mFracX;
+  std::vector<float> mRow;
+};
+
+// Size in gain map samples of the square tiles classified by UniformGainTiles
+constexpr size_t kGainMapTileSize = 16;
+
+/*
+ * Finds the gain map tiles whose interpolated gain is the same everywhere, such as skies, shadows
+ * or SDR only regions. Tile (tx, ty) covers gain map samples [tx, tx + 1) * kGainMapTileSize
+ * horizontally and [ty, ty + 1) * kGainMapTileSize vertically, that is output pixels scaled by the
+ * map scale factor. A tile is uniform if all of its samples, and the samples to the right of and
+ * below it that the interpolation reads, have the same value.
+ */
+class UniformGainTiles {
+ public:
+  /*
+   * Classifies the tiles of the tile rows that overlap gain map rows [mapRowStart, mapRowEnd).
+   * Only those tile rows may be queried.
+   */
+  UniformGainTiles(uhdr_uncompressed_ptr map, size_t mapRowStart, size_t mapRowEnd);
+
+  /*
+   * Returns true if tile (tileX, tileY) is uniform, and its gain map value in value.
+   */
+  bool isUniform(size_t tileX, size_t tileY, uint8_t* value) const;
+
+  size_t getTileCols() const { return mTileCols; }
+
+ private:
+  const size_t mTileCols;
+  const size_t mTileRowStart;
+  // per tile min and max gain map value, in raster order
+  std::vector<uint8_t> mMin;
+  std::vector<uint8_t> mMax;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // sRGB transformations
 // NOTE: sRGB has the same color primaries as BT.709, but different transfer
@@ -264,6 +453,14 @@ float srgbInvOetf(float e_gamma);
 Color srgbInvOetf(Color e_gamma);
 float srgbInvOetfLUT(float e_gamma);
 Color srgbInvOetfLUT(Color e_gamma);
+Color srgbInvOetfFast(Color e_gamma);
+
+// srgbInvOetf() using fastPow(), max abs error 3.6e-7 over [0.0, 1.0]
+inline float srgbInvOetfFast(float e_gamma) {
+  const float linear = e_gamma / 12.92f;
+  const float curve = fastPow((e_gamma + 0.055f) / 1.055f, 2.4f);
+  return e_gamma <= 0.04045f ? linear : curve;
+}
 
 constexpr size_t kSrgbInvOETFPrecision = 10;
 constexpr size_t kSrgbInvOETFNumEntries = 1 << kSrgbInvOETFPrecision;
@@ -316,6 +513,9 @@ Color bt2100RgbToYuv(Color e_gamma);
  */
 Color bt2100YuvToRgb(Color e_gamma);
 
+// See ITU-R BT.2100-2, Table 5, HLG Reference OETF.
+constexpr float kHlgA = 0.17883277f, kHlgB = 0.28466892f, kHlgC = 0.55991073f;
+
 /*
  * Convert from scene luminance to HLG.
  *
@@ -325,6 +525,14 @@ float hlgOetf(float e);
 Color hlgOetf(Color e);
 float hlgOetfLUT(float e);
 Color hlgOetfLUT(Color e);
+Color hlgOetfFast(Color e);
+
+// hlgOetf() using fastLog2(), max abs error 6.0e-8 over [0.0, 1.0]
+inline float hlgOetfFast(float e) {
+  const float low = sqrtf(3.0f * (std::max)(e, 0.0f));
+  const float high = kHlgA * kLn2 * fastLog2(12.0f * e - kHlgB) + kHlgC;
+  return e <= 1.0f / 12.0f ? low : high;
+}
 
 constexpr size_t kHlgOETFPrecision = 16;
 constexpr size_t kHlgOETFNumEntries = 1 << kHlgOETFPrecision;
@@ -338,10 +546,23 @@ float hlgInvOetf(float e_gamma);
 Color hlgInvOetf(Color e_gamma);
 float hlgInvOetfLUT(float e_gamma);
 Color hlgInvOetfLUT(Color e_gamma);
+Color hlgInvOetfFast(Color e_gamma);
+
+// hlgInvOetf() using fastExp2(), max abs error 2.4e-7 over [0.0, 1.0]
+inline float hlgInvOetfFast(float e_gamma) {
+  const float low = e_gamma * e_gamma / 3.0f;
+  const float high = (fastExp2((e_gamma - kHlgC) / kHlgA * kLog2E) + kHlgB) / 12.0f;
+  return e_gamma <= 0.5f ? low : high;
+}
 
 constexpr size_t kHlgInvOETFPrecision = 12;
 constexpr size_t kHlgInvOETFNumEntries = 1 << kHlgInvOETFPrecision;
 
+// See ITU-R BT.2100-2, Table 4, Reference PQ OETF.
+constexpr float kPqM1 = 2610.0f / 16384.0f, kPqM2 = 2523.0f / 4096.0f * 128.0f;
+constexpr float kPqC1 = 3424.0f / 4096.0f, kPqC2 = 2413.0f / 4096.0f * 32.0f,
+                kPqC3 = 2392.0f / 4096.0f * 32.0f;
+
 /*
  * Convert from scene luminance to PQ.
  *
@@ -351,6 +572,14 @@ float pqOetf(float e);
 Color pqOetf(Color e);
 float pqOetfLUT(float e);
 Color pqOetfLUT(Color e);
+Color pqOetfFast(Color e);
+
+// pqOetf() using fastPow(), max abs error 1.9e-5 over [0.0, 1.0]
+inline float pqOetfFast(float e) {
+  const float e_m1 = fastPow(e, kPqM1);
+  const float e_gamma = fastPow((kPqC1 + kPqC2 * e_m1) / (1 + kPqC3 * e_m1), kPqM2);
+  return e <= 0.0f ? 0.0f : e_gamma;
+}
 
 constexpr size_t kPqOETFPrecision = 16;
 constexpr size_t kPqOETFNumEntries = 1 << kPqOETFPrecision;
@@ -364,6 +593,20 @@ float pqInvOetf(float e_gamma);
 Color pqInvOetf(Color e_gamma);
 float pqInvOetfLUT(float e_gamma);
 Color pqInvOetfLUT(Color e_gamma);
+Color pqInvOetfFast(Color e_gamma);
+
+// Derived from the inverse of the Reference PQ OETF.
+constexpr float kPqInvA = 128.0f, kPqInvB = 107.0f, kPqInvC = 2413.0f, kPqInvD = 2392.0f,
+                kPqInvE = 6.2773946361f, kPqInvF = 0.0126833f;
+
+// pqInvOetf() using fastPow(), max abs error 1.5e-4 over [0.0, 1.0]
+inline float pqInvOetfFast(float e_gamma) {
+  const float e_f = fastPow(e_gamma, kPqInvF);
+  // the base rounds slightly below zero for inputs close to the cutoff
+  const float e = fastPow((std::max)((kPqInvA * e_f - kPqInvB) / (kPqInvC - kPqInvD * e_f), 0.0f),
+                          kPqInvE);
+  return e_gamma <= 0.0001f ? 0.0f : e;
+}
 
 constexpr size_t kPqInvOETFPrecision = 12;
 constexpr size_t kPqInvOETFNumEntries = 1 << kPqInvOETFPrecision;
@@ -445,7 +688,91 @@ uint8_t encodeGain(float y_sdr, float y_hdr, ultrahdr_metadata_ptr metadata,
  */
 Color applyGain(Color e, float gain, ultrahdr_metadata_ptr metadata);
 Color applyGain(Color e, float gain, ultrahdr_metadata_ptr metadata, float displayBoost);
-Color applyGainLUT(Color e, float gain, GainLUT& gainLUT);
+Color applyGainLUT(Color e, float gain, const GainLUT& gainLUT);
+
+/*
+ * Returns the factor that applyGain() with a display boost scales the sdr input by.
+ */
+float computeGainFactor(float gain, ultrahdr_metadata_ptr metadata, float displayBoost);
+
+/*
+ * Adds one pixel of a reconstructed HDR image to stats.
+ *
+ * @param luminance luminance of the pixel, relative to SDR white
+ * @param gain applied gain map value, in range [0, 1]
+ * @param clipped true if a component of the output pixel is outside of range [0, 1]
+ */
+inline void addPixelToImageStats(ultrahdr_image_stats_ptr stats, float luminance, float gain,
+                                 bool clipped) {
+  stats->maxLuminance = (std::max)(stats->maxLuminance, luminance);
+  stats->sumLuminance += luminance;
+  stats->numPixels++;
+  stats->numClippedPixels += clipped;
+  size_t bin = static_cast<size_t>(gain * (kGainHistogramBins - 1) + 0.5f);
+  stats->gainHistogram[(std::min)(bin, kGainHistogramBins - 1)]++;
+}
+
+/*
+ * Adds the statistics of src to dest.
+ */
+void mergeImageStats(ultrahdr_image_stats_ptr dest, const ultrahdr_image_stats_struct& src);
+
+/*
+ * Returns true if a display with the given headroom is served the SDR rendition of the image. As
+ * per the gain map weighting, this is the case when the headroom does not exceed hdrCapacityMin
+ * (or 1.0, whichever is larger), and the gain map then has no effect on the output.
+ */
+inline bool isSdrRendition(ultrahdr_metadata_ptr metadata, float maxDisplayBoost) {
+  return maxDisplayBoost <= (std::max)(1.0f, metadata->hdrCapacityMin);
+}
+
+// Number of 8-bit codes indexing each dimension of a GainCodeLUT
+constexpr size_t kGainCodeLUTDim = 256;
+
+/*
+ * Output of the gain map application for one channel as a function of its 8-bit sRGB code and of
+ * the 8-bit gain code of the pixel, for one display boost and output format. The sRGB inverse
+ * OETF, the gain, the scaling by 1 / displayBoost and the output OETF and quantization are folded
+ * in to one lookup. Entries are half floats for ULTRAHDR_OUTPUT_HDR_LINEAR and 10-bit codes for
+ * ULTRAHDR_OUTPUT_HDR_PQ and ULTRAHDR_OUTPUT_HDR_HLG, the table takes 128 KiB.
+ *
+ * Compared to applyGainMap(), the input is the 8-bit RGB of the JPEG color conversion instead of
+ * the floating point conversion of the YUV samples. Also, the upsampled gains are rounded to the
+ * nearest 8-bit code. The gain factor can then be off by half a code step in the log2 domain, for a
+ * gamma of 1 a factor of up to exp2(log2(maxContentBoost / minContentBoost) / 510) at full weight.
+ */
+class GainCodeLUT {
+ public:
+  GainCodeLUT(ultrahdr_metadata_ptr metadata, float displayBoost,
+              ultrahdr_output_format outputFormat);
+
+  // Returns true for the output formats the table can be built for
+  static bool isOutputFormatSupported(ultrahdr_output_format outputFormat) {
+    return outputFormat == ULTRAHDR_OUTPUT_HDR_LINEAR || outputFormat == ULTRAHDR_OUTPUT_HDR_PQ ||
+           outputFormat == ULTRAHDR_OUTPUT_HDR_HLG;
+  }
+
+  ultrahdr_output_format getOutputFormat() const { return mOutputFormat; }
+
+  // Returns the outputs for a gain code, indexed by sRGB code
+  const uint16_t* getRow(size_t gainCode) const { return &mTable[gainCode * kGainCodeLUTDim]; }
+
+ private:
+  const ultrahdr_output_format mOutputFormat;
+  std::vector<uint16_t> mTable;
+};
+
+/*
+ * Reconstructs one row of an HDR image from an RGB decoded SDR row with a GainCodeLUT.
+ *
+ * @param src SDR pixels, packed RGB with bytesPerPixel bytes per pixel (3 or 4)
+ * @param gains upsampled gain map values of the row, in range [0.0, 1.0]
+ * @param width number of pixels of the row
+ * @param lut table for the display boost and output format
+ * @param dest destination row, laid out as applyGainMap() writes the output format of lut
+ */
+void applyGainCodeLUT(const uint8_t* src, size_t bytesPerPixel, const float* gains, size_t width,
+                      const GainCodeLUT& lut, void* dest);
 
 /*
  * Helper for sampling from YUV 420 images.
@@ -479,7 +806,7 @@ Color sampleP010(uhdr_uncompressed_ptr map, size_t map_scale_factor, size_t x, s
  */
 float sampleMap(uhdr_uncompressed_ptr map, float map_scale_factor, size_t x, size_t y);
 float sampleMap(uhdr_uncompressed_ptr map, size_t map_scale_factor, size_t x, size_t y,
-                ShepardsIDW& weightTables);
+                const ShepardsIDW& weightTables);
 
 /*
  * Convert from Color to RGBA1010102.
@@ -488,6 +815,32 @@ float sampleMap(uhdr_uncompressed_ptr map, size_t map_scale_factor, size_t x, si
  */
 uint32_t colorToRgba1010102(Color e_gamma);
 
+/*
+ * Convert from scene luminance to a 10-bit HLG or PQ code in one table lookup, folding the OETF,
+ * the rounding to the nearest code and the clamping to [0, 1023] together.
+ *
+ * The table is indexed by the exponent and the top kOetf10BitMantissaBits bits of the mantissa of
+ * the input, so the step between entries is relative to the input and dark values, where both
+ * OETFs are steepest, quantize as accurately as bright ones. Inputs at or below
+ * 2^kOetf10BitMinExponent map to code 0, inputs above 1.0 to code 1023, and NaN to code 0.
+ */
+constexpr size_t kOetf10BitMantissaBits = 10;
+constexpr int kOetf10BitMinExponent = -34;
+constexpr size_t kOetf10BitNumEntries =
+    (static_cast<size_t>(-kOetf10BitMinExponent) << kOetf10BitMantissaBits) + 1;
+
+uint16_t hlgOetf10BitLUT(float e);
+uint16_t pqOetf10BitLUT(float e);
+
+/*
+ * Convert from scene luminance Color to HLG or PQ RGBA1010102 with hlgOetf10BitLUT() or
+ * pqOetf10BitLUT().
+ *
+ * Alpha always set to 1.0.
+ */
+uint32_t hlgColorToRgba1010102LUT(Color e);
+uint32_t pqColorToRgba1010102LUT(Color e);
+
 /*
  * Convert from Color to F16.
  *
@@ -495,6 +848,91 @@ uint32_t colorToRgba1010102(Color e_gamma);
  */
 uint64_t colorToRgbaF16(Color e_gamma);
 
+/*
+ * Convert from narrow range luma in range [0, 1] to a P010 sample, 10 bits in the MSBs.
+ *
+ * Inverse of the luma conversion of getP010Pixel(). Result is clamped to the narrow range.
+ */
+uint16_t lumaToP010(float y);
+
+/*
+ * Convert from narrow range chroma in range [-0.5, 0.5] to a P010 sample, 10 bits in the MSBs.
+ *
+ * Inverse of the chroma conversion of getP010Pixel(). Result is clamped to the narrow range.
+ */
+uint16_t chromaToP010(float uv);
+
+// Returns true for the output formats that are written as P010
+inline bool isP010OutputFormat(ultrahdr_output_format outputFormat) {
+  return outputFormat == ULTRAHDR_OUTPUT_HDR_PQ_P010 ||
+         outputFormat == ULTRAHDR_OUTPUT_HDR_HLG_P010;
+}
+
+/*
+ * Writes an image in P010 one pixel at a time. Luma is written as is, chroma is subsampled 4:2:0
+ * by averaging each 2x2 block. The chroma of a block is summed up as its pixels arrive and written
+ * with the last one, so only one row of chroma sums is kept and the image is not read back.
+ *
+ * The rows of a pair must be written by the same instance, the first row before the second. An
+ * instance keeps per row state and must not be shared across threads.
+ */
+class P010Writer {
+ public:
+  /*
+   * @param dest destination image. Luma is at dest->data, interleaved chroma at dest->chroma_data,
+   *             or right after the luma plane if nullptr. Strides are in samples, 0 defaults to
+   *             the image width for luma and to the luma stride for chroma.
+   * @param width image width
+   * @param height image height
+   */
+  P010Writer(uhdr_uncompressed_ptr dest, size_t width, size_t height);
+
+  // Writes the narrow range yuv color of pixel (x, y)
+  void putPixel(size_t x, size_t y, Color yuv);
+
+ private:
+  uint16_t* mLuma;
+  size_t mLumaStride;
+  uint16_t* mChroma;
+  size_t mChromaStride;
+  size_t mWidth;
+  size_t mHeight;
+  // u and v sums of the blocks of the current row pair
+  std::vector<float> mChromaSum;
+};
+
+/*
+ * Writes linear RGB in to three float32 planes one pixel at a time. The writer keeps no state
+ * besides the plane layout, instances may be shared across threads that write distinct pixels.
+ */
+class PlanarFloatWriter {
+ public:
+  /*
+   * @param dest destination image. The red plane is at dest->data, the green and blue planes at
+   *             dest->green_data and dest->blue_data, or each right after the previous plane if
+   *             nullptr. Strides are in pixels, 0 defaults to the image width for the red plane and
+   *             to the stride of the previous plane for the others.
+   * @param width image width
+   * @param height image height
+   */
+  PlanarFloatWriter(uhdr_uncompressed_ptr dest, size_t width, size_t height);
+
+  // Writes the linear rgb color of pixel (x, y)
+  void putPixel(size_t x, size_t y, Color rgb) {
+    mRed[y * mRedStride + x] = rgb.r;
+    mGreen[y * mGreenStride + x] = rgb.g;
+    mBlue[y * mBlueStride + x] = rgb.b;
+  }
+
+ private:
+  float* mRed;
+  size_t mRedStride;
+  float* mGreen;
+  size_t mGreenStride;
+  float* mBlue;
+  size_t mBlueStride;
+};
+
 }  // namespace ultrahdr
 
 #endif  // ULTRAHDR_GAINMAPMATH_H
@@ -37,7 +37,7 @@ public:
   MemoryWriter() : data_(nullptr), size_(0), capacity_(0) {}
 
   ~MemoryWriter() {
-    free(data_);
+    uhdrFree(data_);
   }
 
   const uint8_t* data() const {
@@ -48,19 +48,23 @@ public:
     return size_;
   }
 
-  void write(const void* data, size_t size) {
+  bool write(const void* data, size_t size) {
     if (capacity_ - size_ < size) {
       size_t new_capacity = capacity_ + size;
-      uint8_t* new_data = static_cast<uint8_t*>(malloc(new_capacity));
+      uint8_t* new_data = static_cast<uint8_t*>(uhdrMalloc(new_capacity));
+      if (new_data == nullptr) {
+        return false;
+      }
       if (data_) {
         memcpy(new_data, data_, size_);
-        free(data_);
+        uhdrFree(data_);
       }
       data_ = new_data;
       capacity_ = new_capacity;
     }
     memcpy(&data_[size_], data, size);
     size_ += size;
+    return true;
   }
 
 public:
@@ -246,15 +246,23 @@ class IccHelper {
   static bool tagsEqualToMatrix(const Matrix3x3& matrix, const uint8_t* red_tag,
                                 const uint8_t* green_tag, const uint8_t* blue_tag);
 
+  // Uncached implementations of writeIccProfile() and readIccColorGamut()
+  static std::shared_ptr<DataStruct> generateIccProfile(const ultrahdr_transfer_function tf,
+                                                        const ultrahdr_color_gamut gamut);
+  static ultrahdr_color_gamut parseIccColorGamut(const void* icc_data, size_t icc_size);
+
  public:
   // Output includes JPEG embedding identifier and chunk information, but not
   // APPx information.
-  static std::shared_ptr<DataStruct> writeIccProfile(const ultrahdr_transfer_function tf,
-                                                     const ultrahdr_color_gamut gamut);
+  // Profiles are generated once per (tf, gamut) and the same instance is returned to every
+  // caller.
+  static std::shared_ptr<const DataStruct> writeIccProfile(const ultrahdr_transfer_function tf,
+                                                           const ultrahdr_color_gamut gamut);
   // NOTE: this function is not robust; it can infer gamuts that IccHelper
   // writes out but should not be considered a reference implementation for
   // robust parsing of ICC profiles or their gamuts.
-  static ultrahdr_color_gamut readIccColorGamut(void* icc_data, size_t icc_size);
+  // Results of the most recently seen profiles are cached.
+  static ultrahdr_color_gamut readIccColorGamut(const void* icc_data, size_t icc_size);
 };
 }  // namespace ultrahdr
 
@@ -32,15 +32,18 @@ extern "C" {
 #endif
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <vector>
 
+#include "ultrahdr/allocator.h"
+
 namespace ultrahdr {
 
-// constraint on max width and max height is only due to device alloc constraints
-// Can tune these values basing on the target device
-static const int kMaxWidth = 8192;
-static const int kMaxHeight = 8192;
+// Largest dimensions a JPEG image can describe. Large images are decoded in bands, so the input
+// resolution is not otherwise constrained.
+static const int kMaxWidth = JPEG_MAX_DIMENSION;
+static const int kMaxHeight = JPEG_MAX_DIMENSION;
 
 typedef enum {
   PARSE_ONLY = 0,       // Dont decode. Parse for dimensions, EXIF, ICC, XMP
@@ -48,6 +51,31 @@ typedef enum {
   DECODE_TO_YCBCR = 2,  // Parse and decode to YCBCR or Grayscale
 } decode_mode_t;
 
+/*
+ * Reads up to size bytes of a compressed stream into buffer. Returns the number of bytes read, 0 at
+ * the end of the stream or a negative value on error.
+ */
+typedef std::function<int(void* buffer, size_t size)> jpegr_read_fn;
+
+/*
+ * Caller provided destination of a decode. For DECODE_TO_RGBA planes[0] receives the packed pixels.
+ * For DECODE_TO_YCBCR planes[0], planes[1] and planes[2] receive Y, Cb and Cr, grayscale images
+ * only use planes[0]. If planes[1] or planes[2] is nullptr only the luma is returned, the chroma
+ * of a color image is then decoded to scratch memory of the decoder. Strides are in pixels, a
+ * stride of 0 selects a tightly packed plane.
+ */
+struct jpeg_output_planes {
+  uint8_t* planes[3];
+  size_t strides[3];
+};
+
+/*
+ * Receives rowCount decoded rows of the image starting at row rowStart. The rows are laid out as
+ * described by band, chroma planes hold rowCount / 2 rows. Returns false to abort the decode.
+ */
+typedef std::function<bool(const jpeg_output_planes& band, size_t rowStart, size_t rowCount)>
+    jpeg_band_fn;
+
 /*
  * Encapsulates a converter from JPEG to raw image (YUV420planer or grey-scale) format.
  * This class is not thread-safe.
@@ -59,12 +87,58 @@ class JpegDecoderHelper {
   /*
    * Decompresses JPEG image to raw image (YUV420planer, grey-scale or RGBA) format. After
    * calling this method, call getDecompressedImage() to get the image.
+   * If outputPlanes is not nullptr, the image is written straight to the given planes instead,
+   * which must be large enough to hold it (see getCompressedImageParameters() to learn the
+   * dimensions upfront). getDecompressedImagePtr() returns nullptr in that case.
    * Returns false if decompressing the image fails.
    */
-  bool decompressImage(const void* image, int length, decode_mode_t decodeTo = DECODE_TO_YCBCR);
+  bool decompressImage(const void* image, int length, decode_mode_t decodeTo = DECODE_TO_YCBCR,
+                       const jpeg_output_planes* outputPlanes = nullptr);
+  /*
+   * Decompresses JPEG image that is read incrementally through reader. Reading stops once the EOI
+   * marker of the image is consumed, bytes that were read past it are made available via
+   * getStreamRemainderPtr(). Returns false if reading or decompressing the image fails.
+   */
+  bool decompressImage(const jpegr_read_fn& reader, decode_mode_t decodeTo = DECODE_TO_YCBCR);
+  /*
+   * Decompresses JPEG image to raw image (YUV420planer or grey-scale) format band by band, so that
+   * only bandHeight rows (rounded up to a multiple of 16) of the image are held in memory at a
+   * time. onBand is invoked for each band from top to bottom. The band buffer is owned by the
+   * decoder and is reused for the next band once onBand returns.
+   * Returns false if decompressing the image fails or onBand returns false.
+   */
+  bool decompressImageInBands(const void* image, int length, size_t bandHeight,
+                              const jpeg_band_fn& onBand);
+  /*
+   * Sets the scaling of the following decodes. Images are decoded at 1 / denom of their resolution
+   * in each dimension, rounded up, by scaling in the IDCT instead of decoding the full image and
+   * downsampling it. Returns false unless denom is one of {1, 2, 4, 8}.
+   */
+  bool setScaleDenom(size_t denom);
+
+  /*
+   * Returns the scale denominator set with setScaleDenom(), 1 by default.
+   */
+  size_t getScaleDenom() { return mScaleDenom; }
+
+  /*
+   * Restricts the following decodes to the region of width x height pixels at (left, top), in
+   * the coordinates of the scaled image. Only the iMCU rows and columns covering the region are
+   * decoded where libjpeg-turbo is available. The decode fails if the region exceeds the image. A
+   * width or height of 0 decodes the whole image, which is the default.
+   */
+  void setCropRegion(size_t left, size_t top, size_t width, size_t height);
+
+  /*
+   * Selects the chroma upsampling of the following decodes to RGBA. By default libjpeg interpolates
+   * the chroma samples. If disabled, each chroma sample is replicated over its 2x2 luma pixels,
+   * which is how getYuv420Pixel() samples a YUV 420 image.
+   */
+  void setFancyUpsampling(bool enable) { mFancyUpsampling = enable; }
+
   /*
    * Returns the decompressed raw image buffer pointer. This method must be called only after
-   * calling decompressImage().
+   * calling decompressImage(). Returns nullptr if the image was decoded to caller planes.
    */
   void* getDecompressedImagePtr();
   /*
@@ -73,15 +147,25 @@ class JpegDecoderHelper {
    */
   size_t getDecompressedImageSize();
   /*
-   * Returns the image width in pixels. This method must be called only after calling
+   * Returns the image width in pixels, after scaling. This method must be called only after calling
    * decompressImage().
    */
   size_t getDecompressedImageWidth();
   /*
-   * Returns the image width in pixels. This method must be called only after calling
-   * decompressImage().
+   * Returns the image height in pixels, after scaling. This method must be called only after
+   * calling decompressImage().
    */
   size_t getDecompressedImageHeight();
+  /*
+   * Returns the image width in pixels, as coded and before any scaling. This method must be called
+   * only after calling decompressImage().
+   */
+  size_t getImageWidth() { return mImageWidth; }
+  /*
+   * Returns the image height in pixels, as coded and before any scaling. This method must be called
+   * only after calling decompressImage().
+   */
+  size_t getImageHeight() { return mImageHeight; }
   /*
    * Returns the XMP data from the image.
    */
@@ -121,36 +205,105 @@ class JpegDecoderHelper {
    * calling decompressImage() or getCompressedImageParameters().
    */
   size_t getICCSize();
+  /*
+   * Returns the MPF data from the image, starting with the MPF signature.
+   */
+  void* getMPFPtr();
+  /*
+   * Returns the MPF buffer size. This method must be called only after calling
+   * decompressImage() or getCompressedImageParameters().
+   */
+  size_t getMPFSize();
+  /*
+   * Returns the position offset of MPF package (the byte after FF E2 XX XX <this byte>),
+   * or -1 if no MPF exists.
+   */
+  int getMPFPos() { return mMpfPos; }
+  /*
+   * Returns the number of stream bytes consumed by decompressImage(reader), up to and including
+   * the EOI marker of the image.
+   */
+  size_t getStreamPosition() { return mStreamPosition; }
+  /*
+   * Returns the bytes read from the stream past the EOI marker of the image by
+   * decompressImage(reader).
+   */
+  void* getStreamRemainderPtr();
+  /*
+   * Returns the size of the bytes read from the stream past the EOI marker of the image.
+   */
+  size_t getStreamRemainderSize();
   /*
    * Decompresses metadata of the image. All vectors are owned by the caller.
    */
   bool getCompressedImageParameters(const void* image, int length);
 
  private:
-  bool decode(const void* image, int length, decode_mode_t decodeTo);
+  bool decode(const void* image, int length, decode_mode_t decodeTo,
+              const jpeg_output_planes* outputPlanes = nullptr);
+  bool decode(jpeg_source_mgr* mgr, decode_mode_t decodeTo,
+              const jpeg_output_planes* outputPlanes = nullptr);
   // Returns false if errors occur.
-  bool decompress(jpeg_decompress_struct* cinfo, const uint8_t* dest, bool isSingleChannel);
-  bool decompressYUV(jpeg_decompress_struct* cinfo, const uint8_t* dest);
-  bool decompressRGBA(jpeg_decompress_struct* cinfo, const uint8_t* dest);
-  bool decompressSingleChannel(jpeg_decompress_struct* cinfo, const uint8_t* dest);
+  bool decompress(jpeg_decompress_struct* cinfo, const jpeg_output_planes& dest,
+                  bool isSingleChannel);
+  bool decompressYUV(jpeg_decompress_struct* cinfo, const jpeg_output_planes& dest);
+  bool decompressRGBA(jpeg_decompress_struct* cinfo, const jpeg_output_planes& dest);
+  bool decompressSingleChannel(jpeg_decompress_struct* cinfo, const jpeg_output_planes& dest);
+  // Decodes a scaled or cropped image to YUV420 planar or grey-scale. The scanlines are read
+  // instead of raw data, as libjpeg scales the chroma of 4:2:0 images up to the luma resolution in
+  // the IDCT, and as the crop region can only be decoded through scanlines.
+  bool decompressScanlines(jpeg_decompress_struct* cinfo, const jpeg_output_planes& dest,
+                           bool isSingleChannel);
+  bool isCropped() const { return mCropWidth != 0 && mCropHeight != 0; }
+  // Skips the scanlines above the crop region and narrows the decode to the iMCU columns covering
+  // it. column receives the offset of the crop region in the scanlines read afterwards.
+  bool startCrop(jpeg_decompress_struct* cinfo, size_t* column);
+  // Skips the scanlines below the crop region.
+  bool finishCrop(jpeg_decompress_struct* cinfo);
+  // Hands the band of rows [bandStart, output_scanline) to mBandFn once it is full or the image is
+  // complete, and starts a new band. No-op unless decoding in bands.
+  bool flushBand(jpeg_decompress_struct* cinfo, const jpeg_output_planes& dest, size_t& bandStart);
   // Process 16 lines of Y and 16 lines of U/V each time.
   // We must pass at least 16 scanlines according to libjpeg documentation.
   static const int kCompressBatchSize = 16;
   // The buffer that holds the decompressed result.
-  std::vector<JOCTET> mResultBuffer;
+  uhdr_vector<JOCTET> mResultBuffer;
   // The buffer that holds XMP Data.
   std::vector<JOCTET> mXMPBuffer;
   // The buffer that holds EXIF Data.
   std::vector<JOCTET> mEXIFBuffer;
   // The buffer that holds ICC Data.
   std::vector<JOCTET> mICCBuffer;
+  // The buffer that holds MPF Data.
+  std::vector<JOCTET> mMPFBuffer;
+  // The buffer that holds stream bytes read past the EOI marker.
+  std::vector<JOCTET> mStreamRemainder;
 
   // Resolution of the decompressed image.
   size_t mWidth;
   size_t mHeight;
+  // Resolution of the coded image, the image is decoded at 1 / mScaleDenom of it.
+  size_t mImageWidth;
+  size_t mImageHeight;
+  size_t mScaleDenom = 1;
+  // Region of the scaled image that is decoded, the whole image if mCropWidth or mCropHeight is 0.
+  size_t mCropLeft = 0;
+  size_t mCropTop = 0;
+  size_t mCropWidth = 0;
+  size_t mCropHeight = 0;
+  // Chroma upsampling of RGBA decodes, see setFancyUpsampling().
+  bool mFancyUpsampling = true;
 
   // Position of EXIF package, default value is -1 which means no EXIF package appears.
   int mExifPos = -1;
+  // Position of MPF package, default value is -1 which means no MPF package appears.
+  int mMpfPos = -1;
+  // Number of stream bytes consumed while decoding from a reader.
+  size_t mStreamPosition = 0;
+
+  // Band decode state, see decompressImageInBands()
+  const jpeg_band_fn* mBandFn = nullptr;
+  size_t mBandHeight = 0;
 
   std::unique_ptr<uint8_t[]> mEmpty = nullptr;
   std::unique_ptr<uint8_t[]> mBufferIntermediate = nullptr;
@@ -34,6 +34,8 @@ extern "C" {
 #include <cstdint>
 #include <vector>
 
+#include "ultrahdr/allocator.h"
+
 namespace ultrahdr {
 
 /*
@@ -56,6 +58,24 @@ class JpegEncoderHelper {
                      int lumaStride, int chromaStride, int quality, const void* iccBuffer,
                      unsigned int iccSize);
 
+  /*
+   * Sets a caller owned buffer in which the compressed image is written, so that the compressed
+   * bytes land in their final location. If the compressed image does not fit in |capacity|
+   * bytes, the bytes written so far are moved to an internally managed buffer and compression
+   * continues there. As libjpeg hands back a buffer as soon as it is full, |capacity| must exceed
+   * the compressed size for the output to stay in place. The buffer must stay valid until the
+   * compressed image is consumed. Pass nullptr to go back to internally managed buffers.
+   */
+  void setOutputBuffer(void* buffer, size_t capacity);
+
+  /*
+   * Returns an estimate of the compressed JPEG size in bytes for the given configuration. The
+   * estimate is biased to over-shoot, so that in the common case the output buffer does not
+   * need to grow during compression.
+   */
+  static size_t estimateCompressedSize(int width, int height, int quality, bool isSingleChannel,
+                                       unsigned int iccSize);
+
   /*
    * Returns the compressed JPEG buffer pointer. This method must be called only after calling
    * compressImage().
@@ -94,11 +114,25 @@ class JpegEncoderHelper {
                    int lumaStride, int chromaStride);
   bool compressY(jpeg_compress_struct* cinfo, const uint8_t* yBuffer, int lumaStride);
 
-  // The block size for encoded jpeg image buffer.
+  // Returns the size the output buffer is grown to, once |size| bytes are exhausted.
+  static size_t getGrowthSize(size_t size);
+
+  // The minimum block size for encoded jpeg image buffer.
   static const int kBlockSize = 16384;
 
   // The buffer that holds the compressed result.
-  std::vector<JOCTET> mResultBuffer;
+  uhdr_vector<JOCTET> mResultBuffer;
+
+  // Estimated size of the compressed result, used for sizing |mResultBuffer| upfront.
+  size_t mEstimatedSize = kBlockSize;
+
+  // The caller owned buffer that holds the compressed result, see setOutputBuffer().
+  JOCTET* mOutputBuffer = nullptr;
+  size_t mOutputBufferCapacity = 0;
+  // Size of the compressed result in |mOutputBuffer|.
+  size_t mOutputSize = 0;
+  // Whether the compressed result is held in |mOutputBuffer| or in |mResultBuffer|.
+  bool mIsOutputInPlace = false;
 };
 
 } /* namespace ultrahdr  */
@@ -18,6 +18,7 @@
 #define ULTRAHDR_JPEGR_H
 
 #include <cfloat>
+#include <functional>
 
 #include "ultrahdr/ultrahdr.h"
 #include "ultrahdr/jpegdecoderhelper.h"
@@ -31,6 +32,10 @@ namespace ultrahdr {
 static const int kMinWidth = 2 * kMapDimensionScaleFactor;
 static const int kMinHeight = 2 * kMapDimensionScaleFactor;
 
+// Number of primary image rows held in memory at a time while reconstructing the HDR image from a
+// compressed JPEGR image
+static const size_t kDecodeBandHeight = 256;
+
 /*
  * Holds information of jpeg image
  */
@@ -56,6 +61,73 @@ struct jpegr_info_struct {
 typedef struct jpeg_info_struct* j_info_ptr;
 typedef struct jpegr_info_struct* uhdr_info_ptr;
 
+class DataStruct;
+
+// Upper bound on the number of marker headers (EXIF, XMP, ICC, MPF, gain map XMP) that are
+// generated while assembling a JPEG/R container
+static const int kMaxContainerMarkers = 5;
+
+/*
+ * Holds a contiguous run of bytes of a JPEG/R container. The memory is not owned by the segment
+ */
+struct jpegr_segment_struct {
+  const void* data;
+  size_t length;
+};
+
+/*
+ * Scatter-gather layout of a JPEG/R container. Segments are stored in output order. Marker
+ * headers, XMP packets and MPF are owned by this struct, compressed bitstreams, EXIF and ICC are
+ * referenced in place. As segments point into this struct, it must not be copied once filled.
+ */
+struct jpegr_container_struct {
+  std::vector<jpegr_segment_struct> segments;
+  size_t size = 0;  // exact size in bytes of the container
+  std::string xmpPrimary;
+  std::string xmpSecondary;
+  std::shared_ptr<DataStruct> mpf;
+  uint8_t markerHeaders[kMaxContainerMarkers][4];
+  int numMarkerHeaders = 0;
+};
+
+/*
+ * Optional settings of decodeJPEGR(). The defaults reconstruct dest only, at full resolution.
+ */
+struct jpegr_decode_options_struct {
+  // Additional renditions to be written in the same pass as dest, each with its own HDR output
+  // format and display boost. The images are decoded and the gain map is interpolated once for
+  // all of them. Only valid if the output format is an HDR output format.
+  ultrahdr_rendition_ptr renditions = nullptr;
+  // Number of entries in renditions
+  size_t numRenditions = 0;
+  // Destination of the statistics of the image written to dest. They are gathered while the gain
+  // map is applied, so they come without another pass over the output. Only valid if the output
+  // format is an HDR output format.
+  ultrahdr_image_stats_ptr stats = nullptr;
+  // Color gamut of dest and of the renditions. The conversion from the gamut of the primary image
+  // is done while the gain map is applied. If unspecified, the output is in the gamut of the
+  // primary image. Only valid if the output format is an HDR output format.
+  ultrahdr_color_gamut outputGamut = ULTRAHDR_COLORGAMUT_UNSPECIFIED;
+  // If true, the primary image is decoded to RGB by libjpeg and each output channel is
+  // reconstructed with one lookup in a GainCodeLUT. This is faster than the floating point
+  // reconstruction, but quantizes the gains to 8 bits and holds the RGB primary image in memory
+  // instead of a band of it. Only taken for the output formats GainCodeLUT supports, without
+  // renditions, statistics, gamut conversion or region of interest, the floating point
+  // reconstruction is used otherwise.
+  bool useGainCodeLut = false;
+  // One of {1, 2, 4, 8}. The images are decoded at 1 / scaleDenom of their resolution, rounded
+  // up, with the scaling done in the IDCT of libjpeg. The gain map is scaled by the largest factor
+  // that keeps it an integer fraction of the scaled primary image. dest, the renditions and the
+  // gain map receive the scaled resolutions. The decoder of an already decoded primary image
+  // carries its own scale, and ignores this one.
+  size_t scaleDenom = 1;
+  // Region of interest, in the coordinates of the scaled image. Only the iMCU rows and columns of
+  // the primary image that cover the region are decoded, and the gain map is decoded and applied
+  // inside of the region only. dest and the renditions receive the region, the gain map receives
+  // the window of it that the region reads.
+  const ultrahdr_region_struct* roi = nullptr;
+};
+
 class JpegR : public UltraHdr {
  public:
   /*
@@ -182,7 +254,10 @@ class JpegR : public UltraHdr {
    * @param jpegr_image_ptr compressed JPEGR image.
    * @param dest destination of the uncompressed JPEGR image.
    * @param max_display_boost (optional) the maximum available boost supported by a display,
-   *                          the value must be greater than or equal to 1.0.
+   *                          the value must be greater than or equal to 1.0. If it does not
+   *                          exceed hdrCapacityMin (or 1.0), the SDR rendition is written in
+   *                          the HDR output format. The gain map image is then only decoded if
+   *                          gainmap_image_ptr is given.
    * @param exif destination of the decoded EXIF metadata. The default value is NULL where the
                  decoder will do nothing about it. If configured not NULL the decoder will write
                  EXIF data into this structure. The format is defined in {@code jpegr_exif_struct}
@@ -208,13 +283,92 @@ class JpegR : public UltraHdr {
                      decoder will do nothing about it. If configured not NULL the decoder will
                      write metadata into this structure. the format of metadata is defined in
                      {@code ultrahdr_metadata_struct}.
+   * @param options (optional) renditions, statistics, gamut, scale and region of interest of the
+   *                decode, see jpegr_decode_options_struct. If NULL, the defaults are used.
    * @return NO_ERROR if decoding succeeds, error code if error occurs.
    */
   status_t decodeJPEGR(uhdr_compressed_ptr jpegr_image_ptr, uhdr_uncompressed_ptr dest,
                        float max_display_boost = FLT_MAX, uhdr_exif_ptr exif = nullptr,
                        ultrahdr_output_format output_format = ULTRAHDR_OUTPUT_HDR_LINEAR,
                        uhdr_uncompressed_ptr gainmap_image_ptr = nullptr,
-                       ultrahdr_metadata_ptr metadata = nullptr);
+                       ultrahdr_metadata_ptr metadata = nullptr,
+                       const jpegr_decode_options_struct* options = nullptr);
+
+  /*
+   * Decompress JPEGR image whose primary image has been decoded by
+   * decodePrimaryImageFromStream().
+   *
+   * @param primary_decoder decoder holding the decoded primary image and its metadata. The
+   *                        output is decoded at the scale set on it with setScaleDenom()
+   * @param gainmap_jpg_image_ptr compressed gain map image
+   * @param primary_jpg_image_ptr compressed primary image. If not NULL, primary_decoder is
+   *                              expected to hold only the parsed headers of this image, and
+   *                              the image is decoded in bands of kDecodeBandHeight rows while
+   *                              applying the gain map. Only valid for HDR output formats.
+   * Rest of the arguments are as in decodeJPEGR() above.
+   * @return NO_ERROR if decoding succeeds, error code if error occurs.
+   */
+  status_t decodeJPEGR(JpegDecoderHelper* primary_decoder, uhdr_compressed_ptr gainmap_jpg_image_ptr,
+                       uhdr_uncompressed_ptr dest, float max_display_boost = FLT_MAX,
+                       uhdr_exif_ptr exif = nullptr,
+                       ultrahdr_output_format output_format = ULTRAHDR_OUTPUT_HDR_LINEAR,
+                       uhdr_uncompressed_ptr gainmap_image_ptr = nullptr,
+                       ultrahdr_metadata_ptr metadata = nullptr,
+                       uhdr_compressed_ptr primary_jpg_image_ptr = nullptr,
+                       const jpegr_decode_options_struct* options = nullptr);
+
+  /*
+   * Reads a JPEGR image sequentially through reader. The primary image is decoded while its bytes
+   * arrive, the gain map image is located using the MPF offsets of the primary image and only its
+   * compressed bitstream is buffered. If MPF is absent or inconsistent, the first jpeg image that
+   * follows the primary image is taken as the gain map.
+   *
+   * @param reader source of the compressed JPEGR image
+   * @param output_format output format that decodeJPEGR() will be called with. This decides
+   *                      the color format of the decoded primary image
+   * @param primary_decoder destination of the decoded primary image
+   * @param gainmap_jpg_image destination of the compressed gain map image
+   * @param jpegr_image_info_ptr if not nullptr, filled as in getJPEGRInfo(). The primary image
+   *                             bitstream is not retained, hence primaryImgInfo->imgData is empty
+   * @return NO_ERROR if reading succeeds, error code if error occurs.
+   */
+  status_t decodePrimaryImageFromStream(const jpegr_read_fn& reader,
+                                        ultrahdr_output_format output_format,
+                                        JpegDecoderHelper* primary_decoder,
+                                        uhdr_vector<uint8_t>* gainmap_jpg_image,
+                                        uhdr_info_ptr jpegr_image_info_ptr = nullptr);
+
+  /*
+   * Decodes the gain map image of a JPEGR image, for callers that need the gain map and its
+   * metadata but not the reconstructed image. The gain map is located with the MP entries in the
+   * header of the primary image, so that the entropy coded data of the primary image is neither
+   * decoded nor scanned. Without usable MP entries, the images of the container are scanned.
+   *
+   * @param jpegr_image_ptr compressed JPEGR image
+   * @param gainmap_decoder destination of the decoded gain map image, and of its XMP
+   * @param jpegr_image_info_ptr if not nullptr, filled as in getJPEGRInfo(). The bitstreams are
+   *                             not retained, hence imgData of both images is empty
+   * @return NO_ERROR if decoding succeeds, error code if error occurs.
+   */
+  status_t decodeGainMap(uhdr_compressed_ptr jpegr_image_ptr, JpegDecoderHelper* gainmap_decoder,
+                         uhdr_info_ptr jpegr_image_info_ptr = nullptr);
+
+  /*
+   * Decodes the gain map image as decodeJPEGR() does, at the scale of the decode and in the window
+   * that its region of interest reads. This serves the gain map of a decodeJPEGR() call that has
+   * written the SDR rendition without decoding it.
+   *
+   * @param gainmap_jpg_image_ptr compressed gain map image
+   * @param width width of the primary image, at the scale of the decode
+   * @param height height of the primary image, at the scale of the decode
+   * @param dest destination of the decoded gain map, large enough for the full gain map. Its width
+   *             and height are set to the ones of the decoded gain map.
+   * @param options (optional) options of the decode, only scaleDenom and roi are read
+   * @return NO_ERROR if decoding succeeds, error code if error occurs.
+   */
+  status_t decodeGainMapImage(uhdr_compressed_ptr gainmap_jpg_image_ptr, size_t width,
+                              size_t height, uhdr_uncompressed_ptr dest,
+                              const jpegr_decode_options_struct* options = nullptr);
 
   /*
    * Gets Info from JPEGR file without decoding it.
@@ -264,6 +418,32 @@ class JpegR : public UltraHdr {
                        ultrahdr_metadata_ptr metadata, uhdr_compressed_ptr dest, int quality,
                        uhdr_exif_ptr exif);
 
+  /*
+   * Sets the allocator used by the encode APIs to obtain the destination buffer.
+   *
+   * If set, the exact size of the JPEG/R container is computed before anything is written and
+   * the allocator is asked for a buffer of that size. {@code dest->data} and {@code
+   * dest->maxLength} need not be set by the caller, they are updated to the buffer returned by
+   * the allocator. This avoids sizing the destination for the worst case upfront.
+   *
+   * @param allocator callable returning a buffer of at least the requested size, or nullptr on
+   *                  failure. Pass an empty function to restore the default behavior
+   */
+  void setOutputBufferAllocator(std::function<void*(size_t)> allocator);
+
+  /*
+   * Sets the sink that receives the output of the encode APIs.
+   *
+   * If set, the JPEG/R container is not written to {@code dest->data}. Instead its segments are
+   * handed to the sink in output order, as they are assembled. {@code dest->length} is still
+   * updated to the size of the container. The layout of the container is computed before the
+   * first segment is handed over, so the sink never needs to seek.
+   *
+   * @param sink callable consuming the given bytes, returns false to abort. Pass an empty
+   *             function to restore the default behavior
+   */
+  void setOutputSink(std::function<bool(const void*, size_t)> sink);
+
  private:
   /*
    * This method is called in the encoding pipeline. It will encode the gain map.
@@ -311,8 +491,29 @@ class JpegR : public UltraHdr {
    * @return NO_ERROR if calculation succeeds, error code if error occurs.
    */
   status_t appendGainMap(uhdr_compressed_ptr primary_jpg_image_ptr,
-                         uhdr_compressed_ptr gainmap_jpg_image_ptr, uhdr_exif_ptr pExif, void* pIcc,
-                         size_t icc_size, ultrahdr_metadata_ptr metadata, uhdr_compressed_ptr dest);
+                         uhdr_compressed_ptr gainmap_jpg_image_ptr, uhdr_exif_ptr pExif,
+                         const void* pIcc, size_t icc_size, ultrahdr_metadata_ptr metadata,
+                         uhdr_compressed_ptr dest);
+
+  /*
+   * This method computes the layout of the JPEG/R container that appendGainMap() emits, without
+   * copying any of the bitstreams. If the primary image carries EXIF, the EXIF package is
+   * referenced in place and the primary image is split in to two segments around it.
+   *
+   * @param primary_jpg_image_ptr primary image
+   * @param gainmap_jpg_image_ptr compressed gain map image
+   * @param (nullable) pExif EXIF package
+   * @param (nullable) pIcc ICC package
+   * @param icc_size length in bytes of ICC package
+   * @param metadata JPEG/R metadata to encode in XMP of the jpeg
+   * @param container destination of the container layout
+   * @return NO_ERROR if calculation succeeds, error code if error occurs.
+   */
+  status_t generateContainerLayout(uhdr_compressed_ptr primary_jpg_image_ptr,
+                                   uhdr_compressed_ptr gainmap_jpg_image_ptr, uhdr_exif_ptr pExif,
+                                   const void* pIcc, size_t icc_size,
+                                   ultrahdr_metadata_ptr metadata,
+                                   jpegr_container_struct* container);
 
   /*
    * This method will convert a YUV420 image from one YUV encoding to another in-place (eg.
@@ -329,6 +530,16 @@ class JpegR : public UltraHdr {
   status_t convertYuv(uhdr_uncompressed_ptr image, ultrahdr_color_gamut src_encoding,
                       ultrahdr_color_gamut dest_encoding);
 
+  /*
+   * This method checks the validity of the arguments shared by the decode APIs.
+   *
+   * @return NO_ERROR if the arguments are valid, error code otherwise.
+   */
+  status_t areDecodeArgumentsValid(uhdr_uncompressed_ptr dest, float max_display_boost,
+                                   uhdr_exif_ptr exif, ultrahdr_output_format output_format,
+                                   uhdr_uncompressed_ptr gainmap_image_ptr,
+                                   const jpegr_decode_options_struct* options = nullptr);
+
   /*
    * This method will check the validity of the input arguments.
    *
@@ -365,6 +576,11 @@ class JpegR : public UltraHdr {
                                   uhdr_uncompressed_ptr yuv420_image_ptr,
                                   ultrahdr_transfer_function hdr_tf, uhdr_compressed_ptr dest,
                                   int quality);
+
+  // allocator for the destination buffer of encode APIs, see setOutputBufferAllocator()
+  std::function<void*(size_t)> mOutputBufferAllocator;
+  // sink for the output of encode APIs, see setOutputSink()
+  std::function<bool(const void*, size_t)> mOutputSink;
 };
 }  // namespace ultrahdr
 
@@ -45,8 +45,9 @@ class DataStruct {
   ~DataStruct();
 
   void* getData();
-  int getLength();
-  int getBytesWritten();
+  const void* getData() const;
+  int getLength() const;
+  int getBytesWritten() const;
   bool write8(uint8_t value);
   bool write16(uint16_t value);
   bool write32(uint32_t value);
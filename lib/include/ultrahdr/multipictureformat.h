@@ -73,6 +73,19 @@ size_t calculateMpfSize();
 std::shared_ptr<DataStruct> generateMpf(int primary_image_size, int primary_image_offset,
                                         int secondary_image_size, int secondary_image_offset);
 
+/*
+ * Parses MPF data and returns the size and offset of the secondary image. The offset is relative
+ * to the MP endian field, i.e. the byte following the MPF signature.
+ *
+ * @param mpf MPF data starting with the MPF signature
+ * @param mpf_size size of the MPF data
+ * @param secondary_image_size size of the secondary image
+ * @param secondary_image_offset offset of the secondary image
+ * @return true if the MP entry of the secondary image is found, false otherwise
+ */
+bool getSecondaryImageFromMpf(const uint8_t* mpf, size_t mpf_size, uint32_t* secondary_image_size,
+                              uint32_t* secondary_image_offset);
+
 }  // namespace ultrahdr
 
 #endif  // ULTRAHDR_MULTIPICTUREFORMAT_H
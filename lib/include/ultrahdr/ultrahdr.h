@@ -17,6 +17,7 @@
 #ifndef ULTRAHDR_ULTRAHDR_H
 #define ULTRAHDR_ULTRAHDR_H
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -60,7 +61,10 @@ typedef enum {
   ULTRAHDR_OUTPUT_HDR_PQ,      // HDR in RGBA_1010102 color format (PQ transfer function)
   ULTRAHDR_OUTPUT_HDR_HLG,     // HDR in RGBA_1010102 color format (HLG transfer function)
   ULTRAHDR_OUTPUT_HDR_LINEAR_RGB_10BIT,
-  ULTRAHDR_OUTPUT_MAX = ULTRAHDR_OUTPUT_HDR_LINEAR_RGB_10BIT,
+  ULTRAHDR_OUTPUT_HDR_PQ_P010,   // HDR in P010 color format (PQ transfer function, BT.2100 matrix)
+  ULTRAHDR_OUTPUT_HDR_HLG_P010,  // HDR in P010 color format (HLG transfer function, BT.2100 matrix)
+  ULTRAHDR_OUTPUT_HDR_LINEAR_FLOAT_PLANAR,  // HDR in three float32 R, G, B planes (linear)
+  ULTRAHDR_OUTPUT_MAX = ULTRAHDR_OUTPUT_HDR_LINEAR_FLOAT_PLANAR,
 } ultrahdr_output_format;
 
 // Supported pixel format
@@ -115,6 +119,7 @@ typedef enum {
   ERROR_ULTRAHDR_MULTIPLE_EXIFS_RECEIVED = ULTRAHDR_RUNTIME_ERROR_BASE - 7,
   ERROR_ULTRAHDR_UNSUPPORTED_MAP_SCALE_FACTOR = ULTRAHDR_RUNTIME_ERROR_BASE - 8,
   ERROR_ULTRAHDR_INSUFFICIENT_RESOURCE = ULTRAHDR_RUNTIME_ERROR_BASE - 9,
+  ERROR_ULTRAHDR_OUTPUT_SINK_ERROR = ULTRAHDR_RUNTIME_ERROR_BASE - 10,
 
   ERROR_ULTRAHDR_UNSUPPORTED_FEATURE = -30000,
 } status_t;
@@ -175,11 +180,91 @@ struct ultrahdr_uncompressed_struct {
   // NOTE: if chroma_data is nullptr, chroma_stride is irrelevant. Just as the way,
   // chroma_data is derived from luma ptr, chroma stride is derived from luma stride.
   size_t chroma_stride = 0;
+  // Pointers to the green and blue planes of planar RGB images, the red plane is at data. If a
+  // pointer is NULL, its plane is considered to be immediately after the previous plane.
+  void* green_data = nullptr;
+  void* blue_data = nullptr;
+  // Strides of the green and blue planes in number of pixels. 0 indicates the member is
+  // uninitialized, the stride of the previous plane is assumed then.
+  size_t green_stride = 0;
+  size_t blue_stride = 0;
   // Pixel format.
   ultrahdr_pixel_format pixelFormat = ULTRAHDR_PIX_FMT_UNSPECIFIED;
 };
 typedef struct ultrahdr_uncompressed_struct* uhdr_uncompressed_ptr;
 
+/*
+ * Holds information for one output of a multi rendition decode.
+ */
+struct ultrahdr_rendition_struct {
+  // Output format of the rendition, one of the HDR output formats.
+  ultrahdr_output_format outputFormat;
+  // Max display boost the rendition is rendered for.
+  float maxDisplayBoost;
+  // Destination of the rendition, sized for the full image.
+  uhdr_uncompressed_ptr dest;
+};
+typedef struct ultrahdr_rendition_struct* ultrahdr_rendition_ptr;
+
+/*
+ * Holds a rectangular region of an image, in pixels.
+ */
+struct ultrahdr_region_struct {
+  size_t left = 0;
+  size_t top = 0;
+  size_t width = 0;
+  size_t height = 0;
+};
+typedef struct ultrahdr_region_struct* ultrahdr_region_ptr;
+
+// Number of bins of the gain histogram of ultrahdr_image_stats_struct, one per gain map code
+constexpr size_t kGainHistogramBins = 256;
+
+/*
+ * Holds statistics of a reconstructed HDR image, gathered while the gain map is applied.
+ */
+struct ultrahdr_image_stats_struct {
+  // Max luminance of the HDR image, relative to SDR white
+  float maxLuminance = 0.0f;
+  // Sum of the luminance of all pixels, relative to SDR white
+  double sumLuminance = 0.0;
+  // Number of pixels accumulated
+  uint64_t numPixels = 0;
+  // Number of pixels with a component outside of the output range, these are clipped by the
+  // integer output formats
+  uint64_t numClippedPixels = 0;
+  // Number of pixels per applied gain, quantized to the gain map codes
+  uint64_t gainHistogram[kGainHistogramBins] = {};
+};
+typedef struct ultrahdr_image_stats_struct* ultrahdr_image_stats_ptr;
+
+/*
+ * Holds the band of the SDR image and the outputs of the band applyGainMap().
+ */
+struct ultrahdr_apply_options_struct {
+  // First image row held in the band, must be even
+  size_t rowStart = 0;
+  // Number of valid rows in the band
+  size_t rowCount = 0;
+  // Height of the full SDR image
+  size_t imageHeight = 0;
+  // Outputs to be written, each with its own output format and display boost
+  ultrahdr_rendition_ptr renditions = nullptr;
+  // Number of entries in renditions, must be at least 1
+  size_t numRenditions = 0;
+  // If not nullptr, the statistics of the first rendition are added to it. Every worker
+  // accumulates in to its own copy and the copies are merged at the end.
+  ultrahdr_image_stats_ptr stats = nullptr;
+  // Color gamut of the renditions. The linear HDR color is converted from the gamut of the SDR
+  // image before the OETF, in the same pass. If unspecified, the renditions keep the gamut of the
+  // SDR image.
+  ultrahdr_color_gamut outputGamut = ULTRAHDR_COLORGAMUT_UNSPECIFIED;
+  // If not nullptr, only the pixels of this region of the SDR image are reconstructed, and the
+  // renditions are sized for the region instead of the full image. Its left and top must be even
+  // if a rendition is p010.
+  const ultrahdr_region_struct* outRegion = nullptr;
+};
+
 /*
  * Holds information for compressed image or gain map.
  */
@@ -371,6 +456,45 @@ protected:
                                ultrahdr_metadata_ptr metadata, ultrahdr_output_format output_format,
                                float max_display_boost, uhdr_uncompressed_ptr dest);
 
+  /*
+   * Variant of applyGainMap() that reconstructs rows [rowStart, rowStart + rowCount) of the HDR
+   * image from a band of the SDR image, to several renditions in one pass. This lets the caller
+   * stream the SDR image through a buffer of a few rows instead of holding the full frame. The
+   * linear SDR color and the interpolated gain of a pixel are computed once and shared, only the
+   * gain application and the packing of the output differ per rendition.
+   *
+   * @param yuv420_band_ptr band of the SDR image in YUV_420 color format. Its first row is image
+   *                        row rowStart and its height is the number of rows the band buffer
+   *                        can hold.
+   * @param gainmap_image_ptr if nullptr, the renditions are the SDR rendition of the image. The
+   *                          SDR image is then linearized, scaled and packed without a gain, and
+   *                          the statistics must not be requested.
+   * @param options band, renditions and optional settings, see ultrahdr_apply_options_struct.
+   *                The renditions are sized for the full image, only the rows of the band are
+   *                written.
+   * The rest of the parameters are same as the ones of applyGainMap().
+   * @return NO_ERROR if calculation succeeds, error code if error occurs.
+   */
+  status_t applyGainMap(uhdr_uncompressed_ptr yuv420_band_ptr,
+                        uhdr_uncompressed_ptr gainmap_image_ptr, ultrahdr_metadata_ptr metadata,
+                        const ultrahdr_apply_options_struct* options);
+
+  /*
+   * Variant of applyGainMap() for an SDR image decoded to RGB, that reconstructs every channel
+   * with one lookup in a GainCodeLUT instead of the floating point math of applyGainMap(). The
+   * gains are quantized to 8-bit codes, see GainCodeLUT for the accuracy.
+   *
+   * @param rgb_image_ptr SDR image, packed RGB with bytes_per_pixel bytes per pixel
+   * @param bytes_per_pixel 3 or 4
+   * @param output_format one of the output formats GainCodeLUT supports
+   * The rest of the parameters are same as the ones of applyGainMap().
+   * @return NO_ERROR if calculation succeeds, error code if error occurs.
+   */
+  status_t applyGainMapLUT(uhdr_uncompressed_ptr rgb_image_ptr, size_t bytes_per_pixel,
+                           uhdr_uncompressed_ptr gainmap_image_ptr, ultrahdr_metadata_ptr metadata,
+                           ultrahdr_output_format output_format, float max_display_boost,
+                           uhdr_uncompressed_ptr dest);
+
   /*
    * This method will tone map a HDR image to an SDR image.
    *
@@ -397,7 +521,7 @@ private:
    */
   status_t maybeToneMapRawHdr();
 
-  void createOutputMemory(int size, void*& dest);
+  void createOutputMemory(size_t size, void*& dest);
 
   std::shared_ptr<ultrahdr_uncompressed_struct> sdr_raw_img       = nullptr;
   std::shared_ptr<ultrahdr_uncompressed_struct> hdr_raw_img       = nullptr;
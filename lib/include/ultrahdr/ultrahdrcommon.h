@@ -24,6 +24,8 @@
 #include <vector>
 
 #include "ultrahdr_api.h"
+#include "ultrahdr/allocator.h"
+#include "ultrahdr/jpegdecoderhelper.h"
 
 // ===============================================================================================
 // Function Macros
@@ -81,14 +83,16 @@ namespace ultrahdr {
 typedef struct uhdr_memory_block {
   uhdr_memory_block(size_t capacity);
 
-  std::unique_ptr<uint8_t[]> m_buffer; /**< data */
-  size_t m_capacity;                   /**< capacity */
+  uhdr_unique_ptr<uint8_t> m_buffer; /**< data, allocated with uhdrMalloc() */
+  size_t m_capacity;                 /**< capacity */
 } uhdr_memory_block_t;                 /**< alias for struct uhdr_memory_block */
 
 /**\brief extended raw image descriptor */
 typedef struct uhdr_raw_image_ext : uhdr_raw_image_t {
   uhdr_raw_image_ext(uhdr_img_fmt_t fmt, uhdr_color_gamut_t cg, uhdr_color_transfer_t ct,
                      uhdr_color_range_t range, unsigned w, unsigned h, unsigned align_stride_to);
+  // describes the planes of an application owned image, no memory is allocated
+  explicit uhdr_raw_image_ext(const uhdr_raw_image_t& img);
 
  private:
   std::unique_ptr<ultrahdr::uhdr_memory_block> m_block;
@@ -103,6 +107,31 @@ typedef struct uhdr_compressed_image_ext : uhdr_compressed_image_t {
   std::unique_ptr<ultrahdr::uhdr_memory_block> m_block;
 } uhdr_compressed_image_ext_t; /**< alias for struct uhdr_compressed_image_ext */
 
+/**\brief configuration of an additional decoder output, see uhdr_dec_add_out_rendition() */
+typedef struct uhdr_out_rendition {
+  uhdr_img_fmt_t fmt;        /**< output image format */
+  uhdr_color_transfer_t ct;  /**< output color transfer */
+  float max_disp_boost;      /**< max display boost */
+} uhdr_out_rendition_t; /**< alias for struct uhdr_out_rendition */
+
+/**\brief read-only view of a file. The file is memory mapped where supported, else it is read in
+ * to a heap buffer */
+typedef struct uhdr_mapped_file {
+  uhdr_mapped_file() = default;
+  ~uhdr_mapped_file();
+  uhdr_mapped_file(const uhdr_mapped_file&) = delete;
+  uhdr_mapped_file& operator=(const uhdr_mapped_file&) = delete;
+
+  bool open(const char* filename);
+
+  const uint8_t* m_data = nullptr; /**< file contents */
+  size_t m_size = 0;               /**< file size */
+
+ private:
+  bool m_is_mapped = false;
+  uhdr_unique_ptr<uint8_t> m_buffer;
+} uhdr_mapped_file_t; /**< alias for struct uhdr_mapped_file */
+
 }  // namespace ultrahdr
 
 // ===============================================================================================
@@ -111,6 +140,10 @@ typedef struct uhdr_compressed_image_ext : uhdr_compressed_image_t {
 
 struct uhdr_codec_private {
   virtual ~uhdr_codec_private() = default;
+
+  // declared in the base so that it outlives the buffers of the derived contexts
+  ultrahdr::AllocStats m_alloc_stats;
+  uhdr_alloc_stats_t m_alloc_stats_info{};
 };
 
 struct uhdr_encoder_private : uhdr_codec_private {
@@ -122,6 +155,8 @@ struct uhdr_encoder_private : uhdr_codec_private {
   std::vector<uint8_t> m_exif;
   uhdr_gainmap_metadata_t m_metadata;
   uhdr_codec_t m_output_format;
+  uhdr_write_cb_t m_output_sink;
+  void* m_output_sink_user_data;
 
   // internal data
   bool m_sailed;
@@ -132,15 +167,32 @@ struct uhdr_encoder_private : uhdr_codec_private {
 struct uhdr_decoder_private : uhdr_codec_private {
   // config data
   std::unique_ptr<ultrahdr::uhdr_compressed_image_ext_t> m_uhdr_compressed_img;
+  std::unique_ptr<ultrahdr::uhdr_mapped_file_t> m_mapped_file;
+  uhdr_read_cb_t m_read_cb;
+  void* m_read_cb_user_data;
   uhdr_img_fmt_t m_output_fmt;
   uhdr_color_transfer_t m_output_ct;
+  uhdr_color_gamut_t m_output_cg;
   float m_output_max_disp_boost;
+  std::vector<ultrahdr::uhdr_out_rendition_t> m_out_renditions;
+  bool m_has_out_img_buffer;
+  uhdr_raw_image_t m_out_img_buffer;
+  bool m_enable_image_stats;
+  bool m_enable_gain_code_lut;
+  int m_scale_denom;
+  bool m_has_roi;
+  int m_roi_x, m_roi_y, m_roi_wd, m_roi_ht;
 
   // internal data
   bool m_probed;
   bool m_sailed;
+  // the context sailed through uhdr_decode_gain_map(), the hdr image is not available
+  bool m_gainmap_only;
   std::unique_ptr<ultrahdr::uhdr_raw_image_ext_t> m_decoded_img_buffer;
   std::unique_ptr<ultrahdr::uhdr_raw_image_ext_t> m_gainmap_img_buffer;
+  std::vector<std::unique_ptr<ultrahdr::uhdr_raw_image_ext_t>> m_rendition_img_buffers;
+  std::unique_ptr<ultrahdr::JpegDecoderHelper> m_stream_primary_dec;
+  ultrahdr::uhdr_vector<uint8_t> m_stream_gainmap;
   int m_img_wd, m_img_ht;
   int m_gainmap_wd, m_gainmap_ht;
   std::vector<uint8_t> m_exif;
@@ -150,6 +202,8 @@ struct uhdr_decoder_private : uhdr_codec_private {
   std::vector<uint8_t> m_base_xmp;
   std::vector<uint8_t> m_gainmap_xmp;
   uhdr_gainmap_metadata_t m_metadata;
+  bool m_has_image_stats;
+  uhdr_image_stats_t m_image_stats;
   uhdr_error_info_t m_probe_call_status;
   uhdr_error_info_t m_decode_call_status;
 };
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+#include <mutex>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#include "ultrahdr/allocator.h"
+
+namespace ultrahdr {
+
+// Bookkeeping stored in front of every block. Recording the callbacks per block keeps blocks valid
+// across calls to setAllocator().
+struct BlockHeader {
+  size_t size;
+  uhdr_free_cb_t free_cb;
+  void* user_data;
+  AllocStats* stats;
+  uint32_t epoch;
+};
+static_assert(sizeof(BlockHeader) <= kAllocAlignment, "block header does not fit in the padding");
+
+static void* defaultAlloc(void* /* user_data */, size_t size, size_t alignment) {
+#ifdef _WIN32
+  return _aligned_malloc(size, alignment);
+#else
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, alignment, size) != 0) return nullptr;
+  return ptr;
+#endif
+}
+
+static void defaultFree(void* /* user_data */, void* ptr) {
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+static std::mutex gAllocatorLock;
+static uhdr_alloc_cb_t gAllocCb = defaultAlloc;
+static uhdr_free_cb_t gFreeCb = defaultFree;
+static void* gUserData = nullptr;
+
+static thread_local AllocStats* tCurrentStats = nullptr;
+
+void AllocStats::reset() {
+  mEpoch.fetch_add(1, std::memory_order_relaxed);
+  mBytesAllocated = 0;
+  mBytesInUse = 0;
+  mPeakBytesInUse = 0;
+  mNumAllocations = 0;
+}
+
+AllocStatsScope::AllocStatsScope(AllocStats* stats) : mPrevious(tCurrentStats) {
+  tCurrentStats = stats;
+}
+
+AllocStatsScope::~AllocStatsScope() { tCurrentStats = mPrevious; }
+
+void setAllocator(uhdr_alloc_cb_t alloc_cb, uhdr_free_cb_t free_cb, void* user_data) {
+  std::lock_guard<std::mutex> guard(gAllocatorLock);
+  if (alloc_cb == nullptr || free_cb == nullptr) {
+    gAllocCb = defaultAlloc;
+    gFreeCb = defaultFree;
+    gUserData = nullptr;
+  } else {
+    gAllocCb = alloc_cb;
+    gFreeCb = free_cb;
+    gUserData = user_data;
+  }
+}
+
+void* uhdrMalloc(size_t size) {
+  if (size > SIZE_MAX - kAllocAlignment) return nullptr;
+
+  uhdr_alloc_cb_t alloc_cb;
+  uhdr_free_cb_t free_cb;
+  void* user_data;
+  {
+    std::lock_guard<std::mutex> guard(gAllocatorLock);
+    alloc_cb = gAllocCb;
+    free_cb = gFreeCb;
+    user_data = gUserData;
+  }
+
+  uint8_t* base =
+      static_cast<uint8_t*>(alloc_cb(user_data, size + kAllocAlignment, kAllocAlignment));
+  if (base == nullptr) return nullptr;
+  if (reinterpret_cast<uintptr_t>(base) % kAllocAlignment != 0) {
+    // custom allocator did not honor the requested alignment
+    free_cb(user_data, base);
+    return nullptr;
+  }
+
+  AllocStats* stats = tCurrentStats;
+  BlockHeader* header = reinterpret_cast<BlockHeader*>(base);
+  header->size = size;
+  header->free_cb = free_cb;
+  header->user_data = user_data;
+  header->stats = stats;
+  header->epoch = 0;
+  if (stats) {
+    header->epoch = stats->mEpoch.load(std::memory_order_relaxed);
+    stats->mBytesAllocated.fetch_add(size, std::memory_order_relaxed);
+    stats->mNumAllocations.fetch_add(1, std::memory_order_relaxed);
+    size_t in_use = stats->mBytesInUse.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = stats->mPeakBytesInUse.load(std::memory_order_relaxed);
+    while (in_use > peak &&
+           !stats->mPeakBytesInUse.compare_exchange_weak(peak, in_use, std::memory_order_relaxed)) {
+    }
+  }
+  return base + kAllocAlignment;
+}
+
+void uhdrFree(void* ptr) {
+  if (ptr == nullptr) return;
+  uint8_t* base = static_cast<uint8_t*>(ptr) - kAllocAlignment;
+  BlockHeader* header = reinterpret_cast<BlockHeader*>(base);
+  AllocStats* stats = header->stats;
+  if (stats && header->epoch == stats->mEpoch.load(std::memory_order_relaxed)) {
+    stats->mBytesInUse.fetch_sub(header->size, std::memory_order_relaxed);
+  }
+  header->free_cb(header->user_data, base);
+}
+
+}  // namespace ultrahdr
@@ -14,54 +14,115 @@
  * limitations under the License.
  */
 
+#include <cstring>
+#include <list>
+#include <mutex>
+
 #include "ultrahdr/gainmapmath.h"
 
 namespace ultrahdr {
 
-static const std::vector<float> kPqOETF = [] {
-  std::vector<float> result;
-  for (size_t idx = 0; idx < kPqOETFNumEntries; idx++) {
-    float value = static_cast<float>(idx) / static_cast<float>(kPqOETFNumEntries - 1);
-    result.push_back(pqOetf(value));
+// Transfer function lookup tables are built on first use instead of during static
+// initialization, so processes that load the library but never reach these paths do not pay for
+// them.
+static std::vector<float> makeTransferLUT(float (*fn)(float), size_t numEntries) {
+  std::vector<float> result(numEntries);
+  for (size_t idx = 0; idx < numEntries; idx++) {
+    float value = static_cast<float>(idx) / static_cast<float>(numEntries - 1);
+    result[idx] = fn(value);
   }
   return result;
-}();
+}
 
-static const std::vector<float> kPqInvOETF = [] {
-  std::vector<float> result;
-  for (size_t idx = 0; idx < kPqInvOETFNumEntries; idx++) {
-    float value = static_cast<float>(idx) / static_cast<float>(kPqInvOETFNumEntries - 1);
-    result.push_back(pqInvOetf(value));
-  }
-  return result;
-}();
+static const float* pqOetfTable() {
+  static const std::vector<float> table = makeTransferLUT(pqOetf, kPqOETFNumEntries);
+  return table.data();
+}
+
+static const float* pqInvOetfTable() {
+  static const std::vector<float> table = makeTransferLUT(pqInvOetf, kPqInvOETFNumEntries);
+  return table.data();
+}
 
-static const std::vector<float> kHlgOETF = [] {
-  std::vector<float> result;
-  for (size_t idx = 0; idx < kHlgOETFNumEntries; idx++) {
-    float value = static_cast<float>(idx) / static_cast<float>(kHlgOETFNumEntries - 1);
-    result.push_back(hlgOetf(value));
+static const float* hlgOetfTable() {
+  static const std::vector<float> table = makeTransferLUT(hlgOetf, kHlgOETFNumEntries);
+  return table.data();
+}
+
+static const float* hlgInvOetfTable() {
+  static const std::vector<float> table = makeTransferLUT(hlgInvOetf, kHlgInvOETFNumEntries);
+  return table.data();
+}
+
+static const float* srgbInvOetfTable() {
+  static const std::vector<float> table = makeTransferLUT(srgbInvOetf, kSrgbInvOETFNumEntries);
+  return table.data();
+}
+
+// Bit patterns of the smallest input of the 10-bit OETF tables and of the step between entries.
+constexpr uint32_t kOetf10BitMinBits = static_cast<uint32_t>(127 + kOetf10BitMinExponent) << 23;
+constexpr uint32_t kOetf10BitShift = 23 - kOetf10BitMantissaBits;
+
+static inline size_t oetf10BitIndex(float e) {
+  // written so that NaN fails the first comparison and clamps to 0
+  e = e > 0.0f ? (e < 1.0f ? e : 1.0f) : 0.0f;
+  uint32_t bits;
+  memcpy(&bits, &e, sizeof(bits));
+  bits = (std::max)(bits, kOetf10BitMinBits);
+  return (bits - kOetf10BitMinBits) >> kOetf10BitShift;
+}
+
+static std::vector<uint16_t> makeOetf10BitLUT(float (*fn)(float)) {
+  std::vector<uint16_t> result(kOetf10BitNumEntries);
+  for (size_t idx = 0; idx < kOetf10BitNumEntries; idx++) {
+    // the entry holds the code of the center of the inputs that share it
+    uint32_t bits = kOetf10BitMinBits + (static_cast<uint32_t>(idx) << kOetf10BitShift) +
+                    (1u << (kOetf10BitShift - 1));
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    float code = fn((std::min)(value, 1.0f)) * 1023.0f + 0.5f;
+    result[idx] = static_cast<uint16_t>(CLIP3(code, 0.0f, 1023.0f));
   }
   return result;
-}();
+}
+
+static const uint16_t* hlgOetf10BitTable() {
+  static const std::vector<uint16_t> table = makeOetf10BitLUT(hlgOetf);
+  return table.data();
+}
 
-static const std::vector<float> kHlgInvOETF = [] {
-  std::vector<float> result;
-  for (size_t idx = 0; idx < kHlgInvOETFNumEntries; idx++) {
-    float value = static_cast<float>(idx) / static_cast<float>(kHlgInvOETFNumEntries - 1);
-    result.push_back(hlgInvOetf(value));
+static const uint16_t* pqOetf10BitTable() {
+  static const std::vector<uint16_t> table = makeOetf10BitLUT(pqOetf);
+  return table.data();
+}
+
+std::shared_ptr<const RenderPlan> getRenderPlan(ultrahdr_metadata_ptr metadata,
+                                                float displayBoost, size_t mapScaleFactor) {
+  // most recently used plan first
+  static std::mutex cacheLock;
+  static std::list<std::shared_ptr<const RenderPlan>> cache;
+
+  std::lock_guard<std::mutex> guard(cacheLock);
+  for (auto it = cache.begin(); it != cache.end(); ++it) {
+    const RenderPlan& plan = **it;
+    if (plan.mMinContentBoost == metadata->minContentBoost &&
+        plan.mMaxContentBoost == metadata->maxContentBoost &&
+        plan.mDisplayBoost == displayBoost && plan.mMapScaleFactor == mapScaleFactor) {
+      cache.splice(cache.begin(), cache, it);
+      return cache.front();
+    }
   }
-  return result;
-}();
 
-static const std::vector<float> kSrgbInvOETF = [] {
-  std::vector<float> result;
-  for (size_t idx = 0; idx < kSrgbInvOETFNumEntries; idx++) {
-    float value = static_cast<float>(idx) / static_cast<float>(kSrgbInvOETFNumEntries - 1);
-    result.push_back(srgbInvOetf(value));
+  std::shared_ptr<const RenderPlan> plan;
+  try {
+    plan = std::make_shared<const RenderPlan>(metadata, displayBoost, mapScaleFactor);
+    cache.push_front(plan);
+  } catch (const std::bad_alloc&) {
+    return plan;
   }
-  return result;
-}();
+  if (cache.size() > kRenderPlanCacheSize) cache.pop_back();
+  return plan;
+}
 
 // Use Shepard's method for inverse distance weighting. For more information:
 // en.wikipedia.org/wiki/Inverse_distance_weighting#Shepard's_method
@@ -158,12 +219,16 @@ Color srgbInvOetf(Color e_gamma) {
   return {{{srgbInvOetf(e_gamma.r), srgbInvOetf(e_gamma.g), srgbInvOetf(e_gamma.b)}}};
 }
 
+Color srgbInvOetfFast(Color e_gamma) {
+  return {{{srgbInvOetfFast(e_gamma.r), srgbInvOetfFast(e_gamma.g), srgbInvOetfFast(e_gamma.b)}}};
+}
+
 // See IEC 61966-2-1, Equations F.5 and F.6.
 float srgbInvOetfLUT(float e_gamma) {
   uint32_t value = static_cast<uint32_t>(e_gamma * (kSrgbInvOETFNumEntries - 1) + 0.5);
   // TODO() : Remove once conversion modules have appropriate clamping in place
   value = CLIP3(value, 0, kSrgbInvOETFNumEntries - 1);
-  return kSrgbInvOETF[value];
+  return srgbInvOetfTable()[value];
 }
 
 Color srgbInvOetfLUT(Color e_gamma) {
@@ -254,8 +319,6 @@ Color bt2100YuvToRgb(Color e_gamma) {
 }
 
 // See ITU-R BT.2100-2, Table 5, HLG Reference OETF.
-static const float kHlgA = 0.17883277f, kHlgB = 0.28466892f, kHlgC = 0.55991073;
-
 float hlgOetf(float e) {
   if (e <= 1.0f / 12.0f) {
     return sqrt(3.0f * e);
@@ -266,12 +329,14 @@ float hlgOetf(float e) {
 
 Color hlgOetf(Color e) { return {{{hlgOetf(e.r), hlgOetf(e.g), hlgOetf(e.b)}}}; }
 
+Color hlgOetfFast(Color e) { return {{{hlgOetfFast(e.r), hlgOetfFast(e.g), hlgOetfFast(e.b)}}}; }
+
 float hlgOetfLUT(float e) {
   uint32_t value = static_cast<uint32_t>(e * (kHlgOETFNumEntries - 1) + 0.5);
   // TODO() : Remove once conversion modules have appropriate clamping in place
   value = CLIP3(value, 0, kHlgOETFNumEntries - 1);
 
-  return kHlgOETF[value];
+  return hlgOetfTable()[value];
 }
 
 Color hlgOetfLUT(Color e) { return {{{hlgOetfLUT(e.r), hlgOetfLUT(e.g), hlgOetfLUT(e.b)}}}; }
@@ -289,12 +354,16 @@ Color hlgInvOetf(Color e_gamma) {
   return {{{hlgInvOetf(e_gamma.r), hlgInvOetf(e_gamma.g), hlgInvOetf(e_gamma.b)}}};
 }
 
+Color hlgInvOetfFast(Color e_gamma) {
+  return {{{hlgInvOetfFast(e_gamma.r), hlgInvOetfFast(e_gamma.g), hlgInvOetfFast(e_gamma.b)}}};
+}
+
 float hlgInvOetfLUT(float e_gamma) {
   uint32_t value = static_cast<uint32_t>(e_gamma * (kHlgInvOETFNumEntries - 1) + 0.5);
   // TODO() : Remove once conversion modules have appropriate clamping in place
   value = CLIP3(value, 0, kHlgInvOETFNumEntries - 1);
 
-  return kHlgInvOETF[value];
+  return hlgInvOetfTable()[value];
 }
 
 Color hlgInvOetfLUT(Color e_gamma) {
@@ -302,10 +371,6 @@ Color hlgInvOetfLUT(Color e_gamma) {
 }
 
 // See ITU-R BT.2100-2, Table 4, Reference PQ OETF.
-static const float kPqM1 = 2610.0f / 16384.0f, kPqM2 = 2523.0f / 4096.0f * 128.0f;
-static const float kPqC1 = 3424.0f / 4096.0f, kPqC2 = 2413.0f / 4096.0f * 32.0f,
-                   kPqC3 = 2392.0f / 4096.0f * 32.0f;
-
 float pqOetf(float e) {
   if (e <= 0.0f) return 0.0f;
   return pow((kPqC1 + kPqC2 * pow(e, kPqM1)) / (1 + kPqC3 * pow(e, kPqM1)), kPqM2);
@@ -313,20 +378,19 @@ float pqOetf(float e) {
 
 Color pqOetf(Color e) { return {{{pqOetf(e.r), pqOetf(e.g), pqOetf(e.b)}}}; }
 
+Color pqOetfFast(Color e) { return {{{pqOetfFast(e.r), pqOetfFast(e.g), pqOetfFast(e.b)}}}; }
+
 float pqOetfLUT(float e) {
   uint32_t value = static_cast<uint32_t>(e * (kPqOETFNumEntries - 1) + 0.5);
   // TODO() : Remove once conversion modules have appropriate clamping in place
   value = CLIP3(value, 0, kPqOETFNumEntries - 1);
 
-  return kPqOETF[value];
+  return pqOetfTable()[value];
 }
 
 Color pqOetfLUT(Color e) { return {{{pqOetfLUT(e.r), pqOetfLUT(e.g), pqOetfLUT(e.b)}}}; }
 
 // Derived from the inverse of the Reference PQ OETF.
-static const float kPqInvA = 128.0f, kPqInvB = 107.0f, kPqInvC = 2413.0f, kPqInvD = 2392.0f,
-                   kPqInvE = 6.2773946361f, kPqInvF = 0.0126833f;
-
 float pqInvOetf(float e_gamma) {
   // This equation blows up if e_gamma is 0.0, and checking on <= 0.0 doesn't
   // always catch 0.0. So, check on 0.0001, since anything this small will
@@ -341,12 +405,16 @@ Color pqInvOetf(Color e_gamma) {
   return {{{pqInvOetf(e_gamma.r), pqInvOetf(e_gamma.g), pqInvOetf(e_gamma.b)}}};
 }
 
+Color pqInvOetfFast(Color e_gamma) {
+  return {{{pqInvOetfFast(e_gamma.r), pqInvOetfFast(e_gamma.g), pqInvOetfFast(e_gamma.b)}}};
+}
+
 float pqInvOetfLUT(float e_gamma) {
   uint32_t value = static_cast<uint32_t>(e_gamma * (kPqInvOETFNumEntries - 1) + 0.5);
   // TODO() : Remove once conversion modules have appropriate clamping in place
   value = CLIP3(value, 0, kPqInvOETFNumEntries - 1);
 
-  return kPqInvOETF[value];
+  return pqInvOetfTable()[value];
 }
 
 Color pqInvOetfLUT(Color e_gamma) {
@@ -547,18 +615,81 @@ Color applyGain(Color e, float gain, ultrahdr_metadata_ptr metadata) {
   return e * gainFactor;
 }
 
-Color applyGain(Color e, float gain, ultrahdr_metadata_ptr metadata, float displayBoost) {
+float computeGainFactor(float gain, ultrahdr_metadata_ptr metadata, float displayBoost) {
   float logBoost =
       log2(metadata->minContentBoost) * (1.0f - gain) + log2(metadata->maxContentBoost) * gain;
-  float gainFactor = exp2(logBoost * displayBoost / metadata->maxContentBoost);
-  return e * gainFactor;
+  return exp2(logBoost * displayBoost / metadata->maxContentBoost);
+}
+
+void mergeImageStats(ultrahdr_image_stats_ptr dest, const ultrahdr_image_stats_struct& src) {
+  dest->maxLuminance = (std::max)(dest->maxLuminance, src.maxLuminance);
+  dest->sumLuminance += src.sumLuminance;
+  dest->numPixels += src.numPixels;
+  dest->numClippedPixels += src.numClippedPixels;
+  for (size_t i = 0; i < kGainHistogramBins; i++) {
+    dest->gainHistogram[i] += src.gainHistogram[i];
+  }
 }
 
-Color applyGainLUT(Color e, float gain, GainLUT& gainLUT) {
+Color applyGain(Color e, float gain, ultrahdr_metadata_ptr metadata, float displayBoost) {
+  return e * computeGainFactor(gain, metadata, displayBoost);
+}
+
+Color applyGainLUT(Color e, float gain, const GainLUT& gainLUT) {
   float gainFactor = gainLUT.getGainFactor(gain);
   return e * gainFactor;
 }
 
+GainCodeLUT::GainCodeLUT(ultrahdr_metadata_ptr metadata, float displayBoost,
+                         ultrahdr_output_format outputFormat)
+    : mOutputFormat(outputFormat), mTable(kGainCodeLUTDim * kGainCodeLUTDim) {
+  float linear[kGainCodeLUTDim];
+  for (size_t idx = 0; idx < kGainCodeLUTDim; idx++) {
+    linear[idx] = srgbInvOetf(static_cast<float>(idx) / 255.0f) / displayBoost;
+  }
+  for (size_t gainCode = 0; gainCode < kGainCodeLUTDim; gainCode++) {
+    const float gainFactor =
+        computeGainFactor(static_cast<float>(gainCode) / 255.0f, metadata, displayBoost);
+    uint16_t* row = &mTable[gainCode * kGainCodeLUTDim];
+    for (size_t idx = 0; idx < kGainCodeLUTDim; idx++) {
+      const float e = linear[idx] * gainFactor;
+      switch (outputFormat) {
+        case ULTRAHDR_OUTPUT_HDR_LINEAR:
+          row[idx] = floatToHalf(e);
+          break;
+        case ULTRAHDR_OUTPUT_HDR_HLG:
+          row[idx] = hlgOetf10BitLUT(e);
+          break;
+        case ULTRAHDR_OUTPUT_HDR_PQ:
+          row[idx] = pqOetf10BitLUT(e);
+          break;
+        default:
+          row[idx] = 0;
+          break;
+      }
+    }
+  }
+}
+
+void applyGainCodeLUT(const uint8_t* src, size_t bytesPerPixel, const float* gains, size_t width,
+                      const GainCodeLUT& lut, void* dest) {
+  if (lut.getOutputFormat() == ULTRAHDR_OUTPUT_HDR_LINEAR) {
+    const uint64_t alpha = static_cast<uint64_t>(floatToHalf(1.0f)) << 48;
+    uint64_t* out = static_cast<uint64_t*>(dest);
+    for (size_t x = 0; x < width; x++, src += bytesPerPixel) {
+      const uint16_t* row = lut.getRow(static_cast<size_t>(gains[x] * 255.0f + 0.5f));
+      out[x] = row[src[0]] | (static_cast<uint64_t>(row[src[1]]) << 16) |
+               (static_cast<uint64_t>(row[src[2]]) << 32) | alpha;
+    }
+  } else {
+    uint32_t* out = static_cast<uint32_t*>(dest);
+    for (size_t x = 0; x < width; x++, src += bytesPerPixel) {
+      const uint16_t* row = lut.getRow(static_cast<size_t>(gains[x] * 255.0f + 0.5f));
+      out[x] = row[src[0]] | (row[src[1]] << 10) | (row[src[2]] << 20) | (0x3 << 30);
+    }
+  }
+}
+
 Color getYuv420Pixel(uhdr_uncompressed_ptr image, size_t x, size_t y) {
   uint8_t* luma_data = reinterpret_cast<uint8_t*>(image->data);
   size_t luma_stride = image->luma_stride;
@@ -684,7 +815,7 @@ float sampleMap(uhdr_uncompressed_ptr map, float map_scale_factor, size_t x, siz
 }
 
 float sampleMap(uhdr_uncompressed_ptr map, size_t map_scale_factor, size_t x, size_t y,
-                ShepardsIDW& weightTables) {
+                const ShepardsIDW& weightTables) {
   // TODO: If map_scale_factor is guaranteed to be an integer power of 2, then optimize the
   // following by computing log2(map_scale_factor) once and then using >> log2(map_scale_factor)
   size_t x_lower = x / map_scale_factor;
@@ -719,6 +850,158 @@ float sampleMap(uhdr_uncompressed_ptr map, size_t map_scale_factor, size_t x, si
   return e1 * weights[0] + e2 * weights[1] + e3 * weights[2] + e4 * weights[3];
 }
 
+GainMapUpsampler::GainMapUpsampler(uhdr_uncompressed_ptr map, size_t mapScaleFactor,
+                                   const ShepardsIDW& idwTable, gainmap_upsample_mode mode)
+    : mMap(map),
+      mMapScaleFactor(mapScaleFactor),
+      mScaleShift(-1),
+      mIdwTable(idwTable),
+      mMode(mode),
+      mLoadedRow(map->height),
+      mLower(map->width + 1),
+      mUpper(map->width + 1),
+      mRow(map->width * mapScaleFactor) {
+  if ((mMapScaleFactor & (mMapScaleFactor - 1)) == 0) {
+    mScaleShift = 0;
+    while ((static_cast<size_t>(1) << mScaleShift) < mMapScaleFactor) mScaleShift++;
+  }
+  if (mMode == GAINMAP_UPSAMPLE_BILINEAR) {
+    mColumn.resize(map->width + 1);
+    mFracX.resize(mMapScaleFactor);
+    for (size_t x = 0; x < mMapScaleFactor; x++) {
+      mFracX[x] = static_cast<float>(x) / mMapScaleFactor;
+    }
+  }
+}
+
+void GainMapUpsampler::loadMapRows(size_t yLower) {
+  const size_t width = mMap->width;
+  const size_t yUpper = (std::min)(yLower + 1, mMap->height - 1);
+  const uint8_t* lower = reinterpret_cast<uint8_t*>(mMap->data) + yLower * width;
+  const uint8_t* upper = reinterpret_cast<uint8_t*>(mMap->data) + yUpper * width;
+  for (size_t x = 0; x < width; x++) {
+    mLower[x] = mapUintToFloat(lower[x]);
+    mUpper[x] = mapUintToFloat(upper[x]);
+  }
+  // replicate the last column, this is where sampleMap() clamps x_upper to
+  mLower[width] = mLower[width - 1];
+  mUpper[width] = mUpper[width - 1];
+  mLoadedRow = yLower;
+}
+
+// Expands one gain map sample to scale output samples. e_lower and e_upper point at the samples
+// of the current and the next gain map row, weights at the table row for the output row.
+static inline void idwExpand(const float* e_lower, const float* e_upper, const float* weights,
+                             size_t scale, float* out) {
+  const float e1 = e_lower[0];
+  const float e2 = e_upper[0];
+  const float e3 = e_lower[1];
+  const float e4 = e_upper[1];
+  for (size_t i = 0; i < scale; i++, weights += 4) {
+    out[i] = e1 * weights[0] + e2 * weights[1] + e3 * weights[2] + e4 * weights[3];
+  }
+}
+
+const float* GainMapUpsampler::getRow(size_t y) { return getRow(y, 0, mMap->width); }
+
+const float* GainMapUpsampler::getRow(size_t y, size_t mapColStart, size_t mapColEnd) {
+  const size_t scale = mMapScaleFactor;
+  size_t yLower, offsetY;
+  if (mScaleShift >= 0) {
+    yLower = y >> mScaleShift;
+    offsetY = y & (scale - 1);
+  } else {
+    yLower = y / scale;
+    offsetY = y - yLower * scale;
+  }
+  yLower = (std::min)(yLower, mMap->height - 1);
+  if (yLower != mLoadedRow) loadMapRows(yLower);
+
+  const size_t width = mMap->width;
+  mapColEnd = (std::min)(mapColEnd, width);
+  if (mapColStart >= mapColEnd) return mRow.data();
+  const float* e_lower = mLower.data();
+  const float* e_upper = mUpper.data();
+  float* out = mRow.data() + mapColStart * scale;
+
+  if (mMode == GAINMAP_UPSAMPLE_BILINEAR) {
+    const float fy = static_cast<float>(offsetY) / scale;
+    float* column = mColumn.data();
+    for (size_t x = mapColStart; x <= mapColEnd; x++) {
+      column[x] = e_lower[x] + (e_upper[x] - e_lower[x]) * fy;
+    }
+    const float* fx = mFracX.data();
+    for (size_t x = mapColStart; x < mapColEnd; x++) {
+      const float left = column[x];
+      const float delta = column[x + 1] - left;
+      for (size_t i = 0; i < scale; i++) {
+        out[i] = left + delta * fx[i];
+      }
+      out += scale;
+    }
+    return mRow.data();
+  }
+
+  // the last gain map row and column have no neighbour below and to the right respectively, they
+  // use the weight tables computed for that case
+  const bool hasBottom = yLower + 1 < mMap->height;
+  const size_t tableOffset = offsetY * scale * 4;
+  const float* weights = (hasBottom ? mIdwTable.mWeights : mIdwTable.mWeightsNB) + tableOffset;
+  const float* weightsLast = (hasBottom ? mIdwTable.mWeightsNR : mIdwTable.mWeightsC) + tableOffset;
+  const size_t interiorEnd = (std::min)(mapColEnd, width - 1);
+  for (size_t x = mapColStart; x < interiorEnd; x++) {
+    idwExpand(e_lower + x, e_upper + x, weights, scale, out);
+    out += scale;
+  }
+  if (mapColEnd == width) {
+    idwExpand(e_lower + width - 1, e_upper + width - 1, weightsLast, scale, out);
+  }
+  return mRow.data();
+}
+
+UniformGainTiles::UniformGainTiles(uhdr_uncompressed_ptr map, size_t mapRowStart,
+                                   size_t mapRowEnd)
+    : mTileCols((map->width + kGainMapTileSize - 1) / kGainMapTileSize),
+      mTileRowStart(mapRowStart / kGainMapTileSize) {
+  mapRowEnd = (std::min)(mapRowEnd, map->height);
+  const size_t tileRowEnd =
+      mapRowStart < mapRowEnd ? (mapRowEnd + kGainMapTileSize - 1) / kGainMapTileSize
+                              : mTileRowStart;
+  mMin.assign((tileRowEnd - mTileRowStart) * mTileCols, 0xff);
+  mMax.assign((tileRowEnd - mTileRowStart) * mTileCols, 0);
+
+  const uint8_t* data = reinterpret_cast<uint8_t*>(map->data);
+  for (size_t ty = mTileRowStart; ty < tileRowEnd; ty++) {
+    // the gain of the last row and column of a tile is also interpolated from the samples below
+    // and to the right of it
+    const size_t rowStart = ty * kGainMapTileSize;
+    const size_t rowEnd = (std::min)(rowStart + kGainMapTileSize + 1, map->height);
+    uint8_t* tileMin = mMin.data() + (ty - mTileRowStart) * mTileCols;
+    uint8_t* tileMax = mMax.data() + (ty - mTileRowStart) * mTileCols;
+    for (size_t y = rowStart; y < rowEnd; y++) {
+      const uint8_t* row = data + y * map->width;
+      for (size_t tx = 0; tx < mTileCols; tx++) {
+        const size_t colStart = tx * kGainMapTileSize;
+        const size_t colEnd = (std::min)(colStart + kGainMapTileSize + 1, map->width);
+        uint8_t lo = tileMin[tx], hi = tileMax[tx];
+        for (size_t x = colStart; x < colEnd; x++) {
+          lo = (std::min)(lo, row[x]);
+          hi = (std::max)(hi, row[x]);
+        }
+        tileMin[tx] = lo;
+        tileMax[tx] = hi;
+      }
+    }
+  }
+}
+
+bool UniformGainTiles::isUniform(size_t tileX, size_t tileY, uint8_t* value) const {
+  const size_t idx = (tileY - mTileRowStart) * mTileCols + tileX;
+  if (mMin[idx] != mMax[idx]) return false;
+  *value = mMin[idx];
+  return true;
+}
+
 uint32_t colorToRgba1010102(Color e_gamma) {
   return (0x3ff & static_cast<uint32_t>(e_gamma.r * 1023.0f)) |
          ((0x3ff & static_cast<uint32_t>(e_gamma.g * 1023.0f)) << 10) |
@@ -726,9 +1009,78 @@ uint32_t colorToRgba1010102(Color e_gamma) {
          (0x3 << 30);  // Set alpha to 1.0
 }
 
+uint16_t hlgOetf10BitLUT(float e) { return hlgOetf10BitTable()[oetf10BitIndex(e)]; }
+
+uint16_t pqOetf10BitLUT(float e) { return pqOetf10BitTable()[oetf10BitIndex(e)]; }
+
+static inline uint32_t colorToRgba1010102LUT(Color e, const uint16_t* table) {
+  const uint32_t r = table[oetf10BitIndex(e.r)];
+  const uint32_t g = table[oetf10BitIndex(e.g)];
+  const uint32_t b = table[oetf10BitIndex(e.b)];
+  return r | (g << 10) | (b << 20) | (0x3 << 30);  // Set alpha to 1.0
+}
+
+uint32_t hlgColorToRgba1010102LUT(Color e) { return colorToRgba1010102LUT(e, hlgOetf10BitTable()); }
+
+uint32_t pqColorToRgba1010102LUT(Color e) { return colorToRgba1010102LUT(e, pqOetf10BitTable()); }
+
 uint64_t colorToRgbaF16(Color e_gamma) {
   return (uint64_t)floatToHalf(e_gamma.r) | (((uint64_t)floatToHalf(e_gamma.g)) << 16) |
          (((uint64_t)floatToHalf(e_gamma.b)) << 32) | (((uint64_t)floatToHalf(1.0f)) << 48);
 }
 
+uint16_t lumaToP010(float y) {
+  float code = (std::min)((std::max)(y * 876.0f + 64.0f + 0.5f, 64.0f), 940.0f);
+  return static_cast<uint16_t>(code) << 6;
+}
+
+uint16_t chromaToP010(float uv) {
+  float code = (std::min)((std::max)(uv * 896.0f + 512.0f + 0.5f, 64.0f), 960.0f);
+  return static_cast<uint16_t>(code) << 6;
+}
+
+P010Writer::P010Writer(uhdr_uncompressed_ptr dest, size_t width, size_t height)
+    : mWidth(width), mHeight(height), mChromaSum(2 * ((width + 1) / 2)) {
+  mLuma = static_cast<uint16_t*>(dest->data);
+  mLumaStride = dest->luma_stride == 0 ? width : dest->luma_stride;
+  mChroma = dest->chroma_data != nullptr ? static_cast<uint16_t*>(dest->chroma_data)
+                                         : mLuma + mLumaStride * height;
+  mChromaStride = dest->chroma_stride == 0 ? mLumaStride : dest->chroma_stride;
+}
+
+void P010Writer::putPixel(size_t x, size_t y, Color yuv) {
+  mLuma[y * mLumaStride + x] = lumaToP010(yuv.y);
+
+  const size_t col = x & ~static_cast<size_t>(1);
+  float* sum = &mChromaSum[col];
+  if ((x & 1) == 0 && (y & 1) == 0) {
+    sum[0] = yuv.u;
+    sum[1] = yuv.v;
+  } else {
+    sum[0] += yuv.u;
+    sum[1] += yuv.v;
+  }
+  // the block is complete with its bottom right pixel, blocks on the right and bottom edges of
+  // odd sized images have fewer pixels
+  const bool last_col = (x & 1) != 0 || x + 1 == mWidth;
+  const bool last_row = (y & 1) != 0 || y + 1 == mHeight;
+  if (last_col && last_row) {
+    const float scale = 1.0f / static_cast<float>(((x & 1) + 1) * ((y & 1) + 1));
+    uint16_t* chroma = mChroma + (y >> 1) * mChromaStride + col;
+    chroma[0] = chromaToP010(sum[0] * scale);
+    chroma[1] = chromaToP010(sum[1] * scale);
+  }
+}
+
+PlanarFloatWriter::PlanarFloatWriter(uhdr_uncompressed_ptr dest, size_t width, size_t height) {
+  mRed = static_cast<float*>(dest->data);
+  mRedStride = dest->luma_stride == 0 ? width : dest->luma_stride;
+  mGreen = dest->green_data != nullptr ? static_cast<float*>(dest->green_data)
+                                       : mRed + mRedStride * height;
+  mGreenStride = dest->green_stride == 0 ? mRedStride : dest->green_stride;
+  mBlue = dest->blue_data != nullptr ? static_cast<float*>(dest->blue_data)
+                                     : mGreen + mGreenStride * height;
+  mBlueStride = dest->blue_stride == 0 ? mGreenStride : dest->blue_stride;
+}
+
 }  // namespace ultrahdr
@@ -43,7 +43,11 @@ static const int kMapCompressQuality = 85;
 
 static struct heif_error writer_write(struct heif_context* ctx, const void* data, size_t size, void* userdata) {
   MemoryWriter* writer = static_cast<MemoryWriter*>(userdata);
-  writer->write(data, size);
+  if (!writer->write(data, size)) {
+    struct heif_error err{heif_error_Memory_allocation_error, heif_suberror_Unspecified,
+                          "failed to allocate memory for output"};
+    return err;
+  }
   struct heif_error err{heif_error_Ok, heif_suberror_Unspecified, nullptr};
   return err;
 }
@@ -204,8 +208,7 @@ status_t HeifR::encodeHeifWithGainMap(uhdr_uncompressed_ptr p010_image_ptr,
   metadata.version = "1";
   ultrahdr_uncompressed_struct gainmap_image;
   generateGainMap(&yuv420_image, &p010_image, hdr_tf, &metadata, &gainmap_image);
-  std::unique_ptr<uint8_t[]> map_data;
-  map_data.reset(reinterpret_cast<uint8_t*>(gainmap_image.data));
+  uhdr_unique_ptr<uint8_t> map_data(static_cast<uint8_t*>(gainmap_image.data));
 
   return encodeHeifWithGainMap(&yuv420_image, &gainmap_image, &metadata, dest, quality, codec, exif);
 }
@@ -15,6 +15,10 @@
  */
 
 #include <cstring>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string_view>
 
 #include "ultrahdr/ultrahdrcommon.h"
 #include "ultrahdr/icc.h"
@@ -407,8 +411,28 @@ std::shared_ptr<DataStruct> IccHelper::write_mAB_or_mBA_tag(uint32_t type, bool
   return dataStruct;
 }
 
-std::shared_ptr<DataStruct> IccHelper::writeIccProfile(ultrahdr_transfer_function tf,
-                                                       ultrahdr_color_gamut gamut) {
+std::shared_ptr<const DataStruct> IccHelper::writeIccProfile(ultrahdr_transfer_function tf,
+                                                             ultrahdr_color_gamut gamut) {
+  static std::mutex profilesLock;
+  static std::map<std::pair<ultrahdr_transfer_function, ultrahdr_color_gamut>,
+                  std::shared_ptr<const DataStruct>>
+      profiles;
+
+  std::lock_guard<std::mutex> guard(profilesLock);
+  auto it = profiles.find({tf, gamut});
+  if (it != profiles.end()) {
+    return it->second;
+  }
+  std::shared_ptr<DataStruct> profile = generateIccProfile(tf, gamut);
+  // do not retain incomplete profiles
+  if (profile->getBytesWritten() == profile->getLength()) {
+    profiles.emplace(std::make_pair(tf, gamut), profile);
+  }
+  return profile;
+}
+
+std::shared_ptr<DataStruct> IccHelper::generateIccProfile(ultrahdr_transfer_function tf,
+                                                          ultrahdr_color_gamut gamut) {
   ICCHeader header;
 
   std::vector<std::pair<uint32_t, std::shared_ptr<DataStruct>>> tags;
@@ -612,7 +636,45 @@ bool IccHelper::tagsEqualToMatrix(const Matrix3x3& matrix, const uint8_t* red_ta
          memcmp(blue_tag, blue_tag_test->getData(), kColorantTagSize) == 0;
 }
 
-ultrahdr_color_gamut IccHelper::readIccColorGamut(void* icc_data, size_t icc_size) {
+// Number of profiles whose gamut is retained by readIccColorGamut()
+static const size_t kIccGamutCacheSize = 8;
+
+struct IccGamutCacheEntry {
+  size_t hash;
+  std::vector<uint8_t> profile;
+  ultrahdr_color_gamut gamut;
+};
+
+ultrahdr_color_gamut IccHelper::readIccColorGamut(const void* icc_data, size_t icc_size) {
+  if (icc_data == nullptr || icc_size == 0) {
+    return ULTRAHDR_COLORGAMUT_UNSPECIFIED;
+  }
+  // most recently used profile first
+  static std::mutex cacheLock;
+  static std::list<IccGamutCacheEntry> cache;
+
+  const uint8_t* icc_bytes = static_cast<const uint8_t*>(icc_data);
+  const size_t hash =
+      std::hash<std::string_view>{}(std::string_view(static_cast<const char*>(icc_data), icc_size));
+  {
+    std::lock_guard<std::mutex> guard(cacheLock);
+    for (auto it = cache.begin(); it != cache.end(); ++it) {
+      if (it->hash == hash && it->profile.size() == icc_size &&
+          memcmp(it->profile.data(), icc_bytes, icc_size) == 0) {
+        cache.splice(cache.begin(), cache, it);
+        return cache.front().gamut;
+      }
+    }
+  }
+
+  ultrahdr_color_gamut gamut = parseIccColorGamut(icc_data, icc_size);
+  std::lock_guard<std::mutex> guard(cacheLock);
+  cache.push_front({hash, std::vector<uint8_t>(icc_bytes, icc_bytes + icc_size), gamut});
+  if (cache.size() > kIccGamutCacheSize) cache.pop_back();
+  return gamut;
+}
+
+ultrahdr_color_gamut IccHelper::parseIccColorGamut(const void* icc_data, size_t icc_size) {
   // Each tag table entry consists of 3 fields of 4 bytes each.
   static const size_t kTagTableEntrySize = 12;
 
@@ -624,9 +686,9 @@ ultrahdr_color_gamut IccHelper::readIccColorGamut(void* icc_data, size_t icc_siz
     return ULTRAHDR_COLORGAMUT_UNSPECIFIED;
   }
 
-  uint8_t* icc_bytes = reinterpret_cast<uint8_t*>(icc_data) + kICCIdentifierSize;
+  const uint8_t* icc_bytes = reinterpret_cast<const uint8_t*>(icc_data) + kICCIdentifierSize;
 
-  ICCHeader* header = reinterpret_cast<ICCHeader*>(icc_bytes);
+  const ICCHeader* header = reinterpret_cast<const ICCHeader*>(icc_bytes);
 
   // Use 0 to indicate not found, since offsets are always relative to start
   // of ICC data and therefore a tag offset of zero would never be valid.
@@ -640,8 +702,8 @@ ultrahdr_color_gamut IccHelper::readIccColorGamut(void* icc_data, size_t icc_siz
           tag_idx, kICCIdentifierSize + sizeof(ICCHeader), kTagTableEntrySize, icc_size);
       return ULTRAHDR_COLORGAMUT_UNSPECIFIED;
     }
-    uint32_t* tag_entry_start =
-        reinterpret_cast<uint32_t*>(icc_bytes + sizeof(ICCHeader) + tag_idx * kTagTableEntrySize);
+    const uint32_t* tag_entry_start = reinterpret_cast<const uint32_t*>(
+        icc_bytes + sizeof(ICCHeader) + tag_idx * kTagTableEntrySize);
     // first 4 bytes are the tag signature, next 4 bytes are the tag offset,
     // last 4 bytes are the tag length in bytes.
     if (red_primary_offset == 0 && *tag_entry_start == Endian_SwapBE32(kTAG_rXYZ)) {
@@ -665,9 +727,9 @@ ultrahdr_color_gamut IccHelper::readIccColorGamut(void* icc_data, size_t icc_siz
     return ULTRAHDR_COLORGAMUT_UNSPECIFIED;
   }
 
-  uint8_t* red_tag = icc_bytes + red_primary_offset;
-  uint8_t* green_tag = icc_bytes + green_primary_offset;
-  uint8_t* blue_tag = icc_bytes + blue_primary_offset;
+  const uint8_t* red_tag = icc_bytes + red_primary_offset;
+  const uint8_t* green_tag = icc_bytes + green_primary_offset;
+  const uint8_t* blue_tag = icc_bytes + blue_primary_offset;
 
   // Serialize tags as we do on encode and compare what we find to that to
   // determine the gamut (since we don't have a need yet for full deserialize).
@@ -42,6 +42,12 @@ constexpr uint8_t kXmpNameSpace[] = {
 constexpr uint8_t kExifIdCode[] = {
     'E', 'x', 'i', 'f', '\0', '\0',
 };
+constexpr uint8_t kMpfIdCode[] = {
+    'M', 'P', 'F', '\0',
+};
+
+// Size of the chunks requested from the reader while decoding a stream
+constexpr size_t kStreamBufferSize = 64 * 1024;
 
 struct jpegr_source_mgr : jpeg_source_mgr {
   jpegr_source_mgr(const uint8_t* ptr, int len);
@@ -91,6 +97,61 @@ jpegr_source_mgr::jpegr_source_mgr(const uint8_t* ptr, int len)
 
 jpegr_source_mgr::~jpegr_source_mgr() {}
 
+struct jpegr_stream_source_mgr : jpeg_source_mgr {
+  jpegr_stream_source_mgr(const jpegr_read_fn& reader);
+  ~jpegr_stream_source_mgr();
+
+  const jpegr_read_fn& mReader;
+  std::vector<JOCTET> mBuffer;
+  size_t mBytesRead;
+};
+
+static void jpegr_stream_init_source(j_decompress_ptr cinfo) {
+  jpegr_stream_source_mgr* src = static_cast<jpegr_stream_source_mgr*>(cinfo->src);
+  src->next_input_byte = nullptr;
+  src->bytes_in_buffer = 0;
+}
+
+static boolean jpegr_stream_fill_input_buffer(j_decompress_ptr cinfo) {
+  jpegr_stream_source_mgr* src = static_cast<jpegr_stream_source_mgr*>(cinfo->src);
+  int bytes = src->mReader(src->mBuffer.data(), src->mBuffer.size());
+  if (bytes <= 0 || bytes > static_cast<int>(src->mBuffer.size())) {
+    if (bytes != 0) ALOGE("%s : read callback returned %d", __func__, bytes);
+    return FALSE;
+  }
+  src->next_input_byte = src->mBuffer.data();
+  src->bytes_in_buffer = bytes;
+  src->mBytesRead += bytes;
+  return TRUE;
+}
+
+static void jpegr_stream_skip_input_data(j_decompress_ptr cinfo, long num_bytes) {
+  jpegr_stream_source_mgr* src = static_cast<jpegr_stream_source_mgr*>(cinfo->src);
+
+  if (num_bytes <= 0) return;
+  while (num_bytes > static_cast<long>(src->bytes_in_buffer)) {
+    num_bytes -= src->bytes_in_buffer;
+    src->bytes_in_buffer = 0;
+    if (!jpegr_stream_fill_input_buffer(cinfo)) {
+      ALOGE("jpegr_stream_skip_input_data - stream ended before skipping requested bytes");
+      return;
+    }
+  }
+  src->next_input_byte += num_bytes;
+  src->bytes_in_buffer -= num_bytes;
+}
+
+jpegr_stream_source_mgr::jpegr_stream_source_mgr(const jpegr_read_fn& reader)
+    : mReader(reader), mBuffer(kStreamBufferSize), mBytesRead(0) {
+  init_source = jpegr_stream_init_source;
+  fill_input_buffer = jpegr_stream_fill_input_buffer;
+  skip_input_data = jpegr_stream_skip_input_data;
+  resync_to_restart = jpeg_resync_to_restart;
+  term_source = jpegr_term_source;
+}
+
+jpegr_stream_source_mgr::~jpegr_stream_source_mgr() {}
+
 static void jpegrerror_exit(j_common_ptr cinfo) {
   jpegrerror_mgr* err = reinterpret_cast<jpegrerror_mgr*>(cinfo->err);
   longjmp(err->setjmp_buffer, 1);
@@ -104,21 +165,104 @@ static void output_message(j_common_ptr cinfo) {
   ALOGE("%s\n", buffer);
 }
 
+// Sizes |buffer| for the decoded image. The library allocator may refuse the request, report it as
+// a decode failure instead of unwinding through libjpeg.
+static bool allocateResultBuffer(uhdr_vector<JOCTET>& buffer, size_t size) {
+  try {
+    buffer.resize(size, 0);
+  } catch (const std::bad_alloc&) {
+    ALOGE("failed to allocate %zu bytes for decoded image", size);
+    return false;
+  }
+  return true;
+}
+
 JpegDecoderHelper::JpegDecoderHelper() {}
 
 JpegDecoderHelper::~JpegDecoderHelper() {}
 
-bool JpegDecoderHelper::decompressImage(const void* image, int length, decode_mode_t decodeTo) {
+bool JpegDecoderHelper::decompressImage(const void* image, int length, decode_mode_t decodeTo,
+                                        const jpeg_output_planes* outputPlanes) {
   if (image == nullptr || length <= 0) {
     ALOGE("Image size can not be handled: %d", length);
     return false;
   }
+  if (outputPlanes != nullptr && outputPlanes->planes[0] == nullptr) {
+    ALOGE("received nullptr for output plane");
+    return false;
+  }
   mResultBuffer.clear();
   mXMPBuffer.clear();
-  return decode(image, length, decodeTo);
+  bool status = decode(image, length, decodeTo, outputPlanes);
+  if (outputPlanes != nullptr) {
+    // scratch chroma planes of a luma only output are not a decoded image
+    uhdr_vector<JOCTET>().swap(mResultBuffer);
+  }
+  return status;
 }
 
-void* JpegDecoderHelper::getDecompressedImagePtr() { return mResultBuffer.data(); }
+bool JpegDecoderHelper::decompressImageInBands(const void* image, int length, size_t bandHeight,
+                                               const jpeg_band_fn& onBand) {
+  if (image == nullptr || length <= 0) {
+    ALOGE("Image size can not be handled: %d", length);
+    return false;
+  }
+  if (!onBand || bandHeight == 0) {
+    ALOGE("received invalid band arguments");
+    return false;
+  }
+  mResultBuffer.clear();
+  mXMPBuffer.clear();
+  mBandFn = &onBand;
+  mBandHeight = ALIGNM(bandHeight, kCompressBatchSize);
+  bool status = decode(image, length, DECODE_TO_YCBCR);
+  mBandFn = nullptr;
+  mBandHeight = 0;
+  // the band buffer is not a decoded image
+  uhdr_vector<JOCTET>().swap(mResultBuffer);
+  return status;
+}
+
+bool JpegDecoderHelper::decompressImage(const jpegr_read_fn& reader, decode_mode_t decodeTo) {
+  if (!reader) {
+    ALOGE("received empty reader for jpeg stream");
+    return false;
+  }
+  mResultBuffer.clear();
+  mXMPBuffer.clear();
+  mStreamRemainder.clear();
+  mStreamPosition = 0;
+
+  jpegr_stream_source_mgr mgr(reader);
+  if (!decode(&mgr, decodeTo)) {
+    return false;
+  }
+  mStreamPosition = mgr.mBytesRead - mgr.bytes_in_buffer;
+  if (mgr.bytes_in_buffer > 0) {
+    mStreamRemainder.assign(mgr.next_input_byte, mgr.next_input_byte + mgr.bytes_in_buffer);
+  }
+  return true;
+}
+
+bool JpegDecoderHelper::setScaleDenom(size_t denom) {
+  if (denom != 1 && denom != 2 && denom != 4 && denom != 8) {
+    ALOGE("unsupported scale denominator %zu, expects one of {1, 2, 4, 8}", denom);
+    return false;
+  }
+  mScaleDenom = denom;
+  return true;
+}
+
+void JpegDecoderHelper::setCropRegion(size_t left, size_t top, size_t width, size_t height) {
+  mCropLeft = left;
+  mCropTop = top;
+  mCropWidth = width;
+  mCropHeight = height;
+}
+
+void* JpegDecoderHelper::getDecompressedImagePtr() {
+  return mResultBuffer.empty() ? nullptr : mResultBuffer.data();
+}
 
 size_t JpegDecoderHelper::getDecompressedImageSize() { return mResultBuffer.size(); }
 
@@ -134,6 +278,14 @@ void* JpegDecoderHelper::getICCPtr() { return mICCBuffer.data(); }
 
 size_t JpegDecoderHelper::getICCSize() { return mICCBuffer.size(); }
 
+void* JpegDecoderHelper::getMPFPtr() { return mMPFBuffer.data(); }
+
+size_t JpegDecoderHelper::getMPFSize() { return mMPFBuffer.size(); }
+
+void* JpegDecoderHelper::getStreamRemainderPtr() { return mStreamRemainder.data(); }
+
+size_t JpegDecoderHelper::getStreamRemainderSize() { return mStreamRemainder.size(); }
+
 size_t JpegDecoderHelper::getDecompressedImageWidth() { return mWidth; }
 
 size_t JpegDecoderHelper::getDecompressedImageHeight() { return mHeight; }
@@ -187,14 +339,26 @@ bool JpegDecoderHelper::extractEXIF(const void* image, int length) {
   return true;
 }
 
-bool JpegDecoderHelper::decode(const void* image, int length, decode_mode_t decodeTo) {
+bool JpegDecoderHelper::decode(const void* image, int length, decode_mode_t decodeTo,
+                               const jpeg_output_planes* outputPlanes) {
+  jpegr_source_mgr mgr(static_cast<const uint8_t*>(image), length);
+  return decode(&mgr, decodeTo, outputPlanes);
+}
+
+bool JpegDecoderHelper::decode(jpeg_source_mgr* mgr, decode_mode_t decodeTo,
+                               const jpeg_output_planes* outputPlanes) {
   bool status = true;
+  jpeg_output_planes dest{};
   jpeg_decompress_struct cinfo;
   jpegrerror_mgr myerr;
   cinfo.err = jpeg_std_error(&myerr.pub);
   myerr.pub.error_exit = jpegrerror_exit;
   myerr.pub.output_message = output_message;
 
+  // the MPF package of an earlier stream must not be reported for this one
+  mMPFBuffer.clear();
+  mMpfPos = -1;
+
   if (setjmp(myerr.setjmp_buffer)) {
     jpeg_destroy_decompress(&cinfo);
     return false;
@@ -206,24 +370,24 @@ bool JpegDecoderHelper::decode(const void* image, int length, decode_mode_t deco
   jpeg_save_markers(&cinfo, kAPP1Marker, 0xFFFF);
   jpeg_save_markers(&cinfo, kAPP2Marker, 0xFFFF);
 
-  jpegr_source_mgr mgr(static_cast<const uint8_t*>(image), length);
-  cinfo.src = &mgr;
+  cinfo.src = mgr;
   if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
     jpeg_destroy_decompress(&cinfo);
     return false;
   }
 
-  // Save XMP data, EXIF data, and ICC data.
-  // Here we only handle the first XMP / EXIF / ICC package.
+  // Save XMP data, EXIF data, ICC data and MPF data.
+  // Here we only handle the first XMP / EXIF / ICC / MPF package.
   // We assume that all packages are starting with two bytes marker (eg FF E1 for EXIF package),
   // two bytes of package length which is stored in marker->original_length, and the real data
   // which is stored in marker->data.
   bool exifAppears = false;
   bool xmpAppears = false;
   bool iccAppears = false;
+  bool mpfAppears = false;
   size_t pos = 2;  // position after SOI
   for (jpeg_marker_struct* marker = cinfo.marker_list;
-       marker && !(exifAppears && xmpAppears && iccAppears); marker = marker->next) {
+       marker && !(exifAppears && xmpAppears && iccAppears && mpfAppears); marker = marker->next) {
     pos += 4;
     pos += marker->original_length;
     if (marker->marker != kAPP1Marker && marker->marker != kAPP2Marker) {
@@ -246,15 +410,36 @@ bool JpegDecoderHelper::decode(const void* image, int length, decode_mode_t deco
       mICCBuffer.resize(len, 0);
       memcpy(static_cast<void*>(mICCBuffer.data()), marker->data, len);
       iccAppears = true;
+    } else if (!mpfAppears && len > sizeof(kMpfIdCode) &&
+               !memcmp(marker->data, kMpfIdCode, sizeof(kMpfIdCode))) {
+      mMPFBuffer.resize(len, 0);
+      memcpy(static_cast<void*>(mMPFBuffer.data()), marker->data, len);
+      mpfAppears = true;
+      mMpfPos = pos - marker->original_length;
     }
   }
 
-  mWidth = cinfo.image_width;
-  mHeight = cinfo.image_height;
-  if (mWidth > kMaxWidth || mHeight > kMaxHeight) {
+  if (cinfo.image_width > kMaxWidth || cinfo.image_height > kMaxHeight) {
     status = false;
     goto CleanUp;
   }
+  mImageWidth = cinfo.image_width;
+  mImageHeight = cinfo.image_height;
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = static_cast<unsigned int>(mScaleDenom);
+  jpeg_calc_output_dimensions(&cinfo);
+  mWidth = cinfo.output_width;
+  mHeight = cinfo.output_height;
+  if (mCropWidth != 0 && mCropHeight != 0) {
+    if (mCropLeft + mCropWidth > mWidth || mCropTop + mCropHeight > mHeight) {
+      ALOGE("crop region %zux%zu at (%zu, %zu) exceeds the image of %zux%zu", mCropWidth,
+            mCropHeight, mCropLeft, mCropTop, mWidth, mHeight);
+      status = false;
+      goto CleanUp;
+    }
+    mWidth = mCropWidth;
+    mHeight = mCropHeight;
+  }
 
   if (decodeTo == DECODE_TO_RGBA) {
     // The primary image is expected to be yuv420 sampling
@@ -272,13 +457,24 @@ bool JpegDecoderHelper::decode(const void* image, int length, decode_mode_t deco
     }
 #ifdef JCS_ALPHA_EXTENSIONS
     // 4 bytes per pixel
-    mResultBuffer.resize(cinfo.image_width * cinfo.image_height * 4);
+    if (outputPlanes == nullptr && !allocateResultBuffer(mResultBuffer, mWidth * mHeight * 4)) {
+      status = false;
+      goto CleanUp;
+    }
     cinfo.out_color_space = JCS_EXT_RGBA;
 #else
     // 3 bytes per pixel
-    mResultBuffer.resize(cinfo.image_width * cinfo.image_height * 3);
+    if (outputPlanes == nullptr && !allocateResultBuffer(mResultBuffer, mWidth * mHeight * 3)) {
+      status = false;
+      goto CleanUp;
+    }
     cinfo.out_color_space = JCS_RGB;
 #endif
+    if (outputPlanes == nullptr) {
+      dest.planes[0] = mResultBuffer.data();
+      dest.strides[0] = mWidth;
+    }
+    cinfo.do_fancy_upsampling = mFancyUpsampling ? TRUE : FALSE;
   } else if (decodeTo == DECODE_TO_YCBCR) {
     if (cinfo.jpeg_color_space == JCS_YCbCr) {
       if (cinfo.comp_info[0].h_samp_factor != 2 || cinfo.comp_info[0].v_samp_factor != 2 ||
@@ -288,26 +484,67 @@ bool JpegDecoderHelper::decode(const void* image, int length, decode_mode_t deco
         ALOGE("%s: decoding to YUV only supports 4:2:0 subsampling", __func__);
         goto CleanUp;
       }
-      mResultBuffer.resize(cinfo.image_width * cinfo.image_height * 3 / 2, 0);
+      if (outputPlanes == nullptr) {
+        const size_t rows = mBandFn ? std::min<size_t>(mBandHeight, mHeight) : mHeight;
+        if (!allocateResultBuffer(mResultBuffer, mWidth * rows * 3 / 2)) {
+          status = false;
+          goto CleanUp;
+        }
+        const size_t luma_plane_size = mWidth * rows;
+        dest.planes[0] = mResultBuffer.data();
+        dest.planes[1] = dest.planes[0] + luma_plane_size;
+        dest.planes[2] = dest.planes[1] + luma_plane_size / 4;
+        dest.strides[0] = mWidth;
+        dest.strides[1] = dest.strides[2] = mWidth / 2;
+      } else if (outputPlanes->planes[1] == nullptr || outputPlanes->planes[2] == nullptr) {
+        // luma only output, the chroma planes are decoded to scratch memory
+        if (!allocateResultBuffer(mResultBuffer, mWidth * mHeight / 2)) {
+          status = false;
+          goto CleanUp;
+        }
+      }
     } else if (cinfo.jpeg_color_space == JCS_GRAYSCALE) {
-      mResultBuffer.resize(cinfo.image_width * cinfo.image_height, 0);
+      if (outputPlanes == nullptr) {
+        const size_t rows = mBandFn ? std::min<size_t>(mBandHeight, mHeight) : mHeight;
+        if (!allocateResultBuffer(mResultBuffer, mWidth * rows)) {
+          status = false;
+          goto CleanUp;
+        }
+        dest.planes[0] = mResultBuffer.data();
+        dest.strides[0] = mWidth;
+      }
     } else {
       status = false;
       ALOGE("%s: decodeToYUV unexpected jpeg color space", __func__);
       goto CleanUp;
     }
     cinfo.out_color_space = cinfo.jpeg_color_space;
-    cinfo.raw_data_out = TRUE;
+    cinfo.raw_data_out = (mScaleDenom == 1 && !isCropped()) ? TRUE : FALSE;
+    // scanlines are then read with the chroma replicated, the 2x2 average in
+    // decompressScanlines() restores the decoded chroma samples
+    cinfo.do_fancy_upsampling = FALSE;
   } else {
     status = decodeTo == PARSE_ONLY;
     jpeg_destroy_decompress(&cinfo);
     return status;
   }
 
+  if (outputPlanes != nullptr) {
+    dest = *outputPlanes;
+    if (decodeTo == DECODE_TO_YCBCR && cinfo.jpeg_color_space == JCS_YCbCr &&
+        (dest.planes[1] == nullptr || dest.planes[2] == nullptr)) {
+      dest.planes[1] = mResultBuffer.data();
+      dest.planes[2] = dest.planes[1] + mWidth * mHeight / 4;
+      dest.strides[1] = dest.strides[2] = mWidth / 2;
+    }
+    if (dest.strides[0] == 0) dest.strides[0] = mWidth;
+    if (dest.strides[1] == 0) dest.strides[1] = mWidth / 2;
+    if (dest.strides[2] == 0) dest.strides[2] = mWidth / 2;
+  }
+
   cinfo.dct_method = JDCT_ISLOW;
   jpeg_start_decompress(&cinfo);
-  if (!decompress(&cinfo, static_cast<const uint8_t*>(mResultBuffer.data()),
-                  cinfo.jpeg_color_space == JCS_GRAYSCALE)) {
+  if (!decompress(&cinfo, dest, cinfo.jpeg_color_space == JCS_GRAYSCALE)) {
     status = false;
     goto CleanUp;
   }
@@ -319,10 +556,11 @@ CleanUp:
   return status;
 }
 
-bool JpegDecoderHelper::decompress(jpeg_decompress_struct* cinfo, const uint8_t* dest,
+bool JpegDecoderHelper::decompress(jpeg_decompress_struct* cinfo, const jpeg_output_planes& dest,
                                    bool isSingleChannel) {
   if (isSingleChannel) {
-    return decompressSingleChannel(cinfo, dest);
+    return cinfo->raw_data_out ? decompressSingleChannel(cinfo, dest)
+                               : decompressScanlines(cinfo, dest, true);
   } else {
 #ifdef JCS_ALPHA_EXTENSIONS
     if (cinfo->out_color_space == JCS_EXT_RGBA) {
@@ -330,6 +568,8 @@ bool JpegDecoderHelper::decompress(jpeg_decompress_struct* cinfo, const uint8_t*
     if (cinfo->out_color_space == JCS_RGB) {
 #endif
       return decompressRGBA(cinfo, dest);
+    } else if (!cinfo->raw_data_out) {
+      return decompressScanlines(cinfo, dest, false);
     } else {
       return decompressYUV(cinfo, dest);
     }
@@ -340,26 +580,75 @@ bool JpegDecoderHelper::getCompressedImageParameters(const void* image, int leng
   return decode(image, length, PARSE_ONLY);
 }
 
-bool JpegDecoderHelper::decompressRGBA(jpeg_decompress_struct* cinfo, const uint8_t* dest) {
-  JSAMPLE* out = (JSAMPLE*)dest;
+// Reads and drops count scanlines. libjpeg-turbo skips them without the color conversion and
+// upsampling, and without decoding them at all if they reach the end of the image.
+static bool skipScanlines(jpeg_decompress_struct* cinfo, size_t count) {
+#ifdef LIBJPEG_TURBO_VERSION
+  return jpeg_skip_scanlines(cinfo, static_cast<JDIMENSION>(count)) == count;
+#else
+  std::vector<JSAMPLE> row(cinfo->output_width * cinfo->output_components);
+  JSAMPROW ptr = row.data();
+  for (size_t i = 0; i < count; i++) {
+    if (1 != jpeg_read_scanlines(cinfo, &ptr, 1)) return false;
+  }
+  return true;
+#endif
+}
+
+bool JpegDecoderHelper::startCrop(jpeg_decompress_struct* cinfo, size_t* column) {
+  *column = mCropLeft;
+  if (!isCropped()) return true;
+#ifdef LIBJPEG_TURBO_VERSION
+  // the region is widened by a column on each side, as the upsampling of the edge columns of a
+  // cropped decode differs from the one of the full image, then to the iMCU columns that cover it
+  JDIMENSION xoffset = static_cast<JDIMENSION>(mCropLeft > 0 ? mCropLeft - 1 : 0);
+  JDIMENSION width = static_cast<JDIMENSION>(
+      (std::min)(mCropLeft + mCropWidth + 1, static_cast<size_t>(cinfo->output_width)) - xoffset);
+  jpeg_crop_scanline(cinfo, &xoffset, &width);
+  *column = mCropLeft - xoffset;
+#endif
+  return skipScanlines(cinfo, mCropTop);
+}
+
+bool JpegDecoderHelper::finishCrop(jpeg_decompress_struct* cinfo) {
+  // jpeg_finish_decompress() expects all scanlines to be read
+  return skipScanlines(cinfo, cinfo->output_height - cinfo->output_scanline);
+}
 
-  while (cinfo->output_scanline < cinfo->image_height) {
-    if (1 != jpeg_read_scanlines(cinfo, &out, 1)) return false;
+bool JpegDecoderHelper::decompressRGBA(jpeg_decompress_struct* cinfo,
+                                       const jpeg_output_planes& dest) {
 #ifdef JCS_ALPHA_EXTENSIONS
-    out += cinfo->image_width * 4;
+  const size_t bytes_per_pixel = 4;
 #else
-    out += cinfo->image_width * 3;
+  const size_t bytes_per_pixel = 3;
 #endif
+  JSAMPLE* out = (JSAMPLE*)dest.planes[0];
+
+  if (!isCropped()) {
+    while (cinfo->output_scanline < cinfo->output_height) {
+      if (1 != jpeg_read_scanlines(cinfo, &out, 1)) return false;
+      out += dest.strides[0] * bytes_per_pixel;
+    }
+    return true;
   }
-  return true;
+
+  size_t column;
+  if (!startCrop(cinfo, &column)) return false;
+  mBufferIntermediate = std::make_unique<uint8_t[]>(cinfo->output_width * bytes_per_pixel);
+  JSAMPROW row = mBufferIntermediate.get();
+  for (size_t y = 0; y < mHeight; y++) {
+    if (1 != jpeg_read_scanlines(cinfo, &row, 1)) return false;
+    memcpy(out, row + column * bytes_per_pixel, mWidth * bytes_per_pixel);
+    out += dest.strides[0] * bytes_per_pixel;
+  }
+  return finishCrop(cinfo);
 }
 
-bool JpegDecoderHelper::decompressYUV(jpeg_decompress_struct* cinfo, const uint8_t* dest) {
-  size_t luma_plane_size = cinfo->image_width * cinfo->image_height;
-  size_t chroma_plane_size = luma_plane_size / 4;
-  uint8_t* y_plane = const_cast<uint8_t*>(dest);
-  uint8_t* u_plane = const_cast<uint8_t*>(dest + luma_plane_size);
-  uint8_t* v_plane = const_cast<uint8_t*>(dest + luma_plane_size + chroma_plane_size);
+bool JpegDecoderHelper::decompressYUV(jpeg_decompress_struct* cinfo,
+                                      const jpeg_output_planes& dest) {
+  uint8_t* y_plane = dest.planes[0];
+  uint8_t* u_plane = dest.planes[1];
+  uint8_t* v_plane = dest.planes[2];
 
   const size_t aligned_width = ALIGNM(cinfo->image_width, kCompressBatchSize);
   const bool is_width_aligned = (aligned_width == cinfo->image_width);
@@ -396,12 +685,14 @@ bool JpegDecoderHelper::decompressYUV(jpeg_decompress_struct* cinfo, const uint8
     }
   }
 
+  // first row of the band held in the planes, always 0 unless decoding in bands
+  size_t band_start = 0;
   while (cinfo->output_scanline < cinfo->image_height) {
     size_t scanline_copy = cinfo->output_scanline;
     for (int i = 0; i < kCompressBatchSize; ++i) {
       size_t scanline = cinfo->output_scanline + i;
       if (scanline < cinfo->image_height) {
-        y[i] = y_plane + scanline * cinfo->image_width;
+        y[i] = y_plane + (scanline - band_start) * dest.strides[0];
       } else {
         y[i] = mEmpty.get();
       }
@@ -410,9 +701,8 @@ bool JpegDecoderHelper::decompressYUV(jpeg_decompress_struct* cinfo, const uint8
     for (int i = 0; i < kCompressBatchSize / 2; ++i) {
       size_t scanline = cinfo->output_scanline / 2 + i;
       if (scanline < cinfo->image_height / 2) {
-        int offset = scanline * (cinfo->image_width / 2);
-        cb[i] = u_plane + offset;
-        cr[i] = v_plane + offset;
+        cb[i] = u_plane + (scanline - band_start / 2) * dest.strides[1];
+        cr[i] = v_plane + (scanline - band_start / 2) * dest.strides[2];
       } else {
         cb[i] = cr[i] = mEmpty.get();
       }
@@ -437,13 +727,14 @@ bool JpegDecoderHelper::decompressYUV(jpeg_decompress_struct* cinfo, const uint8
         }
       }
     }
+    if (!flushBand(cinfo, dest, band_start)) return false;
   }
   return true;
 }
 
 bool JpegDecoderHelper::decompressSingleChannel(jpeg_decompress_struct* cinfo,
-                                                const uint8_t* dest) {
-  uint8_t* y_plane = const_cast<uint8_t*>(dest);
+                                                const jpeg_output_planes& dest) {
+  uint8_t* y_plane = dest.planes[0];
   uint8_t* y_plane_intrm = nullptr;
 
   const size_t aligned_width = ALIGNM(cinfo->image_width, kCompressBatchSize);
@@ -467,12 +758,14 @@ bool JpegDecoderHelper::decompressSingleChannel(jpeg_decompress_struct* cinfo,
     }
   }
 
+  // first row of the band held in the plane, always 0 unless decoding in bands
+  size_t band_start = 0;
   while (cinfo->output_scanline < cinfo->image_height) {
     size_t scanline_copy = cinfo->output_scanline;
     for (int i = 0; i < kCompressBatchSize; ++i) {
       size_t scanline = cinfo->output_scanline + i;
       if (scanline < cinfo->image_height) {
-        y[i] = y_plane + scanline * cinfo->image_width;
+        y[i] = y_plane + (scanline - band_start) * dest.strides[0];
       } else {
         y[i] = mEmpty.get();
       }
@@ -491,7 +784,74 @@ bool JpegDecoderHelper::decompressSingleChannel(jpeg_decompress_struct* cinfo,
         }
       }
     }
+    if (!flushBand(cinfo, dest, band_start)) return false;
+  }
+  return true;
+}
+
+bool JpegDecoderHelper::decompressScanlines(jpeg_decompress_struct* cinfo,
+                                            const jpeg_output_planes& dest, bool isSingleChannel) {
+  const size_t width = mWidth;
+  const size_t height = mHeight;
+  // first row of the band held in the planes, always 0 unless decoding in bands
+  size_t band_start = 0;
+  size_t column;
+  if (!startCrop(cinfo, &column)) return false;
+
+  if (isSingleChannel) {
+    mBufferIntermediate = std::make_unique<uint8_t[]>(cinfo->output_width);
+    JSAMPROW row = mBufferIntermediate.get();
+    for (size_t y = 0; y < height; y++) {
+      if (1 != jpeg_read_scanlines(cinfo, &row, 1)) return false;
+      memcpy(dest.planes[0] + (y - band_start) * dest.strides[0], row + column, width);
+      if (!flushBand(cinfo, dest, band_start)) return false;
+    }
+    return finishCrop(cinfo);
+  }
+
+  // rows are read in pairs of interleaved ycbcr, chroma of each 2x2 block is averaged. Bands hold
+  // an even number of rows, so a pair never spans two bands
+  const size_t row_size = cinfo->output_width * 3;
+  mBufferIntermediate = std::make_unique<uint8_t[]>(row_size * 2);
+  JSAMPROW pair[2] = {mBufferIntermediate.get(), mBufferIntermediate.get() + row_size};
+  for (size_t row = 0; row < height; row += 2) {
+    const size_t y = row - band_start;
+    const size_t count = std::min<size_t>(2, height - row);
+    for (size_t i = 0; i < count; i++) {
+      if (1 != jpeg_read_scanlines(cinfo, &pair[i], 1)) return false;
+      const JSAMPLE* ycbcr = pair[i] + column * 3;
+      uint8_t* luma = dest.planes[0] + (y + i) * dest.strides[0];
+      for (size_t x = 0; x < width; x++) {
+        luma[x] = ycbcr[x * 3];
+      }
+    }
+    // as for unscaled images, chroma of a trailing odd row or column is dropped
+    if (count == 2) {
+      uint8_t* cb = dest.planes[1] + (y / 2) * dest.strides[1];
+      uint8_t* cr = dest.planes[2] + (y / 2) * dest.strides[2];
+      for (size_t x = 0; x < width / 2; x++) {
+        const JSAMPLE* top = pair[0] + (column + x * 2) * 3;
+        const JSAMPLE* bottom = pair[1] + (column + x * 2) * 3;
+        cb[x] = static_cast<uint8_t>((top[1] + top[4] + bottom[1] + bottom[4] + 2) >> 2);
+        cr[x] = static_cast<uint8_t>((top[2] + top[5] + bottom[2] + bottom[5] + 2) >> 2);
+      }
+    }
+    if (!flushBand(cinfo, dest, band_start)) return false;
+  }
+  return finishCrop(cinfo);
+}
+
+bool JpegDecoderHelper::flushBand(jpeg_decompress_struct* cinfo, const jpeg_output_planes& dest,
+                                  size_t& bandStart) {
+  if (mBandFn == nullptr) return true;
+  // rows are counted from the top of the crop region, if any
+  const size_t rowEnd = std::min<size_t>(cinfo->output_scanline - mCropTop, mHeight);
+  if (rowEnd - bandStart < mBandHeight && rowEnd < mHeight) return true;
+  if (!(*mBandFn)(dest, bandStart, rowEnd - bandStart)) {
+    ALOGE("band consumer aborted the decode at row %zu", bandStart);
+    return false;
   }
+  bandStart = rowEnd;
   return true;
 }
 
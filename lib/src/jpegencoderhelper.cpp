@@ -14,6 +14,9 @@
  * limitations under the License.
  */
 
+#include <setjmp.h>
+
+#include <algorithm>
 #include <cstring>
 #include <memory>
 #include <string>
@@ -30,6 +33,29 @@ struct destination_mgr {
   JpegEncoderHelper* encoder;
 };
 
+// Error manager that returns control to encode() instead of exiting the process.
+struct jpegr_encode_error_mgr {
+  struct jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+};
+
+static void jpegrEncodeErrorExit(j_common_ptr cinfo) {
+  jpegr_encode_error_mgr* err = reinterpret_cast<jpegr_encode_error_mgr*>(cinfo->err);
+  (*cinfo->err->output_message)(cinfo);
+  longjmp(err->setjmp_buffer, 1);
+}
+
+// Resizes the output buffer from a destination callback. The library allocator may refuse the
+// request, which is raised as a libjpeg error rather than an exception unwinding through libjpeg.
+static void resizeOutputBuffer(j_compress_ptr cinfo, uhdr_vector<JOCTET>& buffer, size_t size) {
+  try {
+    buffer.resize(size);
+  } catch (const std::bad_alloc&) {
+    ALOGE("failed to allocate %zu bytes for compressed image", size);
+    ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+  }
+}
+
 JpegEncoderHelper::JpegEncoderHelper() {}
 
 JpegEncoderHelper::~JpegEncoderHelper() {}
@@ -38,41 +64,92 @@ bool JpegEncoderHelper::compressImage(const uint8_t* yBuffer, const uint8_t* uvB
                                       int height, int lumaStride, int chromaStride, int quality,
                                       const void* iccBuffer, unsigned int iccSize) {
   mResultBuffer.clear();
+  mOutputSize = 0;
+  mIsOutputInPlace = false;
+  mEstimatedSize = estimateCompressedSize(width, height, quality, uvBuffer == nullptr, iccSize);
   if (!encode(yBuffer, uvBuffer, width, height, lumaStride, chromaStride, quality, iccBuffer,
               iccSize)) {
     return false;
   }
-  ALOGV("Compressed JPEG: %d[%dx%d] -> %zu bytes", (width * height * 12) / 8, width, height,
-        mResultBuffer.size());
+  ALOGV("Compressed JPEG: %d[%dx%d] -> %zu bytes (estimate %zu bytes)", (width * height * 12) / 8,
+        width, height, getCompressedImageSize(), mEstimatedSize);
   return true;
 }
 
-void* JpegEncoderHelper::getCompressedImagePtr() { return mResultBuffer.data(); }
+void JpegEncoderHelper::setOutputBuffer(void* buffer, size_t capacity) {
+  mOutputBuffer = static_cast<JOCTET*>(buffer);
+  mOutputBufferCapacity = buffer == nullptr ? 0 : capacity;
+}
+
+size_t JpegEncoderHelper::estimateCompressedSize(int width, int height, int quality,
+                                                 bool isSingleChannel, unsigned int iccSize) {
+  // Bits per sample grows steeply with quality, from ~0.3 at very low quality to ~2.7 at 100.
+  // The constants are picked to sit above the sizes observed for natural images.
+  const float q = (std::min)((std::max)(quality, 0), 100) / 100.0f;
+  const float bitsPerSample = 0.3f + 2.4f * q * q * q;
+  const size_t numSamples = static_cast<size_t>(width) * height * (isSingleChannel ? 2 : 3) / 2;
+  // headers, quantization and huffman tables
+  const size_t headerSize = 1024 + iccSize;
+  return (std::max)(static_cast<size_t>(kBlockSize),
+                    static_cast<size_t>(numSamples * bitsPerSample / 8) + headerSize);
+}
 
-size_t JpegEncoderHelper::getCompressedImageSize() { return mResultBuffer.size(); }
+size_t JpegEncoderHelper::getGrowthSize(size_t size) {
+  return size + (std::max)(size, static_cast<size_t>(kBlockSize));
+}
+
+void* JpegEncoderHelper::getCompressedImagePtr() {
+  return mIsOutputInPlace ? mOutputBuffer : mResultBuffer.data();
+}
+
+size_t JpegEncoderHelper::getCompressedImageSize() {
+  return mIsOutputInPlace ? mOutputSize : mResultBuffer.size();
+}
 
 void JpegEncoderHelper::initDestination(j_compress_ptr cinfo) {
   destination_mgr* dest = reinterpret_cast<destination_mgr*>(cinfo->dest);
-  std::vector<JOCTET>& buffer = dest->encoder->mResultBuffer;
-  buffer.resize(kBlockSize);
+  JpegEncoderHelper* encoder = dest->encoder;
+  if (encoder->mOutputBuffer != nullptr && encoder->mOutputBufferCapacity > 0) {
+    encoder->mIsOutputInPlace = true;
+    dest->mgr.next_output_byte = encoder->mOutputBuffer;
+    dest->mgr.free_in_buffer = encoder->mOutputBufferCapacity;
+    return;
+  }
+  uhdr_vector<JOCTET>& buffer = encoder->mResultBuffer;
+  resizeOutputBuffer(cinfo, buffer, encoder->mEstimatedSize);
   dest->mgr.next_output_byte = &buffer[0];
   dest->mgr.free_in_buffer = buffer.size();
 }
 
 boolean JpegEncoderHelper::emptyOutputBuffer(j_compress_ptr cinfo) {
   destination_mgr* dest = reinterpret_cast<destination_mgr*>(cinfo->dest);
-  std::vector<JOCTET>& buffer = dest->encoder->mResultBuffer;
-  size_t oldsize = buffer.size();
-  buffer.resize(oldsize + kBlockSize);
+  JpegEncoderHelper* encoder = dest->encoder;
+  uhdr_vector<JOCTET>& buffer = encoder->mResultBuffer;
+  size_t oldsize;
+  if (encoder->mIsOutputInPlace) {
+    // caller buffer is exhausted, continue in internal buffer
+    oldsize = encoder->mOutputBufferCapacity;
+    resizeOutputBuffer(cinfo, buffer, getGrowthSize(oldsize));
+    memcpy(buffer.data(), encoder->mOutputBuffer, oldsize);
+    encoder->mIsOutputInPlace = false;
+  } else {
+    oldsize = buffer.size();
+    resizeOutputBuffer(cinfo, buffer, getGrowthSize(oldsize));
+  }
   dest->mgr.next_output_byte = &buffer[oldsize];
-  dest->mgr.free_in_buffer = kBlockSize;
+  dest->mgr.free_in_buffer = buffer.size() - oldsize;
   return true;
 }
 
 void JpegEncoderHelper::terminateDestination(j_compress_ptr cinfo) {
   destination_mgr* dest = reinterpret_cast<destination_mgr*>(cinfo->dest);
-  std::vector<JOCTET>& buffer = dest->encoder->mResultBuffer;
-  buffer.resize(buffer.size() - dest->mgr.free_in_buffer);
+  JpegEncoderHelper* encoder = dest->encoder;
+  if (encoder->mIsOutputInPlace) {
+    encoder->mOutputSize = encoder->mOutputBufferCapacity - dest->mgr.free_in_buffer;
+    return;
+  }
+  uhdr_vector<JOCTET>& buffer = encoder->mResultBuffer;
+  resizeOutputBuffer(cinfo, buffer, buffer.size() - dest->mgr.free_in_buffer);
 }
 
 void JpegEncoderHelper::outputErrorMessage(j_common_ptr cinfo) {
@@ -87,10 +164,17 @@ bool JpegEncoderHelper::encode(const uint8_t* yBuffer, const uint8_t* uvBuffer,
                                int height, int lumaStride, int chromaStride, int quality,
                                const void* iccBuffer, unsigned int iccSize) {
   jpeg_compress_struct cinfo;
-  jpeg_error_mgr jerr;
+  jpegr_encode_error_mgr jerr;
 
-  cinfo.err = jpeg_std_error(&jerr);
+  cinfo.err = jpeg_std_error(&jerr.pub);
   cinfo.err->output_message = &outputErrorMessage;
+  jerr.pub.error_exit = jpegrEncodeErrorExit;
+
+  if (setjmp(jerr.setjmp_buffer)) {
+    jpeg_destroy_compress(&cinfo);
+    return false;
+  }
+
   jpeg_create_compress(&cinfo);
   setJpegDestination(&cinfo);
   setJpegCompressStruct(width, height, quality, &cinfo, uvBuffer == nullptr);
@@ -14,8 +14,11 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+
 #include "ultrahdr/ultrahdrcommon.h"
 #include "ultrahdr/jpegr.h"
+#include "ultrahdr/gainmapmath.h"
 #include "ultrahdr/icc.h"
 #include "ultrahdr/multipictureformat.h"
 
@@ -51,27 +54,6 @@ class AlogMessageWriter : public MessageWriter {
   }
 };
 
-/*
- * Helper function copies the JPEG image from without EXIF.
- *
- * @param pDest destination of the data to be written.
- * @param pSource source of data being written.
- * @param exif_pos position of the EXIF package, which is aligned with jpegdecoder.getEXIFPos().
- *                 (4 bytes offset to FF sign, the byte after FF E1 XX XX <this byte>).
- * @param exif_size exif size without the initial 4 bytes, aligned with jpegdecoder.getEXIFSize().
- */
-static void copyJpegWithoutExif(uhdr_compressed_ptr pDest, uhdr_compressed_ptr pSource, size_t exif_pos,
-                                size_t exif_size) {
-  const size_t exif_offset = 4;  // exif_pos has 4 bytes offset to the FF sign
-  pDest->length = pSource->length - exif_size - exif_offset;
-  pDest->data = new uint8_t[pDest->length];
-  pDest->maxLength = pDest->length;
-  pDest->colorGamut = pSource->colorGamut;
-  memcpy(pDest->data, pSource->data, exif_pos - exif_offset);
-  memcpy((uint8_t*)pDest->data + exif_pos - exif_offset,
-         (uint8_t*)pSource->data + exif_pos + exif_size, pSource->length - exif_pos - exif_size);
-}
-
 status_t JpegR::areInputArgumentsValid(uhdr_uncompressed_ptr p010_image_ptr,
                                        uhdr_uncompressed_ptr yuv420_image_ptr,
                                        ultrahdr_transfer_function hdr_tf,
@@ -111,7 +93,8 @@ status_t JpegR::areInputArgumentsValid(uhdr_uncompressed_ptr p010_image_ptr,
           p010_image_ptr->chroma_stride, p010_image_ptr->width);
     return ERROR_ULTRAHDR_INVALID_STRIDE;
   }
-  if (dest_ptr == nullptr || dest_ptr->data == nullptr) {
+  if (dest_ptr == nullptr ||
+      (dest_ptr->data == nullptr && !mOutputBufferAllocator && !mOutputSink)) {
     ALOGE("Received nullptr for destination");
     return ERROR_ULTRAHDR_BAD_PTR;
   }
@@ -183,8 +166,12 @@ status_t JpegR::encodeJPEGR(uhdr_uncompressed_ptr p010_image_ptr, ultrahdr_trans
   }
 
   const size_t yu420_luma_stride = ALIGNM(p010_image.width, JpegEncoderHelper::kCompressBatchSize);
-  unique_ptr<uint8_t[]> yuv420_image_data =
-      make_unique<uint8_t[]>(yu420_luma_stride * p010_image.height * 3 / 2);
+  uhdr_unique_ptr<uint8_t> yuv420_image_data =
+      uhdrMakeUnique<uint8_t>(yu420_luma_stride * p010_image.height * 3 / 2);
+  if (yuv420_image_data == nullptr) {
+    ALOGE("failed to allocate memory for sdr intermediate");
+    return ERROR_ULTRAHDR_INSUFFICIENT_RESOURCE;
+  }
   ultrahdr_uncompressed_struct yuv420_image;
   yuv420_image.data = yuv420_image_data.get();
   yuv420_image.width = p010_image.width;
@@ -204,8 +191,7 @@ status_t JpegR::encodeJPEGR(uhdr_uncompressed_ptr p010_image_ptr, ultrahdr_trans
   metadata.version = kGainMapVersion;
   ultrahdr_uncompressed_struct gainmap_image;
   ULTRAHDR_CHECK(generateGainMap(&yuv420_image, &p010_image, hdr_tf, &metadata, &gainmap_image));
-  std::unique_ptr<uint8_t[]> map_data;
-  map_data.reset(reinterpret_cast<uint8_t*>(gainmap_image.data));
+  uhdr_unique_ptr<uint8_t> map_data(static_cast<uint8_t*>(gainmap_image.data));
 
   // compress gain map
   JpegEncoderHelper jpeg_enc_obj_gm;
@@ -216,7 +202,7 @@ status_t JpegR::encodeJPEGR(uhdr_uncompressed_ptr p010_image_ptr, ultrahdr_trans
   compressed_map.maxLength = static_cast<int>(jpeg_enc_obj_gm.getCompressedImageSize());
   compressed_map.colorGamut = ULTRAHDR_COLORGAMUT_UNSPECIFIED;
 
-  std::shared_ptr<DataStruct> icc =
+  std::shared_ptr<const DataStruct> icc =
       IccHelper::writeIccProfile(ULTRAHDR_TF_SRGB, yuv420_image.colorGamut);
 
   // convert to Bt601 YUV encoding for JPEG encode
@@ -282,8 +268,7 @@ status_t JpegR::encodeJPEGR(uhdr_uncompressed_ptr p010_image_ptr,
   metadata.version = kGainMapVersion;
   ultrahdr_uncompressed_struct gainmap_image;
   ULTRAHDR_CHECK(generateGainMap(&yuv420_image, &p010_image, hdr_tf, &metadata, &gainmap_image));
-  std::unique_ptr<uint8_t[]> map_data;
-  map_data.reset(reinterpret_cast<uint8_t*>(gainmap_image.data));
+  uhdr_unique_ptr<uint8_t> map_data(static_cast<uint8_t*>(gainmap_image.data));
 
   // compress gain map
   JpegEncoderHelper jpeg_enc_obj_gm;
@@ -294,17 +279,21 @@ status_t JpegR::encodeJPEGR(uhdr_uncompressed_ptr p010_image_ptr,
   compressed_map.maxLength = static_cast<int>(jpeg_enc_obj_gm.getCompressedImageSize());
   compressed_map.colorGamut = ULTRAHDR_COLORGAMUT_UNSPECIFIED;
 
-  std::shared_ptr<DataStruct> icc =
+  std::shared_ptr<const DataStruct> icc =
       IccHelper::writeIccProfile(ULTRAHDR_TF_SRGB, yuv420_image.colorGamut);
 
   ultrahdr_uncompressed_struct yuv420_bt601_image = yuv420_image;
-  unique_ptr<uint8_t[]> yuv_420_bt601_data;
+  uhdr_unique_ptr<uint8_t> yuv_420_bt601_data;
   // Convert to bt601 YUV encoding for JPEG encode
   if (yuv420_image.colorGamut != ULTRAHDR_COLORGAMUT_P3) {
     const size_t yuv_420_bt601_luma_stride =
         ALIGNM(yuv420_image.width, JpegEncoderHelper::kCompressBatchSize);
     yuv_420_bt601_data =
-        make_unique<uint8_t[]>(yuv_420_bt601_luma_stride * yuv420_image.height * 3 / 2);
+        uhdrMakeUnique<uint8_t>(yuv_420_bt601_luma_stride * yuv420_image.height * 3 / 2);
+    if (yuv_420_bt601_data == nullptr) {
+      ALOGE("failed to allocate memory for bt601 intermediate");
+      return ERROR_ULTRAHDR_INSUFFICIENT_RESOURCE;
+    }
     yuv420_bt601_image.data = yuv_420_bt601_data.get();
     yuv420_bt601_image.colorGamut = yuv420_image.colorGamut;
     yuv420_bt601_image.luma_stride = yuv_420_bt601_luma_stride;
@@ -419,8 +408,7 @@ status_t JpegR::encodeJPEGR(uhdr_uncompressed_ptr p010_image_ptr,
   metadata.version = kGainMapVersion;
   ultrahdr_uncompressed_struct gainmap_image;
   ULTRAHDR_CHECK(generateGainMap(&yuv420_image, &p010_image, hdr_tf, &metadata, &gainmap_image));
-  std::unique_ptr<uint8_t[]> map_data;
-  map_data.reset(reinterpret_cast<uint8_t*>(gainmap_image.data));
+  uhdr_unique_ptr<uint8_t> map_data(static_cast<uint8_t*>(gainmap_image.data));
 
   // compress gain map
   JpegEncoderHelper jpeg_enc_obj_gm;
@@ -501,8 +489,7 @@ status_t JpegR::encodeJPEGR(uhdr_uncompressed_ptr p010_image_ptr,
   ultrahdr_uncompressed_struct gainmap_image;
   ULTRAHDR_CHECK(generateGainMap(&yuv420_image, &p010_image, hdr_tf, &metadata, &gainmap_image,
                               true /* sdr_is_601 */));
-  std::unique_ptr<uint8_t[]> map_data;
-  map_data.reset(reinterpret_cast<uint8_t*>(gainmap_image.data));
+  uhdr_unique_ptr<uint8_t> map_data(static_cast<uint8_t*>(gainmap_image.data));
 
   // compress gain map
   JpegEncoderHelper jpeg_enc_obj_gm;
@@ -528,7 +515,7 @@ status_t JpegR::encodeJPEGR(uhdr_compressed_ptr yuv420jpg_image_ptr,
     ALOGE("received nullptr for compressed gain map");
     return ERROR_ULTRAHDR_BAD_PTR;
   }
-  if (dest == nullptr || dest->data == nullptr) {
+  if (dest == nullptr || (dest->data == nullptr && !mOutputBufferAllocator && !mOutputSink)) {
     ALOGE("received nullptr for destination");
     return ERROR_ULTRAHDR_BAD_PTR;
   }
@@ -551,7 +538,7 @@ status_t JpegR::encodeJPEGR(uhdr_compressed_ptr yuv420jpg_image_ptr,
       ALOGE("Unrecognized 420 color gamut %d", yuv420jpg_image_ptr->colorGamut);
       return ERROR_ULTRAHDR_INVALID_COLORGAMUT;
     }
-    std::shared_ptr<DataStruct> newIcc =
+    std::shared_ptr<const DataStruct> newIcc =
         IccHelper::writeIccProfile(ULTRAHDR_TF_SRGB, yuv420jpg_image_ptr->colorGamut);
     ULTRAHDR_CHECK(appendGainMap(yuv420jpg_image_ptr, gainmapjpg_image_ptr, /* exif */ nullptr,
                               newIcc->getData(), newIcc->getLength(), metadata, dest));
@@ -595,7 +582,7 @@ status_t JpegR::encodeJPEGR(uhdr_uncompressed_ptr yuv420_image_ptr, uhdr_uncompr
   compressed_map.maxLength = static_cast<int>(jpeg_enc_obj_gm.getCompressedImageSize());
   compressed_map.colorGamut = ULTRAHDR_COLORGAMUT_UNSPECIFIED;
 
-  std::shared_ptr<DataStruct> icc =
+  std::shared_ptr<const DataStruct> icc =
       IccHelper::writeIccProfile(ULTRAHDR_TF_SRGB, yuv420_image.colorGamut);
 
   // compress 420 image
@@ -651,15 +638,17 @@ status_t JpegR::getJPEGRInfo(uhdr_compressed_ptr ultrahdr_image_ptr, uhdr_info_p
   return status;
 }
 
-/* Decode API */
-status_t JpegR::decodeJPEGR(uhdr_compressed_ptr ultrahdr_image_ptr, uhdr_uncompressed_ptr dest,
-                            float max_display_boost, uhdr_exif_ptr exif,
-                            ultrahdr_output_format output_format,
-                            uhdr_uncompressed_ptr gainmap_image_ptr, ultrahdr_metadata_ptr metadata) {
-  if (ultrahdr_image_ptr == nullptr || ultrahdr_image_ptr->data == nullptr) {
-    ALOGE("received nullptr for compressed jpegr image");
-    return ERROR_ULTRAHDR_BAD_PTR;
-  }
+status_t JpegR::areDecodeArgumentsValid(uhdr_uncompressed_ptr dest, float max_display_boost,
+                                        uhdr_exif_ptr exif, ultrahdr_output_format output_format,
+                                        uhdr_uncompressed_ptr gainmap_image_ptr,
+                                        const jpegr_decode_options_struct* options) {
+  const jpegr_decode_options_struct default_options;
+  if (options == nullptr) {
+    options = &default_options;
+  }
+  ultrahdr_rendition_ptr renditions = options->renditions;
+  const size_t num_renditions = options->numRenditions;
+  const ultrahdr_color_gamut output_gamut = options->outputGamut;
   if (dest == nullptr || dest->data == nullptr) {
     ALOGE("received nullptr for dest image");
     return ERROR_ULTRAHDR_BAD_PTR;
@@ -680,6 +669,385 @@ status_t JpegR::decodeJPEGR(uhdr_compressed_ptr ultrahdr_image_ptr, uhdr_uncompr
     ALOGE("received bad value for output format %d", output_format);
     return ERROR_ULTRAHDR_INVALID_OUTPUT_FORMAT;
   }
+  if (options->stats != nullptr && output_format == ULTRAHDR_OUTPUT_SDR) {
+    ALOGE("image statistics are only gathered for hdr output formats");
+    return ERROR_ULTRAHDR_INVALID_OUTPUT_FORMAT;
+  }
+  if (output_gamut < ULTRAHDR_COLORGAMUT_UNSPECIFIED || output_gamut > ULTRAHDR_COLORGAMUT_MAX) {
+    ALOGE("received bad value for output color gamut %d", output_gamut);
+    return ERROR_ULTRAHDR_INVALID_COLORGAMUT;
+  }
+  if (output_gamut != ULTRAHDR_COLORGAMUT_UNSPECIFIED && output_format == ULTRAHDR_OUTPUT_SDR) {
+    ALOGE("output color gamut conversion is only supported for hdr output formats");
+    return ERROR_ULTRAHDR_INVALID_OUTPUT_FORMAT;
+  }
+  if (num_renditions > 0) {
+    if (renditions == nullptr) {
+      ALOGE("received nullptr for renditions");
+      return ERROR_ULTRAHDR_BAD_PTR;
+    }
+    if (output_format == ULTRAHDR_OUTPUT_SDR) {
+      ALOGE("additional renditions are only supported along with hdr output formats");
+      return ERROR_ULTRAHDR_INVALID_OUTPUT_FORMAT;
+    }
+  }
+  for (size_t i = 0; i < num_renditions; i++) {
+    if (renditions[i].dest == nullptr || renditions[i].dest->data == nullptr) {
+      ALOGE("received nullptr for dest image of rendition %zu", i);
+      return ERROR_ULTRAHDR_BAD_PTR;
+    }
+    if (renditions[i].maxDisplayBoost < 1.0f) {
+      ALOGE("received bad value for max_display_boost %f of rendition %zu",
+            renditions[i].maxDisplayBoost, i);
+      return ERROR_ULTRAHDR_INVALID_DISPLAY_BOOST;
+    }
+    if (renditions[i].outputFormat <= ULTRAHDR_OUTPUT_SDR ||
+        renditions[i].outputFormat > ULTRAHDR_OUTPUT_MAX) {
+      ALOGE("received bad value for output format %d of rendition %zu",
+            renditions[i].outputFormat, i);
+      return ERROR_ULTRAHDR_INVALID_OUTPUT_FORMAT;
+    }
+  }
+  return ULTRAHDR_NO_ERROR;
+}
+
+status_t JpegR::decodePrimaryImageFromStream(const jpegr_read_fn& reader,
+                                             ultrahdr_output_format output_format,
+                                             JpegDecoderHelper* primary_decoder,
+                                             uhdr_vector<uint8_t>* gainmap_jpg_image,
+                                             uhdr_info_ptr jpegr_image_info_ptr) {
+  if (!reader || primary_decoder == nullptr || gainmap_jpg_image == nullptr) {
+    ALOGE("received nullptr for jpegr stream arguments");
+    return ERROR_ULTRAHDR_BAD_PTR;
+  }
+  if (output_format <= ULTRAHDR_OUTPUT_UNSPECIFIED || output_format > ULTRAHDR_OUTPUT_MAX) {
+    ALOGE("received bad value for output format %d", output_format);
+    return ERROR_ULTRAHDR_INVALID_OUTPUT_FORMAT;
+  }
+
+  if (!primary_decoder->decompressImage(
+          reader, (output_format == ULTRAHDR_OUTPUT_SDR) ? DECODE_TO_RGBA : DECODE_TO_YCBCR)) {
+    return ERROR_ULTRAHDR_DECODE_ERROR;
+  }
+
+  // Bytes that were already pulled from the reader past the primary image are served first
+  const uint8_t* remainder = static_cast<const uint8_t*>(primary_decoder->getStreamRemainderPtr());
+  const size_t remainderSize = primary_decoder->getStreamRemainderSize();
+  size_t remainderPos = 0;
+  size_t position = primary_decoder->getStreamPosition();
+  auto read = [&](uint8_t* buffer, size_t size) -> int {
+    if (remainderPos < remainderSize) {
+      size_t bytes = std::min(size, remainderSize - remainderPos);
+      memcpy(buffer, remainder + remainderPos, bytes);
+      remainderPos += bytes;
+      return static_cast<int>(bytes);
+    }
+    return reader(buffer, size);
+  };
+
+  // Locate gain map using the MP entries of the primary image. The offset is relative to the MP
+  // endian field that follows the MPF signature.
+  uint32_t gainmapSize = 0, gainmapOffset = 0;
+  size_t gainmapPos = position;
+  bool hasMpf = primary_decoder->getMPFPos() >= 0 &&
+                getSecondaryImageFromMpf(static_cast<uint8_t*>(primary_decoder->getMPFPtr()),
+                                         primary_decoder->getMPFSize(), &gainmapSize,
+                                         &gainmapOffset);
+  if (hasMpf) {
+    gainmapPos = primary_decoder->getMPFPos() + sizeof(kMpfSig) + gainmapOffset;
+    if (gainmapPos < position || gainmapSize == 0) {
+      ALOGW("MPF offsets of gain map image are inconsistent, scanning stream instead");
+      hasMpf = false;
+      gainmapPos = position;
+    }
+  }
+
+  constexpr size_t kChunkSize = 64 * 1024;
+  uhdr_vector<uint8_t>& data = *gainmap_jpg_image;
+  size_t length = 0;
+  try {
+    data.clear();
+    while (position < gainmapPos) {
+      data.resize(std::min(kChunkSize, gainmapPos - position));
+      int bytes = read(data.data(), data.size());
+      if (bytes <= 0) return ERROR_ULTRAHDR_GAIN_MAP_IMAGE_NOT_FOUND;
+      position += bytes;
+    }
+    data.clear();
+    while (!hasMpf || length < gainmapSize) {
+      size_t chunk = hasMpf ? std::min(kChunkSize, gainmapSize - length) : kChunkSize;
+      data.resize(length + chunk);
+      int bytes = read(data.data() + length, chunk);
+      if (bytes < 0) return ERROR_ULTRAHDR_GAIN_MAP_IMAGE_NOT_FOUND;
+      if (bytes == 0) break;
+      length += bytes;
+    }
+    data.resize(length);
+  } catch (const std::bad_alloc&) {
+    ALOGE("failed to allocate memory for gain map image");
+    return ERROR_ULTRAHDR_INSUFFICIENT_RESOURCE;
+  }
+  if (hasMpf && length < gainmapSize) {
+    ALOGE("stream ended before the end of gain map image");
+    return ERROR_ULTRAHDR_GAIN_MAP_IMAGE_NOT_FOUND;
+  }
+
+  // Without (usable) MPF, the gain map is the first jpeg image following the primary image
+  if (!hasMpf || length < 2 || data[0] != 0xff || data[1] != 0xd8) {
+    size_t i = 0;
+    while (i + 2 < length && !(data[i] == 0xff && data[i + 1] == 0xd8 && data[i + 2] == 0xff)) i++;
+    if (i + 2 >= length) {
+      return ERROR_ULTRAHDR_GAIN_MAP_IMAGE_NOT_FOUND;
+    }
+    data.erase(data.begin(), data.begin() + i);
+  }
+
+  if (jpegr_image_info_ptr != nullptr) {
+    jpegr_image_info_ptr->width = primary_decoder->getImageWidth();
+    jpegr_image_info_ptr->height = primary_decoder->getImageHeight();
+    jpeg_info_struct* primary_info = jpegr_image_info_ptr->primaryImgInfo;
+    if (primary_info != nullptr) {
+      const uint8_t* icc = static_cast<const uint8_t*>(primary_decoder->getICCPtr());
+      const uint8_t* exif = static_cast<const uint8_t*>(primary_decoder->getEXIFPtr());
+      const uint8_t* xmp = static_cast<const uint8_t*>(primary_decoder->getXMPPtr());
+      primary_info->width = jpegr_image_info_ptr->width;
+      primary_info->height = jpegr_image_info_ptr->height;
+      primary_info->iccData.assign(icc, icc + primary_decoder->getICCSize());
+      primary_info->exifData.assign(exif, exif + primary_decoder->getEXIFSize());
+      primary_info->xmpData.assign(xmp, xmp + primary_decoder->getXMPSize());
+    }
+    if (jpegr_image_info_ptr->gainmapImgInfo != nullptr) {
+      ultrahdr_compressed_struct gainmap_image;
+      gainmap_image.data = data.data();
+      gainmap_image.length = gainmap_image.maxLength = data.size();
+      ULTRAHDR_CHECK(parseJpegInfo(&gainmap_image, jpegr_image_info_ptr->gainmapImgInfo));
+    }
+  }
+
+  return ULTRAHDR_NO_ERROR;
+}
+
+// Locates the gain map image of a JPEGR image with the MP entries of the primary image, whose
+// header is parsed by primary_parser. Without usable MP entries, the images are scanned for.
+static status_t locateGainMap(uhdr_compressed_ptr ultrahdr_image_ptr,
+                              JpegDecoderHelper* primary_parser,
+                              uhdr_compressed_ptr gainmap_jpg_image_ptr) {
+  if (!primary_parser->getCompressedImageParameters(ultrahdr_image_ptr->data,
+                                                    ultrahdr_image_ptr->length)) {
+    return ERROR_ULTRAHDR_DECODE_ERROR;
+  }
+  uint32_t gainmapSize = 0, gainmapOffset = 0;
+  if (primary_parser->getMPFPos() >= 0 &&
+      getSecondaryImageFromMpf(static_cast<uint8_t*>(primary_parser->getMPFPtr()),
+                               primary_parser->getMPFSize(), &gainmapSize, &gainmapOffset)) {
+    const uint8_t* data = static_cast<const uint8_t*>(ultrahdr_image_ptr->data);
+    const size_t gainmapPos = primary_parser->getMPFPos() + sizeof(kMpfSig) + gainmapOffset;
+    if (gainmapSize >= 2 &&
+        gainmapPos + gainmapSize <= static_cast<size_t>(ultrahdr_image_ptr->length) &&
+        data[gainmapPos] == 0xff && data[gainmapPos + 1] == 0xd8) {
+      gainmap_jpg_image_ptr->data = const_cast<uint8_t*>(data) + gainmapPos;
+      gainmap_jpg_image_ptr->length = gainmapSize;
+      return ULTRAHDR_NO_ERROR;
+    }
+    ALOGW("MPF offsets of gain map image are inconsistent, scanning image instead");
+  }
+  return JpegR::extractPrimaryImageAndGainMap(ultrahdr_image_ptr, nullptr, gainmap_jpg_image_ptr);
+}
+
+// Fills the dimensions and the metadata blocks of info from a decoder that has parsed an image
+static void fillJpegInfo(JpegDecoderHelper* decoder, j_info_ptr info) {
+  const uint8_t* icc = static_cast<const uint8_t*>(decoder->getICCPtr());
+  const uint8_t* exif = static_cast<const uint8_t*>(decoder->getEXIFPtr());
+  const uint8_t* xmp = static_cast<const uint8_t*>(decoder->getXMPPtr());
+  info->width = decoder->getImageWidth();
+  info->height = decoder->getImageHeight();
+  info->iccData.assign(icc, icc + decoder->getICCSize());
+  info->exifData.assign(exif, exif + decoder->getEXIFSize());
+  info->xmpData.assign(xmp, xmp + decoder->getXMPSize());
+}
+
+status_t JpegR::decodeGainMap(uhdr_compressed_ptr ultrahdr_image_ptr,
+                              JpegDecoderHelper* gainmap_decoder,
+                              uhdr_info_ptr jpegr_image_info_ptr) {
+  if (ultrahdr_image_ptr == nullptr || ultrahdr_image_ptr->data == nullptr) {
+    ALOGE("received nullptr for compressed jpegr image");
+    return ERROR_ULTRAHDR_BAD_PTR;
+  }
+  if (gainmap_decoder == nullptr) {
+    ALOGE("received nullptr for gain map decoder");
+    return ERROR_ULTRAHDR_BAD_PTR;
+  }
+
+  JpegDecoderHelper primary_parser;
+  ultrahdr_compressed_struct gainmap_jpeg_image;
+  ULTRAHDR_CHECK(locateGainMap(ultrahdr_image_ptr, &primary_parser, &gainmap_jpeg_image));
+  if (!gainmap_decoder->decompressImage(gainmap_jpeg_image.data, gainmap_jpeg_image.length)) {
+    return ERROR_ULTRAHDR_DECODE_ERROR;
+  }
+
+  if (jpegr_image_info_ptr != nullptr) {
+    jpegr_image_info_ptr->width = primary_parser.getImageWidth();
+    jpegr_image_info_ptr->height = primary_parser.getImageHeight();
+    if (jpegr_image_info_ptr->primaryImgInfo != nullptr) {
+      fillJpegInfo(&primary_parser, jpegr_image_info_ptr->primaryImgInfo);
+    }
+    if (jpegr_image_info_ptr->gainmapImgInfo != nullptr) {
+      fillJpegInfo(gainmap_decoder, jpegr_image_info_ptr->gainmapImgInfo);
+    }
+  }
+
+  return ULTRAHDR_NO_ERROR;
+}
+
+// Returns the smallest scale denominator, at most scale_denom, that decodes a gain map of
+// map_width x map_height to an integer fraction of the primary image decoded at width x height,
+// with the same scale factor in both dimensions. Returns 0 if there is none.
+static size_t getGainMapScaleDenom(size_t width, size_t height, size_t map_width,
+                                   size_t map_height, size_t scale_denom) {
+  for (size_t denom = 1; denom <= scale_denom; denom *= 2) {
+    const size_t scaled_map_width = (map_width + denom - 1) / denom;
+    const size_t scaled_map_height = (map_height + denom - 1) / denom;
+    if (width % scaled_map_width == 0 && height % scaled_map_height == 0 &&
+        width / scaled_map_width == height / scaled_map_height) {
+      return denom;
+    }
+  }
+  return 0;
+}
+
+// Returns ERROR_ULTRAHDR_INVALID_CROPPING_PARAMETERS unless roi is a non-empty region of the image
+// of width x height.
+static status_t isRegionValid(const ultrahdr_region_struct* roi, size_t width, size_t height) {
+  if (roi->width == 0 || roi->height == 0 || roi->left + roi->width > width ||
+      roi->top + roi->height > height) {
+    ALOGE("region of interest %zux%zu at (%zu, %zu) exceeds the image of %zux%zu", roi->width,
+          roi->height, roi->left, roi->top, width, height);
+    return ERROR_ULTRAHDR_INVALID_CROPPING_PARAMETERS;
+  }
+  return ULTRAHDR_NO_ERROR;
+}
+
+// Finds the window of a gain map of map_width x map_height that the reconstruction of roi reads,
+// and the window of the primary image of width x height that it covers. Every pixel reads the
+// gain map sample of its cell and the samples to the right of and below it. The primary image
+// window starts at an even position, so that its chroma samples are the ones of the image.
+static status_t getGainMapWindow(const ultrahdr_region_struct* roi, size_t width, size_t height,
+                                 size_t map_width, size_t map_height,
+                                 ultrahdr_region_struct* map_window,
+                                 ultrahdr_region_struct* window) {
+  if (width % map_width != 0 || height % map_height != 0 ||
+      width / map_width != height / map_height) {
+    ALOGE("primary image of %zux%zu is not an integer multiple of the gain map of %zux%zu", width,
+          height, map_width, map_height);
+    return ERROR_ULTRAHDR_UNSUPPORTED_MAP_SCALE_FACTOR;
+  }
+  const size_t scale = width / map_width;
+  size_t left = roi->left / scale;
+  size_t top = roi->top / scale;
+  if (scale % 2 != 0) {
+    left -= left % 2;
+    top -= top % 2;
+  }
+  const size_t right = (std::min)((roi->left + roi->width - 1) / scale + 2, map_width);
+  const size_t bottom = (std::min)((roi->top + roi->height - 1) / scale + 2, map_height);
+  *map_window = {left, top, right - left, bottom - top};
+  *window = {left * scale, top * scale, (right - left) * scale, (bottom - top) * scale};
+  return ULTRAHDR_NO_ERROR;
+}
+
+// Configures gainmap_decoder to decode the gain map at the scale of a primary image decoded at
+// 1 / scale_denom to width x height, and only in the window that roi reads if roi is not nullptr.
+// window receives the window of the primary image that the decoded gain map covers.
+static status_t setUpGainMapDecoder(JpegDecoderHelper* gainmap_decoder,
+                                    uhdr_compressed_ptr gainmap_jpg_image_ptr, size_t width,
+                                    size_t height, size_t scale_denom,
+                                    const ultrahdr_region_struct* roi,
+                                    ultrahdr_region_struct* window) {
+  *window = {0, 0, width, height};
+  if (scale_denom == 1 && roi == nullptr) {
+    return ULTRAHDR_NO_ERROR;
+  }
+  if (!gainmap_decoder->getCompressedImageParameters(gainmap_jpg_image_ptr->data,
+                                                     gainmap_jpg_image_ptr->length)) {
+    return ERROR_ULTRAHDR_DECODE_ERROR;
+  }
+  if (scale_denom != 1) {
+    // the gain map is scaled along with the primary image, so that it is applied as is
+    const size_t gainmap_scale_denom =
+        getGainMapScaleDenom(width, height, gainmap_decoder->getImageWidth(),
+                             gainmap_decoder->getImageHeight(), scale_denom);
+    if (gainmap_scale_denom == 0) {
+      ALOGE("gain map of resolution %zux%zu can not be scaled to the scaled primary image",
+            gainmap_decoder->getImageWidth(), gainmap_decoder->getImageHeight());
+      return ERROR_ULTRAHDR_UNSUPPORTED_MAP_SCALE_FACTOR;
+    }
+    gainmap_decoder->setScaleDenom(gainmap_scale_denom);
+  }
+  if (roi != nullptr) {
+    // only the gain map samples that the region reads are decoded
+    const size_t gainmap_scale_denom = gainmap_decoder->getScaleDenom();
+    ultrahdr_region_struct gainmap_window;
+    ULTRAHDR_CHECK(getGainMapWindow(
+        roi, width, height,
+        (gainmap_decoder->getImageWidth() + gainmap_scale_denom - 1) / gainmap_scale_denom,
+        (gainmap_decoder->getImageHeight() + gainmap_scale_denom - 1) / gainmap_scale_denom,
+        &gainmap_window, window));
+    gainmap_decoder->setCropRegion(gainmap_window.left, gainmap_window.top, gainmap_window.width,
+                                   gainmap_window.height);
+  }
+  return ULTRAHDR_NO_ERROR;
+}
+
+status_t JpegR::decodeGainMapImage(uhdr_compressed_ptr gainmap_jpg_image_ptr, size_t width,
+                                   size_t height, uhdr_uncompressed_ptr dest,
+                                   const jpegr_decode_options_struct* options) {
+  if (gainmap_jpg_image_ptr == nullptr || gainmap_jpg_image_ptr->data == nullptr) {
+    ALOGE("received nullptr for compressed gain map image");
+    return ERROR_ULTRAHDR_BAD_PTR;
+  }
+  if (dest == nullptr || dest->data == nullptr) {
+    ALOGE("received nullptr for dest image");
+    return ERROR_ULTRAHDR_BAD_PTR;
+  }
+  const jpegr_decode_options_struct default_options;
+  if (options == nullptr) {
+    options = &default_options;
+  }
+  if (options->roi != nullptr) {
+    ULTRAHDR_CHECK(isRegionValid(options->roi, width, height));
+  }
+  JpegDecoderHelper jpeg_dec_obj_gm;
+  ultrahdr_region_struct window;
+  ULTRAHDR_CHECK(setUpGainMapDecoder(&jpeg_dec_obj_gm, gainmap_jpg_image_ptr, width, height,
+                                     options->scaleDenom, options->roi, &window));
+  jpeg_output_planes gainmap_planes{};
+  gainmap_planes.planes[0] = static_cast<uint8_t*>(dest->data);
+  if (!jpeg_dec_obj_gm.decompressImage(gainmap_jpg_image_ptr->data, gainmap_jpg_image_ptr->length,
+                                       DECODE_TO_YCBCR, &gainmap_planes)) {
+    return ERROR_ULTRAHDR_DECODE_ERROR;
+  }
+  dest->width = jpeg_dec_obj_gm.getDecompressedImageWidth();
+  dest->height = jpeg_dec_obj_gm.getDecompressedImageHeight();
+  return ULTRAHDR_NO_ERROR;
+}
+
+/* Decode API */
+status_t JpegR::decodeJPEGR(uhdr_compressed_ptr ultrahdr_image_ptr, uhdr_uncompressed_ptr dest,
+                            float max_display_boost, uhdr_exif_ptr exif,
+                            ultrahdr_output_format output_format,
+                            uhdr_uncompressed_ptr gainmap_image_ptr, ultrahdr_metadata_ptr metadata,
+                            const jpegr_decode_options_struct* options) {
+  if (ultrahdr_image_ptr == nullptr || ultrahdr_image_ptr->data == nullptr) {
+    ALOGE("received nullptr for compressed jpegr image");
+    return ERROR_ULTRAHDR_BAD_PTR;
+  }
+  ULTRAHDR_CHECK(areDecodeArgumentsValid(dest, max_display_boost, exif, output_format,
+                                         gainmap_image_ptr, options));
+  const jpegr_decode_options_struct default_options;
+  if (options == nullptr) {
+    options = &default_options;
+  }
+  const ultrahdr_region_struct* roi = options->roi;
 
   ultrahdr_compressed_struct primary_jpeg_image, gainmap_jpeg_image;
   status_t status =
@@ -690,13 +1058,96 @@ status_t JpegR::decodeJPEGR(uhdr_compressed_ptr ultrahdr_image_ptr, uhdr_uncompr
   }
 
   JpegDecoderHelper jpeg_dec_obj_yuv420;
-  if (!jpeg_dec_obj_yuv420.decompressImage(
-          primary_jpeg_image.data, primary_jpeg_image.length,
-          (output_format == ULTRAHDR_OUTPUT_SDR) ? DECODE_TO_RGBA : DECODE_TO_YCBCR)) {
+  if (!jpeg_dec_obj_yuv420.setScaleDenom(options->scaleDenom)) {
+    return ERROR_ULTRAHDR_UNSUPPORTED_FEATURE;
+  }
+  if (output_format != ULTRAHDR_OUTPUT_SDR) {
+    // the primary image is decoded in bands while applying the gain map, only parse it here
+    if (!jpeg_dec_obj_yuv420.getCompressedImageParameters(primary_jpeg_image.data,
+                                                          primary_jpeg_image.length)) {
+      return ERROR_ULTRAHDR_DECODE_ERROR;
+    }
+    return decodeJPEGR(&jpeg_dec_obj_yuv420, &gainmap_jpeg_image, dest, max_display_boost, exif,
+                       output_format, gainmap_image_ptr, metadata, &primary_jpeg_image, options);
+  }
+
+  if (roi != nullptr) {
+    // only the region is decoded, straight to dest
+    if (!jpeg_dec_obj_yuv420.getCompressedImageParameters(primary_jpeg_image.data,
+                                                          primary_jpeg_image.length)) {
+      return ERROR_ULTRAHDR_DECODE_ERROR;
+    }
+    ULTRAHDR_CHECK(isRegionValid(roi, jpeg_dec_obj_yuv420.getDecompressedImageWidth(),
+                                 jpeg_dec_obj_yuv420.getDecompressedImageHeight()));
+    jpeg_dec_obj_yuv420.setCropRegion(roi->left, roi->top, roi->width, roi->height);
+  }
+
+#ifdef JCS_ALPHA_EXTENSIONS
+  // sdr output is the decoded primary image as is, decode it in place
+  jpeg_output_planes sdr_planes{};
+  sdr_planes.planes[0] = static_cast<uint8_t*>(dest->data);
+  const jpeg_output_planes* primary_planes = &sdr_planes;
+#else
+  const jpeg_output_planes* primary_planes = nullptr;
+#endif
+  if (!jpeg_dec_obj_yuv420.decompressImage(primary_jpeg_image.data, primary_jpeg_image.length,
+                                           DECODE_TO_RGBA, primary_planes)) {
     return ERROR_ULTRAHDR_DECODE_ERROR;
   }
 
-  if (output_format == ULTRAHDR_OUTPUT_SDR) {
+  // renditions, statistics and gamut conversion are only valid for hdr output formats
+  jpegr_decode_options_struct sdr_options;
+  sdr_options.roi = roi;
+  return decodeJPEGR(&jpeg_dec_obj_yuv420, &gainmap_jpeg_image, dest, max_display_boost, exif,
+                     output_format, gainmap_image_ptr, metadata, nullptr, &sdr_options);
+}
+
+status_t JpegR::decodeJPEGR(JpegDecoderHelper* primary_decoder,
+                            uhdr_compressed_ptr gainmap_jpg_image_ptr, uhdr_uncompressed_ptr dest,
+                            float max_display_boost, uhdr_exif_ptr exif,
+                            ultrahdr_output_format output_format,
+                            uhdr_uncompressed_ptr gainmap_image_ptr, ultrahdr_metadata_ptr metadata,
+                            uhdr_compressed_ptr primary_jpg_image_ptr,
+                            const jpegr_decode_options_struct* options) {
+  if (primary_decoder == nullptr) {
+    ALOGE("received nullptr for primary image decoder");
+    return ERROR_ULTRAHDR_BAD_PTR;
+  }
+  if (gainmap_jpg_image_ptr == nullptr || gainmap_jpg_image_ptr->data == nullptr) {
+    ALOGE("received nullptr for compressed gain map image");
+    return ERROR_ULTRAHDR_BAD_PTR;
+  }
+  ULTRAHDR_CHECK(areDecodeArgumentsValid(dest, max_display_boost, exif, output_format,
+                                         gainmap_image_ptr, options));
+  const jpegr_decode_options_struct default_options;
+  if (options == nullptr) {
+    options = &default_options;
+  }
+  ultrahdr_rendition_ptr renditions = options->renditions;
+  const size_t num_renditions = options->numRenditions;
+  ultrahdr_image_stats_ptr stats = options->stats;
+  const ultrahdr_color_gamut output_gamut = options->outputGamut;
+  const ultrahdr_region_struct* roi = options->roi;
+
+  JpegDecoderHelper& jpeg_dec_obj_yuv420 = *primary_decoder;
+  ultrahdr_compressed_struct& gainmap_jpeg_image = *gainmap_jpg_image_ptr;
+  // the primary image is either yet to be decoded in bands, or may have been decoded straight to
+  // dest
+  const bool decode_in_bands = primary_jpg_image_ptr != nullptr;
+  const bool is_primary_in_dest =
+      !decode_in_bands && jpeg_dec_obj_yuv420.getDecompressedImagePtr() == nullptr;
+
+  if (decode_in_bands) {
+    if (primary_jpg_image_ptr->data == nullptr || output_format == ULTRAHDR_OUTPUT_SDR) {
+      ALOGE("band decode of the primary image is only supported for hdr output formats");
+      return ERROR_ULTRAHDR_DECODE_ERROR;
+    }
+  } else if (is_primary_in_dest) {
+    if (output_format != ULTRAHDR_OUTPUT_SDR) {
+      ALOGE("primary image decoded to dest, but requested output format is %d", output_format);
+      return ERROR_ULTRAHDR_DECODE_ERROR;
+    }
+  } else if (output_format == ULTRAHDR_OUTPUT_SDR) {
 #ifdef JCS_ALPHA_EXTENSIONS
     if ((jpeg_dec_obj_yuv420.getDecompressedImageWidth() *
          jpeg_dec_obj_yuv420.getDecompressedImageHeight() * 4) >
@@ -718,6 +1169,16 @@ status_t JpegR::decodeJPEGR(uhdr_compressed_ptr ultrahdr_image_ptr, uhdr_uncompr
     }
   }
 
+  // dimensions of the primary image at the scale of the decode, regardless of any crop region
+  const size_t scale_denom = jpeg_dec_obj_yuv420.getScaleDenom();
+  const size_t primary_width =
+      (jpeg_dec_obj_yuv420.getImageWidth() + scale_denom - 1) / scale_denom;
+  const size_t primary_height =
+      (jpeg_dec_obj_yuv420.getImageHeight() + scale_denom - 1) / scale_denom;
+  if (roi != nullptr) {
+    ULTRAHDR_CHECK(isRegionValid(roi, primary_width, primary_height));
+  }
+
   if (exif != nullptr) {
     if (exif->length < jpeg_dec_obj_yuv420.getEXIFSize()) {
       return ERROR_ULTRAHDR_BUFFER_TOO_SMALL;
@@ -726,26 +1187,56 @@ status_t JpegR::decodeJPEGR(uhdr_compressed_ptr ultrahdr_image_ptr, uhdr_uncompr
     exif->length = jpeg_dec_obj_yuv420.getEXIFSize();
   }
 
+  // A display without headroom is served the sdr rendition, on which the gain map has no effect.
+  // Only the metadata of the gain map image is needed then, its pixels are decoded on request only
   JpegDecoderHelper jpeg_dec_obj_gm;
-  ultrahdr_uncompressed_struct gainmap_image;
-  if (gainmap_image_ptr != nullptr || output_format != ULTRAHDR_OUTPUT_SDR) {
-    if (!jpeg_dec_obj_gm.decompressImage(gainmap_jpeg_image.data, gainmap_jpeg_image.length)) {
+  bool is_sdr_rendition = false;
+  if (output_format != ULTRAHDR_OUTPUT_SDR && num_renditions == 0 && stats == nullptr) {
+    ultrahdr_metadata_struct gainmap_metadata;
+    if (!jpeg_dec_obj_gm.getCompressedImageParameters(gainmap_jpeg_image.data,
+                                                      gainmap_jpeg_image.length)) {
       return ERROR_ULTRAHDR_DECODE_ERROR;
     }
-    if ((jpeg_dec_obj_gm.getDecompressedImageWidth() *
-         jpeg_dec_obj_gm.getDecompressedImageHeight()) >
-        jpeg_dec_obj_gm.getDecompressedImageSize()) {
-      return ERROR_ULTRAHDR_DECODE_ERROR;
+    if (!getMetadataFromXMP(static_cast<uint8_t*>(jpeg_dec_obj_gm.getXMPPtr()),
+                            jpeg_dec_obj_gm.getXMPSize(), &gainmap_metadata)) {
+      return ERROR_ULTRAHDR_METADATA_ERROR;
+    }
+    is_sdr_rendition = isSdrRendition(&gainmap_metadata, max_display_boost);
+  }
+
+  ultrahdr_uncompressed_struct gainmap_image;
+  // window of the primary image that the decoded gain map covers, the whole image unless there is
+  // a region of interest
+  ultrahdr_region_struct window{0, 0, primary_width, primary_height};
+  if (gainmap_image_ptr != nullptr || output_format != ULTRAHDR_OUTPUT_SDR) {
+    ULTRAHDR_CHECK(setUpGainMapDecoder(&jpeg_dec_obj_gm, &gainmap_jpeg_image, primary_width,
+                                       primary_height, scale_denom, roi, &window));
+    if (gainmap_image_ptr != nullptr) {
+      // decode in place, the gain map is then read from the caller buffer
+      jpeg_output_planes gainmap_planes{};
+      gainmap_planes.planes[0] = static_cast<uint8_t*>(gainmap_image_ptr->data);
+      if (!jpeg_dec_obj_gm.decompressImage(gainmap_jpeg_image.data, gainmap_jpeg_image.length,
+                                           DECODE_TO_YCBCR, &gainmap_planes)) {
+        return ERROR_ULTRAHDR_DECODE_ERROR;
+      }
+      gainmap_image.data = gainmap_image_ptr->data;
+    } else if (!is_sdr_rendition) {
+      if (!jpeg_dec_obj_gm.decompressImage(gainmap_jpeg_image.data, gainmap_jpeg_image.length)) {
+        return ERROR_ULTRAHDR_DECODE_ERROR;
+      }
+      if ((jpeg_dec_obj_gm.getDecompressedImageWidth() *
+           jpeg_dec_obj_gm.getDecompressedImageHeight()) >
+          jpeg_dec_obj_gm.getDecompressedImageSize()) {
+        return ERROR_ULTRAHDR_DECODE_ERROR;
+      }
+      gainmap_image.data = jpeg_dec_obj_gm.getDecompressedImagePtr();
     }
-    gainmap_image.data = jpeg_dec_obj_gm.getDecompressedImagePtr();
     gainmap_image.width = jpeg_dec_obj_gm.getDecompressedImageWidth();
     gainmap_image.height = jpeg_dec_obj_gm.getDecompressedImageHeight();
 
     if (gainmap_image_ptr != nullptr) {
       gainmap_image_ptr->width = gainmap_image.width;
       gainmap_image_ptr->height = gainmap_image.height;
-      memcpy(gainmap_image_ptr->data, gainmap_image.data,
-             gainmap_image_ptr->width * gainmap_image_ptr->height);
     }
   }
 
@@ -768,18 +1259,33 @@ status_t JpegR::decodeJPEGR(uhdr_compressed_ptr ultrahdr_image_ptr, uhdr_uncompr
   }
 
   if (output_format == ULTRAHDR_OUTPUT_SDR) {
-    dest->width = jpeg_dec_obj_yuv420.getDecompressedImageWidth();
-    dest->height = jpeg_dec_obj_yuv420.getDecompressedImageHeight();
+    const size_t src_width = jpeg_dec_obj_yuv420.getDecompressedImageWidth();
+    const size_t src_height = jpeg_dec_obj_yuv420.getDecompressedImageHeight();
+    dest->width = roi != nullptr ? roi->width : src_width;
+    dest->height = roi != nullptr ? roi->height : src_height;
+    // the primary image is either decoded cropped to the region, or in full from a stream
+    const bool is_cropped = src_width == dest->width && src_height == dest->height;
+    const size_t src_left = is_cropped ? 0 : roi->left;
+    const size_t src_top = is_cropped ? 0 : roi->top;
 #ifdef JCS_ALPHA_EXTENSIONS
-    memcpy(dest->data, jpeg_dec_obj_yuv420.getDecompressedImagePtr(),
-           dest->width * dest->height * 4);
+    if (!is_primary_in_dest) {
+      const uint8_t* src = static_cast<uint8_t*>(jpeg_dec_obj_yuv420.getDecompressedImagePtr());
+      uint8_t* dst = static_cast<uint8_t*>(dest->data);
+      for (size_t y = 0; y < dest->height; y++) {
+        memcpy(dst + y * dest->width * 4, src + ((src_top + y) * src_width + src_left) * 4,
+               dest->width * 4);
+      }
+    }
 #else
     uint32_t* pixelDst = static_cast<uint32_t*>(dest->data);
-    uint8_t* pixelSrc = static_cast<uint8_t*>(jpeg_dec_obj_yuv420.getDecompressedImagePtr());
-    for (int i = 0; i < dest->width * dest->height; i++) {
-      *pixelDst = pixelSrc[0] | (pixelSrc[1] << 8) | (pixelSrc[2] << 16) | (0xff << 24);
-      pixelSrc += 3;
-      pixelDst += 1;
+    for (size_t y = 0; y < dest->height; y++) {
+      uint8_t* pixelSrc = static_cast<uint8_t*>(jpeg_dec_obj_yuv420.getDecompressedImagePtr()) +
+                          ((src_top + y) * src_width + src_left) * 3;
+      for (size_t x = 0; x < dest->width; x++) {
+        *pixelDst = pixelSrc[0] | (pixelSrc[1] << 8) | (pixelSrc[2] << 16) | (0xff << 24);
+        pixelSrc += 3;
+        pixelDst += 1;
+      }
     }
 #endif
     dest->colorGamut = IccHelper::readIccColorGamut(jpeg_dec_obj_yuv420.getICCPtr(),
@@ -789,17 +1295,116 @@ status_t JpegR::decodeJPEGR(uhdr_compressed_ptr ultrahdr_image_ptr, uhdr_uncompr
 
   ultrahdr_uncompressed_struct yuv420_image;
   yuv420_image.data = jpeg_dec_obj_yuv420.getDecompressedImagePtr();
-  yuv420_image.width = jpeg_dec_obj_yuv420.getDecompressedImageWidth();
-  yuv420_image.height = jpeg_dec_obj_yuv420.getDecompressedImageHeight();
+  yuv420_image.width = primary_width;
+  yuv420_image.height = primary_height;
   yuv420_image.colorGamut = IccHelper::readIccColorGamut(jpeg_dec_obj_yuv420.getICCPtr(),
                                                          jpeg_dec_obj_yuv420.getICCSize());
+  // the region of interest in the window of the primary image that is reconstructed
+  ultrahdr_region_struct out_region;
+  const ultrahdr_region_struct* out_region_ptr = nullptr;
+  if (roi != nullptr) {
+    out_region = {roi->left - window.left, roi->top - window.top, roi->width, roi->height};
+    out_region_ptr = &out_region;
+  }
+
+  if (decode_in_bands && !is_sdr_rendition && roi == nullptr && options->useGainCodeLut &&
+      num_renditions == 0 && stats == nullptr &&
+      output_gamut == ULTRAHDR_COLORGAMUT_UNSPECIFIED &&
+      GainCodeLUT::isOutputFormatSupported(output_format)) {
+    // the color conversion of libjpeg replaces the one of applyGainMap(), the rest of the
+    // reconstruction is a table lookup per channel. The chroma is replicated as applyGainMap()
+    // does, so that the two paths only differ by the rounding of rgb and of the gains
+    jpeg_dec_obj_yuv420.setFancyUpsampling(false);
+    if (!jpeg_dec_obj_yuv420.decompressImage(primary_jpg_image_ptr->data,
+                                             primary_jpg_image_ptr->length, DECODE_TO_RGBA)) {
+      return ERROR_ULTRAHDR_DECODE_ERROR;
+    }
+    ultrahdr_uncompressed_struct rgb_image = yuv420_image;
+    rgb_image.data = jpeg_dec_obj_yuv420.getDecompressedImagePtr();
+#ifdef JCS_ALPHA_EXTENSIONS
+    const size_t bytes_per_pixel = 4;
+#else
+    const size_t bytes_per_pixel = 3;
+#endif
+    return applyGainMapLUT(&rgb_image, bytes_per_pixel, &gainmap_image, &uhdr_metadata,
+                           output_format, max_display_boost, dest);
+  }
+
+  // dest is the first rendition, the additional ones are reconstructed in the same pass
+  std::vector<ultrahdr_rendition_struct> all_renditions;
+  try {
+    all_renditions.push_back({output_format, max_display_boost, dest});
+    all_renditions.insert(all_renditions.end(), renditions, renditions + num_renditions);
+  } catch (const std::bad_alloc&) {
+    return ERROR_ULTRAHDR_INSUFFICIENT_RESOURCE;
+  }
+  // applyGainMap() adds the statistics of each band
+  if (stats != nullptr) {
+    *stats = ultrahdr_image_stats_struct();
+  }
+  ultrahdr_apply_options_struct apply_options;
+  apply_options.renditions = all_renditions.data();
+  apply_options.numRenditions = all_renditions.size();
+  apply_options.stats = stats;
+  apply_options.outputGamut = output_gamut;
+  apply_options.outRegion = out_region_ptr;
+
+  if (decode_in_bands) {
+    // reconstruct the hdr image band by band, so that only kDecodeBandHeight rows of the primary
+    // image are resident instead of the full frame
+    status_t band_status = ULTRAHDR_NO_ERROR;
+    yuv420_image.width = window.width;
+    apply_options.imageHeight = window.height;
+    jpeg_band_fn onBand = [&](const jpeg_output_planes& band, size_t rowStart,
+                              size_t rowCount) -> bool {
+      if (band.planes[1] == nullptr || band.planes[2] == nullptr) {
+        ALOGE("hdr reconstruction expects a yuv420 primary image");
+        band_status = ERROR_ULTRAHDR_DECODE_ERROR;
+        return false;
+      }
+      ultrahdr_uncompressed_struct band_image = yuv420_image;
+      band_image.data = band.planes[0];
+      band_image.chroma_data = band.planes[1];
+      band_image.luma_stride = band.strides[0];
+      band_image.chroma_stride = band.strides[1];
+      // the cr plane follows the cb plane, height is the row capacity of the band buffer
+      band_image.height = 2 * (band.planes[2] - band.planes[1]) / band.strides[1];
+      ultrahdr_apply_options_struct band_options = apply_options;
+      band_options.rowStart = rowStart;
+      band_options.rowCount = rowCount;
+      // the sdr rendition is reconstructed without the gain map
+      band_status = applyGainMap(&band_image, is_sdr_rendition ? nullptr : &gainmap_image,
+                                 &uhdr_metadata, &band_options);
+      return band_status == ULTRAHDR_NO_ERROR;
+    };
+    JpegDecoderHelper band_decoder;
+    band_decoder.setScaleDenom(scale_denom);
+    if (roi != nullptr) {
+      band_decoder.setCropRegion(window.left, window.top, window.width, window.height);
+    }
+    if (!band_decoder.decompressImageInBands(primary_jpg_image_ptr->data,
+                                             primary_jpg_image_ptr->length, kDecodeBandHeight,
+                                             onBand)) {
+      return band_status != ULTRAHDR_NO_ERROR ? band_status : ERROR_ULTRAHDR_DECODE_ERROR;
+    }
+    return ULTRAHDR_NO_ERROR;
+  }
+
   yuv420_image.luma_stride = yuv420_image.width;
   uint8_t* data = reinterpret_cast<uint8_t*>(yuv420_image.data);
   yuv420_image.chroma_data = data + yuv420_image.luma_stride * yuv420_image.height;
   yuv420_image.chroma_stride = yuv420_image.width >> 1;
-
-  ULTRAHDR_CHECK(applyGainMap(&yuv420_image, &gainmap_image, &uhdr_metadata, output_format,
-                           max_display_boost, dest));
+  // the window starts at an even position. Its height is kept, as the cr plane is located from
+  // the cb plane with it
+  yuv420_image.data = data + window.top * yuv420_image.luma_stride + window.left;
+  yuv420_image.chroma_data = reinterpret_cast<uint8_t*>(yuv420_image.chroma_data) +
+                             window.top / 2 * yuv420_image.chroma_stride + window.left / 2;
+  yuv420_image.width = window.width;
+
+  apply_options.rowCount = window.height;
+  apply_options.imageHeight = window.height;
+  ULTRAHDR_CHECK(applyGainMap(&yuv420_image, is_sdr_rendition ? nullptr : &gainmap_image,
+                              &uhdr_metadata, &apply_options));
   return ULTRAHDR_NO_ERROR;
 }
 
@@ -950,10 +1555,64 @@ status_t JpegR::parseJpegInfo(uhdr_compressed_ptr jpeg_image_ptr, j_info_ptr jpe
 // ICC v4.3 spec for ICC
 status_t JpegR::appendGainMap(uhdr_compressed_ptr primary_jpg_image_ptr,
                               uhdr_compressed_ptr gainmap_jpg_image_ptr, uhdr_exif_ptr pExif,
-                              void* pIcc, size_t icc_size, ultrahdr_metadata_ptr metadata,
+                              const void* pIcc, size_t icc_size, ultrahdr_metadata_ptr metadata,
                               uhdr_compressed_ptr dest) {
+  if (dest == nullptr) {
+    return ERROR_ULTRAHDR_BAD_PTR;
+  }
+
+  jpegr_container_struct container;
+  ULTRAHDR_CHECK(generateContainerLayout(primary_jpg_image_ptr, gainmap_jpg_image_ptr, pExif, pIcc,
+                                         icc_size, metadata, &container));
+
+  if (mOutputSink) {
+    for (const auto& segment : container.segments) {
+      if (!mOutputSink(segment.data, segment.length)) {
+        ALOGE("output sink failed to consume %zu bytes", segment.length);
+        return ERROR_ULTRAHDR_OUTPUT_SINK_ERROR;
+      }
+    }
+    dest->length = static_cast<int>(container.size);
+    return ULTRAHDR_NO_ERROR;
+  }
+
+  if (mOutputBufferAllocator) {
+    void* data = mOutputBufferAllocator(container.size);
+    if (data == nullptr) {
+      ALOGE("failed to allocate %zu bytes for the output", container.size);
+      return ERROR_ULTRAHDR_BUFFER_TOO_SMALL;
+    }
+    dest->data = data;
+    dest->maxLength = static_cast<int>(container.size);
+  }
+  if (dest->data == nullptr) {
+    return ERROR_ULTRAHDR_BAD_PTR;
+  }
+  if (dest->maxLength < 0 || container.size > static_cast<size_t>(dest->maxLength)) {
+    ALOGE("output buffer is too small, required %zu bytes, available %d bytes", container.size,
+          dest->maxLength);
+    return ERROR_ULTRAHDR_BUFFER_TOO_SMALL;
+  }
+
+  int pos = 0;
+  for (const auto& segment : container.segments) {
+    ULTRAHDR_CHECK(Write(dest, segment.data, segment.length, pos));
+  }
+
+  // Set back length
+  dest->length = pos;
+
+  // Done!
+  return ULTRAHDR_NO_ERROR;
+}
+
+status_t JpegR::generateContainerLayout(uhdr_compressed_ptr primary_jpg_image_ptr,
+                                        uhdr_compressed_ptr gainmap_jpg_image_ptr,
+                                        uhdr_exif_ptr pExif, const void* pIcc, size_t icc_size,
+                                        ultrahdr_metadata_ptr metadata,
+                                        jpegr_container_struct* container) {
   if (primary_jpg_image_ptr == nullptr || gainmap_jpg_image_ptr == nullptr || metadata == nullptr ||
-      dest == nullptr) {
+      container == nullptr) {
     return ERROR_ULTRAHDR_BAD_PTR;
   }
 
@@ -984,151 +1643,137 @@ status_t JpegR::appendGainMap(uhdr_compressed_ptr primary_jpg_image_ptr,
     return ERROR_ULTRAHDR_BAD_METADATA;
   }
 
-  const string nameSpace = "http://ns.adobe.com/xap/1.0/";
-  const int nameSpaceLength = nameSpace.size() + 1;  // need to count the null terminator
+  static const uint8_t kSoi[] = {JpegMarker::kStart, JpegMarker::kSOI};
+  // name space ("http://ns.adobe.com/xap/1.0/\0"), need to count the null terminator
+  static const char kNameSpace[] = "http://ns.adobe.com/xap/1.0/";
+  const int nameSpaceLength = sizeof(kNameSpace);
 
   // calculate secondary image length first, because the length will be written into the primary
   // image xmp
-  const string xmp_secondary = generateXmpForSecondaryImage(*metadata);
+  container->xmpSecondary = generateXmpForSecondaryImage(*metadata);
   // xmp_secondary_length = 2 bytes representing the length of the package +
   //  + nameSpaceLength = 29 bytes length
   //  + length of xmp packet = xmp_secondary.size()
-  const int xmp_secondary_length = 2 + nameSpaceLength + xmp_secondary.size();
+  const int xmp_secondary_length = 2 + nameSpaceLength + container->xmpSecondary.size();
   const int secondary_image_size = 2 /* 2 bytes length of APP1 sign */
                                    + xmp_secondary_length + gainmap_jpg_image_ptr->length;
   // primary image
-  const string xmp_primary = generateXmpForPrimaryImage(secondary_image_size, *metadata);
+  container->xmpPrimary = generateXmpForPrimaryImage(secondary_image_size, *metadata);
   // same as primary
-  const int xmp_primary_length = 2 + nameSpaceLength + xmp_primary.size();
+  const int xmp_primary_length = 2 + nameSpaceLength + container->xmpPrimary.size();
 
   // Check if EXIF package presents in the JPEG input.
-  // If so, extract and remove the EXIF package.
+  // If so, reference the EXIF package in place and skip it while writing the primary image.
   JpegDecoderHelper decoder;
   if (!decoder.extractEXIF(primary_jpg_image_ptr->data, primary_jpg_image_ptr->length)) {
     return ERROR_ULTRAHDR_DECODE_ERROR;
   }
+  const uint8_t* primary_data = static_cast<const uint8_t*>(primary_jpg_image_ptr->data);
   ultrahdr_exif_struct exif_from_jpg;
   exif_from_jpg.data = nullptr;
   exif_from_jpg.length = 0;
-  ultrahdr_compressed_struct new_jpg_image;
-  new_jpg_image.data = nullptr;
-  new_jpg_image.length = 0;
-  new_jpg_image.maxLength = 0;
-  new_jpg_image.colorGamut = ULTRAHDR_COLORGAMUT_UNSPECIFIED;
-  std::unique_ptr<uint8_t[]> dest_data;
+  // primary image without SOI, split around the EXIF package if present
+  jpegr_segment_struct primary_head{primary_data + 2,
+                                    static_cast<size_t>(primary_jpg_image_ptr->length - 2)};
+  jpegr_segment_struct primary_tail{nullptr, 0};
   if (decoder.getEXIFPos() >= 0) {
     if (pExif != nullptr) {
       ALOGE("received EXIF from outside while the primary image already contains EXIF");
       return ERROR_ULTRAHDR_MULTIPLE_EXIFS_RECEIVED;
     }
-    copyJpegWithoutExif(&new_jpg_image, primary_jpg_image_ptr, decoder.getEXIFPos(),
-                        decoder.getEXIFSize());
-    dest_data.reset(reinterpret_cast<uint8_t*>(new_jpg_image.data));
-    exif_from_jpg.data = decoder.getEXIFPtr();
-    exif_from_jpg.length = decoder.getEXIFSize();
+    // exif pos has 4 bytes offset to the FF sign, the byte after FF E1 XX XX <this byte>
+    const size_t exif_offset = 4;
+    const size_t exif_pos = decoder.getEXIFPos();
+    const size_t exif_size = decoder.getEXIFSize();
+    primary_head.length = exif_pos - exif_offset - 2;
+    primary_tail.data = primary_data + exif_pos + exif_size;
+    primary_tail.length = primary_jpg_image_ptr->length - exif_pos - exif_size;
+    exif_from_jpg.data = const_cast<uint8_t*>(primary_data + exif_pos);
+    exif_from_jpg.length = exif_size;
     pExif = &exif_from_jpg;
   }
 
-  uhdr_compressed_ptr final_primary_jpg_image_ptr =
-      new_jpg_image.length == 0 ? primary_jpg_image_ptr : &new_jpg_image;
+  auto addSegment = [container](const void* data, size_t length) {
+    if (length > 0) {
+      container->segments.push_back({data, length});
+      container->size += length;
+    }
+  };
+  auto addMarker = [container, &addSegment](uint8_t type, int length) {
+    uint8_t* header = container->markerHeaders[container->numMarkerHeaders++];
+    header[0] = JpegMarker::kStart;
+    header[1] = type;
+    header[2] = ((length >> 8) & 0xff);
+    header[3] = (length & 0xff);
+    addSegment(header, 4);
+  };
 
-  int pos = 0;
   // Begin primary image
   // Write SOI
-  ULTRAHDR_CHECK(Write(dest, &photos_editing_formats::image_io::JpegMarker::kStart, 1, pos));
-  ULTRAHDR_CHECK(Write(dest, &photos_editing_formats::image_io::JpegMarker::kSOI, 1, pos));
+  addSegment(kSoi, sizeof(kSoi));
 
   // Write EXIF
   if (pExif != nullptr) {
-    const int length = 2 + pExif->length;
-    const uint8_t lengthH = ((length >> 8) & 0xff);
-    const uint8_t lengthL = (length & 0xff);
-    ULTRAHDR_CHECK(Write(dest, &photos_editing_formats::image_io::JpegMarker::kStart, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, &photos_editing_formats::image_io::JpegMarker::kAPP1, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, &lengthH, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, &lengthL, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, pExif->data, pExif->length, pos));
+    addMarker(JpegMarker::kAPP1, 2 + pExif->length);
+    addSegment(pExif->data, pExif->length);
   }
 
   // Prepare and write XMP
-  {
-    const int length = xmp_primary_length;
-    const uint8_t lengthH = ((length >> 8) & 0xff);
-    const uint8_t lengthL = (length & 0xff);
-    ULTRAHDR_CHECK(Write(dest, &photos_editing_formats::image_io::JpegMarker::kStart, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, &photos_editing_formats::image_io::JpegMarker::kAPP1, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, &lengthH, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, &lengthL, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, (void*)nameSpace.c_str(), nameSpaceLength, pos));
-    ULTRAHDR_CHECK(Write(dest, (void*)xmp_primary.c_str(), xmp_primary.size(), pos));
-  }
+  addMarker(JpegMarker::kAPP1, xmp_primary_length);
+  addSegment(kNameSpace, nameSpaceLength);
+  addSegment(container->xmpPrimary.c_str(), container->xmpPrimary.size());
 
   // Write ICC
   if (pIcc != nullptr && icc_size > 0) {
-    const int length = icc_size + 2;
-    const uint8_t lengthH = ((length >> 8) & 0xff);
-    const uint8_t lengthL = (length & 0xff);
-    ULTRAHDR_CHECK(Write(dest, &photos_editing_formats::image_io::JpegMarker::kStart, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, &photos_editing_formats::image_io::JpegMarker::kAPP2, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, &lengthH, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, &lengthL, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, pIcc, icc_size, pos));
+    addMarker(JpegMarker::kAPP2, icc_size + 2);
+    addSegment(pIcc, icc_size);
   }
 
   // Prepare and write MPF
   {
     const int length = 2 + calculateMpfSize();
-    const uint8_t lengthH = ((length >> 8) & 0xff);
-    const uint8_t lengthL = (length & 0xff);
-    int primary_image_size = pos + length + final_primary_jpg_image_ptr->length;
+    const int pos = container->size;
+    int primary_image_size = pos + 2 + length + primary_head.length + primary_tail.length;
     // between APP2 + package size + signature
     // ff e2 00 58 4d 50 46 00
     // 2 + 2 + 4 = 8 (bytes)
     // and ff d8 sign of the secondary image
     int secondary_image_offset = primary_image_size - pos - 8;
-    std::shared_ptr<DataStruct> mpf = generateMpf(primary_image_size, 0, /* primary_image_offset */
-                                                  secondary_image_size, secondary_image_offset);
-    ULTRAHDR_CHECK(Write(dest, &photos_editing_formats::image_io::JpegMarker::kStart, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, &photos_editing_formats::image_io::JpegMarker::kAPP2, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, &lengthH, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, &lengthL, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, (void*)mpf->getData(), mpf->getLength(), pos));
+    container->mpf = generateMpf(primary_image_size, 0, /* primary_image_offset */
+                                 secondary_image_size, secondary_image_offset);
+    addMarker(JpegMarker::kAPP2, length);
+    addSegment(container->mpf->getData(), container->mpf->getLength());
   }
 
   // Write primary image
-  ULTRAHDR_CHECK(Write(dest, (uint8_t*)final_primary_jpg_image_ptr->data + 2,
-                    final_primary_jpg_image_ptr->length - 2, pos));
+  addSegment(primary_head.data, primary_head.length);
+  addSegment(primary_tail.data, primary_tail.length);
   // Finish primary image
 
   // Begin secondary image (gain map)
   // Write SOI
-  ULTRAHDR_CHECK(Write(dest, &photos_editing_formats::image_io::JpegMarker::kStart, 1, pos));
-  ULTRAHDR_CHECK(Write(dest, &photos_editing_formats::image_io::JpegMarker::kSOI, 1, pos));
+  addSegment(kSoi, sizeof(kSoi));
 
   // Prepare and write XMP
-  {
-    const int length = xmp_secondary_length;
-    const uint8_t lengthH = ((length >> 8) & 0xff);
-    const uint8_t lengthL = (length & 0xff);
-    ULTRAHDR_CHECK(Write(dest, &photos_editing_formats::image_io::JpegMarker::kStart, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, &photos_editing_formats::image_io::JpegMarker::kAPP1, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, &lengthH, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, &lengthL, 1, pos));
-    ULTRAHDR_CHECK(Write(dest, (void*)nameSpace.c_str(), nameSpaceLength, pos));
-    ULTRAHDR_CHECK(Write(dest, (void*)xmp_secondary.c_str(), xmp_secondary.size(), pos));
-  }
+  addMarker(JpegMarker::kAPP1, xmp_secondary_length);
+  addSegment(kNameSpace, nameSpaceLength);
+  addSegment(container->xmpSecondary.c_str(), container->xmpSecondary.size());
 
   // Write secondary image
-  ULTRAHDR_CHECK(Write(dest, (uint8_t*)gainmap_jpg_image_ptr->data + 2,
-                    gainmap_jpg_image_ptr->length - 2, pos));
-
-  // Set back length
-  dest->length = pos;
+  addSegment(static_cast<const uint8_t*>(gainmap_jpg_image_ptr->data) + 2,
+             gainmap_jpg_image_ptr->length - 2);
 
-  // Done!
   return ULTRAHDR_NO_ERROR;
 }
 
+void JpegR::setOutputBufferAllocator(std::function<void*(size_t)> allocator) {
+  mOutputBufferAllocator = std::move(allocator);
+}
+
+void JpegR::setOutputSink(std::function<bool(const void*, size_t)> sink) {
+  mOutputSink = std::move(sink);
+}
+
 status_t JpegR::convertYuv(uhdr_uncompressed_ptr image, ultrahdr_color_gamut src_encoding,
                            ultrahdr_color_gamut dest_encoding) {
   if (image == nullptr) {
@@ -60,9 +60,11 @@ DataStruct::~DataStruct() {
 
 void* DataStruct::getData() { return data; }
 
-int DataStruct::getLength() { return length; }
+const void* DataStruct::getData() const { return data; }
 
-int DataStruct::getBytesWritten() { return writePos; }
+int DataStruct::getLength() const { return length; }
+
+int DataStruct::getBytesWritten() const { return writePos; }
 
 bool DataStruct::write8(uint8_t value) {
   uint8_t v = value;
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <cstring>
+
 #include "ultrahdr/multipictureformat.h"
 
 namespace ultrahdr {
@@ -89,4 +91,49 @@ std::shared_ptr<DataStruct> generateMpf(int primary_image_size, int primary_imag
   return dataStruct;
 }
 
+bool getSecondaryImageFromMpf(const uint8_t* mpf, size_t mpf_size, uint32_t* secondary_image_size,
+                              uint32_t* secondary_image_offset) {
+  if (mpf == nullptr || mpf_size < sizeof(kMpfSig) + kMpEndianSize + sizeof(uint32_t) ||
+      memcmp(mpf, kMpfSig, sizeof(kMpfSig))) {
+    return false;
+  }
+  const uint8_t* data = mpf + sizeof(kMpfSig);
+  const size_t size = mpf_size - sizeof(kMpfSig);
+
+  bool isBigEndian;
+  if (!memcmp(data, kMpBigEndian, kMpEndianSize)) {
+    isBigEndian = true;
+  } else if (!memcmp(data, kMpLittleEndian, kMpEndianSize)) {
+    isBigEndian = false;
+  } else {
+    return false;
+  }
+  auto read16 = [&](size_t pos) -> uint16_t {
+    return isBigEndian ? (data[pos] << 8) | data[pos + 1] : (data[pos + 1] << 8) | data[pos];
+  };
+  auto read32 = [&](size_t pos) -> uint32_t {
+    return isBigEndian ? ((uint32_t)read16(pos) << 16) | read16(pos + 2)
+                       : ((uint32_t)read16(pos + 2) << 16) | read16(pos);
+  };
+
+  const size_t indexIfdOffset = read32(kMpEndianSize);
+  if (indexIfdOffset > size - sizeof(uint16_t)) return false;
+  const uint16_t tagCount = read16(indexIfdOffset);
+  for (uint16_t i = 0; i < tagCount; i++) {
+    const size_t tagPos = indexIfdOffset + sizeof(uint16_t) + i * kTagSize;
+    if (tagPos + kTagSize > size) return false;
+    if (read16(tagPos) != kMPEntryTag) continue;
+
+    const uint32_t numEntries = read32(tagPos + 4) / kMPEntrySize;
+    const size_t entryPos = static_cast<size_t>(read32(tagPos + 8)) + kMPEntrySize;
+    if (numEntries < kNumPictures || entryPos > size || size - entryPos < kMPEntrySize) {
+      return false;
+    }
+    *secondary_image_size = read32(entryPos + 4);
+    *secondary_image_offset = read32(entryPos + 8);
+    return true;
+  }
+  return false;
+}
+
 }  // namespace ultrahdr
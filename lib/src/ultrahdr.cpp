@@ -206,7 +206,11 @@ status_t UltraHdr::generateGainMap(uhdr_uncompressed_ptr yuv420_image_ptr,
   size_t map_width = image_width / kMapDimensionScaleFactor;
   size_t map_height = image_height / kMapDimensionScaleFactor;
 
-  dest->data = new uint8_t[map_width * map_height];
+  dest->data = uhdrMalloc(map_width * map_height);
+  if (dest->data == nullptr) {
+    ALOGE("failed to allocate memory for gain map");
+    return ERROR_ULTRAHDR_INSUFFICIENT_RESOURCE;
+  }
   dest->width = map_width;
   dest->height = map_height;
   dest->colorGamut = ULTRAHDR_COLORGAMUT_UNSPECIFIED;
@@ -229,6 +233,8 @@ status_t UltraHdr::generateGainMap(uhdr_uncompressed_ptr yuv420_image_ptr,
     case ULTRAHDR_TF_HLG:
 #if USE_HLG_INVOETF_LUT
       hdrInvOetf = hlgInvOetfLUT;
+#elif USE_FAST_TRANSFER_FUNCTIONS
+      hdrInvOetf = hlgInvOetfFast;
 #else
       hdrInvOetf = hlgInvOetf;
 #endif
@@ -237,6 +243,8 @@ status_t UltraHdr::generateGainMap(uhdr_uncompressed_ptr yuv420_image_ptr,
     case ULTRAHDR_TF_PQ:
 #if USE_PQ_INVOETF_LUT
       hdrInvOetf = pqInvOetfLUT;
+#elif USE_FAST_TRANSFER_FUNCTIONS
+      hdrInvOetf = pqInvOetfFast;
 #else
       hdrInvOetf = pqInvOetf;
 #endif
@@ -318,6 +326,8 @@ status_t UltraHdr::generateGainMap(uhdr_uncompressed_ptr yuv420_image_ptr,
           // We are assuming the SDR input is always sRGB transfer.
 #if USE_SRGB_INVOETF_LUT
           Color sdr_rgb = srgbInvOetfLUT(sdr_rgb_gamma);
+#elif USE_FAST_TRANSFER_FUNCTIONS
+          Color sdr_rgb = srgbInvOetfFast(sdr_rgb_gamma);
 #else
           Color sdr_rgb = srgbInvOetf(sdr_rgb_gamma);
 #endif
@@ -361,11 +371,22 @@ status_t UltraHdr::applyGainMap(uhdr_uncompressed_ptr yuv420_image_ptr,
                                 uhdr_uncompressed_ptr gainmap_image_ptr, ultrahdr_metadata_ptr metadata,
                                 ultrahdr_output_format output_format, float max_display_boost,
                                 uhdr_uncompressed_ptr dest) {
-  if (yuv420_image_ptr == nullptr || gainmap_image_ptr == nullptr || metadata == nullptr ||
-      dest == nullptr || yuv420_image_ptr->data == nullptr ||
-      yuv420_image_ptr->chroma_data == nullptr || gainmap_image_ptr->data == nullptr) {
+  if (yuv420_image_ptr == nullptr) {
     return ERROR_ULTRAHDR_BAD_PTR;
   }
+  ultrahdr_rendition_struct rendition{output_format, max_display_boost, dest};
+  ultrahdr_apply_options_struct options;
+  options.rowCount = yuv420_image_ptr->height;
+  options.imageHeight = yuv420_image_ptr->height;
+  options.renditions = &rendition;
+  options.numRenditions = 1;
+  return applyGainMap(yuv420_image_ptr, gainmap_image_ptr, metadata, &options);
+}
+
+// Checks that the gain map and its metadata can be applied to an image of the given dimensions. A
+// missing gain map only has its metadata checked.
+static status_t isGainMapApplicable(ultrahdr_metadata_ptr metadata, size_t width, size_t height,
+                                    uhdr_uncompressed_ptr gainmap_image_ptr) {
   if (metadata->version.compare(kGainMapVersion)) {
     ALOGE("Unsupported metadata version: %s", metadata->version.c_str());
     return ERROR_ULTRAHDR_BAD_METADATA;
@@ -384,132 +405,478 @@ status_t UltraHdr::applyGainMap(uhdr_uncompressed_ptr yuv420_image_ptr,
           metadata->hdrCapacityMax);
     return ERROR_ULTRAHDR_BAD_METADATA;
   }
+  if (gainmap_image_ptr == nullptr) {
+    return ULTRAHDR_NO_ERROR;
+  }
 
-  if (yuv420_image_ptr->width % gainmap_image_ptr->width != 0 ||
-      yuv420_image_ptr->height % gainmap_image_ptr->height != 0) {
+  if (width % gainmap_image_ptr->width != 0 || height % gainmap_image_ptr->height != 0) {
     ALOGE(
         "gain map dimensions scale factor value is not an integer, primary image resolution is "
         "%zux%zu, received gain map resolution is %zux%zu",
-        yuv420_image_ptr->width, yuv420_image_ptr->height, gainmap_image_ptr->width,
-        gainmap_image_ptr->height);
+        width, height, gainmap_image_ptr->width, gainmap_image_ptr->height);
     return ERROR_ULTRAHDR_UNSUPPORTED_MAP_SCALE_FACTOR;
   }
 
-  if (yuv420_image_ptr->width * gainmap_image_ptr->height !=
-      yuv420_image_ptr->height * gainmap_image_ptr->width) {
+  if (width * gainmap_image_ptr->height != height * gainmap_image_ptr->width) {
     ALOGE(
         "gain map dimensions scale factor values for height and width are different, \n primary "
         "image resolution is %zux%zu, received gain map resolution is %zux%zu",
-        yuv420_image_ptr->width, yuv420_image_ptr->height, gainmap_image_ptr->width,
-        gainmap_image_ptr->height);
+        width, height, gainmap_image_ptr->width, gainmap_image_ptr->height);
     return ERROR_ULTRAHDR_UNSUPPORTED_MAP_SCALE_FACTOR;
   }
+  return ULTRAHDR_NO_ERROR;
+}
+
+// Packs one pixel of a reconstructed HDR image in to dest, as laid out for output_format
+static inline void writeHdrPixel(Color rgb_hdr, ultrahdr_output_format output_format, void* dest,
+                                 size_t pixel_idx, size_t plane_size) {
+  switch (output_format) {
+    case ULTRAHDR_OUTPUT_HDR_LINEAR: {
+      uint64_t rgba_f16 = colorToRgbaF16(rgb_hdr);
+      reinterpret_cast<uint64_t*>(dest)[pixel_idx] = rgba_f16;
+      break;
+    }
+    case ULTRAHDR_OUTPUT_HDR_LINEAR_RGB_10BIT: {
+      uint16_t r = 0x3ff & static_cast<uint32_t>(rgb_hdr.r * 1023.0f);
+      uint16_t g = 0x3ff & static_cast<uint32_t>(rgb_hdr.g * 1023.0f);
+      uint16_t b = 0x3ff & static_cast<uint32_t>(rgb_hdr.b * 1023.0f);
+      reinterpret_cast<uint16_t*>(dest)[                 pixel_idx] = r;
+      reinterpret_cast<uint16_t*>(dest)[plane_size +     pixel_idx] = g;
+      reinterpret_cast<uint16_t*>(dest)[plane_size * 2 + pixel_idx] = b;
+      break;
+    }
+    case ULTRAHDR_OUTPUT_HDR_HLG: {
+      uint32_t rgba_1010102 = hlgColorToRgba1010102LUT(rgb_hdr);
+      reinterpret_cast<uint32_t*>(dest)[pixel_idx] = rgba_1010102;
+      break;
+    }
+    case ULTRAHDR_OUTPUT_HDR_PQ: {
+      uint32_t rgba_1010102 = pqColorToRgba1010102LUT(rgb_hdr);
+      reinterpret_cast<uint32_t*>(dest)[pixel_idx] = rgba_1010102;
+      break;
+    }
+    default: {
+    }
+      // Should be impossible to hit after input validation.
+  }
+}
+
+// Writes one pixel of a reconstructed HDR image to a P010 output
+static inline void writeP010Pixel(Color rgb_hdr, ultrahdr_output_format output_format,
+                                  P010Writer* writer, size_t x, size_t y) {
+  Color rgb_gamma_hdr;
+  if (output_format == ULTRAHDR_OUTPUT_HDR_HLG_P010) {
+#if USE_HLG_OETF_LUT
+    rgb_gamma_hdr = hlgOetfLUT(rgb_hdr);
+#elif USE_FAST_TRANSFER_FUNCTIONS
+    rgb_gamma_hdr = hlgOetfFast(rgb_hdr);
+#else
+    rgb_gamma_hdr = hlgOetf(rgb_hdr);
+#endif
+  } else {
+#if USE_PQ_OETF_LUT
+    rgb_gamma_hdr = pqOetfLUT(rgb_hdr);
+#elif USE_FAST_TRANSFER_FUNCTIONS
+    rgb_gamma_hdr = pqOetfFast(rgb_hdr);
+#else
+    rgb_gamma_hdr = pqOetf(rgb_hdr);
+#endif
+  }
+  writer->putPixel(x, y, bt2100RgbToYuv(rgb_gamma_hdr));
+}
+
+status_t UltraHdr::applyGainMap(uhdr_uncompressed_ptr yuv420_band_ptr,
+                                uhdr_uncompressed_ptr gainmap_image_ptr, ultrahdr_metadata_ptr metadata,
+                                const ultrahdr_apply_options_struct* options) {
+  if (yuv420_band_ptr == nullptr || metadata == nullptr || options == nullptr ||
+      options->renditions == nullptr || yuv420_band_ptr->data == nullptr ||
+      yuv420_band_ptr->chroma_data == nullptr ||
+      (gainmap_image_ptr != nullptr && gainmap_image_ptr->data == nullptr)) {
+    return ERROR_ULTRAHDR_BAD_PTR;
+  }
+  const size_t row_start = options->rowStart;
+  const size_t row_count = options->rowCount;
+  const size_t image_height = options->imageHeight;
+  ultrahdr_rendition_ptr renditions = options->renditions;
+  const size_t num_renditions = options->numRenditions;
+  ultrahdr_image_stats_ptr stats = options->stats;
+  const ultrahdr_color_gamut output_gamut = options->outputGamut;
+  const ultrahdr_region_struct* out_region = options->outRegion;
+  if (gainmap_image_ptr == nullptr && stats != nullptr) {
+    ALOGE("statistics are gathered over the gain map, but received no gain map");
+    return ERROR_ULTRAHDR_UNSUPPORTED_FEATURE;
+  }
+  if (num_renditions == 0) {
+    ALOGE("received no renditions to reconstruct");
+    return ERROR_ULTRAHDR_INVALID_OUTPUT_FORMAT;
+  }
+  bool has_p010_output = false;
+  for (size_t i = 0; i < num_renditions; i++) {
+    if (renditions[i].dest == nullptr) {
+      return ERROR_ULTRAHDR_BAD_PTR;
+    }
+    if (renditions[i].outputFormat <= ULTRAHDR_OUTPUT_SDR ||
+        renditions[i].outputFormat > ULTRAHDR_OUTPUT_MAX) {
+      ALOGE("received bad value for output format %d of rendition %zu",
+            renditions[i].outputFormat, i);
+      return ERROR_ULTRAHDR_INVALID_OUTPUT_FORMAT;
+    }
+    has_p010_output |= isP010OutputFormat(renditions[i].outputFormat);
+  }
+  if (row_start % 2 != 0 || row_count > yuv420_band_ptr->height ||
+      row_start + row_count > image_height) {
+    ALOGE("invalid band, rows [%zu, %zu) of image height %zu, band capacity %zu", row_start,
+          row_start + row_count, image_height, yuv420_band_ptr->height);
+    return ERROR_ULTRAHDR_RESOLUTION_MISMATCH;
+  }
+  if (has_p010_output && (row_start % 2 != 0 || ((row_start + row_count) % 2 != 0 &&
+                                                  row_start + row_count != image_height))) {
+    // chroma of p010 output is subsampled over row pairs, which must not be split across bands
+    ALOGE("band rows [%zu, %zu) split a row pair of the p010 output", row_start,
+          row_start + row_count);
+    return ERROR_ULTRAHDR_RESOLUTION_MISMATCH;
+  }
+  ultrahdr_region_struct region{0, 0, yuv420_band_ptr->width, image_height};
+  if (out_region != nullptr) {
+    region = *out_region;
+    if (region.width == 0 || region.height == 0 ||
+        region.left + region.width > yuv420_band_ptr->width ||
+        region.top + region.height > image_height) {
+      ALOGE("output region %zux%zu at (%zu, %zu) exceeds the image of %zux%zu", region.width,
+            region.height, region.left, region.top, yuv420_band_ptr->width, image_height);
+      return ERROR_ULTRAHDR_INVALID_CROPPING_PARAMETERS;
+    }
+    if (has_p010_output && (region.left % 2 != 0 || region.top % 2 != 0)) {
+      // the row and column pairs of the p010 chroma must be pairs of the image too
+      ALOGE("output region at (%zu, %zu) splits the chroma samples of the p010 output",
+            region.left, region.top);
+      return ERROR_ULTRAHDR_INVALID_CROPPING_PARAMETERS;
+    }
+  }
+  if (output_gamut < ULTRAHDR_COLORGAMUT_UNSPECIFIED || output_gamut > ULTRAHDR_COLORGAMUT_MAX) {
+    ALOGE("received bad value for output color gamut %d", output_gamut);
+    return ERROR_ULTRAHDR_INVALID_COLORGAMUT;
+  }
+  ULTRAHDR_CHECK(
+      isGainMapApplicable(metadata, yuv420_band_ptr->width, image_height, gainmap_image_ptr));
   // TODO: Currently map_scale_factor is of type size_t, but it could be changed to a float
   // later.
-  size_t map_scale_factor = yuv420_image_ptr->width / gainmap_image_ptr->width;
+  size_t map_scale_factor =
+      gainmap_image_ptr != nullptr ? yuv420_band_ptr->width / gainmap_image_ptr->width : 1;
+
+  // an image without color gamut information is taken to be sRGB, as the luminance below does
+  const ultrahdr_color_gamut sdr_gamut =
+      yuv420_band_ptr->colorGamut == ULTRAHDR_COLORGAMUT_UNSPECIFIED ? ULTRAHDR_COLORGAMUT_BT709
+                                                                     : yuv420_band_ptr->colorGamut;
+  ultrahdr_color_gamut hdr_gamut = yuv420_band_ptr->colorGamut;
+  ColorTransformFn gamutConversionFn = nullptr;
+  if (output_gamut != ULTRAHDR_COLORGAMUT_UNSPECIFIED) {
+    hdr_gamut = output_gamut;
+    if (output_gamut != sdr_gamut) {
+      gamutConversionFn = getHdrConversionFn(output_gamut, sdr_gamut);
+    }
+  }
+
+  const size_t plane_size = region.width * region.height;
+  std::vector<std::shared_ptr<const RenderPlan>> plans;
+  std::vector<float> display_boosts;
+  for (size_t i = 0; i < num_renditions; i++) {
+    uhdr_uncompressed_ptr dest = renditions[i].dest;
+    dest->width = region.width;
+    dest->height = region.height;
+    dest->colorGamut = hdr_gamut;
+    float display_boost = (std::min)(renditions[i].maxDisplayBoost, metadata->maxContentBoost);
+    display_boosts.push_back(display_boost);
+    if (gainmap_image_ptr == nullptr) {
+      continue;
+    }
+    std::shared_ptr<const RenderPlan> plan =
+        getRenderPlan(metadata, display_boost, map_scale_factor);
+    if (plan == nullptr) {
+      return ERROR_ULTRAHDR_INSUFFICIENT_RESOURCE;
+    }
+    plans.push_back(std::move(plan));
+  }
+
+  // only the rows of the band inside of the output region are reconstructed
+  const size_t job_start = (std::max)(row_start, region.top);
+  const size_t job_end = (std::min)(row_start + row_count, region.top + region.height);
+  if (job_start >= job_end) {
+    return ULTRAHDR_NO_ERROR;
+  }
+
+  // one upsampler per worker, each keeps the gain map rows of the job it is working on. The
+  // interpolation weights depend only on the map scale factor, so any plan's table will do
+  const int threads = (std::min)(GetCPUCoreCount(), 4);
+  std::vector<std::unique_ptr<GainMapUpsampler>> upsamplers;
+  std::unique_ptr<UniformGainTiles> tiles;
+  // gain factors of the current uniform tile, num_renditions entries per worker
+  std::vector<float> tile_gain_factors;
+  // statistics are accumulated per worker and merged once all rows are done
+  std::vector<ultrahdr_image_stats_struct> thread_stats;
+  // p010 writers, num_renditions entries per worker, nullptr for the other output formats
+  std::vector<std::unique_ptr<P010Writer>> p010_writers;
+  // planar float writers, one per rendition shared by the workers, nullptr for the other formats
+  std::vector<std::unique_ptr<PlanarFloatWriter>> float_writers;
+  try {
+    for (int th = 0; th < threads && gainmap_image_ptr != nullptr; th++) {
+      upsamplers.push_back(std::make_unique<GainMapUpsampler>(gainmap_image_ptr, map_scale_factor,
+                                                              plans[0]->mIdwTable));
+    }
+    // only the gain map rows that the band reads are classified
+    if (gainmap_image_ptr != nullptr) {
+      tiles = std::make_unique<UniformGainTiles>(
+          gainmap_image_ptr, job_start / map_scale_factor,
+          (job_end + map_scale_factor - 1) / map_scale_factor);
+    }
+    tile_gain_factors.resize(threads * num_renditions);
+    if (stats != nullptr) {
+      thread_stats.resize(threads);
+    }
+    p010_writers.resize(threads * num_renditions);
+    for (int th = 0; th < threads; th++) {
+      for (size_t i = 0; i < num_renditions; i++) {
+        if (isP010OutputFormat(renditions[i].outputFormat)) {
+          p010_writers[th * num_renditions + i] = std::make_unique<P010Writer>(
+              renditions[i].dest, region.width, region.height);
+        }
+      }
+    }
+    float_writers.resize(num_renditions);
+    for (size_t i = 0; i < num_renditions; i++) {
+      if (renditions[i].outputFormat == ULTRAHDR_OUTPUT_HDR_LINEAR_FLOAT_PLANAR) {
+        float_writers[i] = std::make_unique<PlanarFloatWriter>(renditions[i].dest, region.width,
+                                                               region.height);
+      }
+    }
+  } catch (const std::bad_alloc&) {
+    return ERROR_ULTRAHDR_INSUFFICIENT_RESOURCE;
+  }
+  const size_t tile_width = kGainMapTileSize * map_scale_factor;
 
-  dest->width = yuv420_image_ptr->width;
-  dest->height = yuv420_image_ptr->height;
-  dest->colorGamut = yuv420_image_ptr->colorGamut;
-  ShepardsIDW idwTable(map_scale_factor);
-  float display_boost = (std::min)(max_display_boost, metadata->maxContentBoost);
-  GainLUT gainLUT(metadata, display_boost);
+  ColorCalculationFn luminanceFn = nullptr;
+  switch (hdr_gamut) {
+    case ULTRAHDR_COLORGAMUT_P3:
+      luminanceFn = p3Luminance;
+      break;
+    case ULTRAHDR_COLORGAMUT_BT2100:
+      luminanceFn = bt2100Luminance;
+      break;
+    default:
+      luminanceFn = srgbLuminance;
+      break;
+  }
 
   JobQueue jobQueue;
-  std::function<void()> applyRecMap = [yuv420_image_ptr, gainmap_image_ptr, dest, &jobQueue,
-                                       &idwTable, output_format, &gainLUT, display_boost,
-                                       map_scale_factor, &metadata]() -> void {
-    size_t width = yuv420_image_ptr->width;
-    size_t height = yuv420_image_ptr->height;
+  std::function<void(int)> applyRecMap = [yuv420_band_ptr, row_start, plane_size, renditions,
+                                          num_renditions, &jobQueue, &upsamplers, &tiles,
+                                          &tile_gain_factors, &thread_stats, &p010_writers,
+                                          &float_writers, &region, luminanceFn,
+                                          gamutConversionFn, tile_width, map_scale_factor, &plans,
+                                          &display_boosts, &metadata](int th) -> void {
+    const size_t x_end = region.left + region.width;
+    GainMapUpsampler* upsampler = upsamplers.empty() ? nullptr : upsamplers[th].get();
+    float* tile_gain_factor = &tile_gain_factors[th * num_renditions];
+    std::unique_ptr<P010Writer>* p010_writer = &p010_writers[th * num_renditions];
+    ultrahdr_image_stats_ptr pixel_stats = thread_stats.empty() ? nullptr : &thread_stats[th];
 
     size_t rowStart, rowEnd;
     while (jobQueue.dequeueJob(rowStart, rowEnd)) {
       for (size_t y = rowStart; y < rowEnd; ++y) {
-        for (size_t x = 0; x < width; ++x) {
-          Color yuv_gamma_sdr = getYuv420Pixel(yuv420_image_ptr, x, y);
+        const size_t tile_y = y / map_scale_factor / kGainMapTileSize;
+        const float* gains = nullptr;
+        bool is_uniform = false;
+        float tile_gain = 0.0f;
+        size_t tile_end = region.left;
+        for (size_t x = region.left; x < x_end; ++x) {
+          if (x == tile_end && tiles == nullptr) {
+            // without a gain map the row is one uniform tile that the gain leaves as is
+            tile_end = x_end;
+            is_uniform = true;
+            std::fill(tile_gain_factor, tile_gain_factor + num_renditions, 1.0f);
+          } else if (x == tile_end) {
+            // Uniform tiles use one gain factor per rendition for all of their pixels, the gain
+            // map is only interpolated for the other tiles
+            const size_t tile_x = x / tile_width;
+            tile_end = (std::min)((tile_x + 1) * tile_width, x_end);
+            uint8_t value;
+            is_uniform = tiles->isUniform(tile_x, tile_y, &value);
+            if (is_uniform) {
+              tile_gain = static_cast<float>(value) / 255.0f;
+              for (size_t i = 0; i < num_renditions; i++) {
+#if USE_APPLY_GAIN_LUT
+                tile_gain_factor[i] = plans[i]->mGainLUT.getGainFactor(tile_gain);
+#else
+                tile_gain_factor[i] = computeGainFactor(tile_gain, metadata, display_boosts[i]);
+#endif
+              }
+            } else {
+              gains = upsampler->getRow(y, tile_x * kGainMapTileSize,
+                                        (tile_x + 1) * kGainMapTileSize);
+            }
+          }
+          Color yuv_gamma_sdr = getYuv420Pixel(yuv420_band_ptr, x, y - row_start);
           // Assuming the sdr image is a decoded JPEG, we should always use Rec.601 YUV coefficients
           Color rgb_gamma_sdr = p3YuvToRgb(yuv_gamma_sdr);
           // We are assuming the SDR base image is always sRGB transfer.
 #if USE_SRGB_INVOETF_LUT
           Color rgb_sdr = srgbInvOetfLUT(rgb_gamma_sdr);
+#elif USE_FAST_TRANSFER_FUNCTIONS
+          Color rgb_sdr = srgbInvOetfFast(rgb_gamma_sdr);
 #else
           Color rgb_sdr = srgbInvOetf(rgb_gamma_sdr);
 #endif
-          float gain;
-          // TODO: If map_scale_factor is guaranteed to be an integer, then remove the following.
-          if (map_scale_factor != floorf(map_scale_factor)) {
-            gain = sampleMap(gainmap_image_ptr, map_scale_factor, x, y);
-          } else {
-            gain = sampleMap(gainmap_image_ptr, map_scale_factor, x, y, idwTable);
-          }
-
+          // position in the outputs, which hold the region only
+          const size_t out_x = x - region.left;
+          const size_t out_y = y - region.top;
+          size_t pixel_idx = out_x + out_y * region.width;
+
+          for (size_t i = 0; i < num_renditions; i++) {
+            Color rgb_hdr;
+            if (is_uniform) {
+              // sdr only regions have a gain factor of 1, they are just linearized
+              rgb_hdr = tile_gain_factor[i] == 1.0f ? rgb_sdr : rgb_sdr * tile_gain_factor[i];
+            } else {
+              float gain = gains[x];
 #if USE_APPLY_GAIN_LUT
-          Color rgb_hdr = applyGainLUT(rgb_sdr, gain, gainLUT);
+              rgb_hdr = applyGainLUT(rgb_sdr, gain, plans[i]->mGainLUT);
 #else
-          Color rgb_hdr = applyGain(rgb_sdr, gain, metadata, display_boost);
+              rgb_hdr = applyGain(rgb_sdr, gain, metadata, display_boosts[i]);
 #endif
-          rgb_hdr = rgb_hdr / display_boost;
-          size_t pixel_idx = x + y * width;
-
-          switch (output_format) {
-            case ULTRAHDR_OUTPUT_HDR_LINEAR: {
-              uint64_t rgba_f16 = colorToRgbaF16(rgb_hdr);
-              reinterpret_cast<uint64_t*>(dest->data)[pixel_idx] = rgba_f16;
-              break;
             }
-            case ULTRAHDR_OUTPUT_HDR_LINEAR_RGB_10BIT: {
-              uint16_t r = 0x3ff & static_cast<uint32_t>(rgb_hdr.r * 1023.0f);
-              uint16_t g = 0x3ff & static_cast<uint32_t>(rgb_hdr.g * 1023.0f);
-              uint16_t b = 0x3ff & static_cast<uint32_t>(rgb_hdr.b * 1023.0f);
-              reinterpret_cast<uint16_t*>(dest->data)[                     pixel_idx] = r;
-              reinterpret_cast<uint16_t*>(dest->data)[width * height +     pixel_idx] = g;
-              reinterpret_cast<uint16_t*>(dest->data)[width * height * 2 + pixel_idx] = b;
-              break;
+            rgb_hdr = rgb_hdr / display_boosts[i];
+            if (gamutConversionFn != nullptr) {
+              rgb_hdr = gamutConversionFn(rgb_hdr);
             }
-            case ULTRAHDR_OUTPUT_HDR_HLG: {
-#if USE_HLG_OETF_LUT
-              ColorTransformFn hdrOetf = hlgOetfLUT;
-#else
-              ColorTransformFn hdrOetf = hlgOetf;
-#endif
-              Color rgb_gamma_hdr = hdrOetf(rgb_hdr);
-              uint32_t rgba_1010102 = colorToRgba1010102(rgb_gamma_hdr);
-              reinterpret_cast<uint32_t*>(dest->data)[pixel_idx] = rgba_1010102;
-              break;
+            // the output is normalized to the display boost, colors outside of the output gamut
+            // count as clipped, so this is checked before they are brought to its boundary
+            bool clipped = i == 0 && pixel_stats != nullptr &&
+                           (rgb_hdr.r < 0.0f || rgb_hdr.r > 1.0f || rgb_hdr.g < 0.0f ||
+                            rgb_hdr.g > 1.0f || rgb_hdr.b < 0.0f || rgb_hdr.b > 1.0f);
+            if (gamutConversionFn != nullptr) {
+              rgb_hdr.r = (std::max)(rgb_hdr.r, 0.0f);
+              rgb_hdr.g = (std::max)(rgb_hdr.g, 0.0f);
+              rgb_hdr.b = (std::max)(rgb_hdr.b, 0.0f);
             }
-            case ULTRAHDR_OUTPUT_HDR_PQ: {
-#if USE_PQ_OETF_LUT
-              ColorTransformFn hdrOetf = pqOetfLUT;
-#else
-              ColorTransformFn hdrOetf = pqOetf;
-#endif
-              Color rgb_gamma_hdr = hdrOetf(rgb_hdr);
-              uint32_t rgba_1010102 = colorToRgba1010102(rgb_gamma_hdr);
-              reinterpret_cast<uint32_t*>(dest->data)[pixel_idx] = rgba_1010102;
-              break;
+            if (i == 0 && pixel_stats != nullptr) {
+              // luminance is relative to sdr white
+              addPixelToImageStats(pixel_stats, luminanceFn(rgb_hdr) * display_boosts[0],
+                                   is_uniform ? tile_gain : gains[x], clipped);
             }
-            default: {
+            if (p010_writer[i] != nullptr) {
+              writeP010Pixel(rgb_hdr, renditions[i].outputFormat, p010_writer[i].get(), out_x,
+                             out_y);
+            } else if (float_writers[i] != nullptr) {
+              float_writers[i]->putPixel(out_x, out_y, rgb_hdr);
+            } else {
+              writeHdrPixel(rgb_hdr, renditions[i].outputFormat, renditions[i].dest->data,
+                            pixel_idx, plane_size);
             }
-              // Should be impossible to hit after input validation.
           }
         }
       }
     }
   };
 
+  std::vector<std::thread> workers;
+  for (int th = 1; th < threads; th++) {
+    workers.push_back(std::thread(applyRecMap, th));
+  }
+  size_t rowStep = threads == 1 ? job_end - job_start : map_scale_factor;
+  if (has_p010_output) {
+    // a worker writes both rows of a pair for the chroma subsampling of p010
+    rowStep += rowStep % 2;
+  }
+  for (size_t rowStart = job_start; rowStart < job_end;) {
+    size_t rowEnd = (std::min)(rowStart + rowStep, job_end);
+    jobQueue.enqueueJob(rowStart, rowEnd);
+    rowStart = rowEnd;
+  }
+  jobQueue.markQueueForEnd();
+  applyRecMap(0);
+  std::for_each(workers.begin(), workers.end(), [](std::thread& t) { t.join(); });
+  for (const ultrahdr_image_stats_struct& worker_stats : thread_stats) {
+    mergeImageStats(stats, worker_stats);
+  }
+  return ULTRAHDR_NO_ERROR;
+}
+
+status_t UltraHdr::applyGainMapLUT(uhdr_uncompressed_ptr rgb_image_ptr, size_t bytes_per_pixel,
+                                   uhdr_uncompressed_ptr gainmap_image_ptr,
+                                   ultrahdr_metadata_ptr metadata,
+                                   ultrahdr_output_format output_format, float max_display_boost,
+                                   uhdr_uncompressed_ptr dest) {
+  if (rgb_image_ptr == nullptr || gainmap_image_ptr == nullptr || metadata == nullptr ||
+      dest == nullptr || rgb_image_ptr->data == nullptr || gainmap_image_ptr->data == nullptr ||
+      dest->data == nullptr) {
+    return ERROR_ULTRAHDR_BAD_PTR;
+  }
+  if (!GainCodeLUT::isOutputFormatSupported(output_format)) {
+    ALOGE("output format %d is not supported by the gain code lut", output_format);
+    return ERROR_ULTRAHDR_INVALID_OUTPUT_FORMAT;
+  }
+  if (bytes_per_pixel != 3 && bytes_per_pixel != 4) {
+    ALOGE("received bad value for bytes per pixel %zu", bytes_per_pixel);
+    return ERROR_ULTRAHDR_UNSUPPORTED_FEATURE;
+  }
+  ULTRAHDR_CHECK(isGainMapApplicable(metadata, rgb_image_ptr->width, rgb_image_ptr->height,
+                                     gainmap_image_ptr));
+  const size_t width = rgb_image_ptr->width;
+  const size_t height = rgb_image_ptr->height;
+  const size_t map_scale_factor = width / gainmap_image_ptr->width;
+
+  dest->width = width;
+  dest->height = height;
+  dest->colorGamut = rgb_image_ptr->colorGamut;
+  const float display_boost = (std::min)(max_display_boost, metadata->maxContentBoost);
+  std::shared_ptr<const RenderPlan> plan =
+      getRenderPlan(metadata, display_boost, map_scale_factor);
+  if (plan == nullptr) {
+    return ERROR_ULTRAHDR_INSUFFICIENT_RESOURCE;
+  }
+
   const int threads = (std::min)(GetCPUCoreCount(), 4);
+  std::unique_ptr<GainCodeLUT> lut;
+  std::vector<std::unique_ptr<GainMapUpsampler>> upsamplers;
+  try {
+    lut = std::make_unique<GainCodeLUT>(metadata, display_boost, output_format);
+    for (int th = 0; th < threads; th++) {
+      upsamplers.push_back(std::make_unique<GainMapUpsampler>(gainmap_image_ptr, map_scale_factor,
+                                                              plan->mIdwTable));
+    }
+  } catch (const std::bad_alloc&) {
+    return ERROR_ULTRAHDR_INSUFFICIENT_RESOURCE;
+  }
+  const size_t dest_bytes_per_pixel = output_format == ULTRAHDR_OUTPUT_HDR_LINEAR ? 8 : 4;
+
+  JobQueue jobQueue;
+  std::function<void(int)> applyRecMap = [rgb_image_ptr, bytes_per_pixel, dest,
+                                          dest_bytes_per_pixel, width, &lut, &upsamplers,
+                                          &jobQueue](int th) -> void {
+    GainMapUpsampler& upsampler = *upsamplers[th];
+    const uint8_t* src = static_cast<const uint8_t*>(rgb_image_ptr->data);
+    uint8_t* out = static_cast<uint8_t*>(dest->data);
+    size_t rowStart, rowEnd;
+    while (jobQueue.dequeueJob(rowStart, rowEnd)) {
+      for (size_t y = rowStart; y < rowEnd; ++y) {
+        applyGainCodeLUT(src + y * width * bytes_per_pixel, bytes_per_pixel, upsampler.getRow(y),
+                         width, *lut, out + y * width * dest_bytes_per_pixel);
+      }
+    }
+  };
+
   std::vector<std::thread> workers;
-  for (int th = 0; th < threads - 1; th++) {
-    workers.push_back(std::thread(applyRecMap));
+  for (int th = 1; th < threads; th++) {
+    workers.push_back(std::thread(applyRecMap, th));
   }
-  const int rowStep = threads == 1 ? yuv420_image_ptr->height : map_scale_factor;
-  for (size_t rowStart = 0; rowStart < yuv420_image_ptr->height;) {
-    int rowEnd = (std::min)(rowStart + rowStep, yuv420_image_ptr->height);
+  const size_t rowStep = threads == 1 ? height : map_scale_factor;
+  for (size_t rowStart = 0; rowStart < height;) {
+    size_t rowEnd = (std::min)(rowStart + rowStep, height);
     jobQueue.enqueueJob(rowStart, rowEnd);
     rowStart = rowEnd;
   }
   jobQueue.markQueueForEnd();
-  applyRecMap();
+  applyRecMap(0);
   std::for_each(workers.begin(), workers.end(), [](std::thread& t) { t.join(); });
   return ULTRAHDR_NO_ERROR;
 }
@@ -560,19 +927,24 @@ status_t UltraHdr::toneMap(uhdr_uncompressed_ptr src, uhdr_uncompressed_ptr dest
 static struct heif_error writer_write(struct heif_context* ctx, const void* data, size_t size, void* userdata)
 {
   MemoryWriter* writer = static_cast<MemoryWriter*>(userdata);
-  writer->write(data, size);
+  if (!writer->write(data, size)) {
+    struct heif_error err{heif_error_Memory_allocation_error, heif_suberror_Unspecified,
+                          "failed to allocate memory for output"};
+    return err;
+  }
   struct heif_error err{heif_error_Ok, heif_suberror_Unspecified, nullptr};
   return err;
 }
 
-void UltraHdr::createOutputMemory(int size, void*& dest) {
+void UltraHdr::createOutputMemory(size_t size, void*& dest) {
   if (dest != nullptr) {
     return;
   }
-  dest = new uint8_t[size];
-  std::shared_ptr<uint8_t[]> dest_data;
-  dest_data.reset(reinterpret_cast<uint8_t*>(dest));
-  shared_output_data.push_back(dest_data);
+  dest = uhdrMalloc(size);
+  if (dest == nullptr) {
+    throw std::bad_alloc();
+  }
+  shared_output_data.push_back(std::shared_ptr<uint8_t[]>(static_cast<uint8_t*>(dest), UhdrFree()));
 }
 
 status_t UltraHdr::addImage(ultrahdr_compressed_struct* image) {
@@ -592,17 +964,26 @@ status_t UltraHdr::addImage(ultrahdr_compressed_struct* image) {
       }
       if (gain_map_raw_img == nullptr || gain_map_metadata == nullptr) {
         JpegDecoderHelper jpeg_dec_obj_gainmap;
-        if (!jpeg_dec_obj_gainmap.decompressImage(gainmap_jpeg_image.data, gainmap_jpeg_image.length)) {
+        // xmp is available after parsing, decoding is needed only for the gain map image
+        if (!jpeg_dec_obj_gainmap.getCompressedImageParameters(gainmap_jpeg_image.data,
+                                                               gainmap_jpeg_image.length)) {
           return ERROR_ULTRAHDR_DECODE_ERROR;
         }
         if (gain_map_raw_img == nullptr) {
-          int size = jpeg_dec_obj_gainmap.getDecompressedImageSize();
+          size_t width = jpeg_dec_obj_gainmap.getDecompressedImageWidth();
+          size_t height = jpeg_dec_obj_gainmap.getDecompressedImageHeight();
           gain_map_raw_img = std::make_shared<ultrahdr_uncompressed_struct>();
-          gain_map_raw_img->data = new uint8_t[size];
+          gain_map_raw_img->data = new uint8_t[width * height];
           gain_map_raw_img_data.reset(reinterpret_cast<uint8_t*>(gain_map_raw_img->data));
-          memcpy(gain_map_raw_img->data, jpeg_dec_obj_gainmap.getDecompressedImagePtr(), size);
-          gain_map_raw_img->width = jpeg_dec_obj_gainmap.getDecompressedImageWidth();
-          gain_map_raw_img->height = jpeg_dec_obj_gainmap.getDecompressedImageHeight();
+          jpeg_output_planes planes{};
+          planes.planes[0] = reinterpret_cast<uint8_t*>(gain_map_raw_img->data);
+          if (!jpeg_dec_obj_gainmap.decompressImage(gainmap_jpeg_image.data,
+                                                    gainmap_jpeg_image.length, DECODE_TO_YCBCR,
+                                                    &planes)) {
+            return ERROR_ULTRAHDR_DECODE_ERROR;
+          }
+          gain_map_raw_img->width = width;
+          gain_map_raw_img->height = height;
         }
         if (gain_map_metadata == nullptr) {
           gain_map_metadata = std::make_shared<ultrahdr_metadata_struct>();
@@ -752,12 +1133,17 @@ status_t UltraHdr::addImage(ultrahdr_uncompressed_struct* image) {
   if (image == nullptr && image->data == nullptr) {
     return ERROR_ULTRAHDR_BAD_PTR;
   }
+  if (image->width > kMaxWidth || image->height > kMaxHeight) {
+    ALOGE("Image dimensions cannot be larger than %dx%d, image dimensions %zux%zu", kMaxWidth,
+          kMaxHeight, image->width, image->height);
+    return ERROR_ULTRAHDR_UNSUPPORTED_WIDTH_HEIGHT;
+  }
 
   switch (image->pixelFormat) {
     case ULTRAHDR_PIX_FMT_P010: {
       if (hdr_raw_img == nullptr) {
         hdr_raw_img = std::make_shared<ultrahdr_uncompressed_struct>();
-        int size = image->width * image->height * 3;
+        size_t size = image->width * image->height * 3;
         hdr_raw_img->width = image->width;
         hdr_raw_img->height = image->height;
         hdr_raw_img->colorGamut = image->colorGamut;
@@ -780,7 +1166,7 @@ status_t UltraHdr::addImage(ultrahdr_uncompressed_struct* image) {
     case ULTRAHDR_PIX_FMT_YUV420: {
       if (sdr_raw_img == nullptr) {
         sdr_raw_img = std::make_shared<ultrahdr_uncompressed_struct>();
-        int size = image->width * image->height * 3 / 2;
+        size_t size = image->width * image->height * 3 / 2;
         sdr_raw_img->width = image->width;
         sdr_raw_img->height = image->height;
         sdr_raw_img->colorGamut = image->colorGamut;
@@ -1214,7 +1600,7 @@ status_t UltraHdr::convert(ultrahdr_configuration* config, uhdr_compressed_ptr &
       createOutputMemory(MAX_BUFFER_SIZE, dest->data);
       dest->maxLength = MAX_BUFFER_SIZE;
 
-      int size = sdr_raw_img->width * sdr_raw_img->height * 8;
+      size_t size = sdr_raw_img->width * sdr_raw_img->height * 8;
       ultrahdr_uncompressed_struct rgba_temp;
       rgba_temp.data = new uint8_t[size];
       std::unique_ptr<uint8_t[]> rgba_temp_data;
@@ -1324,7 +1710,7 @@ status_t UltraHdr::convert(ultrahdr_configuration* config, uhdr_uncompressed_ptr
         std::unique_ptr<uint8_t[]> after_effects_data;
         after_effects_data.reset(reinterpret_cast<uint8_t*>(after_effects.data));
         addEffects(sdr_raw_img.get(), config->effects, &after_effects);
-        int size = after_effects.width * after_effects.height * 3 / 2;
+        size_t size = after_effects.width * after_effects.height * 3 / 2;
         createOutputMemory(size, dest->data);
         dest->width = after_effects.width;
         dest->height = after_effects.height;
@@ -1349,7 +1735,7 @@ status_t UltraHdr::convert(ultrahdr_configuration* config, uhdr_uncompressed_ptr
       }
 
       if (sdr_heif_img != nullptr){
-        int size = sdr_raw_img->width * sdr_raw_img->height * 4;
+        size_t size = sdr_raw_img->width * sdr_raw_img->height * 4;
         createOutputMemory(size, dest->data);
         HeifR decoder;
         return decoder.decodeHeifWithGainMap(sdr_heif_img.get(), dest, config->maxDisplayBoost, nullptr, ULTRAHDR_OUTPUT_SDR);
@@ -1369,7 +1755,7 @@ status_t UltraHdr::convert(ultrahdr_configuration* config, uhdr_uncompressed_ptr
         return ERROR_ULTRAHDR_INSUFFICIENT_RESOURCE;
       }
 
-      int size = sdr_raw_img->width * sdr_raw_img->height * 8;
+      size_t size = sdr_raw_img->width * sdr_raw_img->height * 8;
       createOutputMemory(size, dest->data);
 
       if (config->effects.empty()) {
@@ -1404,7 +1790,7 @@ status_t UltraHdr::convert(ultrahdr_configuration* config, uhdr_uncompressed_ptr
         return ERROR_ULTRAHDR_INSUFFICIENT_RESOURCE;
       }
 
-      int size = sdr_raw_img->width * sdr_raw_img->height * 4;
+      size_t size = sdr_raw_img->width * sdr_raw_img->height * 4;
       createOutputMemory(size, dest->data);
 
       ultrahdr_output_format output_format = ULTRAHDR_OUTPUT_HDR_PQ;
@@ -1449,16 +1835,31 @@ status_t UltraHdr::maybeDecodeJpegSdr() {
   }
 
   JpegDecoderHelper jpeg_dec_obj_yuv420;
-  if (!jpeg_dec_obj_yuv420.decompressImage(sdr_jpeg_img->data, sdr_jpeg_img->length)) {
+  if (!jpeg_dec_obj_yuv420.getCompressedImageParameters(sdr_jpeg_img->data,
+                                                        sdr_jpeg_img->length)) {
     return ERROR_ULTRAHDR_DECODE_ERROR;
   }
-  int size = jpeg_dec_obj_yuv420.getDecompressedImageSize();
+  size_t width = jpeg_dec_obj_yuv420.getDecompressedImageWidth();
+  size_t height = jpeg_dec_obj_yuv420.getDecompressedImageHeight();
+  if (width > kMaxWidth || height > kMaxHeight) {
+    ALOGE("Image dimensions cannot be larger than %dx%d, image dimensions %zux%zu", kMaxWidth,
+          kMaxHeight, width, height);
+    return ERROR_ULTRAHDR_UNSUPPORTED_WIDTH_HEIGHT;
+  }
   sdr_raw_img = std::make_shared<ultrahdr_uncompressed_struct>();
-  sdr_raw_img->data = new uint8_t[size];
+  sdr_raw_img->data = new uint8_t[width * height * 3 / 2];
   sdr_raw_img_data.reset(reinterpret_cast<uint8_t*>(sdr_raw_img->data));
-  memcpy(sdr_raw_img->data, jpeg_dec_obj_yuv420.getDecompressedImagePtr(), size);
-  sdr_raw_img->width = jpeg_dec_obj_yuv420.getDecompressedImageWidth();
-  sdr_raw_img->height = jpeg_dec_obj_yuv420.getDecompressedImageHeight();
+  // decode straight into sdr_raw_img
+  jpeg_output_planes planes{};
+  planes.planes[0] = reinterpret_cast<uint8_t*>(sdr_raw_img->data);
+  planes.planes[1] = planes.planes[0] + width * height;
+  planes.planes[2] = planes.planes[1] + width * height / 4;
+  if (!jpeg_dec_obj_yuv420.decompressImage(sdr_jpeg_img->data, sdr_jpeg_img->length,
+                                           DECODE_TO_YCBCR, &planes)) {
+    return ERROR_ULTRAHDR_DECODE_ERROR;
+  }
+  sdr_raw_img->width = width;
+  sdr_raw_img->height = height;
   sdr_raw_img->colorGamut = sdr_jpeg_img->colorGamut;
   sdr_raw_img->pixelFormat = ULTRAHDR_PIX_FMT_YUV420;
 
@@ -1486,7 +1887,7 @@ status_t UltraHdr::maybeToneMapRawHdr() {
     p010_image.chroma_stride = p010_image.luma_stride;
   }
 
-  int size = p010_image.height * p010_image.width * 3 / 2;
+  size_t size = p010_image.height * p010_image.width * 3 / 2;
   sdr_raw_img = std::make_shared<ultrahdr_uncompressed_struct>();
   sdr_raw_img->data = new uint8_t[size];
   sdr_raw_img_data.reset(reinterpret_cast<uint8_t*>(sdr_raw_img->data));
@@ -14,11 +14,20 @@
  * limitations under the License.
  */
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <climits>
 #include <cstdio>
 #include <cstring>
 
 #include "ultrahdr_api.h"
 #include "ultrahdr/ultrahdrcommon.h"
+#include "ultrahdr/gainmapmath.h"
 #include "ultrahdr/jpegr.h"
 #include "ultrahdr/jpegrutils.h"
 
@@ -27,8 +36,8 @@ static const uhdr_error_info_t g_no_error = {UHDR_CODEC_OK, 0, ""};
 namespace ultrahdr {
 
 uhdr_memory_block::uhdr_memory_block(size_t capacity) {
-  m_buffer = std::make_unique<uint8_t[]>(capacity);
-  m_capacity = capacity;
+  m_buffer = uhdrMakeUnique<uint8_t>(capacity);
+  m_capacity = m_buffer ? capacity : 0;
 }
 
 uhdr_raw_image_ext::uhdr_raw_image_ext(uhdr_img_fmt_t fmt, uhdr_color_gamut_t cg,
@@ -42,12 +51,13 @@ uhdr_raw_image_ext::uhdr_raw_image_ext(uhdr_img_fmt_t fmt, uhdr_color_gamut_t cg
   this->w = w;
   this->h = h;
 
-  int aligned_width = ALIGNM(w, align_stride_to);
+  size_t aligned_width = ALIGNM(w, align_stride_to);
 
-  int bpp = 1;
+  size_t bpp = 1;
   if (fmt == UHDR_IMG_FMT_24bppYCbCrP010) {
     bpp = 2;
-  } else if (fmt == UHDR_IMG_FMT_32bppRGBA8888 || fmt == UHDR_IMG_FMT_32bppRGBA1010102) {
+  } else if (fmt == UHDR_IMG_FMT_32bppRGBA8888 || fmt == UHDR_IMG_FMT_32bppRGBA1010102 ||
+             fmt == UHDR_IMG_FMT_96bppRGBFloatPlanar) {
     bpp = 4;
   } else if (fmt == UHDR_IMG_FMT_64bppRGBAHalfFloat) {
     bpp = 8;
@@ -57,11 +67,14 @@ uhdr_raw_image_ext::uhdr_raw_image_ext(uhdr_img_fmt_t fmt, uhdr_color_gamut_t cg
   size_t plane_2_sz;
   size_t plane_3_sz;
   if (fmt == UHDR_IMG_FMT_24bppYCbCrP010) {
-    plane_2_sz = (2 /* planes */ * ((aligned_width / 2) * (h / 2) * bpp));
+    plane_2_sz = (2 /* planes */ * ((aligned_width / 2) * ((h + 1) / 2) * bpp));
     plane_3_sz = 0;
   } else if (fmt == UHDR_IMG_FMT_12bppYCbCr420) {
     plane_2_sz = (((aligned_width / 2) * (h / 2) * bpp));
     plane_3_sz = (((aligned_width / 2) * (h / 2) * bpp));
+  } else if (fmt == UHDR_IMG_FMT_96bppRGBFloatPlanar) {
+    plane_2_sz = plane_1_sz;
+    plane_3_sz = plane_1_sz;
   } else {
     plane_2_sz = 0;
     plane_3_sz = 0;
@@ -72,7 +85,14 @@ uhdr_raw_image_ext::uhdr_raw_image_ext(uhdr_img_fmt_t fmt, uhdr_color_gamut_t cg
   uint8_t* data = this->m_block->m_buffer.get();
   this->planes[UHDR_PLANE_Y] = data;
   this->stride[UHDR_PLANE_Y] = aligned_width;
-  if (fmt == UHDR_IMG_FMT_24bppYCbCrP010) {
+  if (data == nullptr) {
+    // allocation failure, callers check planes[UHDR_PLANE_Y]
+    this->stride[UHDR_PLANE_Y] = 0;
+    this->planes[UHDR_PLANE_U] = nullptr;
+    this->stride[UHDR_PLANE_U] = 0;
+    this->planes[UHDR_PLANE_V] = nullptr;
+    this->stride[UHDR_PLANE_V] = 0;
+  } else if (fmt == UHDR_IMG_FMT_24bppYCbCrP010) {
     this->planes[UHDR_PLANE_UV] = data + plane_1_sz;
     this->stride[UHDR_PLANE_UV] = aligned_width;
     this->planes[UHDR_PLANE_V] = nullptr;
@@ -82,6 +102,11 @@ uhdr_raw_image_ext::uhdr_raw_image_ext(uhdr_img_fmt_t fmt, uhdr_color_gamut_t cg
     this->stride[UHDR_PLANE_U] = aligned_width / 2;
     this->planes[UHDR_PLANE_V] = data + plane_1_sz + plane_2_sz;
     this->stride[UHDR_PLANE_V] = aligned_width / 2;
+  } else if (fmt == UHDR_IMG_FMT_96bppRGBFloatPlanar) {
+    this->planes[UHDR_PLANE_G] = data + plane_1_sz;
+    this->stride[UHDR_PLANE_G] = aligned_width;
+    this->planes[UHDR_PLANE_B] = data + plane_1_sz + plane_2_sz;
+    this->stride[UHDR_PLANE_B] = aligned_width;
   } else {
     this->planes[UHDR_PLANE_U] = nullptr;
     this->stride[UHDR_PLANE_U] = 0;
@@ -90,18 +115,67 @@ uhdr_raw_image_ext::uhdr_raw_image_ext(uhdr_img_fmt_t fmt, uhdr_color_gamut_t cg
   }
 }
 
+uhdr_raw_image_ext::uhdr_raw_image_ext(const uhdr_raw_image_t& img) : uhdr_raw_image_t(img) {}
+
 uhdr_compressed_image_ext::uhdr_compressed_image_ext(uhdr_color_gamut_t cg,
                                                      uhdr_color_transfer_t ct,
                                                      uhdr_color_range_t range, unsigned size) {
   this->m_block = std::make_unique<uhdr_memory_block_t>(size);
   this->data = this->m_block->m_buffer.get();
-  this->capacity = size;
+  this->capacity = this->m_block->m_capacity;
   this->data_sz = 0;
   this->cg = cg;
   this->ct = ct;
   this->range = range;
 }
 
+uhdr_mapped_file::~uhdr_mapped_file() {
+#ifndef _WIN32
+  if (m_is_mapped) munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+}
+
+bool uhdr_mapped_file::open(const char* filename) {
+#ifndef _WIN32
+  int fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return false;
+  }
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return false;
+  // the container is parsed front to back, let the kernel read ahead aggressively
+  madvise(addr, st.st_size, MADV_SEQUENTIAL);
+  madvise(addr, st.st_size, MADV_WILLNEED);
+  m_data = static_cast<const uint8_t*>(addr);
+  m_size = st.st_size;
+  m_is_mapped = true;
+  return true;
+#else
+  FILE* fp = fopen(filename, "rb");
+  if (fp == nullptr) return false;
+  long size = -1;
+  if (fseek(fp, 0, SEEK_END) == 0) size = ftell(fp);
+  if (size <= 0 || fseek(fp, 0, SEEK_SET) != 0) {
+    fclose(fp);
+    return false;
+  }
+  m_buffer = uhdrMakeUnique<uint8_t>(size);
+  bool ok = m_buffer && fread(m_buffer.get(), 1, size, fp) == static_cast<size_t>(size);
+  fclose(fp);
+  if (!ok) {
+    m_buffer.reset();
+    return false;
+  }
+  m_data = m_buffer.get();
+  m_size = size;
+  return true;
+#endif
+}
+
 }  // namespace ultrahdr
 
 ultrahdr::ultrahdr_pixel_format map_pix_fmt_to_internal_pix_fmt(uhdr_img_fmt_t fmt) {
@@ -170,14 +244,48 @@ ultrahdr::ultrahdr_output_format map_ct_fmt_to_internal_output_fmt(uhdr_color_tr
     return ultrahdr::ULTRAHDR_OUTPUT_HDR_HLG;
   } else if (ct == UHDR_CT_PQ && fmt == UHDR_IMG_FMT_32bppRGBA1010102) {
     return ultrahdr::ULTRAHDR_OUTPUT_HDR_PQ;
+  } else if (ct == UHDR_CT_HLG && fmt == UHDR_IMG_FMT_24bppYCbCrP010) {
+    return ultrahdr::ULTRAHDR_OUTPUT_HDR_HLG_P010;
+  } else if (ct == UHDR_CT_PQ && fmt == UHDR_IMG_FMT_24bppYCbCrP010) {
+    return ultrahdr::ULTRAHDR_OUTPUT_HDR_PQ_P010;
   } else if (ct == UHDR_CT_LINEAR && fmt == UHDR_IMG_FMT_64bppRGBAHalfFloat) {
     return ultrahdr::ULTRAHDR_OUTPUT_HDR_LINEAR;
+  } else if (ct == UHDR_CT_LINEAR && fmt == UHDR_IMG_FMT_96bppRGBFloatPlanar) {
+    return ultrahdr::ULTRAHDR_OUTPUT_HDR_LINEAR_FLOAT_PLANAR;
   } else if (ct == UHDR_CT_SRGB && fmt == UHDR_IMG_FMT_32bppRGBA8888) {
     return ultrahdr::ULTRAHDR_OUTPUT_SDR;
   }
   return ultrahdr::ULTRAHDR_OUTPUT_UNSPECIFIED;
 }
 
+// p010 outputs are subsampled over pixel pairs, their planes are allocated with an even stride
+unsigned output_img_align(uhdr_img_fmt_t fmt) { return fmt == UHDR_IMG_FMT_24bppYCbCrP010 ? 2 : 1; }
+
+uhdr_color_range_t output_img_range(uhdr_img_fmt_t fmt) {
+  return fmt == UHDR_IMG_FMT_24bppYCbCrP010 ? UHDR_CR_LIMITED_RANGE : UHDR_CR_UNSPECIFIED;
+}
+
+// Points dest at the planes of a decoder output buffer
+void set_output_img_planes(ultrahdr::uhdr_raw_image_ext_t* img,
+                           ultrahdr::uhdr_uncompressed_ptr dest) {
+  if (img->fmt == UHDR_IMG_FMT_24bppYCbCrP010) {
+    dest->data = img->planes[UHDR_PLANE_Y];
+    dest->chroma_data = img->planes[UHDR_PLANE_UV];
+    dest->luma_stride = img->stride[UHDR_PLANE_Y];
+    dest->chroma_stride = img->stride[UHDR_PLANE_UV];
+  } else if (img->fmt == UHDR_IMG_FMT_96bppRGBFloatPlanar) {
+    dest->data = img->planes[UHDR_PLANE_R];
+    dest->green_data = img->planes[UHDR_PLANE_G];
+    dest->blue_data = img->planes[UHDR_PLANE_B];
+    dest->luma_stride = img->stride[UHDR_PLANE_R];
+    dest->green_stride = img->stride[UHDR_PLANE_G];
+    dest->blue_stride = img->stride[UHDR_PLANE_B];
+  } else {
+    dest->data = img->planes[UHDR_PLANE_PACKED];
+  }
+  dest->colorGamut = ultrahdr::ULTRAHDR_COLORGAMUT_UNSPECIFIED;
+}
+
 void map_internal_error_status_to_error_info(ultrahdr::status_t internal_status,
                                              uhdr_error_info_t& status) {
   if (internal_status == ultrahdr::ULTRAHDR_NO_ERROR) {
@@ -210,6 +318,14 @@ void map_internal_error_status_to_error_info(ultrahdr::status_t internal_status,
       snprintf(status.detail, sizeof status.detail,
                "received exif from uhdr_enc_set_exif_data() while the base image intent already "
                "contains exif, unsure which one to use");
+    } else if (internal_status == ultrahdr::ERROR_ULTRAHDR_OUTPUT_SINK_ERROR) {
+      status.error_code = UHDR_CODEC_UNKNOWN_ERROR;
+      snprintf(status.detail, sizeof status.detail,
+               "output sink returned error while consuming encoded data");
+    } else if (internal_status == ultrahdr::ERROR_ULTRAHDR_INSUFFICIENT_RESOURCE) {
+      status.error_code = UHDR_CODEC_MEM_ERROR;
+      snprintf(status.detail, sizeof status.detail,
+               "failed to allocate memory for intermediate buffers");
     } else if (internal_status == ultrahdr::ERROR_ULTRAHDR_UNSUPPORTED_MAP_SCALE_FACTOR) {
       status.error_code = UHDR_CODEC_UNSUPPORTED_FEATURE;
       snprintf(status.detail, sizeof status.detail,
@@ -261,6 +377,13 @@ uhdr_error_info_t uhdr_enc_validate_and_set_compressed_img(uhdr_codec_private_t*
 
   auto entry = std::make_unique<ultrahdr::uhdr_compressed_image_ext_t>(img->cg, img->ct, img->range,
                                                                        img->data_sz);
+  if (entry->data == nullptr) {
+    status.error_code = UHDR_CODEC_MEM_ERROR;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "failed to allocate %u bytes for compressed image",
+             img->data_sz);
+    return status;
+  }
   memcpy(entry->data, img->data, img->data_sz);
   entry->data_sz = img->data_sz;
   handle->m_compressed_images.insert_or_assign(intent, std::move(entry));
@@ -268,6 +391,36 @@ uhdr_error_info_t uhdr_enc_validate_and_set_compressed_img(uhdr_codec_private_t*
   return status;
 }
 
+uhdr_error_info_t uhdr_set_allocator(uhdr_alloc_cb_t alloc_cb, uhdr_free_cb_t free_cb,
+                                     void* user_data) {
+  uhdr_error_info_t status = g_no_error;
+
+  if ((alloc_cb == nullptr) != (free_cb == nullptr)) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "received alloc_cb %p and free_cb %p, expected both to be nullptr or both to be set",
+             reinterpret_cast<void*>(alloc_cb), reinterpret_cast<void*>(free_cb));
+    return status;
+  }
+
+  ultrahdr::setAllocator(alloc_cb, free_cb, user_data);
+
+  return status;
+}
+
+uhdr_alloc_stats_t* uhdr_get_alloc_stats(uhdr_codec_private_t* codec) {
+  if (codec == nullptr) {
+    return nullptr;
+  }
+
+  ultrahdr::AllocStats& stats = codec->m_alloc_stats;
+  codec->m_alloc_stats_info.bytes_allocated = stats.mBytesAllocated.load();
+  codec->m_alloc_stats_info.peak_bytes = stats.mPeakBytesInUse.load();
+  codec->m_alloc_stats_info.num_allocations = stats.mNumAllocations.load();
+  return &codec->m_alloc_stats_info;
+}
+
 uhdr_codec_private_t* uhdr_create_encoder(void) {
   uhdr_encoder_private* handle = new uhdr_encoder_private();
 
@@ -433,6 +586,12 @@ uhdr_error_info_t uhdr_enc_set_raw_image(uhdr_codec_private_t* enc, uhdr_raw_ima
   std::unique_ptr<ultrahdr::uhdr_raw_image_ext_t> entry =
       std::make_unique<ultrahdr::uhdr_raw_image_ext_t>(img->fmt, img->cg, img->ct, img->range,
                                                        img->w, img->h, 64);
+  if (entry->planes[UHDR_PLANE_Y] == nullptr) {
+    status.error_code = UHDR_CODEC_MEM_ERROR;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "failed to allocate memory for raw image");
+    return status;
+  }
 
   if (img->fmt == UHDR_IMG_FMT_12bppYCbCr420) {
     uint8_t* y_dst = static_cast<uint8_t*>(entry->planes[UHDR_PLANE_Y]);
@@ -663,6 +822,33 @@ uhdr_error_info_t uhdr_enc_set_output_format(uhdr_codec_private_t* enc, uhdr_cod
   return status;
 }
 
+uhdr_error_info_t uhdr_enc_set_output_sink(uhdr_codec_private_t* enc, uhdr_write_cb_t write_cb,
+                                           void* user_data) {
+  uhdr_error_info_t status = g_no_error;
+
+  if (dynamic_cast<uhdr_encoder_private*>(enc) == nullptr) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "received nullptr for uhdr codec instance");
+    return status;
+  }
+
+  uhdr_encoder_private* handle = dynamic_cast<uhdr_encoder_private*>(enc);
+  if (handle->m_sailed) {
+    status.error_code = UHDR_CODEC_INVALID_OPERATION;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "An earlier call to uhdr_encode() has switched the context from configurable state to "
+             "end state. The context is no longer configurable. To reuse, call reset()");
+    return status;
+  }
+
+  handle->m_output_sink = write_cb;
+  handle->m_output_sink_user_data = write_cb == nullptr ? nullptr : user_data;
+
+  return status;
+}
+
 uhdr_error_info_t uhdr_encode(uhdr_codec_private_t* enc) {
   if (dynamic_cast<uhdr_encoder_private*>(enc) == nullptr) {
     uhdr_error_info_t status;
@@ -681,6 +867,8 @@ uhdr_error_info_t uhdr_encode(uhdr_codec_private_t* enc) {
   handle->m_sailed = true;
 
   uhdr_error_info_t& status = handle->m_encode_call_status;
+  handle->m_alloc_stats.reset();
+  ultrahdr::AllocStatsScope alloc_scope(&handle->m_alloc_stats);
 
   ultrahdr::status_t internal_status = ultrahdr::ULTRAHDR_NO_ERROR;
   if (handle->m_output_format == UHDR_CODEC_JPG) {
@@ -691,7 +879,21 @@ uhdr_error_info_t uhdr_encode(uhdr_codec_private_t* enc) {
     }
 
     ultrahdr::JpegR jpegr;
+    if (handle->m_output_sink != nullptr) {
+      jpegr.setOutputSink([handle](const void* data, size_t size) -> bool {
+        return handle->m_output_sink(handle->m_output_sink_user_data, data, size) == 0;
+      });
+    } else {
+      // the output is allocated once the exact size of the jpeg/r container is known
+      jpegr.setOutputBufferAllocator([handle](size_t size) -> void* {
+        handle->m_compressed_output_buffer =
+            std::make_unique<ultrahdr::uhdr_compressed_image_ext_t>(
+                UHDR_CG_UNSPECIFIED, UHDR_CT_UNSPECIFIED, UHDR_CR_UNSPECIFIED, size);
+        return handle->m_compressed_output_buffer->data;
+      });
+    }
     ultrahdr::ultrahdr_compressed_struct dest{};
+    dest.colorGamut = ultrahdr::ULTRAHDR_COLORGAMUT_UNSPECIFIED;
     if (handle->m_compressed_images.find(UHDR_BASE_IMG) != handle->m_compressed_images.end() &&
         handle->m_compressed_images.find(UHDR_GAIN_MAP_IMG) != handle->m_compressed_images.end()) {
       auto& base_entry = handle->m_compressed_images.find(UHDR_BASE_IMG)->second;
@@ -716,32 +918,12 @@ uhdr_error_info_t uhdr_encode(uhdr_codec_private_t* enc) {
       metadata.hdrCapacityMin = handle->m_metadata.hdr_capacity_min;
       metadata.hdrCapacityMax = handle->m_metadata.hdr_capacity_max;
 
-      size_t size = (std::max)((8 * 1024), 2 * (primary_image.length + gainmap_image.length));
-      handle->m_compressed_output_buffer =
-          std::move(std::make_unique<ultrahdr::uhdr_compressed_image_ext_t>(
-              UHDR_CG_UNSPECIFIED, UHDR_CT_UNSPECIFIED, UHDR_CR_UNSPECIFIED, size));
-
-      dest.data = handle->m_compressed_output_buffer->data;
-      dest.length = 0;
-      dest.maxLength = handle->m_compressed_output_buffer->capacity;
-      dest.colorGamut = ultrahdr::ULTRAHDR_COLORGAMUT_UNSPECIFIED;
-
       // api - 4
       internal_status = jpegr.encodeJPEGR(&primary_image, &gainmap_image, &metadata, &dest);
       map_internal_error_status_to_error_info(internal_status, status);
     } else if (handle->m_raw_images.find(UHDR_HDR_IMG) != handle->m_raw_images.end()) {
       auto& hdr_raw_entry = handle->m_raw_images.find(UHDR_HDR_IMG)->second;
 
-      size_t size = (std::max)((8u * 1024), hdr_raw_entry->w * hdr_raw_entry->h * 3 * 2);
-      handle->m_compressed_output_buffer =
-          std::move(std::make_unique<ultrahdr::uhdr_compressed_image_ext_t>(
-              UHDR_CG_UNSPECIFIED, UHDR_CT_UNSPECIFIED, UHDR_CR_UNSPECIFIED, size));
-
-      dest.data = handle->m_compressed_output_buffer->data;
-      dest.length = 0;
-      dest.maxLength = handle->m_compressed_output_buffer->capacity;
-      dest.colorGamut = ultrahdr::ULTRAHDR_COLORGAMUT_UNSPECIFIED;
-
       ultrahdr::ultrahdr_uncompressed_struct p010_image;
       p010_image.data = hdr_raw_entry->planes[UHDR_PLANE_Y];
       p010_image.width = hdr_raw_entry->w;
@@ -809,7 +991,7 @@ uhdr_error_info_t uhdr_encode(uhdr_codec_private_t* enc) {
       snprintf(status.detail, sizeof status.detail,
                "resources required for uhdr_encode() operation are not present");
     }
-    if (status.error_code == UHDR_CODEC_OK) {
+    if (status.error_code == UHDR_CODEC_OK && handle->m_compressed_output_buffer) {
       handle->m_compressed_output_buffer->data_sz = dest.length;
       handle->m_compressed_output_buffer->cg = map_internal_cg_to_cg(dest.colorGamut);
     }
@@ -831,6 +1013,51 @@ uhdr_compressed_image_t* uhdr_get_encoded_stream(uhdr_codec_private_t* enc) {
   return handle->m_compressed_output_buffer.get();
 }
 
+uhdr_error_info_t uhdr_enc_write_to_file(uhdr_codec_private_t* enc, const char* filename) {
+  uhdr_error_info_t status = g_no_error;
+
+  if (dynamic_cast<uhdr_encoder_private*>(enc) == nullptr) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "received nullptr for uhdr codec instance");
+  } else if (filename == nullptr) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "received nullptr for filename");
+  }
+  if (status.error_code != UHDR_CODEC_OK) return status;
+
+  uhdr_compressed_image_t* output = uhdr_get_encoded_stream(enc);
+  if (output == nullptr) {
+    status.error_code = UHDR_CODEC_INVALID_OPERATION;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "no encoded stream available, either uhdr_encode() was not successful or the output "
+             "was handed to the output sink");
+    return status;
+  }
+
+  FILE* fp = fopen(filename, "wb");
+  if (fp == nullptr) {
+    status.error_code = UHDR_CODEC_UNKNOWN_ERROR;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "unable to open file %s for writing", filename);
+    return status;
+  }
+  // the stream is already in one contiguous buffer, skip stdio buffering
+  setvbuf(fp, nullptr, _IONBF, 0);
+  bool ok = fwrite(output->data, 1, output->data_sz, fp) == output->data_sz;
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok) {
+    status.error_code = UHDR_CODEC_UNKNOWN_ERROR;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "unable to write encoded stream to file %s",
+             filename);
+  }
+
+  return status;
+}
+
 void uhdr_reset_encoder(uhdr_codec_private_t* enc) {
   if (dynamic_cast<uhdr_encoder_private*>(enc) != nullptr) {
     uhdr_encoder_private* handle = dynamic_cast<uhdr_encoder_private*>(enc);
@@ -845,6 +1072,8 @@ void uhdr_reset_encoder(uhdr_codec_private_t* enc) {
     handle->m_quality.emplace(UHDR_GAIN_MAP_IMG, 85);
     handle->m_exif.clear();
     handle->m_output_format = UHDR_CODEC_JPG;
+    handle->m_output_sink = nullptr;
+    handle->m_output_sink_user_data = nullptr;
 
     handle->m_sailed = false;
     handle->m_compressed_output_buffer.reset();
@@ -930,10 +1159,94 @@ uhdr_error_info_t uhdr_dec_set_image(uhdr_codec_private_t* dec, uhdr_compressed_
     return status;
   }
 
-  handle->m_uhdr_compressed_img = std::make_unique<ultrahdr::uhdr_compressed_image_ext_t>(
-      img->cg, img->ct, img->range, img->data_sz);
+  auto entry = std::make_unique<ultrahdr::uhdr_compressed_image_ext_t>(img->cg, img->ct, img->range,
+                                                                       img->data_sz);
+  if (entry->data == nullptr) {
+    status.error_code = UHDR_CODEC_MEM_ERROR;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "failed to allocate %u bytes for compressed image",
+             img->data_sz);
+    return status;
+  }
+  handle->m_uhdr_compressed_img = std::move(entry);
   memcpy(handle->m_uhdr_compressed_img->data, img->data, img->data_sz);
   handle->m_uhdr_compressed_img->data_sz = img->data_sz;
+  handle->m_mapped_file.reset();
+  handle->m_read_cb = nullptr;
+  handle->m_read_cb_user_data = nullptr;
+
+  return status;
+}
+
+uhdr_error_info_t uhdr_dec_set_image_source(uhdr_codec_private_t* dec, uhdr_read_cb_t read_cb,
+                                            void* user_data) {
+  uhdr_error_info_t status = g_no_error;
+
+  if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "received nullptr for uhdr codec instance");
+  } else if (read_cb == nullptr) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "received nullptr for read callback");
+  }
+  if (status.error_code != UHDR_CODEC_OK) return status;
+
+  uhdr_decoder_private* handle = dynamic_cast<uhdr_decoder_private*>(dec);
+  if (handle->m_probed) {
+    status.error_code = UHDR_CODEC_INVALID_OPERATION;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "An earlier call to uhdr_decode() has switched the context from configurable state to "
+             "end state. The context is no longer configurable. To reuse, call reset()");
+    return status;
+  }
+
+  handle->m_uhdr_compressed_img.reset();
+  handle->m_mapped_file.reset();
+  handle->m_read_cb = read_cb;
+  handle->m_read_cb_user_data = user_data;
+
+  return status;
+}
+
+uhdr_error_info_t uhdr_dec_set_image_from_file(uhdr_codec_private_t* dec, const char* filename) {
+  uhdr_error_info_t status = g_no_error;
+
+  if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "received nullptr for uhdr codec instance");
+  } else if (filename == nullptr) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "received nullptr for filename");
+  }
+  if (status.error_code != UHDR_CODEC_OK) return status;
+
+  uhdr_decoder_private* handle = dynamic_cast<uhdr_decoder_private*>(dec);
+  if (handle->m_probed) {
+    status.error_code = UHDR_CODEC_INVALID_OPERATION;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "An earlier call to uhdr_decode() has switched the context from configurable state to "
+             "end state. The context is no longer configurable. To reuse, call reset()");
+    return status;
+  }
+
+  auto mapped_file = std::make_unique<ultrahdr::uhdr_mapped_file_t>();
+  if (!mapped_file->open(filename)) {
+    status.error_code = UHDR_CODEC_UNKNOWN_ERROR;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "unable to open or map file %s", filename);
+    return status;
+  }
+
+  handle->m_uhdr_compressed_img.reset();
+  handle->m_mapped_file = std::move(mapped_file);
+  handle->m_read_cb = nullptr;
+  handle->m_read_cb_user_data = nullptr;
 
   return status;
 }
@@ -946,12 +1259,14 @@ uhdr_error_info_t uhdr_dec_set_out_img_format(uhdr_codec_private_t* dec, uhdr_im
     status.has_detail = 1;
     snprintf(status.detail, sizeof status.detail, "received nullptr for uhdr codec instance");
   } else if (fmt != UHDR_IMG_FMT_32bppRGBA8888 && fmt != UHDR_IMG_FMT_64bppRGBAHalfFloat &&
-             fmt != UHDR_IMG_FMT_32bppRGBA1010102) {
+             fmt != UHDR_IMG_FMT_32bppRGBA1010102 && fmt != UHDR_IMG_FMT_24bppYCbCrP010 &&
+             fmt != UHDR_IMG_FMT_96bppRGBFloatPlanar) {
     status.error_code = UHDR_CODEC_INVALID_PARAM;
     status.has_detail = 1;
     snprintf(status.detail, sizeof status.detail,
              "invalid output format %d, expects one of {UHDR_IMG_FMT_32bppRGBA8888,  "
-             "UHDR_IMG_FMT_64bppRGBAHalfFloat, UHDR_IMG_FMT_32bppRGBA1010102}",
+             "UHDR_IMG_FMT_64bppRGBAHalfFloat, UHDR_IMG_FMT_32bppRGBA1010102, "
+             "UHDR_IMG_FMT_24bppYCbCrP010, UHDR_IMG_FMT_96bppRGBFloatPlanar}",
              fmt);
   }
   if (status.error_code != UHDR_CODEC_OK) return status;
@@ -971,6 +1286,60 @@ uhdr_error_info_t uhdr_dec_set_out_img_format(uhdr_codec_private_t* dec, uhdr_im
   return status;
 }
 
+uhdr_error_info_t uhdr_dec_set_out_img_buffer(uhdr_codec_private_t* dec, uhdr_raw_image_t* img) {
+  uhdr_error_info_t status = g_no_error;
+
+  if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "received nullptr for uhdr codec instance");
+  } else if (img != nullptr && img->fmt != UHDR_IMG_FMT_96bppRGBFloatPlanar) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "invalid output buffer format %d, expects UHDR_IMG_FMT_96bppRGBFloatPlanar", img->fmt);
+  } else if (img != nullptr && (img->w == 0 || img->h == 0)) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "invalid output buffer dimensions %ux%u, expects to be > 0", img->w, img->h);
+  } else if (img != nullptr) {
+    for (int i = UHDR_PLANE_R; i <= UHDR_PLANE_B; i++) {
+      if (img->planes[i] == nullptr) {
+        status.error_code = UHDR_CODEC_INVALID_PARAM;
+        status.has_detail = 1;
+        snprintf(status.detail, sizeof status.detail,
+                 "received nullptr for plane %d of the output buffer", i);
+        break;
+      }
+      if (img->stride[i] < img->w) {
+        status.error_code = UHDR_CODEC_INVALID_PARAM;
+        status.has_detail = 1;
+        snprintf(status.detail, sizeof status.detail,
+                 "stride %u of plane %d of the output buffer is less than its width %u",
+                 img->stride[i], i, img->w);
+        break;
+      }
+    }
+  }
+  if (status.error_code != UHDR_CODEC_OK) return status;
+
+  uhdr_decoder_private* handle = dynamic_cast<uhdr_decoder_private*>(dec);
+  if (handle->m_probed) {
+    status.error_code = UHDR_CODEC_INVALID_OPERATION;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "An earlier call to uhdr_decode() has switched the context from configurable state to "
+             "end state. The context is no longer configurable. To reuse, call reset()");
+    return status;
+  }
+
+  handle->m_has_out_img_buffer = img != nullptr;
+  if (img != nullptr) handle->m_out_img_buffer = *img;
+
+  return status;
+}
+
 uhdr_error_info_t uhdr_dec_set_out_color_transfer(uhdr_codec_private_t* dec,
                                                   uhdr_color_transfer_t ct) {
   uhdr_error_info_t status = g_no_error;
@@ -1035,88 +1404,318 @@ uhdr_error_info_t uhdr_dec_set_out_max_display_boost(uhdr_codec_private_t* dec,
   return status;
 }
 
-uhdr_error_info_t uhdr_dec_probe(uhdr_codec_private_t* dec) {
+uhdr_error_info_t uhdr_dec_set_out_color_gamut(uhdr_codec_private_t* dec, uhdr_color_gamut_t cg) {
+  uhdr_error_info_t status = g_no_error;
+
   if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
-    uhdr_error_info_t status;
     status.error_code = UHDR_CODEC_INVALID_PARAM;
     status.has_detail = 1;
     snprintf(status.detail, sizeof status.detail, "received nullptr for uhdr codec instance");
-    return status;
+  } else if (cg < UHDR_CG_UNSPECIFIED || cg > UHDR_CG_BT_2100) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "invalid output color gamut %d, expects one of {UHDR_CG_UNSPECIFIED, UHDR_CG_BT_709, "
+             "UHDR_CG_DISPLAY_P3, UHDR_CG_BT_2100}",
+             cg);
   }
+  if (status.error_code != UHDR_CODEC_OK) return status;
 
   uhdr_decoder_private* handle = dynamic_cast<uhdr_decoder_private*>(dec);
-  uhdr_error_info_t& status = handle->m_probe_call_status;
-
-  if (!handle->m_probed) {
-    handle->m_probed = true;
-
-    if (handle->m_uhdr_compressed_img.get() == nullptr) {
-      status.error_code = UHDR_CODEC_INVALID_OPERATION;
-      status.has_detail = 1;
-      snprintf(status.detail, sizeof status.detail, "did not receive any image for decoding");
-      return status;
-    }
-
-    ultrahdr::jpeg_info_struct primary_image;
-    ultrahdr::jpeg_info_struct gainmap_image;
-    ultrahdr::jpegr_info_struct ultrahdr_info;
-    ultrahdr_info.primaryImgInfo = &primary_image;
-    ultrahdr_info.gainmapImgInfo = &gainmap_image;
-
-    ultrahdr::ultrahdr_compressed_struct uhdr_image;
-    uhdr_image.data = handle->m_uhdr_compressed_img->data;
-    uhdr_image.length = uhdr_image.maxLength = handle->m_uhdr_compressed_img->data_sz;
-    uhdr_image.colorGamut = map_cg_to_internal_cg(handle->m_uhdr_compressed_img->cg);
-
-    ultrahdr::JpegR jpegr;
-    ultrahdr::status_t internal_status = jpegr.getJPEGRInfo(&uhdr_image, &ultrahdr_info);
-    map_internal_error_status_to_error_info(internal_status, status);
-    if (status.error_code != UHDR_CODEC_OK) return status;
-
-    ultrahdr::ultrahdr_metadata_struct metadata;
-    if (ultrahdr::getMetadataFromXMP(gainmap_image.xmpData.data(), gainmap_image.xmpData.size(),
-                                     &metadata)) {
-      handle->m_metadata.max_content_boost = metadata.maxContentBoost;
-      handle->m_metadata.min_content_boost = metadata.minContentBoost;
-      handle->m_metadata.gamma = metadata.gamma;
-      handle->m_metadata.offset_sdr = metadata.offsetSdr;
-      handle->m_metadata.offset_hdr = metadata.offsetHdr;
-      handle->m_metadata.hdr_capacity_min = metadata.hdrCapacityMin;
-      handle->m_metadata.hdr_capacity_max = metadata.hdrCapacityMax;
-    } else {
-      status.error_code = UHDR_CODEC_UNKNOWN_ERROR;
-      status.has_detail = 1;
-      snprintf(status.detail, sizeof status.detail, "encountered error while parsing metadata");
-      return status;
-    }
-
-    handle->m_img_wd = primary_image.width;
-    handle->m_img_ht = primary_image.height;
-    handle->m_gainmap_wd = gainmap_image.width;
-    handle->m_gainmap_ht = gainmap_image.height;
-    handle->m_exif = std::move(primary_image.exifData);
-    handle->m_exif_block.data = handle->m_exif.data();
-    handle->m_exif_block.data_sz = handle->m_exif_block.capacity = handle->m_exif.size();
-    handle->m_icc = std::move(primary_image.iccData);
-    handle->m_icc_block.data = handle->m_icc.data();
-    handle->m_icc_block.data_sz = handle->m_icc_block.capacity = handle->m_icc.size();
-    handle->m_base_xmp = std::move(primary_image.xmpData);
-    handle->m_gainmap_xmp = std::move(gainmap_image.xmpData);
+  if (handle->m_probed) {
+    status.error_code = UHDR_CODEC_INVALID_OPERATION;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "An earlier call to uhdr_decode() has switched the context from configurable state to "
+             "end state. The context is no longer configurable. To reuse, call reset()");
+    return status;
   }
 
+  handle->m_output_cg = cg;
+
   return status;
 }
 
-int uhdr_dec_get_image_width(uhdr_codec_private_t* dec) {
+uhdr_error_info_t uhdr_dec_add_out_rendition(uhdr_codec_private_t* dec, uhdr_img_fmt_t fmt,
+                                             uhdr_color_transfer_t ct, float display_boost) {
+  uhdr_error_info_t status = g_no_error;
+  ultrahdr::ultrahdr_output_format output_fmt = map_ct_fmt_to_internal_output_fmt(ct, fmt);
+
   if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
-    return -1;
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "received nullptr for uhdr codec instance");
+  } else if (output_fmt == ultrahdr::ULTRAHDR_OUTPUT_UNSPECIFIED ||
+             output_fmt == ultrahdr::ULTRAHDR_OUTPUT_SDR) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "invalid rendition output format %d and color transfer %d, expects one of "
+             "{UHDR_IMG_FMT_64bppRGBAHalfFloat or UHDR_IMG_FMT_96bppRGBFloatPlanar with "
+             "UHDR_CT_LINEAR, UHDR_IMG_FMT_32bppRGBA1010102 or UHDR_IMG_FMT_24bppYCbCrP010 with "
+             "UHDR_CT_HLG or UHDR_CT_PQ}",
+             fmt, ct);
+  } else if (display_boost < 1.0f) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "invalid display boost %f, expects to be >= 1.0f}", display_boost);
   }
+  if (status.error_code != UHDR_CODEC_OK) return status;
 
   uhdr_decoder_private* handle = dynamic_cast<uhdr_decoder_private*>(dec);
-  if (!handle->m_probed || handle->m_probe_call_status.error_code != UHDR_CODEC_OK) {
-    return -1;
-  }
-
+  if (handle->m_probed) {
+    status.error_code = UHDR_CODEC_INVALID_OPERATION;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "An earlier call to uhdr_decode() has switched the context from configurable state to "
+             "end state. The context is no longer configurable. To reuse, call reset()");
+    return status;
+  }
+
+  handle->m_out_renditions.push_back({fmt, ct, display_boost});
+
+  return status;
+}
+
+uhdr_error_info_t uhdr_dec_enable_image_stats(uhdr_codec_private_t* dec, int enable) {
+  uhdr_error_info_t status = g_no_error;
+
+  if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "received nullptr for uhdr codec instance");
+    return status;
+  }
+
+  uhdr_decoder_private* handle = dynamic_cast<uhdr_decoder_private*>(dec);
+  if (handle->m_probed) {
+    status.error_code = UHDR_CODEC_INVALID_OPERATION;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "An earlier call to uhdr_decode() has switched the context from configurable state to "
+             "end state. The context is no longer configurable. To reuse, call reset()");
+    return status;
+  }
+
+  handle->m_enable_image_stats = enable != 0;
+
+  return status;
+}
+
+uhdr_error_info_t uhdr_dec_enable_gain_code_lut(uhdr_codec_private_t* dec, int enable) {
+  uhdr_error_info_t status = g_no_error;
+
+  if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "received nullptr for uhdr codec instance");
+    return status;
+  }
+
+  uhdr_decoder_private* handle = dynamic_cast<uhdr_decoder_private*>(dec);
+  if (handle->m_probed) {
+    status.error_code = UHDR_CODEC_INVALID_OPERATION;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "An earlier call to uhdr_decode() has switched the context from configurable state to "
+             "end state. The context is no longer configurable. To reuse, call reset()");
+    return status;
+  }
+
+  handle->m_enable_gain_code_lut = enable != 0;
+
+  return status;
+}
+
+uhdr_error_info_t uhdr_dec_set_scale(uhdr_codec_private_t* dec, int scale_denom) {
+  uhdr_error_info_t status = g_no_error;
+
+  if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "received nullptr for uhdr codec instance");
+  } else if (scale_denom != 1 && scale_denom != 2 && scale_denom != 4 && scale_denom != 8) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "unsupported scale denominator %d, expects one of {1, 2, 4, 8}", scale_denom);
+  }
+  if (status.error_code != UHDR_CODEC_OK) return status;
+
+  uhdr_decoder_private* handle = dynamic_cast<uhdr_decoder_private*>(dec);
+  if (handle->m_probed) {
+    status.error_code = UHDR_CODEC_INVALID_OPERATION;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "An earlier call to uhdr_decode() has switched the context from configurable state to "
+             "end state. The context is no longer configurable. To reuse, call reset()");
+    return status;
+  }
+
+  handle->m_scale_denom = scale_denom;
+
+  return status;
+}
+
+uhdr_error_info_t uhdr_dec_set_roi(uhdr_codec_private_t* dec, int x, int y, int w, int h) {
+  uhdr_error_info_t status = g_no_error;
+
+  if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "received nullptr for uhdr codec instance");
+  } else if (x < 0 || y < 0 || w <= 0 || h <= 0 || w > INT_MAX - x || h > INT_MAX - y) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "invalid region of interest %dx%d at (%d, %d), expects non-negative coordinates and "
+             "positive dimensions",
+             w, h, x, y);
+  }
+  if (status.error_code != UHDR_CODEC_OK) return status;
+
+  uhdr_decoder_private* handle = dynamic_cast<uhdr_decoder_private*>(dec);
+  if (handle->m_probed) {
+    status.error_code = UHDR_CODEC_INVALID_OPERATION;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "An earlier call to uhdr_decode() has switched the context from configurable state to "
+             "end state. The context is no longer configurable. To reuse, call reset()");
+    return status;
+  }
+
+  handle->m_has_roi = true;
+  handle->m_roi_x = x;
+  handle->m_roi_y = y;
+  handle->m_roi_wd = w;
+  handle->m_roi_ht = h;
+
+  return status;
+}
+
+// aliases the registered compressed image, either the internal copy or the mapped file
+static void set_internal_compressed_image(uhdr_decoder_private* handle,
+                                          ultrahdr::ultrahdr_compressed_struct* uhdr_image) {
+  if (handle->m_mapped_file) {
+    uhdr_image->data = const_cast<uint8_t*>(handle->m_mapped_file->m_data);
+    uhdr_image->length = uhdr_image->maxLength = handle->m_mapped_file->m_size;
+    uhdr_image->colorGamut = ultrahdr::ULTRAHDR_COLORGAMUT_UNSPECIFIED;
+  } else {
+    uhdr_image->data = handle->m_uhdr_compressed_img->data;
+    uhdr_image->length = uhdr_image->maxLength = handle->m_uhdr_compressed_img->data_sz;
+    uhdr_image->colorGamut = map_cg_to_internal_cg(handle->m_uhdr_compressed_img->cg);
+  }
+}
+
+// stores the information of the registered image that probing provides in the context
+static uhdr_error_info_t set_probed_info(uhdr_decoder_private* handle,
+                                         ultrahdr::jpeg_info_struct& primary_image,
+                                         ultrahdr::jpeg_info_struct& gainmap_image) {
+  uhdr_error_info_t status = g_no_error;
+
+  ultrahdr::ultrahdr_metadata_struct metadata;
+  if (ultrahdr::getMetadataFromXMP(gainmap_image.xmpData.data(), gainmap_image.xmpData.size(),
+                                   &metadata)) {
+    handle->m_metadata.max_content_boost = metadata.maxContentBoost;
+    handle->m_metadata.min_content_boost = metadata.minContentBoost;
+    handle->m_metadata.gamma = metadata.gamma;
+    handle->m_metadata.offset_sdr = metadata.offsetSdr;
+    handle->m_metadata.offset_hdr = metadata.offsetHdr;
+    handle->m_metadata.hdr_capacity_min = metadata.hdrCapacityMin;
+    handle->m_metadata.hdr_capacity_max = metadata.hdrCapacityMax;
+  } else {
+    status.error_code = UHDR_CODEC_UNKNOWN_ERROR;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "encountered error while parsing metadata");
+    return status;
+  }
+
+  handle->m_img_wd = primary_image.width;
+  handle->m_img_ht = primary_image.height;
+  handle->m_gainmap_wd = gainmap_image.width;
+  handle->m_gainmap_ht = gainmap_image.height;
+  handle->m_exif = std::move(primary_image.exifData);
+  handle->m_exif_block.data = handle->m_exif.data();
+  handle->m_exif_block.data_sz = handle->m_exif_block.capacity = handle->m_exif.size();
+  handle->m_icc = std::move(primary_image.iccData);
+  handle->m_icc_block.data = handle->m_icc.data();
+  handle->m_icc_block.data_sz = handle->m_icc_block.capacity = handle->m_icc.size();
+  handle->m_base_xmp = std::move(primary_image.xmpData);
+  handle->m_gainmap_xmp = std::move(gainmap_image.xmpData);
+
+  return status;
+}
+
+uhdr_error_info_t uhdr_dec_probe(uhdr_codec_private_t* dec) {
+  if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
+    uhdr_error_info_t status;
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "received nullptr for uhdr codec instance");
+    return status;
+  }
+
+  uhdr_decoder_private* handle = dynamic_cast<uhdr_decoder_private*>(dec);
+  uhdr_error_info_t& status = handle->m_probe_call_status;
+
+  if (!handle->m_probed) {
+    handle->m_probed = true;
+    handle->m_alloc_stats.reset();
+    ultrahdr::AllocStatsScope alloc_scope(&handle->m_alloc_stats);
+
+    if (handle->m_uhdr_compressed_img.get() == nullptr && handle->m_mapped_file.get() == nullptr &&
+        handle->m_read_cb == nullptr) {
+      status.error_code = UHDR_CODEC_INVALID_OPERATION;
+      status.has_detail = 1;
+      snprintf(status.detail, sizeof status.detail, "did not receive any image for decoding");
+      return status;
+    }
+
+    ultrahdr::jpeg_info_struct primary_image;
+    ultrahdr::jpeg_info_struct gainmap_image;
+    ultrahdr::jpegr_info_struct ultrahdr_info;
+    ultrahdr_info.primaryImgInfo = &primary_image;
+    ultrahdr_info.gainmapImgInfo = &gainmap_image;
+
+    ultrahdr::JpegR jpegr;
+    ultrahdr::status_t internal_status;
+    if (handle->m_read_cb != nullptr) {
+      // the gain map follows the base image in the stream, so the base image is decoded here
+      uhdr_read_cb_t read_cb = handle->m_read_cb;
+      void* user_data = handle->m_read_cb_user_data;
+      handle->m_stream_primary_dec = std::make_unique<ultrahdr::JpegDecoderHelper>();
+      handle->m_stream_primary_dec->setScaleDenom(handle->m_scale_denom);
+      internal_status = jpegr.decodePrimaryImageFromStream(
+          [read_cb, user_data](void* data, size_t size) {
+            return read_cb(user_data, data, static_cast<unsigned int>(size));
+          },
+          map_ct_fmt_to_internal_output_fmt(handle->m_output_ct, handle->m_output_fmt),
+          handle->m_stream_primary_dec.get(), &handle->m_stream_gainmap, &ultrahdr_info);
+    } else {
+      ultrahdr::ultrahdr_compressed_struct uhdr_image;
+      set_internal_compressed_image(handle, &uhdr_image);
+      internal_status = jpegr.getJPEGRInfo(&uhdr_image, &ultrahdr_info);
+    }
+    map_internal_error_status_to_error_info(internal_status, status);
+    if (status.error_code != UHDR_CODEC_OK) return status;
+
+    status = set_probed_info(handle, primary_image, gainmap_image);
+  }
+
+  return status;
+}
+
+int uhdr_dec_get_image_width(uhdr_codec_private_t* dec) {
+  if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
+    return -1;
+  }
+
+  uhdr_decoder_private* handle = dynamic_cast<uhdr_decoder_private*>(dec);
+  if (!handle->m_probed || handle->m_probe_call_status.error_code != UHDR_CODEC_OK) {
+    return -1;
+  }
+
   return handle->m_img_wd;
 }
 
@@ -1209,49 +1808,318 @@ uhdr_error_info_t uhdr_decode(uhdr_codec_private_t* dec) {
 
   uhdr_decoder_private* handle = dynamic_cast<uhdr_decoder_private*>(dec);
 
+  if (handle->m_sailed && handle->m_gainmap_only) {
+    uhdr_error_info_t status;
+    status.error_code = UHDR_CODEC_INVALID_OPERATION;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "An earlier call to uhdr_decode_gain_map() has switched the context from configurable "
+             "state to end state without decoding the image. To decode it, call reset()");
+    return status;
+  }
   if (handle->m_sailed) {
     return handle->m_decode_call_status;
   }
 
   uhdr_error_info_t& status = handle->m_decode_call_status;
+  handle->m_alloc_stats.reset();
+  ultrahdr::AllocStatsScope alloc_scope(&handle->m_alloc_stats);
   status = uhdr_dec_probe(dec);
   if (status.error_code != UHDR_CODEC_OK) return status;
 
   handle->m_sailed = true;
 
-  ultrahdr::ultrahdr_compressed_struct uhdr_image;
-  uhdr_image.data = handle->m_uhdr_compressed_img->data;
-  uhdr_image.length = uhdr_image.maxLength = handle->m_uhdr_compressed_img->data_sz;
-  uhdr_image.colorGamut = map_cg_to_internal_cg(handle->m_uhdr_compressed_img->cg);
+  // libjpeg rounds the scaled dimensions up
+  const int scale_denom = handle->m_scale_denom;
+  const int scaled_wd = (handle->m_img_wd + scale_denom - 1) / scale_denom;
+  const int scaled_ht = (handle->m_img_ht + scale_denom - 1) / scale_denom;
+  ultrahdr::ultrahdr_region_struct roi_region{
+      static_cast<size_t>(handle->m_roi_x), static_cast<size_t>(handle->m_roi_y),
+      static_cast<size_t>(handle->m_roi_wd), static_cast<size_t>(handle->m_roi_ht)};
+  const ultrahdr::ultrahdr_region_struct* roi = handle->m_has_roi ? &roi_region : nullptr;
+  if (roi != nullptr && (roi->left + roi->width > static_cast<size_t>(scaled_wd) ||
+                         roi->top + roi->height > static_cast<size_t>(scaled_ht))) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "region of interest %zux%zu at (%zu, %zu) exceeds the image dimensions %dx%d",
+             roi->width, roi->height, roi->left, roi->top, scaled_wd, scaled_ht);
+    return status;
+  }
+  if (roi != nullptr && handle->m_output_fmt == UHDR_IMG_FMT_24bppYCbCrP010 &&
+      (roi->left % 2 != 0 || roi->top % 2 != 0)) {
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail,
+             "region of interest at (%zu, %zu) does not start at an even position, which the "
+             "output format %d requires",
+             roi->left, roi->top, handle->m_output_fmt);
+    return status;
+  }
+  const int out_wd = roi != nullptr ? static_cast<int>(roi->width) : scaled_wd;
+  const int out_ht = roi != nullptr ? static_cast<int>(roi->height) : scaled_ht;
 
-  handle->m_decoded_img_buffer = std::make_unique<ultrahdr::uhdr_raw_image_ext_t>(
-      handle->m_output_fmt, UHDR_CG_UNSPECIFIED, handle->m_output_ct, UHDR_CR_UNSPECIFIED,
-      handle->m_img_wd, handle->m_img_ht, 1);
+  if (handle->m_has_out_img_buffer) {
+    const uhdr_raw_image_t& img = handle->m_out_img_buffer;
+    if (img.fmt != handle->m_output_fmt) {
+      status.error_code = UHDR_CODEC_INVALID_PARAM;
+      status.has_detail = 1;
+      snprintf(status.detail, sizeof status.detail,
+               "output buffer format %d differs from the output format %d", img.fmt,
+               handle->m_output_fmt);
+      return status;
+    }
+    if (img.w != static_cast<unsigned>(out_wd) || img.h != static_cast<unsigned>(out_ht)) {
+      status.error_code = UHDR_CODEC_INVALID_PARAM;
+      status.has_detail = 1;
+      snprintf(status.detail, sizeof status.detail,
+               "output buffer dimensions %ux%u differ from the image dimensions %dx%d", img.w,
+               img.h, out_wd, out_ht);
+      return status;
+    }
+    handle->m_decoded_img_buffer = std::make_unique<ultrahdr::uhdr_raw_image_ext_t>(img);
+    handle->m_decoded_img_buffer->cg = UHDR_CG_UNSPECIFIED;
+    handle->m_decoded_img_buffer->ct = handle->m_output_ct;
+    handle->m_decoded_img_buffer->range = output_img_range(handle->m_output_fmt);
+  } else {
+    handle->m_decoded_img_buffer = std::make_unique<ultrahdr::uhdr_raw_image_ext_t>(
+        handle->m_output_fmt, UHDR_CG_UNSPECIFIED, handle->m_output_ct,
+        output_img_range(handle->m_output_fmt), out_wd, out_ht,
+        output_img_align(handle->m_output_fmt));
+  }
+  if (handle->m_decoded_img_buffer->planes[UHDR_PLANE_Y] == nullptr) {
+    status.error_code = UHDR_CODEC_MEM_ERROR;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "failed to allocate memory for decoded images");
+    return status;
+  }
   // alias
   ultrahdr::ultrahdr_uncompressed_struct dest;
-  dest.data = handle->m_decoded_img_buffer->planes[UHDR_PLANE_PACKED];
-  dest.colorGamut = ultrahdr::ULTRAHDR_COLORGAMUT_UNSPECIFIED;
-
-  handle->m_gainmap_img_buffer = std::make_unique<ultrahdr::uhdr_raw_image_ext_t>(
-      UHDR_IMG_FMT_8bppYCbCr400, UHDR_CG_UNSPECIFIED, UHDR_CT_UNSPECIFIED, UHDR_CR_UNSPECIFIED,
-      handle->m_gainmap_wd, handle->m_gainmap_ht, 1);
+  set_output_img_planes(handle->m_decoded_img_buffer.get(), &dest);
+
+  // additional renditions, written in the same pass as dest
+  const size_t num_renditions = handle->m_out_renditions.size();
+  std::vector<ultrahdr::ultrahdr_uncompressed_struct> rendition_dests(num_renditions);
+  std::vector<ultrahdr::ultrahdr_rendition_struct> renditions(num_renditions);
+  for (size_t i = 0; i < num_renditions; i++) {
+    const ultrahdr::uhdr_out_rendition_t& config = handle->m_out_renditions[i];
+    handle->m_rendition_img_buffers.push_back(std::make_unique<ultrahdr::uhdr_raw_image_ext_t>(
+        config.fmt, UHDR_CG_UNSPECIFIED, config.ct, output_img_range(config.fmt),
+        out_wd, out_ht, output_img_align(config.fmt)));
+    if (handle->m_rendition_img_buffers[i]->planes[UHDR_PLANE_PACKED] == nullptr) {
+      status.error_code = UHDR_CODEC_MEM_ERROR;
+      status.has_detail = 1;
+      snprintf(status.detail, sizeof status.detail,
+               "failed to allocate memory for decoded renditions");
+      return status;
+    }
+    set_output_img_planes(handle->m_rendition_img_buffers[i].get(), &rendition_dests[i]);
+    renditions[i].outputFormat = map_ct_fmt_to_internal_output_fmt(config.ct, config.fmt);
+    renditions[i].maxDisplayBoost = config.max_disp_boost;
+    renditions[i].dest = &rendition_dests[i];
+  }
+
+  const ultrahdr::ultrahdr_output_format output_fmt =
+      map_ct_fmt_to_internal_output_fmt(handle->m_output_ct, handle->m_output_fmt);
+  // statistics are gathered while the gain map is applied, hence only for hdr outputs
+  ultrahdr::ultrahdr_image_stats_struct stats;
+  ultrahdr::ultrahdr_image_stats_ptr stats_ptr =
+      handle->m_enable_image_stats && output_fmt != ultrahdr::ULTRAHDR_OUTPUT_SDR ? &stats
+                                                                                  : nullptr;
+  // the gamut conversion is done while the gain map is applied, hence only for hdr outputs
+  const ultrahdr::ultrahdr_color_gamut output_cg =
+      output_fmt != ultrahdr::ULTRAHDR_OUTPUT_SDR ? map_cg_to_internal_cg(handle->m_output_cg)
+                                                  : ultrahdr::ULTRAHDR_COLORGAMUT_UNSPECIFIED;
+
+  // A display without headroom is served the sdr rendition, on which the gain map has no effect.
+  // The gain map is then decoded by uhdr_get_gain_map_image(), on request only
+  ultrahdr::ultrahdr_metadata_struct probed_metadata;
+  probed_metadata.hdrCapacityMin = handle->m_metadata.hdr_capacity_min;
+  const bool is_sdr_rendition =
+      output_fmt != ultrahdr::ULTRAHDR_OUTPUT_SDR && num_renditions == 0 && stats_ptr == nullptr &&
+      ultrahdr::isSdrRendition(&probed_metadata, handle->m_output_max_disp_boost);
   // alias
   ultrahdr::ultrahdr_uncompressed_struct dest_gainmap;
-  dest_gainmap.data = handle->m_gainmap_img_buffer->planes[UHDR_PLANE_Y];
+  if (!is_sdr_rendition) {
+    // the gain map is decoded at most at this resolution, its buffer is trimmed after decoding
+    handle->m_gainmap_img_buffer = std::make_unique<ultrahdr::uhdr_raw_image_ext_t>(
+        UHDR_IMG_FMT_8bppYCbCr400, UHDR_CG_UNSPECIFIED, UHDR_CT_UNSPECIFIED, UHDR_CR_UNSPECIFIED,
+        handle->m_gainmap_wd, handle->m_gainmap_ht, 1);
+    if (handle->m_gainmap_img_buffer->planes[UHDR_PLANE_Y] == nullptr) {
+      status.error_code = UHDR_CODEC_MEM_ERROR;
+      status.has_detail = 1;
+      snprintf(status.detail, sizeof status.detail, "failed to allocate memory for gain map image");
+      return status;
+    }
+    dest_gainmap.data = handle->m_gainmap_img_buffer->planes[UHDR_PLANE_Y];
+  }
+  ultrahdr::uhdr_uncompressed_ptr dest_gainmap_ptr = is_sdr_rendition ? nullptr : &dest_gainmap;
+
+  ultrahdr::jpegr_decode_options_struct options;
+  options.renditions = renditions.data();
+  options.numRenditions = num_renditions;
+  options.stats = stats_ptr;
+  options.outputGamut = output_cg;
+  options.useGainCodeLut = handle->m_enable_gain_code_lut;
+  options.scaleDenom = handle->m_scale_denom;
+  options.roi = roi;
 
   ultrahdr::JpegR jpegr;
-  ultrahdr::status_t internal_status = jpegr.decodeJPEGR(
-      &uhdr_image, &dest, handle->m_output_max_disp_boost, nullptr,
-      map_ct_fmt_to_internal_output_fmt(handle->m_output_ct, handle->m_output_fmt), &dest_gainmap,
-      nullptr);
+  ultrahdr::status_t internal_status;
+  if (handle->m_stream_primary_dec) {
+    ultrahdr::ultrahdr_compressed_struct gainmap_image;
+    gainmap_image.data = handle->m_stream_gainmap.data();
+    gainmap_image.length = gainmap_image.maxLength = handle->m_stream_gainmap.size();
+    internal_status = jpegr.decodeJPEGR(handle->m_stream_primary_dec.get(), &gainmap_image, &dest,
+                                        handle->m_output_max_disp_boost, nullptr, output_fmt,
+                                        dest_gainmap_ptr, nullptr, nullptr, &options);
+  } else {
+    ultrahdr::ultrahdr_compressed_struct uhdr_image;
+    set_internal_compressed_image(handle, &uhdr_image);
+    internal_status = jpegr.decodeJPEGR(&uhdr_image, &dest, handle->m_output_max_disp_boost,
+                                        nullptr, output_fmt, dest_gainmap_ptr, nullptr, &options);
+  }
   map_internal_error_status_to_error_info(internal_status, status);
   if (status.error_code == UHDR_CODEC_OK) {
+    if (dest_gainmap_ptr != nullptr) {
+      handle->m_gainmap_img_buffer->w = dest_gainmap.width;
+      handle->m_gainmap_img_buffer->h = dest_gainmap.height;
+      handle->m_gainmap_img_buffer->stride[UHDR_PLANE_Y] = dest_gainmap.width;
+    }
     handle->m_decoded_img_buffer->cg = map_internal_cg_to_cg(dest.colorGamut);
+    for (size_t i = 0; i < num_renditions; i++) {
+      handle->m_rendition_img_buffers[i]->cg = map_internal_cg_to_cg(rendition_dests[i].colorGamut);
+    }
+    if (stats_ptr != nullptr) {
+      uhdr_image_stats_t& image_stats = handle->m_image_stats;
+      image_stats.max_luminance = stats.maxLuminance;
+      image_stats.avg_luminance =
+          stats.numPixels > 0 ? static_cast<float>(stats.sumLuminance / stats.numPixels) : 0.0f;
+      image_stats.num_pixels = stats.numPixels;
+      image_stats.num_clipped_pixels = stats.numClippedPixels;
+      static_assert(UHDR_GAIN_HISTOGRAM_BINS == ultrahdr::kGainHistogramBins,
+                    "gain histogram of the api and of the library differ in size");
+      for (size_t i = 0; i < UHDR_GAIN_HISTOGRAM_BINS; i++) {
+        image_stats.gain_histogram[i] = stats.gainHistogram[i];
+      }
+      handle->m_has_image_stats = true;
+    }
   }
 
   return status;
 }
 
+uhdr_error_info_t uhdr_decode_gain_map(uhdr_codec_private_t* dec) {
+  if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
+    uhdr_error_info_t status;
+    status.error_code = UHDR_CODEC_INVALID_PARAM;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "received nullptr for uhdr codec instance");
+    return status;
+  }
+
+  uhdr_decoder_private* handle = dynamic_cast<uhdr_decoder_private*>(dec);
+
+  if (handle->m_sailed) {
+    return handle->m_decode_call_status;
+  }
+
+  uhdr_error_info_t& status = handle->m_decode_call_status;
+  handle->m_alloc_stats.reset();
+  ultrahdr::AllocStatsScope alloc_scope(&handle->m_alloc_stats);
+
+  ultrahdr::JpegR jpegr;
+  ultrahdr::JpegDecoderHelper gainmap_decoder;
+  ultrahdr::status_t internal_status;
+  const bool in_memory =
+      handle->m_uhdr_compressed_img.get() != nullptr || handle->m_mapped_file.get() != nullptr;
+  if (!handle->m_probed && handle->m_read_cb == nullptr && in_memory) {
+    // probe while decoding the gain map, the primary image is not scanned as uhdr_dec_probe() does
+    handle->m_probed = true;
+    uhdr_error_info_t& probe_status = handle->m_probe_call_status;
+
+    ultrahdr::jpeg_info_struct primary_image;
+    ultrahdr::jpeg_info_struct gainmap_image;
+    ultrahdr::jpegr_info_struct ultrahdr_info;
+    ultrahdr_info.primaryImgInfo = &primary_image;
+    ultrahdr_info.gainmapImgInfo = &gainmap_image;
+    ultrahdr::ultrahdr_compressed_struct uhdr_image;
+    set_internal_compressed_image(handle, &uhdr_image);
+    // the decode is attempted, a failure is final as for uhdr_decode()
+    handle->m_sailed = true;
+    handle->m_gainmap_only = true;
+    internal_status = jpegr.decodeGainMap(&uhdr_image, &gainmap_decoder, &ultrahdr_info);
+    map_internal_error_status_to_error_info(internal_status, probe_status);
+    if (probe_status.error_code == UHDR_CODEC_OK) {
+      probe_status = set_probed_info(handle, primary_image, gainmap_image);
+    }
+    status = probe_status;
+    if (status.error_code != UHDR_CODEC_OK) return status;
+  } else {
+    status = uhdr_dec_probe(dec);
+    if (status.error_code != UHDR_CODEC_OK) return status;
+
+    handle->m_sailed = true;
+    handle->m_gainmap_only = true;
+    if (handle->m_stream_primary_dec) {
+      // the compressed gain map was kept while probing the stream
+      if (!gainmap_decoder.decompressImage(handle->m_stream_gainmap.data(),
+                                           handle->m_stream_gainmap.size())) {
+        internal_status = ultrahdr::ERROR_ULTRAHDR_DECODE_ERROR;
+      } else {
+        internal_status = ultrahdr::ULTRAHDR_NO_ERROR;
+      }
+    } else {
+      ultrahdr::ultrahdr_compressed_struct uhdr_image;
+      set_internal_compressed_image(handle, &uhdr_image);
+      internal_status = jpegr.decodeGainMap(&uhdr_image, &gainmap_decoder);
+    }
+    map_internal_error_status_to_error_info(internal_status, status);
+    if (status.error_code != UHDR_CODEC_OK) return status;
+  }
+
+  const size_t width = gainmap_decoder.getDecompressedImageWidth();
+  const size_t height = gainmap_decoder.getDecompressedImageHeight();
+  if (width * height > gainmap_decoder.getDecompressedImageSize()) {
+    status.error_code = UHDR_CODEC_UNKNOWN_ERROR;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "decoded gain map image is truncated");
+    return status;
+  }
+  handle->m_gainmap_img_buffer = std::make_unique<ultrahdr::uhdr_raw_image_ext_t>(
+      UHDR_IMG_FMT_8bppYCbCr400, UHDR_CG_UNSPECIFIED, UHDR_CT_UNSPECIFIED, UHDR_CR_UNSPECIFIED,
+      width, height, 1);
+  uint8_t* dst = static_cast<uint8_t*>(handle->m_gainmap_img_buffer->planes[UHDR_PLANE_Y]);
+  if (dst == nullptr) {
+    status.error_code = UHDR_CODEC_MEM_ERROR;
+    status.has_detail = 1;
+    snprintf(status.detail, sizeof status.detail, "failed to allocate memory for gain map image");
+    return status;
+  }
+  // the luma plane of the decoded image, chroma of a color gain map is not returned
+  const uint8_t* src = static_cast<const uint8_t*>(gainmap_decoder.getDecompressedImagePtr());
+  const size_t dst_stride = handle->m_gainmap_img_buffer->stride[UHDR_PLANE_Y];
+  for (size_t y = 0; y < height; y++) {
+    memcpy(dst + y * dst_stride, src + y * width, width);
+  }
+
+  if (handle->m_enable_image_stats) {
+    // bin i counts the gain map samples of code i
+    memset(&handle->m_image_stats, 0, sizeof handle->m_image_stats);
+    for (size_t y = 0; y < height; y++) {
+      for (size_t x = 0; x < width; x++) {
+        handle->m_image_stats.gain_histogram[src[y * width + x]]++;
+      }
+    }
+    handle->m_image_stats.num_pixels = width * height;
+    handle->m_has_image_stats = true;
+  }
+  // the primary image of a stream is not decoded in this end state, release what its probe holds
+  handle->m_stream_primary_dec.reset();
+
+  return status;
+}
+
 uhdr_raw_image_t* uhdr_get_decoded_image(uhdr_codec_private_t* dec) {
   if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
     return nullptr;
@@ -1265,6 +2133,37 @@ uhdr_raw_image_t* uhdr_get_decoded_image(uhdr_codec_private_t* dec) {
   return handle->m_decoded_img_buffer.get();
 }
 
+uhdr_raw_image_t* uhdr_get_decoded_rendition(uhdr_codec_private_t* dec, int index) {
+  if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
+    return nullptr;
+  }
+
+  uhdr_decoder_private* handle = dynamic_cast<uhdr_decoder_private*>(dec);
+  if (!handle->m_sailed || handle->m_decode_call_status.error_code != UHDR_CODEC_OK) {
+    return nullptr;
+  }
+  if (index < 0 || static_cast<size_t>(index) > handle->m_rendition_img_buffers.size()) {
+    return nullptr;
+  }
+
+  return index == 0 ? handle->m_decoded_img_buffer.get()
+                    : handle->m_rendition_img_buffers[index - 1].get();
+}
+
+uhdr_image_stats_t* uhdr_dec_get_image_stats(uhdr_codec_private_t* dec) {
+  if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
+    return nullptr;
+  }
+
+  uhdr_decoder_private* handle = dynamic_cast<uhdr_decoder_private*>(dec);
+  if (!handle->m_sailed || handle->m_decode_call_status.error_code != UHDR_CODEC_OK ||
+      !handle->m_has_image_stats) {
+    return nullptr;
+  }
+
+  return &handle->m_image_stats;
+}
+
 uhdr_raw_image_t* uhdr_get_gain_map_image(uhdr_codec_private_t* dec) {
   if (dynamic_cast<uhdr_decoder_private*>(dec) == nullptr) {
     return nullptr;
@@ -1274,6 +2173,52 @@ uhdr_raw_image_t* uhdr_get_gain_map_image(uhdr_codec_private_t* dec) {
   if (!handle->m_sailed || handle->m_decode_call_status.error_code != UHDR_CODEC_OK) {
     return nullptr;
   }
+  if (handle->m_gainmap_img_buffer) {
+    return handle->m_gainmap_img_buffer.get();
+  }
+
+  // uhdr_decode() has written the sdr rendition without decoding the gain map, decode it now as
+  // part of that call
+  ultrahdr::AllocStatsScope alloc_scope(&handle->m_alloc_stats);
+  auto gainmap_img_buffer = std::make_unique<ultrahdr::uhdr_raw_image_ext_t>(
+      UHDR_IMG_FMT_8bppYCbCr400, UHDR_CG_UNSPECIFIED, UHDR_CT_UNSPECIFIED, UHDR_CR_UNSPECIFIED,
+      handle->m_gainmap_wd, handle->m_gainmap_ht, 1);
+  if (gainmap_img_buffer->planes[UHDR_PLANE_Y] == nullptr) {
+    return nullptr;
+  }
+  ultrahdr::ultrahdr_uncompressed_struct dest_gainmap;
+  dest_gainmap.data = gainmap_img_buffer->planes[UHDR_PLANE_Y];
+
+  ultrahdr::ultrahdr_compressed_struct gainmap_image;
+  if (handle->m_stream_primary_dec) {
+    gainmap_image.data = handle->m_stream_gainmap.data();
+    gainmap_image.length = gainmap_image.maxLength = handle->m_stream_gainmap.size();
+  } else {
+    ultrahdr::ultrahdr_compressed_struct uhdr_image;
+    set_internal_compressed_image(handle, &uhdr_image);
+    if (ultrahdr::JpegR::extractPrimaryImageAndGainMap(&uhdr_image, nullptr, &gainmap_image) !=
+        ultrahdr::ULTRAHDR_NO_ERROR) {
+      return nullptr;
+    }
+  }
+  ultrahdr::ultrahdr_region_struct roi_region{
+      static_cast<size_t>(handle->m_roi_x), static_cast<size_t>(handle->m_roi_y),
+      static_cast<size_t>(handle->m_roi_wd), static_cast<size_t>(handle->m_roi_ht)};
+  ultrahdr::jpegr_decode_options_struct options;
+  options.scaleDenom = handle->m_scale_denom;
+  options.roi = handle->m_has_roi ? &roi_region : nullptr;
+  // libjpeg rounds the scaled dimensions up
+  const size_t scale_denom = handle->m_scale_denom;
+  ultrahdr::JpegR jpegr;
+  if (jpegr.decodeGainMapImage(&gainmap_image, (handle->m_img_wd + scale_denom - 1) / scale_denom,
+                               (handle->m_img_ht + scale_denom - 1) / scale_denom, &dest_gainmap,
+                               &options) != ultrahdr::ULTRAHDR_NO_ERROR) {
+    return nullptr;
+  }
+  gainmap_img_buffer->w = dest_gainmap.width;
+  gainmap_img_buffer->h = dest_gainmap.height;
+  gainmap_img_buffer->stride[UHDR_PLANE_Y] = dest_gainmap.width;
+  handle->m_gainmap_img_buffer = std::move(gainmap_img_buffer);
 
   return handle->m_gainmap_img_buffer.get();
 }
@@ -1284,15 +2229,31 @@ void uhdr_reset_decoder(uhdr_codec_private_t* dec) {
 
     // clear entries and restore defaults
     handle->m_uhdr_compressed_img.reset();
+    handle->m_mapped_file.reset();
+    handle->m_read_cb = nullptr;
+    handle->m_read_cb_user_data = nullptr;
     handle->m_output_fmt = UHDR_IMG_FMT_64bppRGBAHalfFloat;
     handle->m_output_ct = UHDR_CT_LINEAR;
+    handle->m_output_cg = UHDR_CG_UNSPECIFIED;
     handle->m_output_max_disp_boost = FLT_MAX;
+    handle->m_out_renditions.clear();
+    handle->m_has_out_img_buffer = false;
+    memset(&handle->m_out_img_buffer, 0, sizeof handle->m_out_img_buffer);
+    handle->m_enable_image_stats = false;
+    handle->m_enable_gain_code_lut = false;
+    handle->m_scale_denom = 1;
+    handle->m_has_roi = false;
+    handle->m_roi_x = handle->m_roi_y = handle->m_roi_wd = handle->m_roi_ht = 0;
 
     // ready to be configured
     handle->m_probed = false;
     handle->m_sailed = false;
+    handle->m_gainmap_only = false;
     handle->m_decoded_img_buffer.reset();
     handle->m_gainmap_img_buffer.reset();
+    handle->m_rendition_img_buffers.clear();
+    handle->m_stream_primary_dec.reset();
+    handle->m_stream_gainmap.clear();
     handle->m_img_wd = 0;
     handle->m_img_ht = 0;
     handle->m_gainmap_wd = 0;
@@ -1304,6 +2265,8 @@ void uhdr_reset_decoder(uhdr_codec_private_t* dec) {
     handle->m_base_xmp.clear();
     handle->m_gainmap_xmp.clear();
     memset(&handle->m_metadata, 0, sizeof handle->m_metadata);
+    handle->m_has_image_stats = false;
+    memset(&handle->m_image_stats, 0, sizeof handle->m_image_stats);
     handle->m_probe_call_status = g_no_error;
     handle->m_decode_call_status = g_no_error;
   }
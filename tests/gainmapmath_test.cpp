@@ -16,6 +16,7 @@
 
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
+#include <limits>
 
 #include "ultrahdr/gainmapmath.h"
 
@@ -833,6 +834,31 @@ TEST_F(GainMapMathTest, hlgOetfLUT) {
   }
 }
 
+TEST_F(GainMapMathTest, Oetf10BitLUT) {
+  // the table entry is the code of the center of its inputs, so an input close to the middle of
+  // two codes may round the other way than the exact OETF, but never by more than one code
+  uint16_t (*const luts[])(float) = {hlgOetf10BitLUT, pqOetf10BitLUT};
+  float (*const oetfs[])(float) = {hlgOetf, pqOetf};
+  for (int i = 0; i < 2; i++) {
+    size_t mismatches = 0, samples = 0;
+    for (float value = 1.0f; value > 1e-11f; value *= 0.9993f, samples++) {
+      const int expected = static_cast<int>(oetfs[i](value) * 1023.0f + 0.5f);
+      const int actual = luts[i](value);
+      EXPECT_LE(abs(actual - expected), 1) << "value " << value;
+      if (actual != expected) mismatches++;
+    }
+    EXPECT_LT(mismatches, samples / 20);
+
+    EXPECT_EQ(luts[i](0.0f), 0);
+    EXPECT_EQ(luts[i](1.0f), 1023);
+    EXPECT_EQ(luts[i](-0.5f), 0);
+    EXPECT_EQ(luts[i](1.5f), 1023);
+    EXPECT_EQ(luts[i](std::numeric_limits<float>::infinity()), 1023);
+    EXPECT_EQ(luts[i](std::numeric_limits<float>::quiet_NaN()), 0);
+  }
+  EXPECT_EQ(hlgOetf10BitLUT(1.0f / 12.0f), 512);
+}
+
 TEST_F(GainMapMathTest, srgbInvOetfLUT) {
   for (size_t idx = 0; idx < kSrgbInvOETFNumEntries; idx++) {
     float value = static_cast<float>(idx) / static_cast<float>(kSrgbInvOETFNumEntries - 1);
@@ -840,6 +866,60 @@ TEST_F(GainMapMathTest, srgbInvOetfLUT) {
   }
 }
 
+// The fast transfer functions are checked against the max abs error documented in gainmapmath.h,
+// with some room for a different rounding of the polynomial evaluation, e.g. when contracted to
+// fused multiply-adds
+static const size_t kFastTestNumEntries = 1 << 16;
+static const float kFastTestErrorMargin = 1.5f;
+
+TEST_F(GainMapMathTest, srgbInvOetfFast) {
+  for (size_t idx = 0; idx < kFastTestNumEntries; idx++) {
+    float value = static_cast<float>(idx) / static_cast<float>(kFastTestNumEntries - 1);
+    EXPECT_NEAR(srgbInvOetf(value), srgbInvOetfFast(value), kFastTestErrorMargin * 3.6e-7f);
+  }
+  Color e_gamma = {{{0.01f, 0.5f, 0.99f}}};
+  EXPECT_RGB_NEAR(srgbInvOetf(e_gamma), srgbInvOetfFast(e_gamma));
+}
+
+TEST_F(GainMapMathTest, hlgOetfFast) {
+  for (size_t idx = 0; idx < kFastTestNumEntries; idx++) {
+    float value = static_cast<float>(idx) / static_cast<float>(kFastTestNumEntries - 1);
+    EXPECT_NEAR(hlgOetf(value), hlgOetfFast(value), kFastTestErrorMargin * 6.0e-8f);
+  }
+  Color e = {{{0.04f, 0.5f, 1.0f}}};
+  EXPECT_RGB_NEAR(hlgOetf(e), hlgOetfFast(e));
+}
+
+TEST_F(GainMapMathTest, hlgInvOetfFast) {
+  for (size_t idx = 0; idx < kFastTestNumEntries; idx++) {
+    float value = static_cast<float>(idx) / static_cast<float>(kFastTestNumEntries - 1);
+    EXPECT_NEAR(hlgInvOetf(value), hlgInvOetfFast(value), kFastTestErrorMargin * 2.4e-7f);
+  }
+  Color e_gamma = {{{0.2f, 0.5f, 0.99f}}};
+  EXPECT_RGB_NEAR(hlgInvOetf(e_gamma), hlgInvOetfFast(e_gamma));
+}
+
+TEST_F(GainMapMathTest, pqOetfFast) {
+  for (size_t idx = 0; idx < kFastTestNumEntries; idx++) {
+    float value = static_cast<float>(idx) / static_cast<float>(kFastTestNumEntries - 1);
+    EXPECT_NEAR(pqOetf(value), pqOetfFast(value), kFastTestErrorMargin * 1.9e-5f);
+  }
+  EXPECT_EQ(pqOetfFast(0.0f), 0.0f);
+  EXPECT_EQ(pqOetfFast(-1.0f), 0.0f);
+  Color e = {{{0.01f, 0.5f, 0.99f}}};
+  EXPECT_RGB_NEAR(pqOetf(e), pqOetfFast(e));
+}
+
+TEST_F(GainMapMathTest, pqInvOetfFast) {
+  for (size_t idx = 0; idx < kFastTestNumEntries; idx++) {
+    float value = static_cast<float>(idx) / static_cast<float>(kFastTestNumEntries - 1);
+    EXPECT_NEAR(pqInvOetf(value), pqInvOetfFast(value), kFastTestErrorMargin * 1.5e-4f);
+  }
+  EXPECT_EQ(pqInvOetfFast(0.0f), 0.0f);
+  Color e_gamma = {{{0.01f, 0.5f, 0.99f}}};
+  EXPECT_RGB_NEAR(pqInvOetf(e_gamma), pqInvOetfFast(e_gamma));
+}
+
 TEST_F(GainMapMathTest, applyGainLUT) {
   for (int boost = 1; boost <= 10; boost++) {
     ultrahdr_metadata_struct metadata;
@@ -938,6 +1018,35 @@ TEST_F(GainMapMathTest, applyGainLUT) {
   }
 }
 
+TEST_F(GainMapMathTest, RenderPlanCache) {
+  ultrahdr_metadata_struct metadata;
+  metadata.minContentBoost = 1.0f / 4.0f;
+  metadata.maxContentBoost = 4.0f;
+
+  std::shared_ptr<const RenderPlan> plan = getRenderPlan(&metadata, 2.0f, 4);
+  ASSERT_NE(plan, nullptr);
+  EXPECT_EQ(plan, getRenderPlan(&metadata, 2.0f, 4));
+  EXPECT_NE(plan, getRenderPlan(&metadata, 3.0f, 4));
+  EXPECT_NE(plan, getRenderPlan(&metadata, 2.0f, 2));
+
+  GainLUT gainLUT(&metadata, 2.0f);
+  for (size_t idx = 0; idx < kGainFactorNumEntries; idx++) {
+    float value = static_cast<float>(idx) / static_cast<float>(kGainFactorNumEntries - 1);
+    EXPECT_FLOAT_EQ(gainLUT.getGainFactor(value), plan->mGainLUT.getGainFactor(value));
+  }
+
+  // plans stay valid after they are evicted
+  for (size_t i = 0; i < kRenderPlanCacheSize; i++) {
+    metadata.maxContentBoost = 5.0f + i;
+    ASSERT_NE(getRenderPlan(&metadata, 2.0f, 4), nullptr);
+  }
+  metadata.maxContentBoost = 4.0f;
+  std::shared_ptr<const RenderPlan> rebuilt = getRenderPlan(&metadata, 2.0f, 4);
+  EXPECT_NE(plan, rebuilt);
+  EXPECT_EQ(plan->mDisplayBoost, rebuilt->mDisplayBoost);
+  EXPECT_FLOAT_EQ(plan->mGainLUT.getGainFactor(1.0f), rebuilt->mGainLUT.getGainFactor(1.0f));
+}
+
 TEST_F(GainMapMathTest, PqTransferFunctionRoundtrip) {
   EXPECT_FLOAT_EQ(pqInvOetf(pqOetf(0.0f)), 0.0f);
   EXPECT_NEAR(pqInvOetf(pqOetf(0.01f)), 0.01f, ComparisonEpsilon());
@@ -1112,6 +1221,108 @@ TEST_F(GainMapMathTest, ApplyGain) {
   EXPECT_RGB_EQ(applyGain(e, 1.0f, &metadata), applyGain(e, 1.0f, &metadata, displayBoost));
 }
 
+TEST_F(GainMapMathTest, IsSdrRendition) {
+  ultrahdr_metadata_struct metadata;
+  metadata.hdrCapacityMin = 1.0f;
+  EXPECT_TRUE(isSdrRendition(&metadata, 1.0f));
+  EXPECT_FALSE(isSdrRendition(&metadata, 1.5f));
+  metadata.hdrCapacityMin = 0.5f;
+  EXPECT_TRUE(isSdrRendition(&metadata, 1.0f));
+  metadata.hdrCapacityMin = 2.0f;
+  EXPECT_TRUE(isSdrRendition(&metadata, 2.0f));
+  EXPECT_FALSE(isSdrRendition(&metadata, 2.5f));
+}
+
+TEST_F(GainMapMathTest, ImageStats) {
+  ultrahdr_image_stats_struct a, b;
+  addPixelToImageStats(&a, 0.5f, 0.0f, false);
+  addPixelToImageStats(&a, 2.0f, 1.0f, true);
+  addPixelToImageStats(&a, 1.0f, 0.5f, false);
+  // gains are binned to the closest gain map code, out of range gains go to the last bin
+  addPixelToImageStats(&b, 4.0f, 1.0f / 255.0f, false);
+  addPixelToImageStats(&b, 0.0f, 1.5f, true);
+
+  EXPECT_FLOAT_EQ(a.maxLuminance, 2.0f);
+  EXPECT_DOUBLE_EQ(a.sumLuminance, 3.5);
+  EXPECT_EQ(a.numPixels, 3u);
+  EXPECT_EQ(a.numClippedPixels, 1u);
+  EXPECT_EQ(a.gainHistogram[0], 1u);
+  EXPECT_EQ(a.gainHistogram[128], 1u);
+  EXPECT_EQ(a.gainHistogram[kGainHistogramBins - 1], 1u);
+
+  mergeImageStats(&a, b);
+  EXPECT_FLOAT_EQ(a.maxLuminance, 4.0f);
+  EXPECT_DOUBLE_EQ(a.sumLuminance, 7.5);
+  EXPECT_EQ(a.numPixels, 5u);
+  EXPECT_EQ(a.numClippedPixels, 2u);
+  EXPECT_EQ(a.gainHistogram[1], 1u);
+  EXPECT_EQ(a.gainHistogram[kGainHistogramBins - 1], 2u);
+  uint64_t count = 0;
+  for (size_t i = 0; i < kGainHistogramBins; i++) {
+    count += a.gainHistogram[i];
+  }
+  EXPECT_EQ(count, a.numPixels);
+}
+
+TEST_F(GainMapMathTest, GainCodeLUT) {
+  ultrahdr_metadata_struct metadata;
+  metadata.minContentBoost = 1.0f;
+  metadata.maxContentBoost = 4.0f;
+  const float kDisplayBoost = 3.0f;
+  const size_t kWidth = 256;
+  // rgb pixels, each channel runs over all codes
+  std::vector<uint8_t> rgb(kWidth * 3);
+  for (size_t i = 0; i < kWidth; i++) {
+    rgb[i * 3] = i;
+    rgb[i * 3 + 1] = 255 - i;
+    rgb[i * 3 + 2] = (i * 7) & 0xff;
+  }
+  // channel c of a packed output pixel, for comparisons with a tolerance in output codes
+  auto channel = [](uint64_t pixel, ultrahdr_output_format format, int c) -> int {
+    return format == ULTRAHDR_OUTPUT_HDR_LINEAR ? (pixel >> (c * 16)) & 0xffff
+                                                : (pixel >> (c * 10)) & 0x3ff;
+  };
+
+  const ultrahdr_output_format formats[] = {ULTRAHDR_OUTPUT_HDR_LINEAR, ULTRAHDR_OUTPUT_HDR_PQ,
+                                            ULTRAHDR_OUTPUT_HDR_HLG};
+  for (ultrahdr_output_format format : formats) {
+    ASSERT_TRUE(GainCodeLUT::isOutputFormatSupported(format));
+    GainCodeLUT lut(&metadata, kDisplayBoost, format);
+    const float gains[] = {0.0f, 51.0f / 255.0f, 0.3f, 0.5f, 0.73f, 1.0f};
+    for (float gain : gains) {
+      std::vector<float> gainRow(kWidth, gain);
+      std::vector<uint64_t> out(kWidth);
+      applyGainCodeLUT(rgb.data(), 3, gainRow.data(), kWidth, lut, out.data());
+      // gains that are not a multiple of a code step are off by up to half a step, which changes
+      // the output by up to 0.2% here, or 5 half float steps
+      const bool exactCode = gain * 255.0f == floorf(gain * 255.0f);
+      const int tolerance = exactCode ? 1 : (format == ULTRAHDR_OUTPUT_HDR_LINEAR ? 5 : 2);
+      for (size_t i = 0; i < kWidth; i++) {
+        Color e_gamma{{{rgb[i * 3] / 255.0f, rgb[i * 3 + 1] / 255.0f, rgb[i * 3 + 2] / 255.0f}}};
+        Color e = applyGain(srgbInvOetf(e_gamma), gain, &metadata, kDisplayBoost) / kDisplayBoost;
+        uint64_t expected;
+        uint64_t actual;
+        if (format == ULTRAHDR_OUTPUT_HDR_LINEAR) {
+          expected = colorToRgbaF16(e);
+          actual = out[i];
+        } else {
+          expected = format == ULTRAHDR_OUTPUT_HDR_PQ ? pqColorToRgba1010102LUT(e)
+                                                      : hlgColorToRgba1010102LUT(e);
+          actual = reinterpret_cast<uint32_t*>(out.data())[i];
+        }
+        for (int c = 0; c < 3; c++) {
+          EXPECT_LE(abs(channel(actual, format, c) - channel(expected, format, c)), tolerance)
+              << "format " << format << ", gain " << gain << ", pixel " << i;
+        }
+        EXPECT_EQ(actual >> (format == ULTRAHDR_OUTPUT_HDR_LINEAR ? 48 : 30),
+                  expected >> (format == ULTRAHDR_OUTPUT_HDR_LINEAR ? 48 : 30));
+      }
+    }
+  }
+  EXPECT_FALSE(GainCodeLUT::isOutputFormatSupported(ULTRAHDR_OUTPUT_SDR));
+  EXPECT_FALSE(GainCodeLUT::isOutputFormatSupported(ULTRAHDR_OUTPUT_HDR_LINEAR_RGB_10BIT));
+}
+
 TEST_F(GainMapMathTest, GetYuv420Pixel) {
   ultrahdr_uncompressed_struct image = Yuv420Image();
   Color(*colors)[4] = Yuv420Colors();
@@ -1134,6 +1345,107 @@ TEST_F(GainMapMathTest, GetP010Pixel) {
   }
 }
 
+TEST_F(GainMapMathTest, P010Quantization) {
+  const uint16_t luma_codes[] = {64, 65, 100, 502, 939, 940};
+  for (uint16_t code : luma_codes) {
+    EXPECT_EQ(lumaToP010(P010(code, 512, 512).y), code << 6);
+  }
+  const uint16_t chroma_codes[] = {64, 65, 300, 512, 959, 960};
+  for (uint16_t code : chroma_codes) {
+    EXPECT_EQ(chromaToP010(P010(64, code, code).u), code << 6);
+  }
+
+  // out of range values are clamped to the narrow range
+  EXPECT_EQ(lumaToP010(-0.1f), 64 << 6);
+  EXPECT_EQ(lumaToP010(1.1f), 940 << 6);
+  EXPECT_EQ(chromaToP010(-0.6f), 64 << 6);
+  EXPECT_EQ(chromaToP010(0.6f), 960 << 6);
+}
+
+TEST_F(GainMapMathTest, P010Writer) {
+  // chroma is uniform in every 2x2 block, the writer reproduces the codes of the pixels
+  uint16_t pixels[16 + 8] = {};
+  ultrahdr_uncompressed_struct image = {pixels, 4, 4, ULTRAHDR_COLORGAMUT_BT2100};
+  P010Writer writer(&image, 4, 4);
+  for (size_t y = 0; y < 4; ++y) {
+    for (size_t x = 0; x < 4; ++x) {
+      const uint16_t block = (y / 2) * 2 + x / 2;
+      writer.putPixel(x, y, P010(0x100 + 0x10 * y + x, 0x200 + block, 0x300 + block));
+    }
+  }
+  for (size_t y = 0; y < 4; ++y) {
+    for (size_t x = 0; x < 4; ++x) {
+      EXPECT_EQ(pixels[y * 4 + x], (0x100 + 0x10 * y + x) << 6);
+    }
+  }
+  for (size_t block = 0; block < 4; ++block) {
+    EXPECT_EQ(pixels[16 + block * 2], (0x200 + block) << 6);
+    EXPECT_EQ(pixels[16 + block * 2 + 1], (0x300 + block) << 6);
+  }
+
+  // odd dimensions with strides, the chroma of the last column and row averages fewer pixels
+  const size_t kWidth = 3, kHeight = 3, kStride = 6;
+  uint16_t luma[kStride * kHeight] = {};
+  uint16_t chroma[kStride * 2] = {};
+  ultrahdr_uncompressed_struct odd_image = {
+      luma, kWidth, kHeight, ULTRAHDR_COLORGAMUT_BT2100, chroma, kStride, kStride};
+  P010Writer odd_writer(&odd_image, kWidth, kHeight);
+  for (size_t y = 0; y < kHeight; ++y) {
+    for (size_t x = 0; x < kWidth; ++x) {
+      odd_writer.putPixel(x, y, {{{0.25f * y, 0.1f * x, -0.1f * y}}});
+    }
+  }
+  const float kChromaEpsilon = 1.0f / 896.0f;
+  for (size_t y = 0; y < kHeight; ++y) {
+    for (size_t x = 0; x < kWidth; ++x) {
+      Color yuv = getP010Pixel(&odd_image, x, y);
+      EXPECT_NEAR(yuv.y, 0.25f * y, 1.0f / 876.0f);
+      EXPECT_NEAR(yuv.u, x < 2 ? 0.05f : 0.2f, kChromaEpsilon);
+      EXPECT_NEAR(yuv.v, y < 2 ? -0.05f : -0.2f, kChromaEpsilon);
+    }
+  }
+  // padding past the image width is not written
+  EXPECT_EQ(luma[3], 0);
+  EXPECT_EQ(chroma[kStride - 2], 0);
+}
+
+TEST_F(GainMapMathTest, PlanarFloatWriter) {
+  // planes follow each other at the image width by default
+  float pixels[3 * 6] = {};
+  ultrahdr_uncompressed_struct image = {pixels, 3, 2, ULTRAHDR_COLORGAMUT_BT709};
+  PlanarFloatWriter writer(&image, 3, 2);
+  for (size_t y = 0; y < 2; ++y) {
+    for (size_t x = 0; x < 3; ++x) {
+      const float v = static_cast<float>(y * 3 + x);
+      writer.putPixel(x, y, {{{v, v + 0.25f, v + 0.5f}}});
+    }
+  }
+  for (size_t i = 0; i < 6; i++) {
+    EXPECT_FLOAT_EQ(pixels[i], static_cast<float>(i));
+    EXPECT_FLOAT_EQ(pixels[6 + i], static_cast<float>(i) + 0.25f);
+    EXPECT_FLOAT_EQ(pixels[12 + i], static_cast<float>(i) + 0.5f);
+  }
+
+  // planes and strides of their own, padding is not written
+  float red[2 * 4], green[2 * 5], blue[2 * 3];
+  std::fill(std::begin(red), std::end(red), -1.0f);
+  std::fill(std::begin(green), std::end(green), -1.0f);
+  std::fill(std::begin(blue), std::end(blue), -1.0f);
+  ultrahdr_uncompressed_struct strided = {red, 3, 2, ULTRAHDR_COLORGAMUT_BT709};
+  strided.luma_stride = 4;
+  strided.green_data = green;
+  strided.green_stride = 5;
+  strided.blue_data = blue;
+  strided.blue_stride = 3;
+  PlanarFloatWriter stridedWriter(&strided, 3, 2);
+  stridedWriter.putPixel(2, 1, RgbRed());
+  EXPECT_FLOAT_EQ(red[1 * 4 + 2], 1.0f);
+  EXPECT_FLOAT_EQ(green[1 * 5 + 2], 0.0f);
+  EXPECT_FLOAT_EQ(blue[1 * 3 + 2], 0.0f);
+  EXPECT_FLOAT_EQ(red[1 * 4 + 3], -1.0f);
+  EXPECT_FLOAT_EQ(green[1 * 5 + 3], -1.0f);
+}
+
 TEST_F(GainMapMathTest, SampleYuv420) {
   ultrahdr_uncompressed_struct image = Yuv420Image();
   Color(*colors)[4] = Yuv420Colors();
@@ -1226,6 +1538,91 @@ TEST_F(GainMapMathTest, SampleMap) {
   }
 }
 
+TEST_F(GainMapMathTest, GainMapUpsampler) {
+  ultrahdr_uncompressed_struct image = MapImage();
+  float(*values)[4] = MapValues();
+
+  for (size_t mapScaleFactor : {1, 2, 3, 4}) {
+    ShepardsIDW idwTable(mapScaleFactor);
+    GainMapUpsampler idw(&image, mapScaleFactor, idwTable);
+    GainMapUpsampler bilinear(&image, mapScaleFactor, idwTable, GAINMAP_UPSAMPLE_BILINEAR);
+    for (size_t y = 0; y < 4 * mapScaleFactor; ++y) {
+      const float* idwRow = idw.getRow(y);
+      const float* bilinearRow = bilinear.getRow(y);
+      for (size_t x = 0; x < 4 * mapScaleFactor; ++x) {
+        EXPECT_FLOAT_EQ(idwRow[x], sampleMap(&image, mapScaleFactor, x, y, idwTable));
+
+        size_t x_base = x / mapScaleFactor;
+        size_t y_base = y / mapScaleFactor;
+        size_t x_next = (std::min)(x_base + 1, static_cast<size_t>(3));
+        size_t y_next = (std::min)(y_base + 1, static_cast<size_t>(3));
+        float min = fmin(fmin(values[y_base][x_base], values[y_base][x_next]),
+                         fmin(values[y_next][x_base], values[y_next][x_next]));
+        float max = fmax(fmax(values[y_base][x_base], values[y_base][x_next]),
+                         fmax(values[y_next][x_base], values[y_next][x_next]));
+        EXPECT_THAT(bilinearRow[x],
+                    testing::AllOf(testing::Ge(min - 1e-6f), testing::Le(max + 1e-6f)));
+        if (x % mapScaleFactor == 0 && y % mapScaleFactor == 0) {
+          EXPECT_FLOAT_EQ(bilinearRow[x], values[y_base][x_base]);
+        }
+      }
+    }
+    // rows may be requested out of order
+    EXPECT_FLOAT_EQ(idw.getRow(0)[0], values[0][0]);
+  }
+}
+
+TEST_F(GainMapMathTest, UniformGainTiles) {
+  // 2.5 x 2.5 tiles, the gain map is constant except for one sample
+  const size_t kMapSize = kGainMapTileSize * 5 / 2;
+  std::vector<uint8_t> pixels(kMapSize * kMapSize, 0x40);
+  ultrahdr_uncompressed_struct map{pixels.data(), kMapSize, kMapSize,
+                                   ULTRAHDR_COLORGAMUT_UNSPECIFIED};
+  // first sample of tile (1, 1), the tiles above and to the left of it interpolate from it too
+  pixels[kGainMapTileSize * kMapSize + kGainMapTileSize] = 0x80;
+
+  UniformGainTiles tiles(&map, 0, kMapSize);
+  ASSERT_EQ(tiles.getTileCols(), 3);
+  uint8_t value = 0;
+  EXPECT_FALSE(tiles.isUniform(0, 0, &value));
+  EXPECT_FALSE(tiles.isUniform(1, 0, &value));
+  EXPECT_FALSE(tiles.isUniform(0, 1, &value));
+  EXPECT_FALSE(tiles.isUniform(1, 1, &value));
+  EXPECT_TRUE(tiles.isUniform(2, 0, &value));
+  EXPECT_EQ(value, 0x40);
+  EXPECT_TRUE(tiles.isUniform(2, 1, &value));
+  EXPECT_TRUE(tiles.isUniform(0, 2, &value));
+  EXPECT_TRUE(tiles.isUniform(1, 2, &value));
+  EXPECT_TRUE(tiles.isUniform(2, 2, &value));
+
+  // a band only classifies the tile rows it overlaps
+  UniformGainTiles band(&map, kGainMapTileSize * 2, kMapSize);
+  EXPECT_TRUE(band.isUniform(1, 2, &value));
+
+  // interpolated gains of uniform tiles are the tile value, and spans of a row match the full row
+  const size_t kMapScaleFactor = 4;
+  ShepardsIDW idwTable(kMapScaleFactor);
+  GainMapUpsampler upsampler(&map, kMapScaleFactor, idwTable);
+  GainMapUpsampler spans(&map, kMapScaleFactor, idwTable);
+  for (size_t y = 0; y < kMapSize * kMapScaleFactor; y++) {
+    std::vector<float> row(upsampler.getRow(y), upsampler.getRow(y) + kMapSize * kMapScaleFactor);
+    const size_t tileY = y / kMapScaleFactor / kGainMapTileSize;
+    for (size_t tileX = 0; tileX < tiles.getTileCols(); tileX++) {
+      const float* span =
+          spans.getRow(y, tileX * kGainMapTileSize, (tileX + 1) * kGainMapTileSize);
+      const size_t xStart = tileX * kGainMapTileSize * kMapScaleFactor;
+      const size_t xEnd = (std::min)(xStart + kGainMapTileSize * kMapScaleFactor, row.size());
+      const bool uniform = tiles.isUniform(tileX, tileY, &value);
+      for (size_t x = xStart; x < xEnd; x++) {
+        EXPECT_EQ(span[x], row[x]);
+        if (uniform) {
+          EXPECT_FLOAT_EQ(row[x], value / 255.0f);
+        }
+      }
+    }
+  }
+}
+
 TEST_F(GainMapMathTest, ColorToRgba1010102) {
   EXPECT_EQ(colorToRgba1010102(RgbBlack()), 0x3 << 30);
   EXPECT_EQ(colorToRgba1010102(RgbWhite()), 0xFFFFFFFF);
@@ -1240,6 +1637,20 @@ TEST_F(GainMapMathTest, ColorToRgba1010102) {
                 static_cast<uint32_t>(0.3f * static_cast<float>(0x3ff)) << 20);
 }
 
+TEST_F(GainMapMathTest, ColorToRgba1010102LUT) {
+  EXPECT_EQ(pqColorToRgba1010102LUT(RgbBlack()), 0x3 << 30);
+  EXPECT_EQ(pqColorToRgba1010102LUT(RgbWhite()), 0xFFFFFFFF);
+  EXPECT_EQ(hlgColorToRgba1010102LUT(RgbBlack()), 0x3 << 30);
+  EXPECT_EQ(hlgColorToRgba1010102LUT(RgbWhite()), 0xFFFFFFFF);
+
+  // out of range channels clamp instead of wrapping into their neighbours
+  Color e = {{{-1.0f, 2.0f, 0.01f}}};
+  EXPECT_EQ(pqColorToRgba1010102LUT(e),
+            0x3 << 30 | 0x3ff << 10 | static_cast<uint32_t>(pqOetf10BitLUT(0.01f)) << 20);
+  EXPECT_EQ(hlgColorToRgba1010102LUT(e),
+            0x3 << 30 | 0x3ff << 10 | static_cast<uint32_t>(hlgOetf10BitLUT(0.01f)) << 20);
+}
+
 TEST_F(GainMapMathTest, ColorToRgbaF16) {
   EXPECT_EQ(colorToRgbaF16(RgbBlack()), ((uint64_t)0x3C00) << 48);
   EXPECT_EQ(colorToRgbaF16(RgbWhite()), 0x3C003C003C003C00);
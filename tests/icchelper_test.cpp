@@ -16,6 +16,9 @@
 
 #include <gtest/gtest.h>
 
+#include <cstring>
+#include <vector>
+
 #include "ultrahdr/icc.h"
 
 namespace ultrahdr {
@@ -39,21 +42,21 @@ void IccHelperTest::SetUp() {}
 void IccHelperTest::TearDown() {}
 
 TEST_F(IccHelperTest, iccWriteThenRead) {
-  std::shared_ptr<DataStruct> iccBt709 =
+  std::shared_ptr<const DataStruct> iccBt709 =
       IccHelper::writeIccProfile(ULTRAHDR_TF_SRGB, ULTRAHDR_COLORGAMUT_BT709);
   ASSERT_NE(iccBt709->getLength(), 0);
   ASSERT_NE(iccBt709->getData(), nullptr);
   EXPECT_EQ(IccHelper::readIccColorGamut(iccBt709->getData(), iccBt709->getLength()),
             ULTRAHDR_COLORGAMUT_BT709);
 
-  std::shared_ptr<DataStruct> iccP3 =
+  std::shared_ptr<const DataStruct> iccP3 =
       IccHelper::writeIccProfile(ULTRAHDR_TF_SRGB, ULTRAHDR_COLORGAMUT_P3);
   ASSERT_NE(iccP3->getLength(), 0);
   ASSERT_NE(iccP3->getData(), nullptr);
   EXPECT_EQ(IccHelper::readIccColorGamut(iccP3->getData(), iccP3->getLength()),
             ULTRAHDR_COLORGAMUT_P3);
 
-  std::shared_ptr<DataStruct> iccBt2100 =
+  std::shared_ptr<const DataStruct> iccBt2100 =
       IccHelper::writeIccProfile(ULTRAHDR_TF_SRGB, ULTRAHDR_COLORGAMUT_BT2100);
   ASSERT_NE(iccBt2100->getLength(), 0);
   ASSERT_NE(iccBt2100->getData(), nullptr);
@@ -61,12 +64,32 @@ TEST_F(IccHelperTest, iccWriteThenRead) {
             ULTRAHDR_COLORGAMUT_BT2100);
 }
 
+TEST_F(IccHelperTest, iccProfilesAreShared) {
+  std::shared_ptr<const DataStruct> iccBt709 =
+      IccHelper::writeIccProfile(ULTRAHDR_TF_SRGB, ULTRAHDR_COLORGAMUT_BT709);
+  EXPECT_EQ(iccBt709, IccHelper::writeIccProfile(ULTRAHDR_TF_SRGB, ULTRAHDR_COLORGAMUT_BT709));
+  EXPECT_NE(iccBt709, IccHelper::writeIccProfile(ULTRAHDR_TF_SRGB, ULTRAHDR_COLORGAMUT_P3));
+  EXPECT_NE(iccBt709, IccHelper::writeIccProfile(ULTRAHDR_TF_PQ, ULTRAHDR_COLORGAMUT_BT709));
+
+  // a cached gamut is not returned for a different profile of the same size
+  const uint8_t* iccBytes = static_cast<const uint8_t*>(iccBt709->getData());
+  std::vector<uint8_t> profile(iccBytes, iccBytes + iccBt709->getLength());
+  EXPECT_EQ(IccHelper::readIccColorGamut(profile.data(), profile.size()),
+            ULTRAHDR_COLORGAMUT_BT709);
+  // clear the tag table and tags
+  const size_t tagsStart = kICCIdentifierSize + kICCHeaderSize;
+  memset(profile.data() + tagsStart, 0, profile.size() - tagsStart);
+  EXPECT_EQ(IccHelper::readIccColorGamut(profile.data(), profile.size()),
+            ULTRAHDR_COLORGAMUT_UNSPECIFIED);
+}
+
 TEST_F(IccHelperTest, iccEndianness) {
-  std::shared_ptr<DataStruct> icc =
+  std::shared_ptr<const DataStruct> icc =
       IccHelper::writeIccProfile(ULTRAHDR_TF_SRGB, ULTRAHDR_COLORGAMUT_BT709);
   size_t profile_size = icc->getLength() - kICCIdentifierSize;
 
-  uint8_t* icc_bytes = reinterpret_cast<uint8_t*>(icc->getData()) + kICCIdentifierSize;
+  const uint8_t* icc_bytes =
+      reinterpret_cast<const uint8_t*>(icc->getData()) + kICCIdentifierSize;
   uint32_t encoded_size =
       static_cast<uint32_t>(icc_bytes[0]) << 24 | static_cast<uint32_t>(icc_bytes[1]) << 16 |
       static_cast<uint32_t>(icc_bytes[2]) << 8 | static_cast<uint32_t>(icc_bytes[3]);
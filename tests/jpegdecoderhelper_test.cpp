@@ -16,6 +16,7 @@
 
 #include <gtest/gtest.h>
 
+#include <cstring>
 #include <fstream>
 #include <iostream>
 
@@ -113,6 +114,75 @@ TEST_F(JpegDecoderHelperTest, decodeGreyImage) {
   ASSERT_GT(decoder.getDecompressedImageSize(), static_cast<uint32_t>(0));
 }
 
+TEST_F(JpegDecoderHelperTest, decodeYuvImageToOutputPlanes) {
+  JpegDecoderHelper refDecoder;
+  ASSERT_TRUE(refDecoder.decompressImage(mYuvImage.buffer.get(), mYuvImage.size));
+  const uint8_t* ref = static_cast<const uint8_t*>(refDecoder.getDecompressedImagePtr());
+
+  const size_t lumaStride = IMAGE_WIDTH + 24, chromaStride = IMAGE_WIDTH / 2 + 8;
+  std::vector<uint8_t> y(lumaStride * IMAGE_HEIGHT), u(chromaStride * IMAGE_HEIGHT / 2),
+      v(chromaStride * IMAGE_HEIGHT / 2);
+  jpeg_output_planes planes{{y.data(), u.data(), v.data()},
+                            {lumaStride, chromaStride, chromaStride}};
+  JpegDecoderHelper decoder;
+  ASSERT_TRUE(decoder.decompressImage(mYuvImage.buffer.get(), mYuvImage.size, DECODE_TO_YCBCR,
+                                      &planes));
+  EXPECT_EQ(nullptr, decoder.getDecompressedImagePtr());
+  EXPECT_EQ(IMAGE_WIDTH, decoder.getDecompressedImageWidth());
+  EXPECT_EQ(IMAGE_HEIGHT, decoder.getDecompressedImageHeight());
+  for (size_t i = 0; i < IMAGE_HEIGHT; i++) {
+    ASSERT_EQ(0, memcmp(ref + i * IMAGE_WIDTH, y.data() + i * lumaStride, IMAGE_WIDTH));
+  }
+  const uint8_t* refU = ref + IMAGE_WIDTH * IMAGE_HEIGHT;
+  const uint8_t* refV = refU + IMAGE_WIDTH * IMAGE_HEIGHT / 4;
+  for (size_t i = 0; i < IMAGE_HEIGHT / 2; i++) {
+    ASSERT_EQ(0, memcmp(refU + i * IMAGE_WIDTH / 2, u.data() + i * chromaStride, IMAGE_WIDTH / 2));
+    ASSERT_EQ(0, memcmp(refV + i * IMAGE_WIDTH / 2, v.data() + i * chromaStride, IMAGE_WIDTH / 2));
+  }
+}
+
+TEST_F(JpegDecoderHelperTest, decodeYuvImageInBands) {
+  JpegDecoderHelper refDecoder;
+  ASSERT_TRUE(refDecoder.decompressImage(mYuvImage.buffer.get(), mYuvImage.size));
+  const uint8_t* ref = static_cast<const uint8_t*>(refDecoder.getDecompressedImagePtr());
+  const uint8_t* refU = ref + IMAGE_WIDTH * IMAGE_HEIGHT;
+  const uint8_t* refV = refU + IMAGE_WIDTH * IMAGE_HEIGHT / 4;
+
+  size_t nextRow = 0;
+  jpeg_band_fn onBand = [&](const jpeg_output_planes& band, size_t rowStart,
+                            size_t rowCount) -> bool {
+    EXPECT_EQ(nextRow, rowStart);
+    EXPECT_LE(rowCount, static_cast<size_t>(64));
+    for (size_t i = 0; i < rowCount; i++) {
+      if (memcmp(ref + (rowStart + i) * IMAGE_WIDTH, band.planes[0] + i * band.strides[0],
+                 IMAGE_WIDTH)) {
+        return false;
+      }
+    }
+    for (size_t i = 0; i < rowCount / 2; i++) {
+      size_t row = rowStart / 2 + i;
+      if (memcmp(refU + row * IMAGE_WIDTH / 2, band.planes[1] + i * band.strides[1],
+                 IMAGE_WIDTH / 2) ||
+          memcmp(refV + row * IMAGE_WIDTH / 2, band.planes[2] + i * band.strides[2],
+                 IMAGE_WIDTH / 2)) {
+        return false;
+      }
+    }
+    nextRow = rowStart + rowCount;
+    return true;
+  };
+  JpegDecoderHelper decoder;
+  // band height is rounded up to 64 rows
+  ASSERT_TRUE(decoder.decompressImageInBands(mYuvImage.buffer.get(), mYuvImage.size, 50, onBand));
+  EXPECT_EQ(static_cast<size_t>(IMAGE_HEIGHT), nextRow);
+  EXPECT_EQ(nullptr, decoder.getDecompressedImagePtr());
+
+  // consumer can abort the decode
+  jpeg_band_fn abortBand = [](const jpeg_output_planes&, size_t, size_t) { return false; };
+  EXPECT_FALSE(decoder.decompressImageInBands(mYuvImage.buffer.get(), mYuvImage.size, 16,
+                                              abortBand));
+}
+
 TEST_F(JpegDecoderHelperTest, getCompressedImageParameters) {
   JpegDecoderHelper decoder;
   EXPECT_TRUE(decoder.getCompressedImageParameters(mYuvImage.buffer.get(), mYuvImage.size));
@@ -122,4 +122,40 @@ TEST_F(JpegEncoderHelperTest, encodeSingleChannelImage) {
   ASSERT_GT(encoder.getCompressedImageSize(), static_cast<uint32_t>(0));
 }
 
+TEST_F(JpegEncoderHelperTest, encodeToOutputBuffer) {
+  JpegEncoderHelper encoder;
+  EXPECT_TRUE(encoder.compressImage(
+      mAlignedImage.buffer.get(),
+      mAlignedImage.buffer.get() + mAlignedImage.width * mAlignedImage.height, mAlignedImage.width,
+      mAlignedImage.height, mAlignedImage.width, mAlignedImage.width / 2, JPEG_QUALITY, NULL, 0));
+  size_t size = encoder.getCompressedImageSize();
+  ASSERT_GT(size, static_cast<uint32_t>(0));
+  size_t capacity = JpegEncoderHelper::estimateCompressedSize(
+      mAlignedImage.width, mAlignedImage.height, JPEG_QUALITY, false, 0);
+  ASSERT_GT(capacity, size);
+
+  // output fits in caller buffer, compressed bytes are written in place
+  std::unique_ptr<uint8_t[]> output = std::make_unique<uint8_t[]>(capacity);
+  JpegEncoderHelper encoder2;
+  encoder2.setOutputBuffer(output.get(), capacity);
+  EXPECT_TRUE(encoder2.compressImage(
+      mAlignedImage.buffer.get(),
+      mAlignedImage.buffer.get() + mAlignedImage.width * mAlignedImage.height, mAlignedImage.width,
+      mAlignedImage.height, mAlignedImage.width, mAlignedImage.width / 2, JPEG_QUALITY, NULL, 0));
+  ASSERT_EQ(encoder2.getCompressedImagePtr(), output.get());
+  ASSERT_EQ(encoder2.getCompressedImageSize(), size);
+  ASSERT_EQ(0, memcmp(encoder.getCompressedImagePtr(), output.get(), size));
+
+  // output does not fit in caller buffer, compression continues in internal buffer
+  JpegEncoderHelper encoder3;
+  encoder3.setOutputBuffer(output.get(), size / 2);
+  EXPECT_TRUE(encoder3.compressImage(
+      mAlignedImage.buffer.get(),
+      mAlignedImage.buffer.get() + mAlignedImage.width * mAlignedImage.height, mAlignedImage.width,
+      mAlignedImage.height, mAlignedImage.width, mAlignedImage.width / 2, JPEG_QUALITY, NULL, 0));
+  ASSERT_NE(encoder3.getCompressedImagePtr(), output.get());
+  ASSERT_EQ(encoder3.getCompressedImageSize(), size);
+  ASSERT_EQ(0, memcmp(encoder.getCompressedImagePtr(), encoder3.getCompressedImagePtr(), size));
+}
+
 }  // namespace ultrahdr
@@ -21,6 +21,7 @@
 #endif
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
@@ -29,6 +30,7 @@
 #include "ultrahdr/ultrahdrcommon.h"
 #include "ultrahdr/jpegr.h"
 #include "ultrahdr/jpegrutils.h"
+#include "ultrahdr/gainmapmath.h"
 
 //#define DUMP_OUTPUT
 
@@ -331,6 +333,22 @@ uhdr_color_transfer_t map_internal_ct_to_ct(ultrahdr::ultrahdr_transfer_function
   }
 }
 
+struct StreamSource {
+  const uint8_t* data;
+  size_t size;
+  size_t pos;
+};
+
+int readStreamSource(void* user_data, void* data, unsigned int size) {
+  StreamSource* source = static_cast<StreamSource*>(user_data);
+  // serve odd sized chunks, so that the decoder has to refill its input often
+  size_t bytes = std::min(static_cast<size_t>(size), source->size - source->pos);
+  bytes = std::min(bytes, static_cast<size_t>(4093));
+  memcpy(data, source->data + source->pos, bytes);
+  source->pos += bytes;
+  return static_cast<int>(bytes);
+}
+
 void decodeJpegRImg(uhdr_compressed_ptr img, [[maybe_unused]] const char* outFileName) {
   jpegr_info_struct info{};
   JpegR jpegHdr;
@@ -1431,6 +1449,270 @@ TEST(JpegRTest, writeXmpThenRead) {
   EXPECT_FLOAT_EQ(metadata_expected.hdrCapacityMax, metadata_read.hdrCapacityMax);
 }
 
+/* Test JPEG/R container is assembled in exactly sized destination */
+TEST(JpegRTest, EncodeAPI4ExactSizeOutput) {
+  UhdrCompressedStructWrapper jpgImg(kImageWidth, kImageHeight);
+  ASSERT_TRUE(jpgImg.allocateMemory());
+  auto sdr = jpgImg.getImageHandle();
+  ASSERT_TRUE(readFile(kSdrJpgFileName, sdr->data, sdr->maxLength, sdr->length));
+  sdr->colorGamut = ULTRAHDR_COLORGAMUT_BT709;
+
+  ultrahdr_metadata_struct metadata;
+  metadata.version = "1.0";
+  metadata.minContentBoost = 1.0f;
+  metadata.maxContentBoost = 4.0f;
+  metadata.gamma = 1.0f;
+  metadata.offsetSdr = 0.0f;
+  metadata.offsetHdr = 0.0f;
+  metadata.hdrCapacityMin = 1.0f;
+  metadata.hdrCapacityMax = 4.0f;
+
+  // reference encode, input jpeg carries exif
+  UhdrCompressedStructWrapper jpgImgR(kImageWidth, kImageHeight);
+  ASSERT_TRUE(jpgImgR.allocateMemory());
+  JpegR uHdrLib;
+  ASSERT_EQ(uHdrLib.encodeJPEGR(sdr, sdr, &metadata, jpgImgR.getImageHandle()), ULTRAHDR_NO_ERROR);
+  auto jpg1 = jpgImgR.getImageHandle();
+
+  // destination obtained from allocator is sized to fit the output exactly
+  std::unique_ptr<uint8_t[]> data;
+  size_t requestedSize = 0;
+  JpegR uHdrLib2;
+  uHdrLib2.setOutputBufferAllocator([&data, &requestedSize](size_t size) -> void* {
+    requestedSize = size;
+    data = std::make_unique<uint8_t[]>(size);
+    return data.get();
+  });
+  ultrahdr_compressed_struct jpg2{};
+  ASSERT_EQ(uHdrLib2.encodeJPEGR(sdr, sdr, &metadata, &jpg2), ULTRAHDR_NO_ERROR);
+  ASSERT_EQ(static_cast<size_t>(jpg1->length), requestedSize);
+  ASSERT_EQ(jpg1->length, jpg2.length);
+  ASSERT_EQ(0, memcmp(jpg1->data, jpg2.data, jpg1->length));
+
+  // destination one byte short of the output is rejected before anything is written
+  std::unique_ptr<uint8_t[]> data2 = std::make_unique<uint8_t[]>(jpg1->length);
+  ultrahdr_compressed_struct jpg3{};
+  jpg3.data = data2.get();
+  jpg3.maxLength = jpg1->length - 1;
+  ASSERT_EQ(uHdrLib.encodeJPEGR(sdr, sdr, &metadata, &jpg3), ERROR_ULTRAHDR_BUFFER_TOO_SMALL);
+  jpg3.maxLength = jpg1->length;
+  ASSERT_EQ(uHdrLib.encodeJPEGR(sdr, sdr, &metadata, &jpg3), ULTRAHDR_NO_ERROR);
+  ASSERT_EQ(0, memcmp(jpg1->data, jpg3.data, jpg1->length));
+}
+
+/* Test decode of an image whose gain map is coded with three channels */
+TEST(JpegRTest, DecodeColorGainMap) {
+  UhdrCompressedStructWrapper jpgImg(kImageWidth, kImageHeight);
+  ASSERT_TRUE(jpgImg.allocateMemory());
+  auto sdr = jpgImg.getImageHandle();
+  ASSERT_TRUE(readFile(kSdrJpgFileName, sdr->data, sdr->maxLength, sdr->length));
+  sdr->colorGamut = ULTRAHDR_COLORGAMUT_BT709;
+
+  ultrahdr_metadata_struct metadata;
+  metadata.version = "1.0";
+  metadata.minContentBoost = 1.0f;
+  metadata.maxContentBoost = 4.0f;
+  metadata.gamma = 1.0f;
+  metadata.offsetSdr = 0.0f;
+  metadata.offsetHdr = 0.0f;
+  metadata.hdrCapacityMin = 1.0f;
+  metadata.hdrCapacityMax = 4.0f;
+
+  // the sdr image, a YCbCr 4:2:0 jpeg, doubles as gain map
+  UhdrCompressedStructWrapper jpgImgR(kImageWidth, kImageHeight);
+  ASSERT_TRUE(jpgImgR.allocateMemory());
+  JpegR uHdrLib;
+  ASSERT_EQ(uHdrLib.encodeJPEGR(sdr, sdr, &metadata, jpgImgR.getImageHandle()), ULTRAHDR_NO_ERROR);
+  auto jpg = jpgImgR.getImageHandle();
+
+  uhdr_codec_private_t* obj = uhdr_create_decoder();
+  uhdr_compressed_image_t uhdrImage{};
+  uhdrImage.data = jpg->data;
+  uhdrImage.data_sz = static_cast<unsigned int>(jpg->length);
+  uhdrImage.capacity = static_cast<unsigned int>(jpg->length);
+  uhdrImage.cg = UHDR_CG_UNSPECIFIED;
+  uhdrImage.ct = UHDR_CT_UNSPECIFIED;
+  uhdrImage.range = UHDR_CR_UNSPECIFIED;
+  uhdr_error_info_t status = uhdr_dec_set_image(obj, &uhdrImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(obj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* gainmapImg = uhdr_get_gain_map_image(obj);
+  ASSERT_NE(nullptr, gainmapImg);
+
+  // the gain map is the luma of the gain map image
+  JpegDecoderHelper decoder;
+  ASSERT_TRUE(decoder.decompressImage(sdr->data, sdr->length));
+  ASSERT_EQ(decoder.getDecompressedImageWidth(), gainmapImg->w);
+  ASSERT_EQ(decoder.getDecompressedImageHeight(), gainmapImg->h);
+  const uint8_t* luma = static_cast<const uint8_t*>(decoder.getDecompressedImagePtr());
+  for (unsigned y = 0; y < gainmapImg->h; y++) {
+    ASSERT_EQ(0, memcmp(luma + y * gainmapImg->w,
+                        static_cast<uint8_t*>(gainmapImg->planes[UHDR_PLANE_Y]) +
+                            y * gainmapImg->stride[UHDR_PLANE_Y],
+                        gainmapImg->w))
+        << "row " << y;
+  }
+  uhdr_release_decoder(obj);
+}
+
+/* Test encode of an image wider than 8192 pixels and its decode */
+TEST(JpegRTest, EncodeWideImage) {
+  const unsigned kWidth = 8448, kHeight = 64;
+  // a mid gray p010 image
+  std::vector<uint16_t> luma(static_cast<size_t>(kWidth) * kHeight, 512 << 6);
+  std::vector<uint16_t> chroma(static_cast<size_t>(kWidth) * kHeight / 2, 512 << 6);
+  uhdr_raw_image_t uhdrRawImg{};
+  uhdrRawImg.fmt = UHDR_IMG_FMT_24bppYCbCrP010;
+  uhdrRawImg.cg = UHDR_CG_BT_709;
+  uhdrRawImg.ct = UHDR_CT_HLG;
+  uhdrRawImg.range = UHDR_CR_LIMITED_RANGE;
+  uhdrRawImg.w = kWidth;
+  uhdrRawImg.h = kHeight;
+  uhdrRawImg.planes[UHDR_PLANE_Y] = luma.data();
+  uhdrRawImg.stride[UHDR_PLANE_Y] = kWidth;
+  uhdrRawImg.planes[UHDR_PLANE_UV] = chroma.data();
+  uhdrRawImg.stride[UHDR_PLANE_UV] = kWidth;
+
+  uhdr_codec_private_t* encObj = uhdr_create_encoder();
+  uhdr_error_info_t status = uhdr_enc_set_raw_image(encObj, &uhdrRawImg, UHDR_HDR_IMG);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_encode(encObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_compressed_image_t* compressedImage = uhdr_get_encoded_stream(encObj);
+  ASSERT_NE(nullptr, compressedImage);
+
+  uhdr_codec_private_t* decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image(decObj, compressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* decImg = uhdr_get_decoded_image(decObj);
+  ASSERT_NE(nullptr, decImg);
+  ASSERT_EQ(kWidth, decImg->w);
+  ASSERT_EQ(kHeight, decImg->h);
+  uhdr_raw_image_t* gainmapImg = uhdr_get_gain_map_image(decObj);
+  ASSERT_NE(nullptr, gainmapImg);
+  ASSERT_EQ(kWidth / kMapDimensionScaleFactor, gainmapImg->w);
+  uhdr_release_decoder(decObj);
+  uhdr_release_encoder(encObj);
+}
+
+/* Test that a display without headroom gets the sdr rendition, with the gain map left as is */
+TEST(JpegRTest, DecodeSdrRendition) {
+  UhdrCompressedStructWrapper jpgImg(kImageWidth, kImageHeight);
+  ASSERT_TRUE(jpgImg.allocateMemory());
+  auto sdr = jpgImg.getImageHandle();
+  ASSERT_TRUE(readFile(kSdrJpgFileName, sdr->data, sdr->maxLength, sdr->length));
+  sdr->colorGamut = ULTRAHDR_COLORGAMUT_BT709;
+
+  ultrahdr_metadata_struct metadata;
+  metadata.version = "1.0";
+  metadata.minContentBoost = 1.0f;
+  metadata.maxContentBoost = 4.0f;
+  metadata.gamma = 1.0f;
+  metadata.offsetSdr = 0.0f;
+  metadata.offsetHdr = 0.0f;
+  metadata.hdrCapacityMin = 1.0f;
+  metadata.hdrCapacityMax = 4.0f;
+
+  // jpegr images of the same primary image, with a uniform gain map of the given code
+  const size_t mapWidth = kImageWidth / kMapDimensionScaleFactor;
+  const size_t mapHeight = kImageHeight / kMapDimensionScaleFactor;
+  auto encode = [&](uint8_t gain, UhdrCompressedStructWrapper& jpgImgR) {
+    std::vector<uint8_t> map(mapWidth * mapHeight, gain);
+    JpegEncoderHelper encoder;
+    ASSERT_TRUE(encoder.compressImage(map.data(), nullptr, mapWidth, mapHeight, mapWidth, 0, 95,
+                                      nullptr, 0));
+    ultrahdr_compressed_struct gainmap;
+    gainmap.data = encoder.getCompressedImagePtr();
+    gainmap.length = static_cast<int>(encoder.getCompressedImageSize());
+    gainmap.maxLength = gainmap.length;
+    gainmap.colorGamut = ULTRAHDR_COLORGAMUT_UNSPECIFIED;
+    ASSERT_TRUE(jpgImgR.allocateMemory());
+    JpegR uHdrLib;
+    ASSERT_EQ(uHdrLib.encodeJPEGR(sdr, &gainmap, &metadata, jpgImgR.getImageHandle()),
+              ULTRAHDR_NO_ERROR);
+  };
+  // decodes to linear float planes at the given display boost, and checks the gain map of the
+  // given code
+  auto decode = [&](uhdr_compressed_ptr jpg, float displayBoost, uint8_t gain,
+                    std::vector<float>& pixels) {
+    uhdr_codec_private_t* obj = uhdr_create_decoder();
+    uhdr_compressed_image_t uhdrImage{};
+    uhdrImage.data = jpg->data;
+    uhdrImage.data_sz = static_cast<unsigned int>(jpg->length);
+    uhdrImage.capacity = static_cast<unsigned int>(jpg->length);
+    uhdrImage.cg = UHDR_CG_UNSPECIFIED;
+    uhdrImage.ct = UHDR_CT_UNSPECIFIED;
+    uhdrImage.range = UHDR_CR_UNSPECIFIED;
+    uhdr_error_info_t status = uhdr_dec_set_image(obj, &uhdrImage);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_out_img_format(obj, UHDR_IMG_FMT_96bppRGBFloatPlanar);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_out_color_transfer(obj, UHDR_CT_LINEAR);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_out_max_display_boost(obj, displayBoost);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_decode(obj);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    const size_t decodeBytes = uhdr_get_alloc_stats(obj)->bytes_allocated;
+    // the gain map is still available. For the sdr rendition, uhdr_decode() has skipped it and it
+    // is only decoded now, which adds at least its buffer to the allocations of the decode
+    uhdr_raw_image_t* gainmapImg = uhdr_get_gain_map_image(obj);
+    ASSERT_NE(nullptr, gainmapImg);
+    const size_t gainmapBytes = uhdr_get_alloc_stats(obj)->bytes_allocated - decodeBytes;
+    if (displayBoost <= metadata.hdrCapacityMin) {
+      ASSERT_GE(gainmapBytes, mapWidth * mapHeight);
+    } else {
+      ASSERT_EQ(0u, gainmapBytes);
+    }
+    ASSERT_EQ(uhdr_get_gain_map_image(obj), gainmapImg);
+    ASSERT_EQ(mapWidth, gainmapImg->w);
+    ASSERT_EQ(mapHeight, gainmapImg->h);
+    for (unsigned y = 0; y < gainmapImg->h; y++) {
+      const uint8_t* row =
+          static_cast<uint8_t*>(gainmapImg->planes[UHDR_PLANE_Y]) + y * gainmapImg->stride[0];
+      for (unsigned x = 0; x < gainmapImg->w; x++) {
+        ASSERT_NEAR(gain, row[x], 1) << "gain map sample (" << x << ", " << y << ")";
+      }
+    }
+    uhdr_raw_image_t* decImg = uhdr_get_decoded_image(obj);
+    ASSERT_NE(nullptr, decImg);
+    ASSERT_EQ(kImageWidth, decImg->w);
+    ASSERT_EQ(kImageHeight, decImg->h);
+    pixels.clear();
+    for (int c = UHDR_PLANE_R; c <= UHDR_PLANE_B; c++) {
+      for (unsigned y = 0; y < decImg->h; y++) {
+        const float* row = static_cast<float*>(decImg->planes[c]) + y * decImg->stride[c];
+        pixels.insert(pixels.end(), row, row + decImg->w);
+      }
+    }
+    uhdr_release_decoder(obj);
+  };
+
+  UhdrCompressedStructWrapper maxGainImg(kImageWidth, kImageHeight);
+  UhdrCompressedStructWrapper minGainImg(kImageWidth, kImageHeight);
+  ASSERT_NO_FATAL_FAILURE(encode(255, maxGainImg));
+  ASSERT_NO_FATAL_FAILURE(encode(0, minGainImg));
+
+  // at hdrCapacityMin the gain map has no effect
+  std::vector<float> sdrRendition, maxGainSdrRendition;
+  ASSERT_NO_FATAL_FAILURE(decode(minGainImg.getImageHandle(), 1.0f, 0, sdrRendition));
+  ASSERT_NO_FATAL_FAILURE(decode(maxGainImg.getImageHandle(), 1.0f, 255, maxGainSdrRendition));
+  ASSERT_EQ(sdrRendition, maxGainSdrRendition);
+
+  // just above it, the lowest gain code has no effect either, so the full reconstruction of the
+  // same sdr image must match up to the scaling by the display boost
+  const float kDisplayBoost = 1.01f;
+  std::vector<float> reconstruction;
+  ASSERT_NO_FATAL_FAILURE(decode(minGainImg.getImageHandle(), kDisplayBoost, 0, reconstruction));
+  ASSERT_EQ(sdrRendition.size(), reconstruction.size());
+  for (size_t i = 0; i < sdrRendition.size(); i++) {
+    ASSERT_NEAR(sdrRendition[i], reconstruction[i] * kDisplayBoost, 1e-5f) << "sample " << i;
+  }
+}
+
 class JpegRAPIEncodeAndDecodeTest
     : public ::testing::TestWithParam<std::tuple<ultrahdr_color_gamut, ultrahdr_color_gamut>> {
  public:
@@ -1480,6 +1762,33 @@ TEST_P(JpegRAPIEncodeAndDecodeTest, EncodeAPI0AndDecodeTest) {
   ASSERT_EQ(jpgImg.getImageHandle()->length, compressedImage->data_sz);
   ASSERT_EQ(0,
             memcmp(jpgImg.getImageHandle()->data, compressedImage->data, compressedImage->data_sz));
+
+  // encode with output sink set
+  {
+    std::vector<uint8_t> sinkData;
+    auto sink = [](void* user_data, const void* data, unsigned int size) -> int {
+      auto out = static_cast<std::vector<uint8_t>*>(user_data);
+      out->insert(out->end(), static_cast<const uint8_t*>(data),
+                  static_cast<const uint8_t*>(data) + size);
+      return 0;
+    };
+    uhdr_reset_encoder(obj);
+    status = uhdr_enc_set_raw_image(obj, &uhdrRawImg, UHDR_HDR_IMG);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_enc_set_quality(obj, kQuality, UHDR_BASE_IMG);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_enc_set_output_sink(obj, sink, &sinkData);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_encode(obj);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    ASSERT_EQ(nullptr, uhdr_get_encoded_stream(obj));
+    status = uhdr_enc_write_to_file(obj, "encode_api0_sink_output.jpg");
+    ASSERT_EQ(UHDR_CODEC_INVALID_OPERATION, status.error_code)
+        << "fail, wrote to file an output that was handed to the sink";
+    ASSERT_EQ(static_cast<size_t>(jpgImg.getImageHandle()->length), sinkData.size());
+    ASSERT_EQ(0, memcmp(jpgImg.getImageHandle()->data, sinkData.data(), sinkData.size()));
+  }
+
   uhdr_release_encoder(obj);
 
   // encode with luma stride set
@@ -2158,6 +2467,817 @@ INSTANTIATE_TEST_SUITE_P(
                        ::testing::Values(ULTRAHDR_COLORGAMUT_BT709, ULTRAHDR_COLORGAMUT_P3,
                                          ULTRAHDR_COLORGAMUT_BT2100)));
 
+/* Decode API features, exercised on a reference image encoded with API-0 */
+class JpegRAPIDecodeTest : public ::testing::TestWithParam<ultrahdr_color_gamut> {
+ public:
+  JpegRAPIDecodeTest()
+      : mP010ColorGamut(GetParam()),
+        mRawImg(kImageWidth, kImageHeight, YCbCr_p010),
+        mJpgImg(kImageWidth, kImageHeight){};
+
+  void SetUp() override {
+    ASSERT_TRUE(mRawImg.setImageColorGamut(mP010ColorGamut));
+    ASSERT_TRUE(mRawImg.allocateMemory());
+    ASSERT_TRUE(mRawImg.loadRawResource(kYCbCrP010FileName));
+    ASSERT_TRUE(mJpgImg.allocateMemory());
+    JpegR uHdrLib;
+    ASSERT_EQ(
+        uHdrLib.encodeJPEGR(mRawImg.getImageHandle(), ultrahdr_transfer_function::ULTRAHDR_TF_HLG,
+                            mJpgImg.getImageHandle(), kQuality, nullptr),
+        ULTRAHDR_NO_ERROR);
+    uhdr_compressed_ptr jpg = mJpgImg.getImageHandle();
+    mCompressedImage.data = jpg->data;
+    mCompressedImage.data_sz = static_cast<unsigned int>(jpg->length);
+    mCompressedImage.capacity = static_cast<unsigned int>(jpg->length);
+    mCompressedImage.cg = UHDR_CG_UNSPECIFIED;
+    mCompressedImage.ct = UHDR_CT_UNSPECIFIED;
+    mCompressedImage.range = UHDR_CR_UNSPECIFIED;
+
+    mUhdrRawImg.fmt = UHDR_IMG_FMT_24bppYCbCrP010;
+    mUhdrRawImg.cg = map_internal_cg_to_cg(mP010ColorGamut);
+    mUhdrRawImg.ct = map_internal_ct_to_ct(ultrahdr_transfer_function::ULTRAHDR_TF_HLG);
+    mUhdrRawImg.range = UHDR_CR_UNSPECIFIED;
+    mUhdrRawImg.w = kImageWidth;
+    mUhdrRawImg.h = kImageHeight;
+    mUhdrRawImg.planes[UHDR_PLANE_Y] = mRawImg.getImageHandle()->data;
+    mUhdrRawImg.stride[UHDR_PLANE_Y] = kImageWidth;
+    mUhdrRawImg.planes[UHDR_PLANE_UV] =
+        static_cast<uint8_t*>(mRawImg.getImageHandle()->data) + kImageWidth * kImageHeight * 2;
+    mUhdrRawImg.stride[UHDR_PLANE_UV] = kImageWidth;
+  }
+
+  const ultrahdr_color_gamut mP010ColorGamut;
+  UhdrUnCompressedStructWrapper mRawImg;
+  UhdrCompressedStructWrapper mJpgImg;
+  // reference encode, as seen by the encoder and the decoder api
+  uhdr_raw_image_t mUhdrRawImg{};
+  uhdr_compressed_image_t mCompressedImage{};
+};
+
+/* Test decode with the input read through a callback */
+TEST_P(JpegRAPIDecodeTest, DecodeFromImageSource) {
+  uhdr_codec_private_t* refObj = uhdr_create_decoder();
+  uhdr_error_info_t status = uhdr_dec_set_image(refObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(refObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* refDecImg = uhdr_get_decoded_image(refObj);
+  ASSERT_NE(nullptr, refDecImg);
+
+  StreamSource source{static_cast<const uint8_t*>(mCompressedImage.data),
+                      mCompressedImage.data_sz, 0};
+  uhdr_codec_private_t* decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image_source(decObj, readStreamSource, &source);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* decImg = uhdr_get_decoded_image(decObj);
+  ASSERT_NE(nullptr, decImg);
+  ASSERT_EQ(refDecImg->cg, decImg->cg);
+  ASSERT_EQ(refDecImg->w, decImg->w);
+  ASSERT_EQ(refDecImg->h, decImg->h);
+  ASSERT_EQ(refDecImg->stride[UHDR_PLANE_PACKED], decImg->stride[UHDR_PLANE_PACKED]);
+  ASSERT_EQ(0, memcmp(refDecImg->planes[UHDR_PLANE_PACKED], decImg->planes[UHDR_PLANE_PACKED],
+                      refDecImg->stride[UHDR_PLANE_PACKED] * refDecImg->h * 8));
+  uhdr_release_decoder(decObj);
+  uhdr_release_decoder(refObj);
+
+  // truncated stream
+  source = {static_cast<const uint8_t*>(mCompressedImage.data),
+            static_cast<size_t>(mCompressedImage.data_sz - 64), 0};
+  decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image_source(decObj, readStreamSource, &source);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(decObj);
+  ASSERT_NE(UHDR_CODEC_OK, status.error_code) << "fail, decode succeeded for truncated stream";
+  uhdr_release_decoder(decObj);
+}
+
+/* Test encoded stream written to file and decoded in place */
+TEST_P(JpegRAPIDecodeTest, DecodeFromFile) {
+  uhdr_codec_private_t* obj = uhdr_create_encoder();
+  uhdr_error_info_t status = uhdr_enc_set_raw_image(obj, &mUhdrRawImg, UHDR_HDR_IMG);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_enc_set_quality(obj, kQuality, UHDR_BASE_IMG);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_encode(obj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+
+  const char* fileName = "encode_api0_output.jpg";
+  status = uhdr_enc_write_to_file(obj, fileName);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_codec_private_t* decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image_from_file(decObj, fileName);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* fileDecImg = uhdr_get_decoded_image(decObj);
+  ASSERT_NE(nullptr, fileDecImg);
+
+  uhdr_codec_private_t* refObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image(refObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(refObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* refDecImg = uhdr_get_decoded_image(refObj);
+  ASSERT_NE(nullptr, refDecImg);
+  ASSERT_EQ(refDecImg->w, fileDecImg->w);
+  ASSERT_EQ(refDecImg->h, fileDecImg->h);
+  ASSERT_EQ(refDecImg->stride[UHDR_PLANE_PACKED], fileDecImg->stride[UHDR_PLANE_PACKED]);
+  ASSERT_EQ(0, memcmp(refDecImg->planes[UHDR_PLANE_PACKED], fileDecImg->planes[UHDR_PLANE_PACKED],
+                      refDecImg->stride[UHDR_PLANE_PACKED] * refDecImg->h * 8));
+  uhdr_release_decoder(refObj);
+  uhdr_release_decoder(decObj);
+  std::remove(fileName);
+
+  decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image_from_file(decObj, fileName);
+  ASSERT_NE(UHDR_CODEC_OK, status.error_code) << "fail, mapped a file that does not exist";
+  uhdr_release_decoder(decObj);
+  uhdr_release_encoder(obj);
+}
+
+/* Test encode and decode with a custom allocator */
+TEST_P(JpegRAPIDecodeTest, EncodeAndDecodeWithAllocator) {
+  struct CountingAllocator {
+    int liveBlocks = 0;
+    int numAllocs = 0;
+  } counter;
+  auto allocCb = [](void* user_data, size_t size, size_t alignment) -> void* {
+    auto c = static_cast<CountingAllocator*>(user_data);
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, alignment, size) != 0) return nullptr;
+    c->liveBlocks++;
+    c->numAllocs++;
+    return ptr;
+  };
+  auto freeCb = [](void* user_data, void* ptr) {
+    auto c = static_cast<CountingAllocator*>(user_data);
+    c->liveBlocks--;
+    free(ptr);
+  };
+  uhdr_error_info_t status = uhdr_set_allocator(allocCb, nullptr, &counter);
+  ASSERT_EQ(UHDR_CODEC_INVALID_PARAM, status.error_code) << "fail, accepted only alloc_cb";
+  status = uhdr_set_allocator(allocCb, freeCb, &counter);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+
+  uhdr_codec_private_t* obj = uhdr_create_encoder();
+  status = uhdr_enc_set_raw_image(obj, &mUhdrRawImg, UHDR_HDR_IMG);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_enc_set_quality(obj, kQuality, UHDR_BASE_IMG);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_encode(obj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_compressed_image_t* output = uhdr_get_encoded_stream(obj);
+  ASSERT_NE(nullptr, output);
+  ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(output->data) % 64);
+  ASSERT_EQ(mJpgImg.getImageHandle()->length, output->data_sz);
+  ASSERT_EQ(0, memcmp(mJpgImg.getImageHandle()->data, output->data, output->data_sz));
+  uhdr_alloc_stats_t* stats = uhdr_get_alloc_stats(obj);
+  ASSERT_NE(nullptr, stats);
+  ASSERT_GT(stats->num_allocations, 0u);
+  ASSERT_GE(stats->bytes_allocated, static_cast<size_t>(output->data_sz));
+  ASSERT_GT(stats->peak_bytes, 0u);
+  ASSERT_LE(stats->peak_bytes, stats->bytes_allocated);
+
+  uhdr_codec_private_t* decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image(decObj, output);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* decImg = uhdr_get_decoded_image(decObj);
+  ASSERT_NE(nullptr, decImg);
+  ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(decImg->planes[UHDR_PLANE_PACKED]) % 64);
+  stats = uhdr_get_alloc_stats(decObj);
+  ASSERT_NE(nullptr, stats);
+  ASSERT_GE(stats->bytes_allocated, static_cast<size_t>(decImg->w) * decImg->h * 8);
+  ASSERT_LE(stats->peak_bytes, stats->bytes_allocated);
+  uhdr_release_decoder(decObj);
+  uhdr_release_encoder(obj);
+
+  status = uhdr_set_allocator(nullptr, nullptr, nullptr);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  ASSERT_GT(counter.numAllocs, 0);
+  ASSERT_EQ(0, counter.liveBlocks) << "fail, blocks of the custom allocator are leaked";
+}
+
+/* Test decode of several renditions in one pass */
+TEST_P(JpegRAPIDecodeTest, DecodeRenditions) {
+  struct {
+    uhdr_img_fmt_t fmt;
+    uhdr_color_transfer_t ct;
+    float displayBoost;
+    size_t bpp;
+  } configs[] = {{UHDR_IMG_FMT_64bppRGBAHalfFloat, UHDR_CT_LINEAR, FLT_MAX, 8},
+                 {UHDR_IMG_FMT_64bppRGBAHalfFloat, UHDR_CT_LINEAR, 2.0f, 8},
+                 {UHDR_IMG_FMT_32bppRGBA1010102, UHDR_CT_PQ, 4.0f, 4},
+                 {UHDR_IMG_FMT_32bppRGBA1010102, UHDR_CT_HLG, 1.5f, 4}};
+  uhdr_codec_private_t* decObj = uhdr_create_decoder();
+  uhdr_error_info_t status = uhdr_dec_set_image(decObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_add_out_rendition(decObj, UHDR_IMG_FMT_32bppRGBA8888, UHDR_CT_SRGB, 2.0f);
+  ASSERT_EQ(UHDR_CODEC_INVALID_PARAM, status.error_code) << "fail, added an sdr rendition";
+  status = uhdr_dec_add_out_rendition(decObj, UHDR_IMG_FMT_32bppRGBA1010102, UHDR_CT_LINEAR,
+                                      2.0f);
+  ASSERT_EQ(UHDR_CODEC_INVALID_PARAM, status.error_code)
+      << "fail, added a rendition with mismatched format and transfer";
+  for (size_t i = 1; i < sizeof configs / sizeof configs[0]; i++) {
+    status = uhdr_dec_add_out_rendition(decObj, configs[i].fmt, configs[i].ct,
+                                        configs[i].displayBoost);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  }
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  ASSERT_EQ(uhdr_get_decoded_image(decObj), uhdr_get_decoded_rendition(decObj, 0));
+  ASSERT_EQ(nullptr, uhdr_get_decoded_rendition(decObj, sizeof configs / sizeof configs[0]));
+
+  for (size_t i = 0; i < sizeof configs / sizeof configs[0]; i++) {
+    uhdr_codec_private_t* refObj = uhdr_create_decoder();
+    status = uhdr_dec_set_image(refObj, &mCompressedImage);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_out_img_format(refObj, configs[i].fmt);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_out_color_transfer(refObj, configs[i].ct);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_out_max_display_boost(refObj, configs[i].displayBoost);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_decode(refObj);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    uhdr_raw_image_t* refDecImg = uhdr_get_decoded_image(refObj);
+    uhdr_raw_image_t* decImg = uhdr_get_decoded_rendition(decObj, i);
+    ASSERT_NE(nullptr, refDecImg);
+    ASSERT_NE(nullptr, decImg);
+    ASSERT_EQ(refDecImg->fmt, decImg->fmt);
+    ASSERT_EQ(refDecImg->ct, decImg->ct);
+    ASSERT_EQ(refDecImg->cg, decImg->cg);
+    ASSERT_EQ(refDecImg->w, decImg->w);
+    ASSERT_EQ(refDecImg->h, decImg->h);
+    ASSERT_EQ(0, memcmp(refDecImg->planes[UHDR_PLANE_PACKED], decImg->planes[UHDR_PLANE_PACKED],
+                        refDecImg->stride[UHDR_PLANE_PACKED] * refDecImg->h * configs[i].bpp))
+        << "fail, rendition " << i << " differs from its single rendition decode";
+    uhdr_release_decoder(refObj);
+  }
+  uhdr_release_decoder(decObj);
+}
+
+/* Test gathering of image statistics while decoding */
+TEST_P(JpegRAPIDecodeTest, DecodeWithImageStats) {
+  uhdr_codec_private_t* decObj = uhdr_create_decoder();
+  uhdr_error_info_t status = uhdr_dec_set_image(decObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_enable_image_stats(decObj, 1);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  ASSERT_EQ(nullptr, uhdr_dec_get_image_stats(decObj));
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* decImg = uhdr_get_decoded_image(decObj);
+  uhdr_image_stats_t* stats = uhdr_dec_get_image_stats(decObj);
+  ASSERT_NE(nullptr, decImg);
+  ASSERT_NE(nullptr, stats);
+  ASSERT_EQ(static_cast<size_t>(decImg->w) * decImg->h, stats->num_pixels);
+  ASSERT_LE(stats->num_clipped_pixels, stats->num_pixels);
+  ASSERT_GT(stats->max_luminance, 0.0f);
+  ASSERT_GE(stats->max_luminance, stats->avg_luminance);
+  size_t count = 0;
+  for (size_t i = 0; i < UHDR_GAIN_HISTOGRAM_BINS; i++) {
+    count += stats->gain_histogram[i];
+  }
+  ASSERT_EQ(stats->num_pixels, count);
+  uhdr_release_decoder(decObj);
+
+  // not gathered unless enabled
+  decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image(decObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  ASSERT_EQ(nullptr, uhdr_dec_get_image_stats(decObj));
+  uhdr_release_decoder(decObj);
+}
+
+/* Test decode to p010, alone and as a rendition */
+TEST_P(JpegRAPIDecodeTest, DecodeToP010) {
+  uhdr_codec_private_t* decObj = uhdr_create_decoder();
+  uhdr_error_info_t status = uhdr_dec_set_image(decObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_set_out_img_format(decObj, UHDR_IMG_FMT_24bppYCbCrP010);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_set_out_color_transfer(decObj, UHDR_CT_PQ);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* decImg = uhdr_get_decoded_image(decObj);
+  ASSERT_NE(nullptr, decImg);
+  ASSERT_EQ(UHDR_IMG_FMT_24bppYCbCrP010, decImg->fmt);
+  ASSERT_EQ(UHDR_CR_LIMITED_RANGE, decImg->range);
+  for (unsigned y = 0; y < decImg->h; y++) {
+    const uint16_t* luma =
+        static_cast<uint16_t*>(decImg->planes[UHDR_PLANE_Y]) + y * decImg->stride[UHDR_PLANE_Y];
+    for (unsigned x = 0; x < decImg->w; x++) {
+      ASSERT_EQ(0, luma[x] & 0x3f);
+      ASSERT_GE(luma[x] >> 6, 64);
+      ASSERT_LE(luma[x] >> 6, 940);
+    }
+  }
+
+  uhdr_codec_private_t* renditionObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image(renditionObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_add_out_rendition(renditionObj, UHDR_IMG_FMT_24bppYCbCrP010, UHDR_CT_PQ,
+                                      FLT_MAX);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(renditionObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* renditionImg = uhdr_get_decoded_rendition(renditionObj, 1);
+  ASSERT_NE(nullptr, renditionImg);
+  ASSERT_EQ(decImg->stride[UHDR_PLANE_Y], renditionImg->stride[UHDR_PLANE_Y]);
+  ASSERT_EQ(decImg->stride[UHDR_PLANE_UV], renditionImg->stride[UHDR_PLANE_UV]);
+  ASSERT_EQ(0, memcmp(decImg->planes[UHDR_PLANE_Y], renditionImg->planes[UHDR_PLANE_Y],
+                      decImg->stride[UHDR_PLANE_Y] * decImg->h * 2));
+  ASSERT_EQ(0, memcmp(decImg->planes[UHDR_PLANE_UV], renditionImg->planes[UHDR_PLANE_UV],
+                      decImg->stride[UHDR_PLANE_UV] * ((decImg->h + 1) / 2) * 2));
+  uhdr_release_decoder(renditionObj);
+  uhdr_release_decoder(decObj);
+}
+
+/* Test conversion of the output color gamut while decoding */
+TEST_P(JpegRAPIDecodeTest, DecodeToColorGamut) {
+  uhdr_codec_private_t* refObj = uhdr_create_decoder();
+  uhdr_error_info_t status = uhdr_dec_set_image(refObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(refObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* refDecImg = uhdr_get_decoded_image(refObj);
+  ASSERT_NE(nullptr, refDecImg);
+  const size_t size = refDecImg->stride[UHDR_PLANE_PACKED] * refDecImg->h * 8;
+
+  const uhdr_color_gamut_t gamuts[] = {UHDR_CG_BT_709, UHDR_CG_DISPLAY_P3, UHDR_CG_BT_2100};
+  for (uhdr_color_gamut_t cg : gamuts) {
+    uhdr_codec_private_t* decObj = uhdr_create_decoder();
+    status = uhdr_dec_set_image(decObj, &mCompressedImage);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_out_color_gamut(decObj, cg);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_enable_image_stats(decObj, 1);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_decode(decObj);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_out_color_gamut(decObj, UHDR_CG_BT_709);
+    ASSERT_EQ(UHDR_CODEC_INVALID_OPERATION, status.error_code)
+        << "fail, configured the output color gamut after decode";
+    uhdr_raw_image_t* decImg = uhdr_get_decoded_image(decObj);
+    ASSERT_NE(nullptr, decImg);
+    ASSERT_EQ(cg, decImg->cg);
+    if (cg == refDecImg->cg) {
+      ASSERT_EQ(0, memcmp(refDecImg->planes[UHDR_PLANE_PACKED], decImg->planes[UHDR_PLANE_PACKED],
+                          size))
+          << "fail, conversion to the gamut of the base image changed the output";
+    } else {
+      ASSERT_NE(0, memcmp(refDecImg->planes[UHDR_PLANE_PACKED], decImg->planes[UHDR_PLANE_PACKED],
+                          size))
+          << "fail, output was not converted to color gamut " << cg;
+      // colors that were brought to the boundary of the output gamut count as clipped
+      size_t clipped = 0;
+      for (unsigned y = 0; y < decImg->h; y++) {
+        const uint64_t* refRow = static_cast<uint64_t*>(refDecImg->planes[UHDR_PLANE_PACKED]) +
+                                 y * refDecImg->stride[UHDR_PLANE_PACKED];
+        const uint64_t* row = static_cast<uint64_t*>(decImg->planes[UHDR_PLANE_PACKED]) +
+                              y * decImg->stride[UHDR_PLANE_PACKED];
+        for (unsigned x = 0; x < decImg->w; x++) {
+          bool positive = true, zero = false, aboveOne = false;
+          for (int c = 0; c < 3; c++) {
+            const uint16_t refValue = static_cast<uint16_t>(refRow[x] >> (c * 16));
+            const uint16_t value = static_cast<uint16_t>(row[x] >> (c * 16));
+            positive = positive && refValue != 0 && (refValue & 0x8000) == 0;
+            zero = zero || value == 0;
+            aboveOne = aboveOne || value > floatToHalf(1.0f);
+          }
+          clipped += (positive && zero) || aboveOne;
+        }
+      }
+      uhdr_image_stats_t* stats = uhdr_dec_get_image_stats(decObj);
+      ASSERT_NE(nullptr, stats);
+      ASSERT_GE(stats->num_clipped_pixels, clipped)
+          << "fail, colors outside of color gamut " << cg << " were not counted as clipped";
+    }
+    uhdr_release_decoder(decObj);
+  }
+  uhdr_release_decoder(refObj);
+
+  uhdr_codec_private_t* decObj = uhdr_create_decoder();
+  status =
+      uhdr_dec_set_out_color_gamut(decObj, static_cast<uhdr_color_gamut_t>(UHDR_CG_BT_2100 + 1));
+  ASSERT_EQ(UHDR_CODEC_INVALID_PARAM, status.error_code) << "fail, accepted an unknown gamut";
+  uhdr_release_decoder(decObj);
+}
+
+/* Test table based gain map application against the default path */
+TEST_P(JpegRAPIDecodeTest, DecodeWithGainCodeLUT) {
+  const uhdr_color_transfer_t transfers[] = {UHDR_CT_PQ, UHDR_CT_HLG};
+  for (uhdr_color_transfer_t ct : transfers) {
+    uhdr_raw_image_t* decImgs[2];
+    uhdr_codec_private_t* decObjs[2];
+    for (int i = 0; i < 2; i++) {
+      decObjs[i] = uhdr_create_decoder();
+      uhdr_error_info_t status = uhdr_dec_set_image(decObjs[i], &mCompressedImage);
+      ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+      status = uhdr_dec_set_out_img_format(decObjs[i], UHDR_IMG_FMT_32bppRGBA1010102);
+      ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+      status = uhdr_dec_set_out_color_transfer(decObjs[i], ct);
+      ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+      status = uhdr_dec_enable_gain_code_lut(decObjs[i], i);
+      ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+      status = uhdr_decode(decObjs[i]);
+      ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+      decImgs[i] = uhdr_get_decoded_image(decObjs[i]);
+      ASSERT_NE(nullptr, decImgs[i]);
+    }
+    ASSERT_EQ(decImgs[0]->w, decImgs[1]->w);
+    ASSERT_EQ(decImgs[0]->h, decImgs[1]->h);
+    ASSERT_EQ(decImgs[0]->cg, decImgs[1]->cg);
+    // the base image and the gains are rounded to 8 bits, which moves the 10-bit outputs by a few
+    // codes
+    const int kMaxCodeDiff = 4;
+    const uint32_t* ref = static_cast<uint32_t*>(decImgs[0]->planes[UHDR_PLANE_PACKED]);
+    const uint32_t* lut = static_cast<uint32_t*>(decImgs[1]->planes[UHDR_PLANE_PACKED]);
+    for (size_t i = 0; i < static_cast<size_t>(decImgs[0]->w) * decImgs[0]->h; i++) {
+      for (int c = 0; c < 3; c++) {
+        const int refCode = (ref[i] >> (c * 10)) & 0x3ff;
+        const int lutCode = (lut[i] >> (c * 10)) & 0x3ff;
+        ASSERT_LE(std::abs(refCode - lutCode), kMaxCodeDiff)
+            << "transfer " << ct << ", pixel " << i << ", channel " << c;
+      }
+    }
+    uhdr_release_decoder(decObjs[0]);
+    uhdr_release_decoder(decObjs[1]);
+  }
+}
+
+/* Test decode to float planes owned by the application, with padded strides */
+TEST_P(JpegRAPIDecodeTest, DecodeToFloatPlanes) {
+  uhdr_codec_private_t* refObj = uhdr_create_decoder();
+  uhdr_error_info_t status = uhdr_dec_set_image(refObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(refObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* refDecImg = uhdr_get_decoded_image(refObj);
+  ASSERT_NE(nullptr, refDecImg);
+
+  const unsigned kPadding = 3;
+  const unsigned stride = refDecImg->w + kPadding;
+  const size_t planeSize = static_cast<size_t>(stride) * refDecImg->h;
+  const float kCanary = -1.0f;
+  std::vector<float> tensor(planeSize * 3, kCanary);
+  uhdr_raw_image_t outImg{};
+  outImg.fmt = UHDR_IMG_FMT_96bppRGBFloatPlanar;
+  outImg.w = refDecImg->w;
+  outImg.h = refDecImg->h;
+  for (int i = UHDR_PLANE_R; i <= UHDR_PLANE_B; i++) {
+    outImg.planes[i] = tensor.data() + i * planeSize;
+    outImg.stride[i] = stride;
+  }
+
+  uhdr_codec_private_t* decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image(decObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_set_out_img_format(decObj, UHDR_IMG_FMT_96bppRGBFloatPlanar);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_set_out_img_buffer(decObj, &outImg);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* decImg = uhdr_get_decoded_image(decObj);
+  ASSERT_NE(nullptr, decImg);
+  ASSERT_EQ(UHDR_IMG_FMT_96bppRGBFloatPlanar, decImg->fmt);
+  ASSERT_EQ(UHDR_CT_LINEAR, decImg->ct);
+  ASSERT_EQ(refDecImg->cg, decImg->cg);
+  ASSERT_EQ(outImg.planes[UHDR_PLANE_R], decImg->planes[UHDR_PLANE_R]);
+  // same values as the half float output, padding is left untouched
+  const uint64_t* ref = static_cast<uint64_t*>(refDecImg->planes[UHDR_PLANE_PACKED]);
+  for (unsigned y = 0; y < decImg->h; y++) {
+    for (unsigned x = 0; x < decImg->w; x++) {
+      const uint64_t refPixel = ref[y * refDecImg->stride[UHDR_PLANE_PACKED] + x];
+      for (int c = 0; c < 3; c++) {
+        const float value = tensor[c * planeSize + y * stride + x];
+        ASSERT_EQ(static_cast<uint16_t>(refPixel >> (c * 16)), floatToHalf(value))
+            << "pixel (" << x << ", " << y << "), channel " << c;
+      }
+    }
+    for (unsigned x = decImg->w; x < stride; x++) {
+      for (int c = 0; c < 3; c++) {
+        ASSERT_EQ(kCanary, tensor[c * planeSize + y * stride + x]);
+      }
+    }
+  }
+  uhdr_release_decoder(decObj);
+
+  // as a rendition, the planes are allocated by the decoder
+  decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image(decObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status =
+      uhdr_dec_add_out_rendition(decObj, UHDR_IMG_FMT_96bppRGBFloatPlanar, UHDR_CT_LINEAR, FLT_MAX);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* renditionImg = uhdr_get_decoded_rendition(decObj, 1);
+  ASSERT_NE(nullptr, renditionImg);
+  for (int c = UHDR_PLANE_R; c <= UHDR_PLANE_B; c++) {
+    for (unsigned y = 0; y < renditionImg->h; y++) {
+      ASSERT_EQ(0, memcmp(static_cast<float*>(renditionImg->planes[c]) +
+                              y * renditionImg->stride[c],
+                          tensor.data() + c * planeSize + y * stride,
+                          renditionImg->w * sizeof(float)));
+    }
+  }
+  uhdr_release_decoder(decObj);
+
+  // the buffer must match the output format and the image dimensions
+  decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image(decObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_set_out_img_buffer(decObj, &outImg);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_INVALID_PARAM, status.error_code)
+      << "fail, decoded half floats to a float buffer";
+  uhdr_release_decoder(decObj);
+
+  decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image(decObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_set_out_img_format(decObj, UHDR_IMG_FMT_96bppRGBFloatPlanar);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  outImg.h -= 1;
+  status = uhdr_dec_set_out_img_buffer(decObj, &outImg);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_INVALID_PARAM, status.error_code)
+      << "fail, decoded to a buffer smaller than the image";
+  uhdr_release_decoder(decObj);
+
+  decObj = uhdr_create_decoder();
+  outImg.stride[UHDR_PLANE_G] = outImg.w - 1;
+  status = uhdr_dec_set_out_img_buffer(decObj, &outImg);
+  ASSERT_EQ(UHDR_CODEC_INVALID_PARAM, status.error_code) << "fail, accepted a short stride";
+  outImg.stride[UHDR_PLANE_G] = stride;
+  outImg.fmt = UHDR_IMG_FMT_64bppRGBAHalfFloat;
+  status = uhdr_dec_set_out_img_buffer(decObj, &outImg);
+  ASSERT_EQ(UHDR_CODEC_INVALID_PARAM, status.error_code)
+      << "fail, accepted a buffer of a packed format";
+  uhdr_release_decoder(decObj);
+  uhdr_release_decoder(refObj);
+}
+
+/* Test reduced resolution decode against the box filtered full resolution decode */
+TEST_P(JpegRAPIDecodeTest, DecodeAtReducedResolution) {
+  uhdr_codec_private_t* refObj = uhdr_create_decoder();
+  uhdr_error_info_t status = uhdr_dec_set_image(refObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_set_out_img_format(refObj, UHDR_IMG_FMT_32bppRGBA1010102);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_set_out_color_transfer(refObj, UHDR_CT_PQ);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(refObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* refDecImg = uhdr_get_decoded_image(refObj);
+  ASSERT_NE(nullptr, refDecImg);
+  const uint32_t* ref = static_cast<uint32_t*>(refDecImg->planes[UHDR_PLANE_PACKED]);
+
+  for (int scale : {2, 4, 8}) {
+    uhdr_codec_private_t* decObj = uhdr_create_decoder();
+    status = uhdr_dec_set_image(decObj, &mCompressedImage);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_out_img_format(decObj, UHDR_IMG_FMT_32bppRGBA1010102);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_out_color_transfer(decObj, UHDR_CT_PQ);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_scale(decObj, scale);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_decode(decObj);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    ASSERT_EQ(static_cast<int>(refDecImg->w), uhdr_dec_get_image_width(decObj));
+    uhdr_raw_image_t* decImg = uhdr_get_decoded_image(decObj);
+    ASSERT_NE(nullptr, decImg);
+    ASSERT_EQ((refDecImg->w + scale - 1) / scale, decImg->w);
+    ASSERT_EQ((refDecImg->h + scale - 1) / scale, decImg->h);
+    ASSERT_EQ(refDecImg->cg, decImg->cg);
+    uhdr_raw_image_t* gainmapImg = uhdr_get_gain_map_image(decObj);
+    ASSERT_NE(nullptr, gainmapImg);
+    ASSERT_EQ(0u, decImg->w % gainmapImg->w);
+    ASSERT_EQ(decImg->w / gainmapImg->w, decImg->h / gainmapImg->h);
+    if (scale == kMapDimensionScaleFactor) {
+      // the gain map is used as is
+      ASSERT_EQ(decImg->w, gainmapImg->w);
+      ASSERT_EQ(decImg->h, gainmapImg->h);
+    }
+
+    const uint32_t* scaled = static_cast<uint32_t*>(decImg->planes[UHDR_PLANE_PACKED]);
+    double sumAbsDiff = 0;
+    for (unsigned y = 0; y < refDecImg->h / scale; y++) {
+      for (unsigned x = 0; x < refDecImg->w / scale; x++) {
+        for (int c = 0; c < 3; c++) {
+          int sum = 0;
+          for (int i = 0; i < scale; i++) {
+            for (int j = 0; j < scale; j++) {
+              const size_t idx = (y * scale + i) * refDecImg->stride[UHDR_PLANE_PACKED] +
+                                 x * scale + j;
+              sum += (ref[idx] >> (c * 10)) & 0x3ff;
+            }
+          }
+          const uint32_t pixel = scaled[y * decImg->stride[UHDR_PLANE_PACKED] + x];
+          const int code = (pixel >> (c * 10)) & 0x3ff;
+          sumAbsDiff += std::abs(code - static_cast<double>(sum) / (scale * scale));
+        }
+      }
+    }
+    const double meanAbsDiff =
+        sumAbsDiff / (3.0 * (refDecImg->w / scale) * (refDecImg->h / scale));
+    ASSERT_LE(meanAbsDiff, 8.0) << "scale 1/" << scale;
+    uhdr_release_decoder(decObj);
+  }
+  uhdr_release_decoder(refObj);
+
+  uhdr_codec_private_t* decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_scale(decObj, 3);
+  ASSERT_EQ(UHDR_CODEC_INVALID_PARAM, status.error_code) << "fail, accepted scale 1/3";
+  status = uhdr_dec_set_image(decObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_probe(decObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_set_scale(decObj, 2);
+  ASSERT_EQ(UHDR_CODEC_INVALID_OPERATION, status.error_code)
+      << "fail, changed the scale of a probed context";
+  uhdr_release_decoder(decObj);
+}
+
+/* Test region of interest decode against the region of the full decode */
+TEST_P(JpegRAPIDecodeTest, DecodeRegionOfInterest) {
+  uhdr_error_info_t status;
+  for (uhdr_color_transfer_t ct : {UHDR_CT_PQ, UHDR_CT_SRGB}) {
+    const uhdr_img_fmt_t fmt =
+        ct == UHDR_CT_PQ ? UHDR_IMG_FMT_32bppRGBA1010102 : UHDR_IMG_FMT_32bppRGBA8888;
+    uhdr_codec_private_t* refObj = uhdr_create_decoder();
+    status = uhdr_dec_set_image(refObj, &mCompressedImage);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_out_img_format(refObj, fmt);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_out_color_transfer(refObj, ct);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_decode(refObj);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    uhdr_raw_image_t* refDecImg = uhdr_get_decoded_image(refObj);
+    ASSERT_NE(nullptr, refDecImg);
+    const uint32_t* ref = static_cast<uint32_t*>(refDecImg->planes[UHDR_PLANE_PACKED]);
+
+    const int x = 37, y = 23, w = refDecImg->w / 3, h = refDecImg->h / 4;
+    uhdr_codec_private_t* decObj = uhdr_create_decoder();
+    status = uhdr_dec_set_image(decObj, &mCompressedImage);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_out_img_format(decObj, fmt);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_out_color_transfer(decObj, ct);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_dec_set_roi(decObj, x, y, w, h);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    status = uhdr_decode(decObj);
+    ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+    uhdr_raw_image_t* decImg = uhdr_get_decoded_image(decObj);
+    ASSERT_NE(nullptr, decImg);
+    ASSERT_EQ(static_cast<unsigned>(w), decImg->w);
+    ASSERT_EQ(static_cast<unsigned>(h), decImg->h);
+    uhdr_raw_image_t* gainmapImg = uhdr_get_gain_map_image(decObj);
+    ASSERT_NE(nullptr, gainmapImg);
+    ASSERT_LT(gainmapImg->w, refDecImg->w / kMapDimensionScaleFactor);
+    ASSERT_LT(gainmapImg->h, refDecImg->h / kMapDimensionScaleFactor);
+
+    const uint32_t* region = static_cast<uint32_t*>(decImg->planes[UHDR_PLANE_PACKED]);
+    for (int i = 0; i < h; i++) {
+      for (int j = 0; j < w; j++) {
+        ASSERT_EQ(ref[(y + i) * refDecImg->stride[UHDR_PLANE_PACKED] + x + j],
+                  region[i * decImg->stride[UHDR_PLANE_PACKED] + j])
+            << "transfer " << ct << " pixel (" << x + j << ", " << y + i << ")";
+      }
+    }
+    uhdr_release_decoder(decObj);
+    uhdr_release_decoder(refObj);
+  }
+
+  uhdr_codec_private_t* decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_roi(decObj, 0, 0, 0, 16);
+  ASSERT_EQ(UHDR_CODEC_INVALID_PARAM, status.error_code) << "fail, accepted an empty region";
+  status = uhdr_dec_set_image(decObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_set_roi(decObj, 16, 16, kImageWidth, 16);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_INVALID_PARAM, status.error_code)
+      << "fail, decoded a region outside of the image";
+  uhdr_release_decoder(decObj);
+
+  decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image(decObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_set_out_img_format(decObj, UHDR_IMG_FMT_24bppYCbCrP010);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_set_out_color_transfer(decObj, UHDR_CT_HLG);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_set_roi(decObj, 15, 16, 32, 32);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_INVALID_PARAM, status.error_code)
+      << "fail, decoded a 10-bit yuv region at an odd position";
+  status = uhdr_dec_set_roi(decObj, 16, 16, 32, 32);
+  ASSERT_EQ(UHDR_CODEC_INVALID_OPERATION, status.error_code)
+      << "fail, changed the region of a probed context";
+  uhdr_release_decoder(decObj);
+}
+
+/* Test gain map only decode against the gain map of the full decode */
+TEST_P(JpegRAPIDecodeTest, DecodeGainMapOnly) {
+  uhdr_codec_private_t* refObj = uhdr_create_decoder();
+  uhdr_error_info_t status = uhdr_dec_set_image(refObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(refObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  uhdr_raw_image_t* refGainmapImg = uhdr_get_gain_map_image(refObj);
+  ASSERT_NE(nullptr, refGainmapImg);
+  uhdr_gainmap_metadata_t* refMetadata = uhdr_dec_get_gain_map_metadata(refObj);
+  ASSERT_NE(nullptr, refMetadata);
+
+  uhdr_codec_private_t* decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image(decObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_dec_enable_image_stats(decObj, 1);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode_gain_map(decObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  ASSERT_EQ(uhdr_dec_get_image_width(refObj), uhdr_dec_get_image_width(decObj));
+  ASSERT_EQ(uhdr_dec_get_image_height(refObj), uhdr_dec_get_image_height(decObj));
+  ASSERT_EQ(nullptr, uhdr_get_decoded_image(decObj)) << "fail, decoded the base image";
+  uhdr_gainmap_metadata_t* metadata = uhdr_dec_get_gain_map_metadata(decObj);
+  ASSERT_NE(nullptr, metadata);
+  ASSERT_EQ(refMetadata->max_content_boost, metadata->max_content_boost);
+  ASSERT_EQ(refMetadata->min_content_boost, metadata->min_content_boost);
+  ASSERT_EQ(refMetadata->gamma, metadata->gamma);
+  ASSERT_EQ(refMetadata->hdr_capacity_max, metadata->hdr_capacity_max);
+
+  uhdr_raw_image_t* gainmapImg = uhdr_get_gain_map_image(decObj);
+  ASSERT_NE(nullptr, gainmapImg);
+  ASSERT_EQ(refGainmapImg->w, gainmapImg->w);
+  ASSERT_EQ(refGainmapImg->h, gainmapImg->h);
+  uhdr_image_stats_t* stats = uhdr_dec_get_image_stats(decObj);
+  ASSERT_NE(nullptr, stats);
+  size_t histogram[UHDR_GAIN_HISTOGRAM_BINS] = {};
+  for (unsigned y = 0; y < gainmapImg->h; y++) {
+    const uint8_t* refRow = static_cast<uint8_t*>(refGainmapImg->planes[UHDR_PLANE_Y]) +
+                            y * refGainmapImg->stride[UHDR_PLANE_Y];
+    const uint8_t* row = static_cast<uint8_t*>(gainmapImg->planes[UHDR_PLANE_Y]) +
+                         y * gainmapImg->stride[UHDR_PLANE_Y];
+    ASSERT_EQ(0, memcmp(refRow, row, gainmapImg->w)) << "row " << y;
+    for (unsigned x = 0; x < gainmapImg->w; x++) histogram[row[x]]++;
+  }
+  ASSERT_EQ(static_cast<size_t>(gainmapImg->w) * gainmapImg->h, stats->num_pixels);
+  for (int i = 0; i < UHDR_GAIN_HISTOGRAM_BINS; i++) {
+    ASSERT_EQ(histogram[i], stats->gain_histogram[i]) << "bin " << i;
+  }
+
+  // the context is in end state without the image
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_INVALID_OPERATION, status.error_code)
+      << "fail, decoded after a gain map only decode";
+  ASSERT_EQ(nullptr, uhdr_get_decoded_image(decObj));
+  ASSERT_EQ(gainmapImg, uhdr_get_gain_map_image(decObj));
+  uhdr_reset_decoder(decObj);
+  status = uhdr_dec_set_image(decObj, &mCompressedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  ASSERT_NE(nullptr, uhdr_get_decoded_image(decObj));
+  uhdr_release_decoder(decObj);
+  uhdr_release_decoder(refObj);
+
+  // a failed gain map only decode ends the configurable state too
+  uhdr_compressed_image_t truncatedImage = mCompressedImage;
+  truncatedImage.data_sz = mCompressedImage.data_sz / 2;
+  decObj = uhdr_create_decoder();
+  status = uhdr_dec_set_image(decObj, &truncatedImage);
+  ASSERT_EQ(UHDR_CODEC_OK, status.error_code) << status.detail;
+  status = uhdr_decode_gain_map(decObj);
+  ASSERT_NE(UHDR_CODEC_OK, status.error_code) << "fail, decoded the gain map of a truncated image";
+  const uhdr_codec_err_t error = status.error_code;
+  status = uhdr_decode_gain_map(decObj);
+  ASSERT_EQ(error, status.error_code);
+  status = uhdr_decode(decObj);
+  ASSERT_EQ(UHDR_CODEC_INVALID_OPERATION, status.error_code);
+  ASSERT_EQ(nullptr, uhdr_get_gain_map_image(decObj));
+  uhdr_release_decoder(decObj);
+}
+
+INSTANTIATE_TEST_SUITE_P(JpegRAPIParameterizedTests, JpegRAPIDecodeTest,
+                         ::testing::Values(ULTRAHDR_COLORGAMUT_BT709, ULTRAHDR_COLORGAMUT_P3,
+                                           ULTRAHDR_COLORGAMUT_BT2100));
+
 // ============================================================================
 // Profiling
 // ============================================================================
@@ -2224,7 +3344,7 @@ void JpegRBenchmark::BenchmarkGenerateGainMap(uhdr_uncompressed_ptr yuv420Image,
               generateGainMap(yuv420Image, p010Image, ultrahdr_transfer_function::ULTRAHDR_TF_HLG,
                               metadata, map));
     if (i != kProfileCount - 1) {
-      delete[] static_cast<uint8_t*>(map->data);
+      uhdrFree(map->data);
       map->data = nullptr;
     }
   }
@@ -2297,10 +3417,8 @@ TEST(JpegRTest, ProfileGainMapFuncs) {
   ASSERT_NO_FATAL_FAILURE(
       benchmark.BenchmarkApplyGainMap(rawImg420.getImageHandle(), &map, &metadata, &dest));
 
-  if (map.data) {
-    delete[] static_cast<uint8_t*>(map.data);
-    map.data = nullptr;
-  }
+  uhdrFree(map.data);
+  map.data = nullptr;
 }
 
 }  // namespace ultrahdr
@@ -23,6 +23,8 @@
 #ifndef ULTRAHDR_API_H
 #define ULTRAHDR_API_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 #define UHDR_EXTERN extern "C"
 #else
@@ -50,6 +52,9 @@ typedef enum uhdr_img_fmt {
                                       blue, and 2-bit alpha components. Using 32-bit little-endian
                                       representation, colors stored as Red 9:0, Green 19:10, Blue
                                       29:20, and Alpha 31:30. */
+  UHDR_IMG_FMT_96bppRGBFloatPlanar, /**< 96 bits per pixel RGB color format, with 32-bit floating
+                                       point red, green and blue components, each in a plane of
+                                       its own. */
 } uhdr_img_fmt_t;                  /**< alias for enum uhdr_img_fmt */
 
 /*!\brief List of supported color gamuts */
@@ -145,6 +150,9 @@ typedef struct uhdr_raw_image {
 #define UHDR_PLANE_U 1      /**< U (Chroma) plane */
 #define UHDR_PLANE_UV 1     /**< UV (Chroma plane interleaved) To be used for semi planar format */
 #define UHDR_PLANE_V 2      /**< V (Chroma) plane */
+#define UHDR_PLANE_R 0      /**< R plane, to be used for planar RGB formats */
+#define UHDR_PLANE_G 1      /**< G plane, to be used for planar RGB formats */
+#define UHDR_PLANE_B 2      /**< B plane, to be used for planar RGB formats */
   void* planes[3];          /**< pointer to the top left pixel for each plane */
   unsigned int stride[3];   /**< stride in pixels between rows for each plane */
 } uhdr_raw_image_t;         /**< alias for struct uhdr_raw_image */
@@ -184,10 +192,82 @@ typedef struct uhdr_gainmap_metadata {
 /**\brief ultrahdr codec context opaque descriptor */
 typedef struct uhdr_codec_private uhdr_codec_private_t;
 
+/**\brief Output sink callback. Receives \p size bytes of the encoded stream at \p data. Returns 0
+ * on success, any other value aborts the encode process */
+typedef int (*uhdr_write_cb_t)(void* user_data, const void* data, unsigned int size);
+
+/**\brief Input source callback. Reads up to \p size bytes of the compressed stream into \p data.
+ * Returns the number of bytes read, 0 once the end of the stream is reached, or a negative value on
+ * error */
+typedef int (*uhdr_read_cb_t)(void* user_data, void* data, unsigned int size);
+
+/**\brief Allocation callback. Returns a block of at least \p size bytes whose address is a
+ * multiple of \p alignment, or nullptr on failure */
+typedef void* (*uhdr_alloc_cb_t)(void* user_data, size_t size, size_t alignment);
+
+/**\brief Release callback. Frees a block returned by the paired uhdr_alloc_cb_t */
+typedef void (*uhdr_free_cb_t)(void* user_data, void* ptr);
+
+/**\brief Memory usage of the last uhdr_encode(), uhdr_dec_probe() or uhdr_decode() call */
+typedef struct uhdr_alloc_stats {
+  size_t bytes_allocated;       /**< sum of the sizes of all allocations made during the call */
+  size_t peak_bytes;            /**< peak of the bytes held by allocations made during the call */
+  unsigned int num_allocations; /**< number of allocations made during the call */
+} uhdr_alloc_stats_t;           /**< alias for struct uhdr_alloc_stats */
+
+/**\brief Number of bins of the gain histogram of uhdr_image_stats_t, one per gain map code */
+#define UHDR_GAIN_HISTOGRAM_BINS 256
+
+/**\brief Statistics of the decoded hdr image, gathered by uhdr_decode() while the gain map is
+ * applied. Luminance is in linear light relative to sdr white, at the display boost of the output.
+ */
+typedef struct uhdr_image_stats {
+  float max_luminance;       /**< max luminance of the image */
+  float avg_luminance;       /**< average luminance of the image */
+  size_t num_pixels;         /**< number of pixels of the image */
+  size_t num_clipped_pixels; /**< number of pixels with a component outside of the output range,
+                                these are clipped by the integer output formats */
+  size_t gain_histogram[UHDR_GAIN_HISTOGRAM_BINS]; /**< number of pixels per applied gain, bin i
+                                                      counts the gains closest to gain map code
+                                                      i. Code 0 is min_content_boost and the
+                                                      last code is max_content_boost */
+} uhdr_image_stats_t; /**< alias for struct uhdr_image_stats */
+
 // ===============================================================================================
 // Function Declarations
 // ===============================================================================================
 
+// ===============================================================================================
+// Common APIs
+// ===============================================================================================
+
+/*!\brief Set the allocator used for image sized buffers. These include the raw and compressed
+ * intermediates of the codec, the decoded output and the encoded output. Metadata blocks (exif,
+ * icc, xmp, mpf), row sized scratch buffers and the process wide caches of the library are not
+ * covered and come from the C++ runtime. Every block is requested with an alignment of 64 bytes.
+ * The allocator is process wide and applies to allocations made after this call; blocks already
+ * handed out are released with the allocator that created them. The callbacks may be invoked
+ * concurrently from multiple threads.
+ *
+ * \param[in]  alloc_cb  allocation callback. nullptr restores the default allocator.
+ * \param[in]  free_cb  release callback. nullptr restores the default allocator.
+ * \param[in]  user_data  opaque pointer passed to the callbacks.
+ *
+ * \return uhdr_error_info_t #UHDR_CODEC_OK if operation succeeds,
+ *                           #UHDR_CODEC_INVALID_PARAM if only one of the callbacks is nullptr.
+ */
+UHDR_EXTERN uhdr_error_info_t uhdr_set_allocator(uhdr_alloc_cb_t alloc_cb, uhdr_free_cb_t free_cb,
+                                                 void* user_data);
+
+/*!\brief Get the memory usage of the last uhdr_encode(), uhdr_dec_probe() or uhdr_decode() call
+ * made on the instance. Only allocations made on the calling thread are accounted.
+ *
+ * \param[in]  codec  encoder or decoder instance.
+ *
+ * \return nullptr if codec is nullptr, pointer to uhdr_alloc_stats_t otherwise.
+ */
+UHDR_EXTERN uhdr_alloc_stats_t* uhdr_get_alloc_stats(uhdr_codec_private_t* codec);
+
 // ===============================================================================================
 // Encoder APIs
 // ===============================================================================================
@@ -296,6 +376,22 @@ UHDR_EXTERN uhdr_error_info_t uhdr_enc_set_exif_data(uhdr_codec_private_t* enc,
 UHDR_EXTERN uhdr_error_info_t uhdr_enc_set_output_format(uhdr_codec_private_t* enc,
                                                          uhdr_codec_t media_type);
 
+/*!\brief Set output sink. If set, the encoded stream is handed to \p write_cb in order, one
+ * container segment (marker, metadata packet or bitstream) at a time, as it is assembled. The
+ * stream is not gathered in to a contiguous buffer, so uhdr_get_encoded_stream() returns nullptr
+ * in this mode. Offsets that depend on the size of later segments (MPF, XMP) are resolved before
+ * the first byte is delivered, hence \p write_cb is never asked to seek.
+ *
+ * \param[in]  enc  encoder instance.
+ * \param[in]  write_cb  output sink callback, nullptr restores the default behavior.
+ * \param[in]  user_data  opaque pointer passed back to \p write_cb.
+ *
+ * \return uhdr_error_info_t #UHDR_CODEC_OK if operation succeeds,
+ *                           #UHDR_CODEC_INVALID_PARAM otherwise.
+ */
+UHDR_EXTERN uhdr_error_info_t uhdr_enc_set_output_sink(uhdr_codec_private_t* enc,
+                                                       uhdr_write_cb_t write_cb, void* user_data);
+
 /*!\brief Encode process call
  * After initializing the encoder context, call to this function will submit data for encoding. If
  * the call is successful, the encoded output is stored internally and is accessible via
@@ -314,6 +410,8 @@ UHDR_EXTERN uhdr_error_info_t uhdr_enc_set_output_format(uhdr_codec_private_t* e
  *   - uhdr_enc_set_exif_data()
  * - If the application wants to control target compression format
  *   - uhdr_enc_set_output_format()
+ * - If the application wants to receive the output as it is assembled
+ *   - uhdr_enc_set_output_sink()
  * - The program calls uhdr_encode() to encode data. This call would initiate the process of
  * computing gain map from hdr intent and sdr intent. The sdr intent and gain map image are
  * compressed at the set quality using the codec of choice.
@@ -370,10 +468,25 @@ UHDR_EXTERN uhdr_error_info_t uhdr_encode(uhdr_codec_private_t* enc);
  *
  * \param[in]  enc  encoder instance.
  *
- * \return nullptr if encode process call is unsuccessful, uhdr image descriptor otherwise
+ * \return nullptr if encode process call is unsuccessful or if output sink is set, uhdr image
+ * descriptor otherwise
  */
 UHDR_EXTERN uhdr_compressed_image_t* uhdr_get_encoded_stream(uhdr_codec_private_t* enc);
 
+/*!\brief Write encoded ultra hdr stream to a file. The stream is written straight from the
+ * internal output buffer, without intermediate buffering.
+ *
+ * \param[in]  enc  encoder instance.
+ * \param[in]  filename  path of the output file. An existing file is truncated.
+ *
+ * \return uhdr_error_info_t #UHDR_CODEC_OK if operation succeeds,
+ *                           #UHDR_CODEC_INVALID_OPERATION if encode process call is unsuccessful or
+ *                           if output sink is set, #UHDR_CODEC_UNKNOWN_ERROR if the file can not be
+ *                           written, #UHDR_CODEC_INVALID_PARAM otherwise.
+ */
+UHDR_EXTERN uhdr_error_info_t uhdr_enc_write_to_file(uhdr_codec_private_t* enc,
+                                                     const char* filename);
+
 /*!\brief Reset encoder instance.
  * Clears all previous settings and resets to default state and ready for re-initialization
  *
@@ -427,7 +540,47 @@ UHDR_EXTERN void uhdr_release_decoder(uhdr_codec_private_t* dec);
 UHDR_EXTERN uhdr_error_info_t uhdr_dec_set_image(uhdr_codec_private_t* dec,
                                                  uhdr_compressed_image_t* img);
 
+/*!\brief Register a read callback as the source of the compressed image. This is an alternative to
+ * uhdr_dec_set_image() for inputs that are not resident in memory, such as files or network
+ * streams; a file descriptor can be served by a callback that wraps read(). The stream is consumed
+ * sequentially and only once. The base image is decoded as its bytes arrive and only the
+ * compressed gain map image is buffered, which is located using the MPF offsets of the base image.
+ * As the gain map image follows the base image in the stream, uhdr_dec_probe() consumes the
+ * stream and decodes the base image. Hence all uhdr_dec_set_*() settings must be configured
+ * before probing. Repeated calls to this function or to uhdr_dec_set_image() replace the old
+ * entry with the current.
+ *
+ * \param[in]  dec  decoder instance.
+ * \param[in]  read_cb  callback that reads the compressed stream.
+ * \param[in]  user_data  opaque pointer passed to read_cb.
+ *
+ * \return uhdr_error_info_t #UHDR_CODEC_OK if operation succeeds,
+ *                           #UHDR_CODEC_INVALID_PARAM otherwise.
+ */
+UHDR_EXTERN uhdr_error_info_t uhdr_dec_set_image_source(uhdr_codec_private_t* dec,
+                                                        uhdr_read_cb_t read_cb, void* user_data);
+
+/*!\brief Register a file as the compressed image of decoder context. The file is memory mapped
+ * read-only where the platform supports it, with sequential read-ahead requested for the mapped
+ * range, and the mapping is decoded in place without copying it. The file must not be modified
+ * until the context is reset or released. Repeated calls to this function, uhdr_dec_set_image() or
+ * uhdr_dec_set_image_source() replace the old entry with the current.
+ *
+ * \param[in]  dec  decoder instance.
+ * \param[in]  filename  path of the compressed image file.
+ *
+ * \return uhdr_error_info_t #UHDR_CODEC_OK if operation succeeds,
+ *                           #UHDR_CODEC_UNKNOWN_ERROR if the file can not be opened or mapped,
+ *                           #UHDR_CODEC_INVALID_PARAM otherwise.
+ */
+UHDR_EXTERN uhdr_error_info_t uhdr_dec_set_image_from_file(uhdr_codec_private_t* dec,
+                                                           const char* filename);
+
 /*!\brief Set output image format
+ * UHDR_IMG_FMT_24bppYCbCrP010 outputs limited range BT.2100 YUV with 4:2:0 chroma, its transfer is
+ * set with uhdr_dec_set_out_color_transfer() to one of {UHDR_CT_HLG, UHDR_CT_PQ}.
+ * UHDR_IMG_FMT_96bppRGBFloatPlanar outputs linear RGB in float32 planes, its transfer is set to
+ * #UHDR_CT_LINEAR. The planes may be supplied by the application, see uhdr_dec_set_out_img_buffer().
  *
  * \param[in]  dec  decoder instance.
  * \param[in]  fmt  output image format.
@@ -438,6 +591,24 @@ UHDR_EXTERN uhdr_error_info_t uhdr_dec_set_image(uhdr_codec_private_t* dec,
 UHDR_EXTERN uhdr_error_info_t uhdr_dec_set_out_img_format(uhdr_codec_private_t* dec,
                                                           uhdr_img_fmt_t fmt);
 
+/*!\brief Set output image buffer
+ * By default uhdr_decode() allocates the output configured with uhdr_dec_set_out_*() functions.
+ * If set, the output is written to the planes of \p img instead, at the strides of \p img, so an
+ * application can have it written straight in to memory it owns, for example a padded tensor. The
+ * planes must stay valid until uhdr_decode() returns and uhdr_get_decoded_image() then describes
+ * them. Currently this is supported for the UHDR_IMG_FMT_96bppRGBFloatPlanar output only.
+ *
+ * \param[in]  dec  decoder instance.
+ * \param[in]  img  output image descriptor, its fmt, w, h, planes and stride are used. fmt must match
+ *                  the output format at the time of uhdr_decode(), and w and h the image
+ *                  dimensions. nullptr restores the default behavior.
+ *
+ * \return uhdr_error_info_t #UHDR_CODEC_OK if operation succeeds,
+ *                           #UHDR_CODEC_INVALID_PARAM otherwise.
+ */
+UHDR_EXTERN uhdr_error_info_t uhdr_dec_set_out_img_buffer(uhdr_codec_private_t* dec,
+                                                          uhdr_raw_image_t* img);
+
 /*!\brief Set output color transfer
  *
  * \param[in]  dec  decoder instance.
@@ -460,6 +631,124 @@ UHDR_EXTERN uhdr_error_info_t uhdr_dec_set_out_color_transfer(uhdr_codec_private
 UHDR_EXTERN uhdr_error_info_t uhdr_dec_set_out_max_display_boost(uhdr_codec_private_t* dec,
                                                                  float display_boost);
 
+/*!\brief Set output color gamut
+ * The decoded hdr image is converted to this gamut while the gain map is applied, before the
+ * transfer function, so the conversion takes no additional pass over the output. Colors outside of
+ * the output gamut are clipped. The setting applies to the renditions too and is ignored for sdr
+ * output. The default #UHDR_CG_UNSPECIFIED keeps the gamut of the base image.
+ *
+ * \param[in]  dec  decoder instance.
+ * \param[in]  cg  output color gamut
+ *
+ * \return uhdr_error_info_t #UHDR_CODEC_OK if operation succeeds,
+ *                           #UHDR_CODEC_INVALID_PARAM otherwise.
+ */
+UHDR_EXTERN uhdr_error_info_t uhdr_dec_set_out_color_gamut(uhdr_codec_private_t* dec,
+                                                          uhdr_color_gamut_t cg);
+
+/*!\brief Add an output rendition
+ * Requests an additional output image that is written in the same pass as the output configured
+ * with uhdr_dec_set_out_img_format(), uhdr_dec_set_out_color_transfer() and
+ * uhdr_dec_set_out_max_display_boost(). The base image and the gain map image are decoded and the
+ * gain map is interpolated once for all outputs, only the application of the gain and the packing
+ * of the output differ per rendition. This is cheaper than decoding the image once per target
+ * display.
+ *
+ * Renditions are numbered from 1 in the order of their addition, see
+ * uhdr_get_decoded_rendition(). Only hdr outputs can be added, and uhdr_decode() fails if the
+ * output configured with uhdr_dec_set_out_*() functions is sdr.
+ *
+ * \param[in]  dec  decoder instance.
+ * \param[in]  fmt  output image format, one of {UHDR_IMG_FMT_64bppRGBAHalfFloat,
+ *                  UHDR_IMG_FMT_32bppRGBA1010102, UHDR_IMG_FMT_24bppYCbCrP010,
+ *                  UHDR_IMG_FMT_96bppRGBFloatPlanar}.
+ * \param[in]  ct  output color transfer, #UHDR_CT_LINEAR for UHDR_IMG_FMT_64bppRGBAHalfFloat and
+ *                 UHDR_IMG_FMT_96bppRGBFloatPlanar, one of {UHDR_CT_HLG, UHDR_CT_PQ} for the other
+ *                 formats.
+ * \param[in]  display_boost  max display boost
+ *
+ * \return uhdr_error_info_t #UHDR_CODEC_OK if operation succeeds,
+ *                           #UHDR_CODEC_INVALID_PARAM otherwise.
+ */
+UHDR_EXTERN uhdr_error_info_t uhdr_dec_add_out_rendition(uhdr_codec_private_t* dec,
+                                                         uhdr_img_fmt_t fmt,
+                                                         uhdr_color_transfer_t ct,
+                                                         float display_boost);
+
+/*!\brief Enable image statistics
+ * If enabled, uhdr_decode() gathers the statistics of uhdr_image_stats_t for the output configured
+ * with uhdr_dec_set_out_*() functions. They are accumulated per worker while the gain map is
+ * applied and merged at the end, which saves the application a second pass over the decoded
+ * image. Statistics are only gathered for hdr outputs. By default statistics are disabled.
+ *
+ * \param[in]  dec  decoder instance.
+ * \param[in]  enable  0 to disable, any other value to enable.
+ *
+ * \return uhdr_error_info_t #UHDR_CODEC_OK if operation succeeds,
+ *                           #UHDR_CODEC_INVALID_PARAM otherwise.
+ */
+UHDR_EXTERN uhdr_error_info_t uhdr_dec_enable_image_stats(uhdr_codec_private_t* dec, int enable);
+
+/*!\brief Enable table based gain map application
+ * If enabled, uhdr_decode() decodes the base image to RGB with the color converter of libjpeg and
+ * reconstructs each output channel with one lookup in a table indexed by the 8-bit base image code
+ * and the 8-bit gain code, instead of evaluating the transfer functions per pixel. This is faster,
+ * but the interpolated gains are quantized to 8 bits, and the decoded base image is held in memory
+ * in full. The table is used for the UHDR_IMG_FMT_64bppRGBAHalfFloat and
+ * UHDR_IMG_FMT_32bppRGBA1010102 outputs when no renditions, statistics or color gamut conversion
+ * are requested, the default path is taken otherwise. By default the table is disabled.
+ * The chroma of the base image is sampled as on the default path, so the outputs only differ by the
+ * rounding of the base image to 8-bit RGB and of the gains to 8-bit codes.
+ *
+ * \param[in]  dec  decoder instance.
+ * \param[in]  enable  0 to disable, any other value to enable.
+ *
+ * \return uhdr_error_info_t #UHDR_CODEC_OK if operation succeeds,
+ *                           #UHDR_CODEC_INVALID_PARAM otherwise.
+ */
+UHDR_EXTERN uhdr_error_info_t uhdr_dec_enable_gain_code_lut(uhdr_codec_private_t* dec, int enable);
+
+/*!\brief Set output scale
+ * uhdr_decode() outputs the image at 1 / \p scale_denom of its resolution in each dimension,
+ * rounded up. The scaling is done in the inverse DCT of the base image and of the gain map image,
+ * which is several times faster than decoding at full resolution and downscaling, for example to
+ * produce thumbnails and previews. The gain map is scaled along with the base image and applied at
+ * the reduced resolution, a gain map of a quarter of the base image resolution is used as is when
+ * \p scale_denom is 4. uhdr_dec_get_image_width() and uhdr_dec_get_image_height() report the
+ * resolution of the image before scaling, uhdr_get_decoded_image() and uhdr_get_gain_map_image()
+ * describe the scaled outputs. By default \p scale_denom is 1.
+ *
+ * \param[in]  dec  decoder instance.
+ * \param[in]  scale_denom  one of {1, 2, 4, 8}.
+ *
+ * \return uhdr_error_info_t #UHDR_CODEC_OK if operation succeeds,
+ *                           #UHDR_CODEC_INVALID_PARAM otherwise.
+ */
+UHDR_EXTERN uhdr_error_info_t uhdr_dec_set_scale(uhdr_codec_private_t* dec, int scale_denom);
+
+/*!\brief Set region of interest
+ * uhdr_decode() outputs only the region of \p w x \p h pixels at (\p x, \p y) of the image, for
+ * example a crop or a tile of a large image. Only the iMCU rows and columns of the base image that
+ * cover the region are entropy decoded, and only the samples of the gain map that the region reads
+ * are decoded and applied, so the cost of the decode follows the size of the region rather than of
+ * the image. The output is the same as the matching region of a full decode.
+ * The coordinates are in the image as scaled by uhdr_dec_set_scale(). uhdr_get_decoded_image()
+ * describes an image of \p w x \p h pixels, uhdr_get_gain_map_image() the window of the gain map
+ * that covers the region. For the 10-bit YUV output format, \p x and \p y are to be even. The
+ * region is checked against the image in uhdr_decode(). By default the whole image is decoded.
+ *
+ * \param[in]  dec  decoder instance.
+ * \param[in]  x  left of the region.
+ * \param[in]  y  top of the region.
+ * \param[in]  w  width of the region.
+ * \param[in]  h  height of the region.
+ *
+ * \return uhdr_error_info_t #UHDR_CODEC_OK if operation succeeds,
+ *                           #UHDR_CODEC_INVALID_PARAM otherwise.
+ */
+UHDR_EXTERN uhdr_error_info_t uhdr_dec_set_roi(uhdr_codec_private_t* dec, int x, int y, int w,
+                                               int h);
+
 /*!\brief This function parses the bitstream that is registered with the decoder context and makes
  * image information available to the client via uhdr_dec_get_() functions. It does not decompress
  * the image. That is done by uhdr_decode().
@@ -536,13 +825,28 @@ UHDR_EXTERN uhdr_gainmap_metadata_t* uhdr_dec_get_gain_map_metadata(uhdr_codec_p
  *   - uhdr_create_decoder().
  * - The program registers input images to the decoder using,
  *   - uhdr_dec_set_image(ctxt, img)
+ *   - or uhdr_dec_set_image_source(ctxt, read_cb, user_data) to stream the input
+ *   - or uhdr_dec_set_image_from_file(ctxt, filename) to decode a file in place
  * - The program overrides the default settings using uhdr_dec_set_*() functions.
  * - If the application wants to control the output image format,
  *   - uhdr_dec_set_out_img_format()
+ * - If the application wants the output written to memory it owns,
+ *   - uhdr_dec_set_out_img_buffer()
  * - If the application wants to control the output transfer characteristics,
  *   - uhdr_dec_set_out_color_transfer()
  * - If the application wants to control the output display boost,
  *   - uhdr_dec_set_out_max_display_boost()
+ * - If the application wants to control the output color gamut,
+ *   - uhdr_dec_set_out_color_gamut()
+ * - If the application wants more than one rendition of the image, for displays of different
+ * headroom,
+ *   - uhdr_dec_add_out_rendition()
+ * - If the application wants luminance, gain and clipping statistics of the decoded image,
+ *   - uhdr_dec_enable_image_stats()
+ * - If the application wants the image at a reduced resolution, for example for a preview,
+ *   - uhdr_dec_set_scale()
+ * - If the application wants a region of the image only, for example a crop or a tile,
+ *   - uhdr_dec_set_roi()
  * - The program calls uhdr_decompress() to decode uhdr stream. This call would initiate the process
  * of decoding base image and gain map image. These two are combined to give the final rendition
  * image.
@@ -555,6 +859,28 @@ UHDR_EXTERN uhdr_gainmap_metadata_t* uhdr_dec_get_gain_map_metadata(uhdr_codec_p
  */
 UHDR_EXTERN uhdr_error_info_t uhdr_decode(uhdr_codec_private_t* dec);
 
+/*!\brief Decode the gain map image only
+ * This is a lightweight alternative to uhdr_decode() for applications that only analyze the gain
+ * map and its metadata, for example to classify how much headroom an image uses. The base image is
+ * not decoded and no hdr image is reconstructed. For an image registered with uhdr_dec_set_image()
+ * or uhdr_dec_set_image_from_file(), the gain map is located with the MP entries in the header of
+ * the base image, and this call also probes the image without scanning the entropy coded data of
+ * the base image. An image registered with uhdr_dec_set_image_source() is read to the end of the
+ * gain map, the base image is decoded while probing.
+ * Afterwards, uhdr_get_gain_map_image() returns the gain map at its full resolution and
+ * uhdr_dec_get_gain_map_metadata() its metadata. If statistics are enabled with
+ * uhdr_dec_enable_image_stats(), uhdr_dec_get_image_stats() returns the histogram of the gain map
+ * codes in gain_histogram and the number of gain map samples in num_pixels, the other fields are 0.
+ * The output settings, the scale and the region of interest do not apply. Like uhdr_decode(), this
+ * call ends the configurable state of the context, also when it fails. A later uhdr_decode() then
+ * fails with #UHDR_CODEC_INVALID_OPERATION until uhdr_reset_decoder().
+ *
+ * \param[in]  dec  decoder instance.
+ *
+ * \return uhdr_error_info_t #UHDR_CODEC_OK if operation succeeds, uhdr_codec_err_t otherwise.
+ */
+UHDR_EXTERN uhdr_error_info_t uhdr_decode_gain_map(uhdr_codec_private_t* dec);
+
 /*!\brief Get final rendition image
  *
  * \param[in]  dec  decoder instance.
@@ -563,7 +889,32 @@ UHDR_EXTERN uhdr_error_info_t uhdr_decode(uhdr_codec_private_t* dec);
  */
 UHDR_EXTERN uhdr_raw_image_t* uhdr_get_decoded_image(uhdr_codec_private_t* dec);
 
+/*!\brief Get rendition image
+ *
+ * \param[in]  dec  decoder instance.
+ * \param[in]  index  0 for the output configured with uhdr_dec_set_out_*() functions, same as
+ *                    uhdr_get_decoded_image(), or n for the nth rendition added with
+ *                    uhdr_dec_add_out_rendition().
+ *
+ * \return nullptr if decoded process call is unsuccessful or index is out of range, raw image
+ * descriptor otherwise
+ */
+UHDR_EXTERN uhdr_raw_image_t* uhdr_get_decoded_rendition(uhdr_codec_private_t* dec, int index);
+
+/*!\brief Get image statistics
+ *
+ * \param[in]  dec  decoder instance.
+ *
+ * \return nullptr if decoded process call is unsuccessful or statistics were not gathered, image
+ * statistics descriptor otherwise
+ */
+UHDR_EXTERN uhdr_image_stats_t* uhdr_dec_get_image_stats(uhdr_codec_private_t* dec);
+
 /*!\brief Get gain map image
+ * If uhdr_decode() has written the sdr rendition of the image, as the max display boost does not
+ * exceed the min hdr capacity of the image, it has not decoded the gain map. The gain map is then
+ * decoded by the first call to this function, and its allocations are added to the statistics of
+ * the uhdr_decode() call.
  *
  * \param[in]  dec  decoder instance.
  *